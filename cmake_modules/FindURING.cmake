@@ -0,0 +1,17 @@
+FIND_PATH(URING_INCLUDE_DIR liburing.h /usr/include /usr/local/include)
+FIND_LIBRARY(URING_LIBRARY NAMES uring PATH /usr/lib /usr/local/lib)
+
+IF (URING_INCLUDE_DIR AND URING_LIBRARY)
+   SET(URING_FOUND TRUE)
+ENDIF (URING_INCLUDE_DIR AND URING_LIBRARY)
+
+
+IF (URING_FOUND)
+   IF (NOT URING_FIND_QUIETLY)
+      MESSAGE(STATUS "Found liburing: ${URING_LIBRARY}")
+   ENDIF (NOT URING_FIND_QUIETLY)
+ELSE (URING_FOUND)
+   IF (URING_FIND_REQUIRED)
+      MESSAGE(FATAL_ERROR "Could not find liburing")
+   ENDIF (URING_FIND_REQUIRED)
+ENDIF (URING_FOUND)
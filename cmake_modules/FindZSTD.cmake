@@ -0,0 +1,17 @@
+FIND_PATH(ZSTD_INCLUDE_DIR zstd.h /usr/include /usr/local/include)
+FIND_LIBRARY(ZSTD_LIBRARY NAMES zstd PATH /usr/lib /usr/local/lib)
+
+IF (ZSTD_INCLUDE_DIR AND ZSTD_LIBRARY)
+   SET(ZSTD_FOUND TRUE)
+ENDIF (ZSTD_INCLUDE_DIR AND ZSTD_LIBRARY)
+
+
+IF (ZSTD_FOUND)
+   IF (NOT ZSTD_FIND_QUIETLY)
+      MESSAGE(STATUS "Found zstd: ${ZSTD_LIBRARY}")
+   ENDIF (NOT ZSTD_FIND_QUIETLY)
+ELSE (ZSTD_FOUND)
+   IF (ZSTD_FIND_REQUIRED)
+      MESSAGE(FATAL_ERROR "Could not find zstd")
+   ENDIF (ZSTD_FIND_REQUIRED)
+ENDIF (ZSTD_FOUND)
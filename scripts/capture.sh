@@ -34,9 +34,16 @@ export GLC_CAPTURE_GLFINISH=0
 # take picture from front or back buffer
 export GLC_CAPTURE=front
 
-# compress stream using 'lzo', 'quicklz' or 'none'
+# compress stream using 'lz4', 'zstd', 'lzo', 'quicklz', 'lzjb', 'adaptive',
+# 'predict', 'dct' or 'none'
 export GLC_COMPRESS=quicklz
 
+# quality of lossy 'dct' compression, from 1 to 100
+export GLC_COMPRESS_QUALITY=75
+
+# code audio losslessly using 'rice', or leave empty to use GLC_COMPRESS
+export GLC_AUDIO_COMPRESS=
+
 # try GL_ARB_pixel_buffer_object to speed up readback
 export GLC_TRY_PBO=1
 
@@ -46,16 +46,35 @@ int main(int argc, char *argv[])
 		{'o', "out",			"GLC_FILE",			NULL},
 		{'f', "fps",			"GLC_FPS",			NULL},
 		{'r', "resize",			"GLC_SCALE",			NULL},
+		{ 0 , "gpu-resize",		"GLC_GPU_SCALE",		 "1"},
 		{'c', "crop",			"GLC_CROP",			NULL},
 		{'a', "record-audio",		"GLC_AUDIO_RECORD",		NULL},
 		{'s', "start",			"GLC_START",			 "1"},
 		{'e', "colorspace",		"GLC_COLORSPACE",		NULL},
+		{ 0 , "gpu-colorspace",		"GLC_GPU_COLORSPACE",		 "1"},
 		{'k', "hotkey",			"GLC_HOTKEY",			NULL},
 		{ 0 , "reload",			"GLC_RELOAD_HOTKEY",		NULL},
 		{'n', "lock-fps",		"GLC_LOCK_FPS",			 "1"},
 		{ 0 , "pbo",			"GLC_TRY_PBO",			 "1"},
+		{ 0 , "pbo-count",		"GLC_PBO_COUNT",		NULL},
+		{ 0 , "capture-worker",		"GLC_CAPTURE_WORKER",		 "1"},
+		{ 0 , "detect-repeat",		"GLC_DETECT_REPEAT",		 "1"},
+		{ 0 , "tiles",			"GLC_TILES",			NULL},
 		{'z', "compression",		"GLC_COMPRESS",			NULL},
+		{ 0 , "compression-level",	"GLC_COMPRESS_LEVEL",		NULL},
+		{ 0 , "quality",		"GLC_COMPRESS_QUALITY",		NULL},
+		{ 0 , "audio-compression",	"GLC_AUDIO_COMPRESS",		NULL},
+		{ 0 , "slice-size",		"GLC_COMPRESS_SLICE_SIZE",	NULL},
+		{ 0 , "keyframe-interval",	"GLC_KEYFRAME_INTERVAL",	NULL},
 		{ 0 , "sync",			"GLC_SYNC",			 "1"},
+		{ 0 , "direct",			"GLC_DIRECT",			 "1"},
+		{ 0 , "write-batch",		"GLC_WRITE_BATCH_SIZE",		NULL},
+		{ 0 , "write-batch-time",	"GLC_WRITE_BATCH_TIME",		NULL},
+		{ 0 , "preallocate",		"GLC_PREALLOCATE",		NULL},
+		{ 0 , "writeback",		"GLC_WRITEBACK",		NULL},
+		{ 0 , "stripe-size",		"GLC_STRIPE_SIZE",		NULL},
+		{ 0 , "segment-size",		"GLC_SEGMENT_SIZE",		NULL},
+		{ 0 , "segment-time",		"GLC_SEGMENT_TIME",		NULL},
 		{ 0 , "byte-aligned",		"GLC_CAPTURE_DWORD_ALIGNED",	 "0"},
 		{'i', "draw-indicator",		"GLC_INDICATOR",		 "1"},
 		{'v', "log",			"GLC_LOG",			NULL},
@@ -151,24 +170,73 @@ usage:
 	       "                                 %%min%%:     2-digit minute\n"
 	       "                                 %%sec%%:     2-digit second\n"
 	       "                               default value is %%app%%-%%pid%%-%%capture%%.glc\n"
+	       "                               stripe:FILE,FILE,... stripes stream over\n"
+	       "                               files, one writer thread per file\n"
 	       "  -f, --fps=FPS              capture at FPS, default value is 30\n"
 	       "  -r, --resize=FACTOR        resize pictures with scale factor FACTOR\n"
+	       "      --gpu-resize           resize pictures on GPU before reading them\n"
+	       "                               with '420jpeg' needs --gpu-colorspace\n"
 	       "  -c, --crop=WxH+X+Y         capture only [width]x[height][+[x][+[y]]]\n"
 	       "  -a, --record-audio=CONFIG  record specified alsa devices\n"
 	       "                               format is device,rate,channels;device2...\n"
 	       "  -s, --start                start capturing immediately\n"
 	       "  -e, --colorspace=CSP       keep as 'bgr' or convert to '420jpeg'\n"
 	       "                               default value is '420jpeg'\n"
+	       "      --gpu-colorspace       convert colorspace on GPU before reading frames\n"
 	       "  -k, --hotkey=HOTKEY        capture hotkey, <Ctrl> and <Shift> modifiers are\n"
 	       "                               supported, default hotkey is '<Shift>F8'\n"
 	       "      --reload=HOTKEY        reload hotkey, switches to next capture file\n"
 	       "                               default reload key is '<Shift>F9'\n"
 	       "  -n, --lock-fps             lock fps when capturing\n"
 	       "      --pbo                  use GL_ARB_pixel_buffer_object if available\n"
+	       "      --pbo-count=NUM        number of PBOs per stream, default is 3\n"
+	       "      --capture-worker       finish PBO transfers in a shared GL context\n"
+	       "      --detect-repeat        write only a small message for repeated frames\n"
+	       "      --tiles=SIZE           write only changed SIZExSIZE tiles of frames\n"
+	       "                               0 disables, default is 0\n"
 	       "  -z, --compression=METHOD   compress stream using METHOD\n"
-	       "                               'none', 'quicklz' and 'lzo' are supported\n"
+	       "                               'none', 'quicklz', 'lzo', 'lzjb', 'lz4' and\n"
+	       "                               'zstd' are supported\n"
+	       "                               'adaptive' picks one per packet based on\n"
+	       "                               how well data compresses and how late\n"
+	       "                               packets are when compressed, which\n"
+	       "                               grows as capture buffer fills up\n"
+	       "                               'predict' filters video frames like PNG\n"
+	       "                               before compressing them\n"
+	       "                               'dct' codes Y'CbCr 4:2:0 frames lossily\n"
+	       "                               like JPEG, see --quality\n"
 	       "                               'quicklz' is used by default\n"
-	       "      --sync                 force synchronized write mode\n"
+	       "      --compression-level=NUM\n"
+	       "                             compression level, used by 'zstd' and 'predict'\n"
+	       "      --quality=NUM          quality of 'dct' compression, from 1 to 100\n"
+	       "                               default is 75\n"
+	       "      --audio-compression=METHOD\n"
+	       "                             compress audio using METHOD, 'rice' codes it\n"
+	       "                               losslessly like FLAC, default is to use\n"
+	       "                               stream compression\n"
+	       "      --slice-size=SIZE      compress large frames in parallel in SIZE KiB\n"
+	       "                               slices, 0 disables, default is 0\n"
+	       "      --keyframe-interval=NUM\n"
+	       "                             compress frames as XOR deltas against previous\n"
+	       "                               frame, full frame every NUM frames\n"
+	       "                               0 disables, default is 0\n"
+	       "      --sync                 wait until written data is on disk\n"
+	       "      --direct               write using O_DIRECT and asynchronous io,\n"
+	       "                               bypassing page cache\n"
+	       "      --write-batch=SIZE     write small packets together in batches of\n"
+	       "                               SIZE KiB, 0 disables, default is 256\n"
+	       "      --write-batch-time=MS  write batch at latest after MS milliseconds\n"
+	       "                               default is 50\n"
+	       "      --preallocate=SIZE     preallocate file in SIZE MiB extents\n"
+	       "                               0 disables, default is 64\n"
+	       "      --writeback=SIZE       write out and drop data from page cache in\n"
+	       "                               SIZE MiB ranges, 0 disables, default is 0\n"
+	       "      --stripe-size=SIZE     stripe over files in SIZE KiB chunks\n"
+	       "                               default is 1024\n"
+	       "      --segment-size=SIZE    continue in new file after SIZE MiB\n"
+	       "                               0 disables, default is 0\n"
+	       "      --segment-time=SEC     continue in new file after SEC seconds\n"
+	       "                               0 disables, default is 0\n"
 	       "      --byte-aligned         use GL_PACK_ALIGNMENT 1 instead of 8\n"
 	       "  -i, --draw-indicator       draw indicator when capturing\n"
 	       "                               indicator does not work with -b 'front'\n"
@@ -323,28 +391,51 @@ int set_opt(struct glc_opt_s *option, const char *arg)
 	 Append current working directory to -o and -l
 	 if they don't start with /. Otherwise running capture
 	 against script can cause glc to write those files into different
-	 directory.
+	 directory. Striped -o is "stripe:" and a comma-separated list,
+	 every file in it gets the same treatment.
 	 */
-	char *fullpath;
-	size_t len, pos;
+	char *fullpath, cwd[1024];
+	const char *name, *next, *list;
+	size_t len, pos = 0;
+	int striped;
 	if ((option->short_name == 'o') || (option->short_name == 'l')) {
 		if (arg == NULL)
 			return EINVAL; /* no segfaults, thanks */
 
-		if (arg[0] != '/') {
+		striped = (option->short_name == 'o') && (!strncmp(arg, "stripe:", 7));
+		if ((arg[0] != '/') || (striped)) {
 			fullpath = malloc(1024);
 			fullpath[0] = '\0'; /* just to make sure */
 
-			getcwd(fullpath, 1024);
+			cwd[0] = '\0';
+			getcwd(cwd, sizeof(cwd));
 
-			pos = strlen(fullpath);
-			len = strlen(arg);
-			if (len + pos + 1 > 1024)
-				len = 1023 - pos;
+			list = arg;
+			if (striped) {
+				pos = sprintf(fullpath, "stripe:");
+				list = &arg[7];
+			}
+
+			for (name = list; (name != NULL) && (pos < 1023); name = next) {
+				next = NULL;
+				len = strlen(name);
+				if ((striped) && ((next = strchr(name, ',')) != NULL))
+					len = next++ - name;
+
+				if (name != list)
+					fullpath[pos++] = ',';
 
-			fullpath[pos++] = '/';
-			memcpy(&fullpath[pos], arg, len);
-			fullpath[pos + len] = '\0';
+				if (name[0] != '/')
+					pos += snprintf(&fullpath[pos], 1024 - pos, "%s/", cwd);
+				if (pos > 1023)
+					pos = 1023;
+
+				if (len + pos + 1 > 1024)
+					len = 1023 - pos;
+				memcpy(&fullpath[pos], name, len);
+				pos += len;
+			}
+			fullpath[pos] = '\0';
 
 			setenv(option->env, fullpath, 1);
 
@@ -41,6 +41,20 @@
 #define GL_CAPTURE_CROP            0x10
 #define GL_CAPTURE_LOCK_FPS        0x20
 #define GL_CAPTURE_IGNORE_TIME     0x40
+#define GL_CAPTURE_TRY_YCBCR       0x80
+#define GL_CAPTURE_USE_YCBCR      0x100
+#define GL_CAPTURE_TRY_SCALE      0x200
+#define GL_CAPTURE_USE_SCALE      0x400
+#define GL_CAPTURE_COPYING        0x800
+#define GL_CAPTURE_TRY_WORKER    0x1000
+#define GL_CAPTURE_USE_WORKER    0x2000
+#define GL_CAPTURE_WORKER_READY  0x4000
+#define GL_CAPTURE_DETECT_REPEAT 0x8000
+
+#define GL_CAPTURE_PBO_FREE           0
+#define GL_CAPTURE_PBO_READING        1
+#define GL_CAPTURE_PBO_COPYING        2
+#define GL_CAPTURE_PBO_DONE           3
 
 typedef void (*FuncPtr)(void);
 typedef FuncPtr (*GLXGetProcAddressProc)(const GLubyte *procName);
@@ -57,6 +71,98 @@ typedef void (*glBindBufferProc)(GLenum target,
 typedef GLvoid *(*glMapBufferProc)(GLenum target,
                                    GLenum access);
 typedef GLboolean (*glUnmapBufferProc)(GLenum target);
+typedef void (*glBufferStorageProc)(GLenum target,
+                                    GLsizeiptr size,
+                                    const GLvoid *data,
+                                    GLbitfield flags);
+typedef GLvoid *(*glMapBufferRangeProc)(GLenum target,
+                                        GLintptr offset,
+                                        GLsizeiptr length,
+                                        GLbitfield access);
+typedef GLsync (*glFenceSyncProc)(GLenum condition,
+                                  GLbitfield flags);
+typedef GLenum (*glClientWaitSyncProc)(GLsync sync,
+                                       GLbitfield flags,
+                                       GLuint64 timeout);
+typedef void (*glDeleteSyncProc)(GLsync sync);
+typedef GLuint (*glCreateShaderProc)(GLenum type);
+typedef void (*glShaderSourceProc)(GLuint shader,
+                                   GLsizei count,
+                                   const GLchar **string,
+                                   const GLint *length);
+typedef void (*glCompileShaderProc)(GLuint shader);
+typedef void (*glGetShaderivProc)(GLuint shader,
+                                  GLenum pname,
+                                  GLint *params);
+typedef void (*glDeleteShaderProc)(GLuint shader);
+typedef GLuint (*glCreateProgramProc)(void);
+typedef void (*glAttachShaderProc)(GLuint program,
+                                   GLuint shader);
+typedef void (*glLinkProgramProc)(GLuint program);
+typedef void (*glGetProgramivProc)(GLuint program,
+                                   GLenum pname,
+                                   GLint *params);
+typedef void (*glUseProgramProc)(GLuint program);
+typedef void (*glDeleteProgramProc)(GLuint program);
+typedef GLint (*glGetUniformLocationProc)(GLuint program,
+                                          const GLchar *name);
+typedef void (*glUniform1iProc)(GLint location,
+                                GLint v0);
+typedef void (*glUniform2fProc)(GLint location,
+                                GLfloat v0,
+                                GLfloat v1);
+typedef void (*glGenFramebuffersProc)(GLsizei n,
+                                      GLuint *framebuffers);
+typedef void (*glDeleteFramebuffersProc)(GLsizei n,
+                                         const GLuint *framebuffers);
+typedef void (*glBindFramebufferProc)(GLenum target,
+                                      GLuint framebuffer);
+typedef void (*glFramebufferTexture2DProc)(GLenum target,
+                                           GLenum attachment,
+                                           GLenum textarget,
+                                           GLuint texture,
+                                           GLint level);
+typedef GLenum (*glCheckFramebufferStatusProc)(GLenum target);
+typedef void (*glBlitFramebufferProc)(GLint srcX0,
+                                      GLint srcY0,
+                                      GLint srcX1,
+                                      GLint srcY1,
+                                      GLint dstX0,
+                                      GLint dstY0,
+                                      GLint dstX1,
+                                      GLint dstY1,
+                                      GLbitfield mask,
+                                      GLenum filter);
+typedef void (*glGenRenderbuffersProc)(GLsizei n,
+                                       GLuint *renderbuffers);
+typedef void (*glDeleteRenderbuffersProc)(GLsizei n,
+                                          const GLuint *renderbuffers);
+typedef void (*glBindRenderbufferProc)(GLenum target,
+                                       GLuint renderbuffer);
+typedef void (*glRenderbufferStorageProc)(GLenum target,
+                                          GLenum internalformat,
+                                          GLsizei width,
+                                          GLsizei height);
+typedef void (*glFramebufferRenderbufferProc)(GLenum target,
+                                              GLenum attachment,
+                                              GLenum renderbuffertarget,
+                                              GLuint renderbuffer);
+
+#define GL_CAPTURE_GET_PROC(gl_capture, proc) \
+	gl_capture->proc = (proc##Proc) \
+		gl_capture->glXGetProcAddress((const GLubyte *) #proc); \
+	if (!gl_capture->proc) \
+		return ENOTSUP;
+
+struct gl_capture_pbo_s {
+	GLuint pbo;
+	GLsync fence;
+	glc_utime_t time;
+
+	/* mapped buffer is owned by copy thread until it is done */
+	GLvoid *map;
+	int state;
+};
 
 struct gl_capture_video_stream_s {
 	glc_state_video_t state_video;
@@ -67,22 +173,43 @@ struct gl_capture_video_stream_s {
 	Display *dpy;
 	int screen;
 	GLXDrawable drawable;
+	GLXContext ctx;
 	Window attribWin;
-	ps_packet_t packet;
-	glc_utime_t last, pbo_time;
+	ps_packet_t packet, copy_packet;
+	/* buffer packets are written to */
+	ps_buffer_t *to;
+	glc_utime_t last;
+	/* GL_CAPTURE_USE_YCBCR or GL_CAPTURE_USE_SCALE if processed on GPU */
+	glc_flags_t gpu;
 
 	unsigned int w, h;
 	unsigned int cw, ch, row, cx, cy;
+	unsigned int ow, oh; /* picture size in stream */
+	size_t size;
+
+	/* fingerprint of previous frame */
+	u_int64_t hash;
+	int hash_valid;
 
 	float brightness, contrast;
 	float gamma_red, gamma_green, gamma_blue;
+	/* color is checked at next frame */
+	int color_pending;
 
 	int indicator_list;
 
 	struct gl_capture_video_stream_s *next;
 
-	GLuint pbo;
-	int pbo_active;
+	/* PBO ring, transfers are collected in order starting from pbo_first */
+	struct gl_capture_pbo_s *pbo;
+	unsigned int pbo_count, pbo_first, pbo_active;
+
+	/* Y'CbCr conversion, frame texture is rendered into target */
+	GLuint ycbcr_program, ycbcr_fbo;
+	GLuint ycbcr_frame, ycbcr_target;
+
+	/* scaled frame is blitted into renderbuffer */
+	GLuint scale_fbo, scale_rb;
 };
 
 struct gl_capture_s {
@@ -91,13 +218,28 @@ struct gl_capture_s {
 
 	GLenum capture_buffer;
 	glc_utime_t fps;
+	double scale;
 
 	pthread_rwlock_t videolist_lock;
 	struct gl_capture_video_stream_s *video;
 
 	ps_buffer_t *to;
+	/* frames not scaled or converted on GPU are written here */
+	ps_buffer_t *fallback;
+	int (*fallback_callback)(ps_buffer_t **);
+
+	pthread_mutex_t init_mutex;
+	unsigned int pbo_count;
+
+	/* frames are copied from PBOs into buffer by copy thread */
+	pthread_t copy_thread;
+	pthread_mutex_t copy_mutex;
+	pthread_cond_t copy_cond, done_cond;
 
-	pthread_mutex_t init_pbo_mutex;
+	/* in worker mode copy thread waits and maps PBOs in a shared context */
+	Display *worker_dpy;
+	GLXContext worker_ctx, worker_share;
+	GLXPbuffer worker_pbuffer;
 
 	unsigned int bpp;
 	GLenum format;
@@ -114,13 +256,85 @@ struct gl_capture_s {
 	glBindBufferProc glBindBuffer;
 	glMapBufferProc glMapBuffer;
 	glUnmapBufferProc glUnmapBuffer;
+	glBufferStorageProc glBufferStorage;
+	glMapBufferRangeProc glMapBufferRange;
+	glFenceSyncProc glFenceSync;
+	glClientWaitSyncProc glClientWaitSync;
+	glDeleteSyncProc glDeleteSync;
+
+	glCreateShaderProc glCreateShader;
+	glShaderSourceProc glShaderSource;
+	glCompileShaderProc glCompileShader;
+	glGetShaderivProc glGetShaderiv;
+	glDeleteShaderProc glDeleteShader;
+	glCreateProgramProc glCreateProgram;
+	glAttachShaderProc glAttachShader;
+	glLinkProgramProc glLinkProgram;
+	glGetProgramivProc glGetProgramiv;
+	glUseProgramProc glUseProgram;
+	glDeleteProgramProc glDeleteProgram;
+	glGetUniformLocationProc glGetUniformLocation;
+	glUniform1iProc glUniform1i;
+	glUniform2fProc glUniform2f;
+	glGenFramebuffersProc glGenFramebuffers;
+	glDeleteFramebuffersProc glDeleteFramebuffers;
+	glBindFramebufferProc glBindFramebuffer;
+	glFramebufferTexture2DProc glFramebufferTexture2D;
+	glCheckFramebufferStatusProc glCheckFramebufferStatus;
+	glBlitFramebufferProc glBlitFramebuffer;
+	glGenRenderbuffersProc glGenRenderbuffers;
+	glDeleteRenderbuffersProc glDeleteRenderbuffers;
+	glBindRenderbufferProc glBindRenderbuffer;
+	glRenderbufferStorageProc glRenderbufferStorage;
+	glFramebufferRenderbufferProc glFramebufferRenderbuffer;
 };
 
+/*
+ Converts capture area into JPEG Y'CbCr 4:2:0 (see glc/core/ycbcr.c).
+ Target is ow x (oh + oh / 2) and holds Y' plane followed by Cb and Cr
+ planes packed row by row, so a single glReadPixels() returns the picture
+ in the same layout ycbcr produces.
+*/
+static const char *gl_capture_ycbcr_shader =
+	"#extension GL_ARB_texture_rectangle : enable\n"
+	"uniform sampler2DRect frame;\n"
+	"uniform vec2 source;\n"
+	"uniform vec2 scale;\n"
+	"uniform vec2 size;\n"
+	"vec3 fetch(vec2 pos)\n"
+	"{\n"
+	"	return texture2DRect(frame, vec2(pos.x * scale.x,\n"
+	"					 source.y - pos.y * scale.y)).rgb;\n"
+	"}\n"
+	"void main()\n"
+	"{\n"
+	"	vec2 pos = floor(gl_FragCoord.xy);\n"
+	"	float plane = size.x * size.y / 4.0;\n"
+	"	vec3 c = vec3(0.5, -0.418688, -0.081312);\n"
+	"	float i, y;\n"
+	"	if (pos.y < size.y) {\n"
+	"		gl_FragColor = vec4(dot(vec3(0.299, 0.587, 0.114), fetch(pos + 0.5)),\n"
+	"				    0.0, 0.0, 1.0);\n"
+	"		return;\n"
+	"	}\n"
+	"	i = (pos.y - size.y) * size.x + pos.x;\n"
+	"	if (i < plane)\n"
+	"		c = vec3(-0.168736, -0.331264, 0.5);\n"
+	"	else\n"
+	"		i -= plane;\n"
+	"	y = floor((i + 0.5) / (size.x / 2.0));\n"
+	"	gl_FragColor = vec4(128.0 / 255.0 + dot(c, fetch(vec2(i - y * (size.x / 2.0), y) * 2.0 + 1.0)),\n"
+	"			    0.0, 0.0, 1.0);\n"
+	"}\n";
+
+
 int gl_capture_get_video_stream(gl_capture_t gl_capture,
 				struct gl_capture_video_stream_s **video,
 				Display *dpy, GLXDrawable drawable);
 int gl_capture_update_video_stream(gl_capture_t gl_capture,
 				   struct gl_capture_video_stream_s *video);
+int gl_capture_update_target(gl_capture_t gl_capture,
+			     struct gl_capture_video_stream_s *video);
 
 void gl_capture_error(gl_capture_t gl_capture, int err);
 
@@ -132,13 +346,52 @@ int gl_capture_update_screen(gl_capture_t gl_capture, struct gl_capture_video_st
 int gl_capture_update_color(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video);
 
 int gl_capture_get_pixels(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video, char *to);
+u_int64_t gl_capture_hash(const unsigned char *data, size_t size);
+int gl_capture_is_repeat(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video,
+			 const char *data, u_int64_t *hash);
+int gl_capture_write_repeat(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video,
+			    ps_packet_t *packet, glc_utime_t time);
 int gl_capture_gen_indicator_list(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video);
 
+int gl_capture_init_glx(gl_capture_t gl_capture);
 int gl_capture_init_pbo(gl_capture_t gl);
 int gl_capture_create_pbo(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video);
 int gl_capture_destroy_pbo(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video);
-int gl_capture_start_pbo(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video);
-int gl_capture_read_pbo(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video);
+int gl_capture_start_pbo(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video,
+			 glc_utime_t time);
+int gl_capture_pbo_ready(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video,
+			 struct gl_capture_pbo_s *pbo);
+int gl_capture_map_pbo(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video,
+		       struct gl_capture_pbo_s *pbo);
+int gl_capture_unmap_pbo(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video,
+			 struct gl_capture_pbo_s *pbo);
+int gl_capture_reclaim_pbo(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video);
+int gl_capture_write_pbo(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video,
+			 int wait);
+int gl_capture_flush_pbo(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video);
+int gl_capture_wait_pbo(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video);
+int gl_capture_finish_pbo(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video);
+int gl_capture_copy_pbo(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video,
+			struct gl_capture_pbo_s *pbo);
+void *gl_capture_copy_thread(void *argptr);
+
+int gl_capture_init_worker(gl_capture_t gl_capture, Display *dpy);
+int gl_capture_start_worker(gl_capture_t gl_capture);
+int gl_capture_worker_video(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video);
+
+int gl_capture_init_fbo(gl_capture_t gl_capture);
+
+int gl_capture_init_ycbcr(gl_capture_t gl_capture);
+int gl_capture_create_ycbcr(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video);
+int gl_capture_destroy_ycbcr(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video);
+int gl_capture_get_ycbcr_pixels(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video,
+				char *to);
+
+int gl_capture_init_scale(gl_capture_t gl_capture);
+int gl_capture_create_scale(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video);
+int gl_capture_destroy_scale(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video);
+int gl_capture_get_scaled_pixels(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video,
+				 char *to);
 
 int gl_capture_init(gl_capture_t *gl_capture, glc_t *glc)
 {
@@ -151,8 +404,13 @@ int gl_capture_init(gl_capture_t *gl_capture, glc_t *glc)
 	(*gl_capture)->format = GL_BGRA;		/* capture as BGRA data by default */
 	(*gl_capture)->bpp = 4;				/* since we use BGRA */
 	(*gl_capture)->capture_buffer = GL_FRONT;	/* front buffer is default */
+	(*gl_capture)->pbo_count = 3;			/* triple-buffered PBO transfers */
+	(*gl_capture)->scale = 1.0;
 
-	pthread_mutex_init(&(*gl_capture)->init_pbo_mutex, NULL);
+	pthread_mutex_init(&(*gl_capture)->init_mutex, NULL);
+	pthread_mutex_init(&(*gl_capture)->copy_mutex, NULL);
+	pthread_cond_init(&(*gl_capture)->copy_cond, NULL);
+	pthread_cond_init(&(*gl_capture)->done_cond, NULL);
 	pthread_rwlock_init(&(*gl_capture)->videolist_lock, NULL);
 
 	return 0;
@@ -167,6 +425,16 @@ int gl_capture_set_buffer(gl_capture_t gl_capture, ps_buffer_t *buffer)
 	return 0;
 }
 
+int gl_capture_set_fallback_callback(gl_capture_t gl_capture,
+				     int (*callback)(ps_buffer_t **))
+{
+	if (gl_capture->fallback_callback)
+		return EALREADY;
+
+	gl_capture->fallback_callback = callback;
+	return 0;
+}
+
 int gl_capture_set_read_buffer(gl_capture_t gl_capture, GLenum buffer)
 {
 	if (buffer == GL_FRONT)
@@ -234,6 +502,40 @@ int gl_capture_try_pbo(gl_capture_t gl_capture, int try_pbo)
 	return 0;
 }
 
+int gl_capture_set_pbo_count(gl_capture_t gl_capture, unsigned int count)
+{
+	if (!count)
+		return EINVAL;
+
+	if (gl_capture->flags & GL_CAPTURE_USE_PBO) {
+		glc_log(gl_capture->glc, GLC_WARNING, "gl_capture",
+			 "can't change PBO count; PBO is in use");
+		return EAGAIN;
+	}
+
+	glc_log(gl_capture->glc, GLC_DEBUG, "gl_capture",
+		 "using %u PBOs per video stream", count);
+	gl_capture->pbo_count = count;
+	return 0;
+}
+
+int gl_capture_use_worker(gl_capture_t gl_capture, int use_worker)
+{
+	if (use_worker)
+		gl_capture->flags |= GL_CAPTURE_TRY_WORKER;
+	else {
+		if (gl_capture->flags & GL_CAPTURE_USE_WORKER) {
+			glc_log(gl_capture->glc, GLC_WARNING, "gl_capture",
+				 "can't disable capture worker; it is in use");
+			return EAGAIN;
+		}
+
+		gl_capture->flags &= ~GL_CAPTURE_TRY_WORKER;
+	}
+
+	return 0;
+}
+
 int gl_capture_set_pixel_format(gl_capture_t gl_capture, GLenum format)
 {
 	if (format == GL_BGRA) {
@@ -254,6 +556,68 @@ int gl_capture_set_pixel_format(gl_capture_t gl_capture, GLenum format)
 	return 0;
 }
 
+int gl_capture_convert_ycbcr_420jpeg(gl_capture_t gl_capture, int convert)
+{
+	if (convert) {
+		gl_capture->flags |= GL_CAPTURE_TRY_YCBCR;
+	} else {
+		if (gl_capture->flags & GL_CAPTURE_USE_YCBCR) {
+			glc_log(gl_capture->glc, GLC_WARNING, "gl_capture",
+				 "can't disable Y'CbCr conversion; it is in use");
+			return EAGAIN;
+		}
+
+		gl_capture->flags &= ~GL_CAPTURE_TRY_YCBCR;
+	}
+
+	return 0;
+}
+
+int gl_capture_set_scale(gl_capture_t gl_capture, double scale)
+{
+	if ((scale <= 0) || (scale > 1.0))
+		return EINVAL;
+
+	if (gl_capture->flags & (GL_CAPTURE_USE_SCALE | GL_CAPTURE_USE_YCBCR)) {
+		glc_log(gl_capture->glc, GLC_WARNING, "gl_capture",
+			 "can't change scale; capturing is in progress");
+		return EAGAIN;
+	}
+
+	if (scale == 1.0)
+		gl_capture->flags &= ~GL_CAPTURE_TRY_SCALE;
+	else {
+		glc_log(gl_capture->glc, GLC_INFORMATION, "gl_capture",
+			 "scaling frames with factor %f", scale);
+		gl_capture->flags |= GL_CAPTURE_TRY_SCALE;
+	}
+
+	gl_capture->scale = scale;
+	return 0;
+}
+
+int gl_capture_detect_repeat(gl_capture_t gl_capture, int detect_repeat)
+{
+	if (detect_repeat)
+		gl_capture->flags |= GL_CAPTURE_DETECT_REPEAT;
+	else
+		gl_capture->flags &= ~GL_CAPTURE_DETECT_REPEAT;
+	return 0;
+}
+
+int gl_capture_refresh(gl_capture_t gl_capture)
+{
+	struct gl_capture_video_stream_s *video;
+
+	/* next frame of every stream is written in full */
+	pthread_rwlock_rdlock(&gl_capture->videolist_lock);
+	for (video = gl_capture->video; video != NULL; video = video->next)
+		video->hash_valid = 0;
+	pthread_rwlock_unlock(&gl_capture->videolist_lock);
+
+	return 0;
+}
+
 int gl_capture_draw_indicator(gl_capture_t gl_capture, int draw_indicator)
 {
 	if (draw_indicator) {
@@ -306,6 +670,8 @@ int gl_capture_lock_fps(gl_capture_t gl_capture, int lock_fps)
 
 int gl_capture_start(gl_capture_t gl_capture)
 {
+	struct gl_capture_video_stream_s *video;
+
 	if (!gl_capture->to) {
 		glc_log(gl_capture->glc, GLC_ERROR, "gl_capture",
 			 "no target buffer specified");
@@ -319,6 +685,12 @@ int gl_capture_start(gl_capture_t gl_capture)
 		glc_log(gl_capture->glc, GLC_INFORMATION, "gl_capture",
 			 "starting capturing");
 
+	/* stream might have been reopened, don't refer to old frames */
+	pthread_rwlock_rdlock(&gl_capture->videolist_lock);
+	for (video = gl_capture->video; video != NULL; video = video->next)
+		video->hash_valid = 0;
+	pthread_rwlock_unlock(&gl_capture->videolist_lock);
+
 	gl_capture->flags |= GL_CAPTURE_CAPTURING;
 	gl_capture_refresh_color_correction(gl_capture);
 	return 0;
@@ -350,12 +722,34 @@ void gl_capture_error(gl_capture_t gl_capture, int err)
 	glc_state_set(gl_capture->glc, GLC_STATE_CANCEL);
 	if (gl_capture->to)
 		ps_buffer_cancel(gl_capture->to);
+	if (gl_capture->fallback)
+		ps_buffer_cancel(gl_capture->fallback);
 }
 
 int gl_capture_destroy(gl_capture_t gl_capture)
 {
 	struct gl_capture_video_stream_s *del;
 
+	/* let copy thread finish with pending frames */
+	if (gl_capture->flags & GL_CAPTURE_COPYING) {
+		for (del = gl_capture->video; del != NULL; del = del->next) {
+			if (del->pbo)
+				gl_capture_flush_pbo(gl_capture, del);
+		}
+
+		pthread_mutex_lock(&gl_capture->copy_mutex);
+		gl_capture->flags &= ~GL_CAPTURE_COPYING;
+		pthread_cond_broadcast(&gl_capture->copy_cond);
+		pthread_mutex_unlock(&gl_capture->copy_mutex);
+
+		pthread_join(gl_capture->copy_thread, NULL);
+	}
+
+	if (gl_capture->worker_ctx)
+		glXDestroyContext(gl_capture->worker_dpy, gl_capture->worker_ctx);
+	if (gl_capture->worker_pbuffer)
+		glXDestroyPbuffer(gl_capture->worker_dpy, gl_capture->worker_pbuffer);
+
 	while (gl_capture->video != NULL) {
 		del = gl_capture->video;
 		gl_capture->video = gl_capture->video->next;
@@ -367,12 +761,22 @@ int gl_capture_destroy(gl_capture_t gl_capture)
 		if (del->pbo)
 			gl_capture_destroy_pbo(gl_capture, del);
 
+		if (del->ycbcr_program)
+			gl_capture_destroy_ycbcr(gl_capture, del);
+
+		if (del->scale_fbo)
+			gl_capture_destroy_scale(gl_capture, del);
+
 		ps_packet_destroy(&del->packet);
+		ps_packet_destroy(&del->copy_packet);
 		free(del);
 	}
 
 	pthread_rwlock_destroy(&gl_capture->videolist_lock);
-	pthread_mutex_destroy(&gl_capture->init_pbo_mutex);
+	pthread_mutex_destroy(&gl_capture->init_mutex);
+	pthread_mutex_destroy(&gl_capture->copy_mutex);
+	pthread_cond_destroy(&gl_capture->copy_cond);
+	pthread_cond_destroy(&gl_capture->done_cond);
 
 	if (gl_capture->libGL_handle)
 		dlclose(gl_capture->libGL_handle);
@@ -440,15 +844,37 @@ int gl_capture_calc_geometry(gl_capture_t gl_capture, struct gl_capture_video_st
 		 "calculated capture area for video %d is %ux%u+%u+%u",
 		 video->id, video->cw, video->ch, video->cx, video->cy);
 
-	video->row = video->cw * gl_capture->bpp;
+	/* scaling is done by either blit or Y'CbCr conversion */
+	if (video->gpu) {
+		video->ow = video->cw * gl_capture->scale;
+		video->oh = video->ch * gl_capture->scale;
+	} else {
+		video->ow = video->cw;
+		video->oh = video->ch;
+	}
+
+	if (video->gpu & GL_CAPTURE_USE_YCBCR) {
+		video->ow -= video->ow % 2; /* safer and faster             */
+		video->oh -= video->oh % 2; /* but we might drop a pixel... */
+		video->size = video->ow * video->oh + 2 * ((video->ow / 2) * (video->oh / 2));
+		return 0;
+	}
+
+	video->row = video->ow * gl_capture->bpp;
 	if (video->row % gl_capture->pack_alignment != 0)
 		video->row += gl_capture->pack_alignment - video->row % gl_capture->pack_alignment;
+	video->size = video->row * video->oh;
 
 	return 0;
 }
 
 int gl_capture_get_pixels(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video, char *to)
 {
+	if (video->gpu & GL_CAPTURE_USE_YCBCR)
+		return gl_capture_get_ycbcr_pixels(gl_capture, video, to);
+	else if (video->gpu & GL_CAPTURE_USE_SCALE)
+		return gl_capture_get_scaled_pixels(gl_capture, video, to);
+
 	glPushAttrib(GL_PIXEL_MODE_BIT);
 	glPushClientAttrib(GL_CLIENT_PIXEL_STORE_BIT);
 
@@ -462,6 +888,91 @@ int gl_capture_get_pixels(gl_capture_t gl_capture, struct gl_capture_video_strea
 	return 0;
 }
 
+u_int64_t gl_capture_hash(const unsigned char *data, size_t size)
+{
+	u_int64_t h[4] = {0x243f6a8885a308d3ULL, 0x13198a2e03707344ULL,
+			  0xa4093822299f31d0ULL, 0x082efa98ec4e6c89ULL};
+	u_int64_t w[4];
+	size_t i;
+	int l;
+
+	/*
+	 Four independent lanes keep multipliers busy. Every step is
+	 a bijection of lane state, so a change in a single word can't
+	 be cancelled later in the same lane.
+	*/
+	for (i = 0; i + sizeof(w) <= size; i += sizeof(w)) {
+		memcpy(w, &data[i], sizeof(w));
+		for (l = 0; l < 4; l++) {
+			h[l] ^= w[l];
+			h[l] = (h[l] << 31) | (h[l] >> 33);
+			h[l] *= 0x9e3779b97f4a7c15ULL;
+		}
+	}
+
+	for (; i < size; i++)
+		h[0] = (h[0] ^ data[i]) * 0x100000001b3ULL;
+
+	/* fold lanes and mix high bits down */
+	h[0] ^= (h[1] << 17 | h[1] >> 47) ^ (h[2] << 34 | h[2] >> 30) ^
+		(h[3] << 51 | h[3] >> 13) ^ size;
+	h[0] ^= h[0] >> 33;
+	h[0] *= 0xff51afd7ed558ccdULL;
+	h[0] ^= h[0] >> 33;
+	h[0] *= 0xc4ceb9fe1a85ec53ULL;
+	h[0] ^= h[0] >> 33;
+
+	return h[0];
+}
+
+int gl_capture_is_repeat(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video,
+			 const char *data, u_int64_t *hash)
+{
+	if (!(gl_capture->flags & GL_CAPTURE_DETECT_REPEAT)) {
+		video->hash_valid = 0;
+		return 0;
+	}
+
+	/* caller updates video->hash once frame is actually written */
+	*hash = gl_capture_hash((const unsigned char *) data, video->size);
+	return (video->hash_valid) && (video->hash == *hash);
+}
+
+int gl_capture_write_repeat(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video,
+			    ps_packet_t *packet, glc_utime_t time)
+{
+	glc_message_header_t msg;
+	glc_video_repeat_message_t repeat;
+	int ret;
+
+	msg.type = GLC_MESSAGE_VIDEO_REPEAT;
+	repeat.id = video->id;
+	repeat.time = time;
+
+	if ((ret = ps_packet_open(packet, ((gl_capture->flags & GL_CAPTURE_LOCK_FPS) |
+					   (gl_capture->flags & GL_CAPTURE_IGNORE_TIME)) ?
+					  (PS_PACKET_WRITE) :
+					  (PS_PACKET_WRITE | PS_PACKET_TRY)))) {
+		if (ret != EBUSY)
+			return ret;
+
+		/* frame is still valid, next repeat refers to it */
+		glc_log(gl_capture->glc, GLC_INFORMATION, "gl_capture",
+			 "dropped frame, buffer not ready");
+		return 0;
+	}
+
+	if ((ret = ps_packet_write(packet, &msg, sizeof(glc_message_header_t))))
+		goto cancel;
+	if ((ret = ps_packet_write(packet, &repeat, sizeof(glc_video_repeat_message_t))))
+		goto cancel;
+	return ps_packet_close(packet);
+
+cancel:
+	ps_packet_cancel(packet);
+	return ret;
+}
+
 int gl_capture_gen_indicator_list(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video)
 {
 	int size;
@@ -492,6 +1003,24 @@ int gl_capture_gen_indicator_list(gl_capture_t gl_capture, struct gl_capture_vid
 	return 0;
 }
 
+int gl_capture_init_glx(gl_capture_t gl_capture)
+{
+	if (gl_capture->glXGetProcAddress)
+		return 0;
+
+	if (!gl_capture->libGL_handle)
+		gl_capture->libGL_handle = dlopen("libGL.so.1", RTLD_LAZY);
+	if (!gl_capture->libGL_handle)
+		return ENOTSUP;
+	gl_capture->glXGetProcAddress =
+		(GLXGetProcAddressProc)
+		dlsym(gl_capture->libGL_handle, "glXGetProcAddressARB");
+	if (!gl_capture->glXGetProcAddress)
+		return ENOTSUP;
+
+	return 0;
+}
+
 int gl_capture_init_pbo(gl_capture_t gl_capture)
 {
 	const char *gl_extensions = (const char *) glGetString(GL_EXTENSIONS);
@@ -501,14 +1030,8 @@ int gl_capture_init_pbo(gl_capture_t gl_capture)
 	
 	if (!strstr(gl_extensions, "GL_ARB_pixel_buffer_object"))
 		return ENOTSUP;
-	
-	gl_capture->libGL_handle = dlopen("libGL.so.1", RTLD_LAZY);
-	if (!gl_capture->libGL_handle)
-		return ENOTSUP;
-	gl_capture->glXGetProcAddress =
-		(GLXGetProcAddressProc)
-		dlsym(gl_capture->libGL_handle, "glXGetProcAddressARB");
-	if (!gl_capture->glXGetProcAddress)
+
+	if (gl_capture_init_glx(gl_capture))
 		return ENOTSUP;
 	
 	gl_capture->glGenBuffers =
@@ -545,121 +1068,956 @@ int gl_capture_init_pbo(gl_capture_t gl_capture)
 	glc_log(gl_capture->glc, GLC_INFORMATION, "gl_capture",
 		 "using GL_ARB_pixel_buffer_object");
 
+	/*
+	 Without fences the oldest transfer is collected only when
+	 the ring is full, which may still stall in glMapBuffer().
+	*/
+	if (strstr(gl_extensions, "GL_ARB_sync")) {
+		gl_capture->glFenceSync =
+			(glFenceSyncProc)
+			gl_capture->glXGetProcAddress((const GLubyte *) "glFenceSync");
+		gl_capture->glClientWaitSync =
+			(glClientWaitSyncProc)
+			gl_capture->glXGetProcAddress((const GLubyte *) "glClientWaitSync");
+		gl_capture->glDeleteSync =
+			(glDeleteSyncProc)
+			gl_capture->glXGetProcAddress((const GLubyte *) "glDeleteSync");
+	}
+
+	if (strstr(gl_extensions, "GL_ARB_buffer_storage")) {
+		gl_capture->glBufferStorage =
+			(glBufferStorageProc)
+			gl_capture->glXGetProcAddress((const GLubyte *) "glBufferStorage");
+		gl_capture->glMapBufferRange =
+			(glMapBufferRangeProc)
+			gl_capture->glXGetProcAddress((const GLubyte *) "glMapBufferRange");
+	}
+
+	if ((gl_capture->glBufferStorage) && (gl_capture->glMapBufferRange))
+		glc_log(gl_capture->glc, GLC_INFORMATION, "gl_capture",
+			 "using GL_ARB_buffer_storage");
+	else {
+		gl_capture->glBufferStorage = NULL;
+		gl_capture->glMapBufferRange = NULL;
+	}
+
+	if ((gl_capture->glFenceSync) && (gl_capture->glClientWaitSync) &&
+	    (gl_capture->glDeleteSync))
+		glc_log(gl_capture->glc, GLC_INFORMATION, "gl_capture",
+			 "using GL_ARB_sync");
+	else {
+		gl_capture->glFenceSync = NULL;
+		gl_capture->glClientWaitSync = NULL;
+		gl_capture->glDeleteSync = NULL;
+		glc_log(gl_capture->glc, GLC_WARNING, "gl_capture",
+			 "GL_ARB_sync not supported, PBO transfers may stall");
+	}
+
 	return 0;
 }
 
 int gl_capture_create_pbo(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video)
 {
 	GLint binding;
+	unsigned int i;
+
+	glc_log(gl_capture->glc, GLC_DEBUG, "gl_capture",
+		 "creating %u PBOs", gl_capture->pbo_count);
 
-	glc_log(gl_capture->glc, GLC_DEBUG, "gl_capture", "creating PBO");
+	video->pbo = (struct gl_capture_pbo_s *)
+		malloc(sizeof(struct gl_capture_pbo_s) * gl_capture->pbo_count);
+	if (!video->pbo)
+		return ENOMEM;
+	memset(video->pbo, 0, sizeof(struct gl_capture_pbo_s) * gl_capture->pbo_count);
+
+	video->pbo_count = gl_capture->pbo_count;
+	video->pbo_first = video->pbo_active = 0;
 
 	glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING_ARB, &binding);
 	glPushAttrib(GL_ALL_ATTRIB_BITS);
 
-	gl_capture->glGenBuffers(1, &video->pbo);
-	gl_capture->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, video->pbo);
-	gl_capture->glBufferData(GL_PIXEL_PACK_BUFFER_ARB, video->row * video->ch,
-		         NULL, GL_STREAM_READ);
+	for (i = 0; i < video->pbo_count; i++) {
+		gl_capture->glGenBuffers(1, &video->pbo[i].pbo);
+		gl_capture->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, video->pbo[i].pbo);
+
+		if (gl_capture->glBufferStorage) {
+			/* mapped once, copy thread reads it when transfer is finished */
+			gl_capture->glBufferStorage(GL_PIXEL_PACK_BUFFER_ARB, video->size, NULL,
+						    GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT |
+						    GL_MAP_COHERENT_BIT);
+			video->pbo[i].map =
+				gl_capture->glMapBufferRange(GL_PIXEL_PACK_BUFFER_ARB, 0, video->size,
+							     GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT |
+							     GL_MAP_COHERENT_BIT);
+			if (!video->pbo[i].map)
+				break;
+		} else
+			gl_capture->glBufferData(GL_PIXEL_PACK_BUFFER_ARB, video->size,
+						 NULL, GL_STREAM_READ);
+	}
 
 	glPopAttrib();
 	gl_capture->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, binding);
+
+	if (i < video->pbo_count) {
+		glc_log(gl_capture->glc, GLC_ERROR, "gl_capture",
+			 "can't map PBO persistently");
+		video->pbo_count = i + 1;
+		gl_capture_destroy_pbo(gl_capture, video);
+		return EINVAL;
+	}
+
 	return 0;
 }
 
 int gl_capture_destroy_pbo(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video)
 {
-	glc_log(gl_capture->glc, GLC_DEBUG, "gl_capture", "destroying PBO");
+	unsigned int i;
+
+	glc_log(gl_capture->glc, GLC_DEBUG, "gl_capture", "destroying PBOs");
 
-	gl_capture->glDeleteBuffers(1, &video->pbo);
+	/* copy thread might still be reading */
+	gl_capture_flush_pbo(gl_capture, video);
+
+	if (video->pbo_active)
+		glc_log(gl_capture->glc, GLC_INFORMATION, "gl_capture",
+			 "dropped %u frames, PBO transfers in progress", video->pbo_active);
+
+	for (i = 0; i < video->pbo_count; i++) {
+		if (video->pbo[i].fence)
+			gl_capture->glDeleteSync(video->pbo[i].fence);
+		/* deleting buffer unmaps it */
+		gl_capture->glDeleteBuffers(1, &video->pbo[i].pbo);
+	}
+
+	pthread_mutex_lock(&gl_capture->copy_mutex);
+	free(video->pbo);
+	video->pbo = NULL;
+	video->pbo_count = video->pbo_first = video->pbo_active = 0;
+	pthread_mutex_unlock(&gl_capture->copy_mutex);
 	return 0;
 }
 
-int gl_capture_start_pbo(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video)
+int gl_capture_start_pbo(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video,
+			 glc_utime_t time)
 {
+	struct gl_capture_pbo_s *pbo;
 	GLint binding;
+	int ret;
 
-	if (video->pbo_active)
+	if (video->pbo_active == video->pbo_count)
 		return EAGAIN;
 
-	glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING_ARB, &binding);
-	glPushAttrib(GL_PIXEL_MODE_BIT);
-	glPushClientAttrib(GL_CLIENT_PIXEL_STORE_BIT);
+	pbo = &video->pbo[(video->pbo_first + video->pbo_active) % video->pbo_count];
 
-	gl_capture->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, video->pbo);
+	glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING_ARB, &binding);
+	gl_capture->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, pbo->pbo);
 
-	glReadBuffer(gl_capture->capture_buffer);
-	glPixelStorei(GL_PACK_ALIGNMENT, gl_capture->pack_alignment);
 	/* to = ((char *)NULL + (offset)) */
-	glReadPixels(video->cx, video->cy, video->cw, video->ch, gl_capture->format, GL_UNSIGNED_BYTE, NULL);
+	if ((ret = gl_capture_get_pixels(gl_capture, video, NULL)))
+		goto finish;
 
-	video->pbo_active = 1;
+	if (gl_capture->glFenceSync)
+		pbo->fence = gl_capture->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	pbo->time = time;
 
-	glPopClientAttrib();
-	glPopAttrib();
+	if (gl_capture_worker_video(gl_capture, video)) {
+		/* worker can't flush our context, fence might never signal otherwise */
+		glFlush();
+
+		/* worker waits for the fence and maps buffer by itself */
+		pthread_mutex_lock(&gl_capture->copy_mutex);
+		pbo->state = GL_CAPTURE_PBO_COPYING;
+		video->pbo_active++;
+		pthread_cond_signal(&gl_capture->copy_cond);
+		pthread_mutex_unlock(&gl_capture->copy_mutex);
+		goto finish;
+	}
+
+	pthread_mutex_lock(&gl_capture->copy_mutex);
+	pbo->state = GL_CAPTURE_PBO_READING;
+	video->pbo_active++;
+	pthread_mutex_unlock(&gl_capture->copy_mutex);
+
+finish:
 	gl_capture->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, binding);
-	return 0;
+	return ret;
 }
 
-int gl_capture_read_pbo(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video)
+int gl_capture_pbo_ready(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video,
+			 struct gl_capture_pbo_s *pbo)
+{
+	GLenum status;
+
+	/* without fence we can only guess */
+	if (!pbo->fence)
+		return video->pbo_active == video->pbo_count;
+
+	/* zero timeout, just poll the fence */
+	status = gl_capture->glClientWaitSync(pbo->fence, 0, 0);
+	return (status == GL_ALREADY_SIGNALED) || (status == GL_CONDITION_SATISFIED);
+}
+
+int gl_capture_map_pbo(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video,
+		       struct gl_capture_pbo_s *pbo)
 {
-	GLvoid *buf;
 	GLint binding;
-	
-	if (!video->pbo_active)
-		return EAGAIN;
+
+	if (pbo->fence) {
+		/* blocks only if transfer is not finished yet */
+		gl_capture->glClientWaitSync(pbo->fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+					     GL_TIMEOUT_IGNORED);
+		gl_capture->glDeleteSync(pbo->fence);
+		pbo->fence = NULL;
+	} else if (pbo->map)
+		glFinish();
+
+	if (pbo->map)
+		return 0; /* persistent mapping */
 
 	glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING_ARB, &binding);
+	gl_capture->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, pbo->pbo);
+	pbo->map = gl_capture->glMapBuffer(GL_PIXEL_PACK_BUFFER_ARB, GL_READ_ONLY);
+	gl_capture->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, binding);
 
-	gl_capture->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, video->pbo);
-	buf = gl_capture->glMapBuffer(GL_PIXEL_PACK_BUFFER_ARB, GL_READ_ONLY);
-	if (!buf)
+	if (!pbo->map)
 		return EINVAL;
+	return 0;
+}
 
-	ps_packet_write(&video->packet, buf, video->row * video->ch);
+int gl_capture_unmap_pbo(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video,
+			 struct gl_capture_pbo_s *pbo)
+{
+	GLint binding;
 
-	gl_capture->glUnmapBuffer(GL_PIXEL_PACK_BUFFER_ARB);
+	if ((gl_capture->glBufferStorage) || (!pbo->map))
+		return 0; /* stays mapped or already unmapped by worker */
 
-	video->pbo_active = 0;
-	
+	glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING_ARB, &binding);
+	gl_capture->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, pbo->pbo);
+	gl_capture->glUnmapBuffer(GL_PIXEL_PACK_BUFFER_ARB);
 	gl_capture->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, binding);
+
+	pbo->map = NULL;
 	return 0;
 }
 
-int gl_capture_get_video_stream(gl_capture_t gl_capture, struct gl_capture_video_stream_s **video, Display *dpy, GLXDrawable drawable)
+int gl_capture_reclaim_pbo(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video)
 {
-	struct gl_capture_video_stream_s *fvideo;
+	struct gl_capture_pbo_s *pbo;
 
-	pthread_rwlock_rdlock(&gl_capture->videolist_lock);
-	fvideo = gl_capture->video;
-	while (fvideo != NULL) {
-		if ((fvideo->drawable == drawable) && (fvideo->dpy == dpy))
+	/* copy_mutex must be held */
+	while (video->pbo_active) {
+		pbo = &video->pbo[video->pbo_first];
+		if (pbo->state != GL_CAPTURE_PBO_DONE)
 			break;
-		
-		fvideo = fvideo->next;
-	}
-	pthread_rwlock_unlock(&gl_capture->videolist_lock);
-	
-	if (fvideo == NULL) {
-		fvideo = (struct gl_capture_video_stream_s *) malloc(sizeof(struct gl_capture_video_stream_s));
-		memset(fvideo, 0, sizeof(struct gl_capture_video_stream_s));
-
-		fvideo->dpy = dpy;
-		fvideo->drawable = drawable;
-		ps_packet_init(&fvideo->packet, gl_capture->to);
-
-		glc_state_video_new(gl_capture->glc, &fvideo->id, &fvideo->state_video);
-
-		/* these functions need to be thread-safe */
-		pthread_rwlock_wrlock(&gl_capture->videolist_lock);
 
-		fvideo->next = gl_capture->video;
-		gl_capture->video = fvideo;
+		gl_capture_unmap_pbo(gl_capture, video, pbo);
+		pbo->state = GL_CAPTURE_PBO_FREE;
 
-		pthread_rwlock_unlock(&gl_capture->videolist_lock);
+		video->pbo_first = (video->pbo_first + 1) % video->pbo_count;
+		video->pbo_active--;
 	}
-	
-	*video = fvideo;
+
+	return 0;
+}
+
+int gl_capture_write_pbo(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video,
+			 int wait)
+{
+	struct gl_capture_pbo_s *pbo;
+	unsigned int i;
+	int ret = 0, queued = 0;
+
+	pthread_mutex_lock(&gl_capture->copy_mutex);
+
+	/* release buffers copy thread is done with */
+	gl_capture_reclaim_pbo(gl_capture, video);
+
+	/*
+	 Hand finished transfers over to copy thread in order. If wait is set
+	 and every slot is in flight, the oldest one is mapped even if it blocks.
+	*/
+	for (i = 0; i < video->pbo_active; i++) {
+		pbo = &video->pbo[(video->pbo_first + i) % video->pbo_count];
+		if (pbo->state != GL_CAPTURE_PBO_READING)
+			continue;
+
+		if ((!gl_capture_pbo_ready(gl_capture, video, pbo)) &&
+		    ((!wait) || (i) || (video->pbo_active < video->pbo_count)))
+			break;
+
+		if ((ret = gl_capture_map_pbo(gl_capture, video, pbo)))
+			goto finish;
+		pbo->state = GL_CAPTURE_PBO_COPYING;
+		queued = 1;
+	}
+
+	if (queued)
+		pthread_cond_signal(&gl_capture->copy_cond);
+
+	/* wait until oldest slot is free */
+	if ((wait) && (video->pbo_active == video->pbo_count)) {
+		while ((video->pbo[video->pbo_first].state != GL_CAPTURE_PBO_DONE) &&
+		       (gl_capture->flags & GL_CAPTURE_COPYING))
+			pthread_cond_wait(&gl_capture->done_cond, &gl_capture->copy_mutex);
+		gl_capture_reclaim_pbo(gl_capture, video);
+	}
+
+finish:
+	pthread_mutex_unlock(&gl_capture->copy_mutex);
+	return ret;
+}
+
+int gl_capture_flush_pbo(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video)
+{
+	gl_capture_wait_pbo(gl_capture, video);
+
+	pthread_mutex_lock(&gl_capture->copy_mutex);
+	gl_capture_reclaim_pbo(gl_capture, video);
+	pthread_mutex_unlock(&gl_capture->copy_mutex);
+	return 0;
+}
+
+int gl_capture_wait_pbo(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video)
+{
+	unsigned int i;
+
+	/* no GL calls here, this is safe in any thread */
+	pthread_mutex_lock(&gl_capture->copy_mutex);
+
+	for (i = 0; i < video->pbo_active; i++) {
+		while ((video->pbo[(video->pbo_first + i) % video->pbo_count].state ==
+			GL_CAPTURE_PBO_COPYING) && (gl_capture->flags & GL_CAPTURE_COPYING))
+			pthread_cond_wait(&gl_capture->done_cond, &gl_capture->copy_mutex);
+	}
+
+	pthread_mutex_unlock(&gl_capture->copy_mutex);
+	return 0;
+}
+
+int gl_capture_finish_pbo(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video)
+{
+	struct gl_capture_pbo_s *pbo;
+	unsigned int i;
+	int ret = 0;
+
+	/* stream context must be current, unfinished transfers are mapped here */
+	pthread_mutex_lock(&gl_capture->copy_mutex);
+	for (i = 0; i < video->pbo_active; i++) {
+		pbo = &video->pbo[(video->pbo_first + i) % video->pbo_count];
+		if (pbo->state != GL_CAPTURE_PBO_READING)
+			continue;
+
+		if ((ret = gl_capture_map_pbo(gl_capture, video, pbo)))
+			break;
+		pbo->state = GL_CAPTURE_PBO_COPYING;
+	}
+	pthread_cond_signal(&gl_capture->copy_cond);
+	pthread_mutex_unlock(&gl_capture->copy_mutex);
+
+	gl_capture_flush_pbo(gl_capture, video);
+	return ret;
+}
+
+int gl_capture_copy_pbo(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video,
+			struct gl_capture_pbo_s *pbo)
+{
+	glc_message_header_t msg;
+	glc_video_frame_header_t pic;
+	u_int64_t hash;
+	int ret = 0;
+
+	msg.type = GLC_MESSAGE_VIDEO_FRAME;
+	pic.id = video->id;
+	pic.time = pbo->time;
+
+	if (gl_capture_is_repeat(gl_capture, video, pbo->map, &hash))
+		return gl_capture_write_repeat(gl_capture, video, &video->copy_packet, pbo->time);
+
+	if ((ret = ps_packet_open(&video->copy_packet, ((gl_capture->flags & GL_CAPTURE_LOCK_FPS) |
+							(gl_capture->flags & GL_CAPTURE_IGNORE_TIME)) ?
+						       (PS_PACKET_WRITE) :
+						       (PS_PACKET_WRITE | PS_PACKET_TRY)))) {
+		if (ret != EBUSY)
+			return ret;
+
+		glc_log(gl_capture->glc, GLC_INFORMATION, "gl_capture",
+			 "dropped frame, buffer not ready");
+		return 0;
+	}
+
+	if ((ret = ps_packet_write(&video->copy_packet, &msg, sizeof(glc_message_header_t))))
+		goto cancel;
+	if ((ret = ps_packet_write(&video->copy_packet, &pic, sizeof(glc_video_frame_header_t))))
+		goto cancel;
+	if ((ret = ps_packet_write(&video->copy_packet, pbo->map, video->size)))
+		goto cancel;
+	if ((ret = ps_packet_close(&video->copy_packet)))
+		return ret;
+
+	if (gl_capture->flags & GL_CAPTURE_DETECT_REPEAT) {
+		video->hash = hash;
+		video->hash_valid = 1;
+	}
+	return 0;
+
+cancel:
+	ps_packet_cancel(&video->copy_packet);
+	return ret;
+}
+
+void *gl_capture_copy_thread(void *argptr)
+{
+	gl_capture_t gl_capture = argptr;
+	struct gl_capture_video_stream_s *video;
+	struct gl_capture_pbo_s *pbo = NULL;
+	unsigned int i;
+	int ret = 0, worker;
+
+	if (gl_capture->flags & GL_CAPTURE_USE_WORKER)
+		gl_capture_start_worker(gl_capture);
+
+	pthread_mutex_lock(&gl_capture->copy_mutex);
+	while (gl_capture->flags & GL_CAPTURE_COPYING) {
+		/* find oldest buffer waiting for copy */
+		pthread_rwlock_rdlock(&gl_capture->videolist_lock);
+		for (video = gl_capture->video, pbo = NULL; (video) && (!pbo); video = video->next) {
+			for (i = 0; i < video->pbo_active; i++) {
+				if (video->pbo[(video->pbo_first + i) % video->pbo_count].state ==
+				    GL_CAPTURE_PBO_COPYING) {
+					pbo = &video->pbo[(video->pbo_first + i) % video->pbo_count];
+					break;
+				}
+			}
+			if (pbo)
+				break;
+		}
+		pthread_rwlock_unlock(&gl_capture->videolist_lock);
+
+		if (!pbo) {
+			pthread_cond_wait(&gl_capture->copy_cond, &gl_capture->copy_mutex);
+			continue;
+		}
+
+		/* buffer is not touched by render thread while it is being copied */
+		pthread_mutex_unlock(&gl_capture->copy_mutex);
+		worker = gl_capture_worker_video(gl_capture, video);
+		if ((!ret) && (worker))
+			ret = gl_capture_map_pbo(gl_capture, video, pbo);
+		if (!ret)
+			ret = gl_capture_copy_pbo(gl_capture, video, pbo);
+		if (ret)
+			gl_capture_error(gl_capture, ret);
+		if (worker) {
+			if (pbo->fence) {
+				gl_capture->glDeleteSync(pbo->fence);
+				pbo->fence = NULL;
+			}
+			gl_capture_unmap_pbo(gl_capture, video, pbo);
+		}
+		pthread_mutex_lock(&gl_capture->copy_mutex);
+
+		/* after an error buffers are just released */
+		pbo->state = GL_CAPTURE_PBO_DONE;
+		pthread_cond_broadcast(&gl_capture->done_cond);
+	}
+	pthread_mutex_unlock(&gl_capture->copy_mutex);
+
+	/* render thread is waiting in gl_capture_destroy() */
+	if (gl_capture->flags & GL_CAPTURE_USE_WORKER)
+		glXMakeContextCurrent(gl_capture->worker_dpy, None, None, NULL);
+
+	return NULL;
+}
+
+int gl_capture_init_worker(gl_capture_t gl_capture, Display *dpy)
+{
+	int attrib[] = {GLX_FBCONFIG_ID, 0, None};
+	int pbuffer_attrib[] = {GLX_PBUFFER_WIDTH, 1, GLX_PBUFFER_HEIGHT, 1, None};
+	GLXFBConfig *configs;
+	int screen, drawable_type, n;
+	GLXContext share;
+
+	/* fences are shared, worker can't poll transfers otherwise */
+	if (!gl_capture->glFenceSync)
+		return ENOTSUP;
+
+	if (!(share = glXGetCurrentContext()))
+		return EINVAL;
+
+	/*
+	 Indirect contexts share objects through X server and every
+	 call from worker would be a round trip, render thread is faster.
+	*/
+	if (!glXIsDirect(dpy, share))
+		return ENOTSUP;
+
+	if ((glXQueryContext(dpy, share, GLX_FBCONFIG_ID, &attrib[1]) != Success) ||
+	    (glXQueryContext(dpy, share, GLX_SCREEN, &screen) != Success))
+		return ENOTSUP;
+
+	configs = glXChooseFBConfig(dpy, screen, attrib, &n);
+	if ((!configs) || (n < 1))
+		return ENOTSUP;
+
+	/* worker context needs a drawable, pbuffer is smallest one available */
+	glXGetFBConfigAttrib(dpy, configs[0], GLX_DRAWABLE_TYPE, &drawable_type);
+	if (!(drawable_type & GLX_PBUFFER_BIT)) {
+		XFree(configs);
+		return ENOTSUP;
+	}
+
+	gl_capture->worker_ctx = glXCreateNewContext(dpy, configs[0], GLX_RGBA_TYPE,
+						     share, True);
+	/* server may still fall back to an indirect context */
+	if ((gl_capture->worker_ctx) && (!glXIsDirect(dpy, gl_capture->worker_ctx))) {
+		glXDestroyContext(dpy, gl_capture->worker_ctx);
+		gl_capture->worker_ctx = NULL;
+	}
+	if (gl_capture->worker_ctx)
+		gl_capture->worker_pbuffer = glXCreatePbuffer(dpy, configs[0], pbuffer_attrib);
+	XFree(configs);
+
+	if (!gl_capture->worker_pbuffer) {
+		if (gl_capture->worker_ctx)
+			glXDestroyContext(dpy, gl_capture->worker_ctx);
+		gl_capture->worker_ctx = NULL;
+		return ENOTSUP;
+	}
+
+	gl_capture->worker_dpy = dpy;
+	gl_capture->worker_share = share;
+
+	glc_log(gl_capture->glc, GLC_INFORMATION, "gl_capture",
+		 "PBO transfers are finished in capture worker");
+	return 0;
+}
+
+int gl_capture_start_worker(gl_capture_t gl_capture)
+{
+	/*
+	 Display connection is not locked, so render thread waits
+	 in gl_capture_update_video_stream() until this is done.
+	*/
+	if (!glXMakeContextCurrent(gl_capture->worker_dpy, gl_capture->worker_pbuffer,
+				   gl_capture->worker_pbuffer, gl_capture->worker_ctx)) {
+		glc_log(gl_capture->glc, GLC_WARNING, "gl_capture",
+			 "can't activate capture worker context");
+		pthread_mutex_lock(&gl_capture->copy_mutex);
+		gl_capture->flags &= ~GL_CAPTURE_USE_WORKER;
+		pthread_cond_broadcast(&gl_capture->done_cond);
+		pthread_mutex_unlock(&gl_capture->copy_mutex);
+		return ENOTSUP;
+	}
+
+	pthread_mutex_lock(&gl_capture->copy_mutex);
+	gl_capture->flags |= GL_CAPTURE_WORKER_READY;
+	pthread_cond_broadcast(&gl_capture->done_cond);
+	pthread_mutex_unlock(&gl_capture->copy_mutex);
+	return 0;
+}
+
+int gl_capture_worker_video(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video)
+{
+	/* only contexts sharing objects with worker can use it */
+	return (gl_capture->flags & GL_CAPTURE_WORKER_READY) &&
+	       (video->ctx == gl_capture->worker_share);
+}
+
+int gl_capture_init_fbo(gl_capture_t gl_capture)
+{
+	const char *gl_extensions = (const char *) glGetString(GL_EXTENSIONS);
+
+	if (gl_capture->glBlitFramebuffer)
+		return 0; /* already done */
+
+	if (gl_extensions == NULL)
+		return EINVAL;
+
+	if (!strstr(gl_extensions, "GL_ARB_framebuffer_object"))
+		return ENOTSUP;
+
+	if (gl_capture_init_glx(gl_capture))
+		return ENOTSUP;
+
+	GL_CAPTURE_GET_PROC(gl_capture, glGenFramebuffers)
+	GL_CAPTURE_GET_PROC(gl_capture, glDeleteFramebuffers)
+	GL_CAPTURE_GET_PROC(gl_capture, glBindFramebuffer)
+	GL_CAPTURE_GET_PROC(gl_capture, glFramebufferTexture2D)
+	GL_CAPTURE_GET_PROC(gl_capture, glCheckFramebufferStatus)
+	GL_CAPTURE_GET_PROC(gl_capture, glGenRenderbuffers)
+	GL_CAPTURE_GET_PROC(gl_capture, glDeleteRenderbuffers)
+	GL_CAPTURE_GET_PROC(gl_capture, glBindRenderbuffer)
+	GL_CAPTURE_GET_PROC(gl_capture, glRenderbufferStorage)
+	GL_CAPTURE_GET_PROC(gl_capture, glFramebufferRenderbuffer)
+
+	/* needed for resetting GL_PIXEL_UNPACK_BUFFER when creating textures */
+	if (!gl_capture->glBindBuffer)
+		gl_capture->glBindBuffer =
+			(glBindBufferProc)
+			gl_capture->glXGetProcAddress((const GLubyte *) "glBindBufferARB");
+	if (!gl_capture->glBindBuffer)
+		return ENOTSUP;
+
+	/* marks initialization done */
+	GL_CAPTURE_GET_PROC(gl_capture, glBlitFramebuffer)
+
+	return 0;
+}
+
+int gl_capture_init_ycbcr(gl_capture_t gl_capture)
+{
+	const char *gl_extensions = (const char *) glGetString(GL_EXTENSIONS);
+
+	if (gl_extensions == NULL)
+		return EINVAL;
+
+	if ((!strstr(gl_extensions, "GL_ARB_fragment_shader")) ||
+	    (!strstr(gl_extensions, "GL_ARB_texture_rectangle")))
+		return ENOTSUP;
+
+	if (gl_capture_init_fbo(gl_capture))
+		return ENOTSUP;
+
+	GL_CAPTURE_GET_PROC(gl_capture, glCreateShader)
+	GL_CAPTURE_GET_PROC(gl_capture, glShaderSource)
+	GL_CAPTURE_GET_PROC(gl_capture, glCompileShader)
+	GL_CAPTURE_GET_PROC(gl_capture, glGetShaderiv)
+	GL_CAPTURE_GET_PROC(gl_capture, glDeleteShader)
+	GL_CAPTURE_GET_PROC(gl_capture, glCreateProgram)
+	GL_CAPTURE_GET_PROC(gl_capture, glAttachShader)
+	GL_CAPTURE_GET_PROC(gl_capture, glLinkProgram)
+	GL_CAPTURE_GET_PROC(gl_capture, glGetProgramiv)
+	GL_CAPTURE_GET_PROC(gl_capture, glUseProgram)
+	GL_CAPTURE_GET_PROC(gl_capture, glDeleteProgram)
+	GL_CAPTURE_GET_PROC(gl_capture, glGetUniformLocation)
+	GL_CAPTURE_GET_PROC(gl_capture, glUniform1i)
+	GL_CAPTURE_GET_PROC(gl_capture, glUniform2f)
+
+	glc_log(gl_capture->glc, GLC_INFORMATION, "gl_capture",
+		 "converting frames to Y'CbCr 4:2:0 with fragment shader");
+
+	return 0;
+}
+
+int gl_capture_create_ycbcr(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video)
+{
+	GLint unpack, program, read_fbo, draw_fbo, status;
+	GLuint shader;
+	int ret = 0;
+
+	glc_log(gl_capture->glc, GLC_DEBUG, "gl_capture",
+		 "creating Y'CbCr conversion for video %d", video->id);
+
+	if ((!video->ow) | (!video->oh))
+		return EINVAL;
+
+	/* program */
+	shader = gl_capture->glCreateShader(GL_FRAGMENT_SHADER);
+	gl_capture->glShaderSource(shader, 1, &gl_capture_ycbcr_shader, NULL);
+	gl_capture->glCompileShader(shader);
+	gl_capture->glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+	if (!status) {
+		glc_log(gl_capture->glc, GLC_ERROR, "gl_capture",
+			 "can't compile Y'CbCr conversion shader");
+		gl_capture->glDeleteShader(shader);
+		return ENOTSUP;
+	}
+
+	video->ycbcr_program = gl_capture->glCreateProgram();
+	gl_capture->glAttachShader(video->ycbcr_program, shader);
+	gl_capture->glLinkProgram(video->ycbcr_program);
+	gl_capture->glDeleteShader(shader); /* freed with program */
+	gl_capture->glGetProgramiv(video->ycbcr_program, GL_LINK_STATUS, &status);
+	if (!status) {
+		glc_log(gl_capture->glc, GLC_ERROR, "gl_capture",
+			 "can't link Y'CbCr conversion program");
+		ret = ENOTSUP;
+		goto err;
+	}
+
+	glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+	gl_capture->glUseProgram(video->ycbcr_program);
+	gl_capture->glUniform2f(gl_capture->glGetUniformLocation(video->ycbcr_program, "source"),
+				video->cw, video->ch);
+	gl_capture->glUniform2f(gl_capture->glGetUniformLocation(video->ycbcr_program, "scale"),
+				1.0 / gl_capture->scale, 1.0 / gl_capture->scale);
+	gl_capture->glUniform2f(gl_capture->glGetUniformLocation(video->ycbcr_program, "size"),
+				video->ow, video->oh);
+	gl_capture->glUseProgram(program);
+
+	/* textures */
+	glGetIntegerv(GL_PIXEL_UNPACK_BUFFER_BINDING_ARB, &unpack);
+	gl_capture->glBindBuffer(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+	glPushAttrib(GL_TEXTURE_BIT);
+
+	glGenTextures(1, &video->ycbcr_frame);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB, video->ycbcr_frame);
+	glTexParameteri(GL_TEXTURE_RECTANGLE_ARB, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_RECTANGLE_ARB, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_RECTANGLE_ARB, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_RECTANGLE_ARB, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexImage2D(GL_TEXTURE_RECTANGLE_ARB, 0, GL_RGBA8, video->cw, video->ch, 0,
+		     GL_BGRA, GL_UNSIGNED_BYTE, NULL);
+
+	glGenTextures(1, &video->ycbcr_target);
+	glBindTexture(GL_TEXTURE_2D, video->ycbcr_target);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, video->ow, video->oh + video->oh / 2, 0,
+		     GL_BGRA, GL_UNSIGNED_BYTE, NULL);
+
+	glPopAttrib();
+	gl_capture->glBindBuffer(GL_PIXEL_UNPACK_BUFFER_ARB, unpack);
+
+	/* framebuffer */
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &read_fbo);
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &draw_fbo);
+
+	gl_capture->glGenFramebuffers(1, &video->ycbcr_fbo);
+	gl_capture->glBindFramebuffer(GL_FRAMEBUFFER, video->ycbcr_fbo);
+	gl_capture->glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+					   GL_TEXTURE_2D, video->ycbcr_target, 0);
+	status = gl_capture->glCheckFramebufferStatus(GL_FRAMEBUFFER);
+
+	gl_capture->glBindFramebuffer(GL_READ_FRAMEBUFFER, read_fbo);
+	gl_capture->glBindFramebuffer(GL_DRAW_FRAMEBUFFER, draw_fbo);
+
+	if (status != GL_FRAMEBUFFER_COMPLETE) {
+		glc_log(gl_capture->glc, GLC_ERROR, "gl_capture",
+			 "Y'CbCr conversion framebuffer is not complete (0x%04x)", status);
+		ret = ENOTSUP;
+		goto err;
+	}
+
+	return 0;
+err:
+	gl_capture_destroy_ycbcr(gl_capture, video);
+	return ret;
+}
+
+int gl_capture_destroy_ycbcr(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video)
+{
+	glc_log(gl_capture->glc, GLC_DEBUG, "gl_capture",
+		 "destroying Y'CbCr conversion for video %d", video->id);
+
+	if (video->ycbcr_fbo)
+		gl_capture->glDeleteFramebuffers(1, &video->ycbcr_fbo);
+	if (video->ycbcr_target)
+		glDeleteTextures(1, &video->ycbcr_target);
+	if (video->ycbcr_frame)
+		glDeleteTextures(1, &video->ycbcr_frame);
+	if (video->ycbcr_program)
+		gl_capture->glDeleteProgram(video->ycbcr_program);
+
+	video->ycbcr_fbo = video->ycbcr_target = video->ycbcr_frame = 0;
+	video->ycbcr_program = 0;
+	return 0;
+}
+
+int gl_capture_get_ycbcr_pixels(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video,
+				char *to)
+{
+	GLint program, read_fbo, draw_fbo, unit;
+
+	glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &read_fbo);
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &draw_fbo);
+	glGetIntegerv(GL_ACTIVE_TEXTURE, &unit);
+
+	glPushAttrib(GL_ALL_ATTRIB_BITS);
+	glPushClientAttrib(GL_CLIENT_PIXEL_STORE_BIT);
+
+	/* copy capture area into frame texture */
+	glReadBuffer(gl_capture->capture_buffer);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB, video->ycbcr_frame);
+	glCopyTexSubImage2D(GL_TEXTURE_RECTANGLE_ARB, 0, 0, 0,
+			    video->cx, video->cy, video->cw, video->ch);
+
+	/* render Y', Cb and Cr planes into target */
+	gl_capture->glBindFramebuffer(GL_FRAMEBUFFER, video->ycbcr_fbo);
+	glDisable(GL_ALPHA_TEST);
+	glDisable(GL_BLEND);
+	glDisable(GL_CULL_FACE);
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_DITHER);
+	glDisable(GL_SCISSOR_TEST);
+	glDisable(GL_STENCIL_TEST);
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	glViewport(0, 0, video->ow, video->oh + video->oh / 2);
+
+	gl_capture->glUseProgram(video->ycbcr_program);
+	gl_capture->glUniform1i(gl_capture->glGetUniformLocation(video->ycbcr_program, "frame"),
+				unit - GL_TEXTURE0);
+
+	glMatrixMode(GL_PROJECTION);
+	glPushMatrix();
+	glLoadIdentity();
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	glLoadIdentity();
+
+	glRectf(-1.0, -1.0, 1.0, 1.0);
+
+	glPopMatrix();
+	glMatrixMode(GL_PROJECTION);
+	glPopMatrix();
+
+	gl_capture->glUseProgram(program);
+
+	/* read it back, only red channel carries data */
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, video->ow, video->oh + video->oh / 2, GL_RED, GL_UNSIGNED_BYTE, to);
+
+	/* read buffer state is popped into application's framebuffer */
+	gl_capture->glBindFramebuffer(GL_READ_FRAMEBUFFER, read_fbo);
+	gl_capture->glBindFramebuffer(GL_DRAW_FRAMEBUFFER, draw_fbo);
+
+	glPopClientAttrib();
+	glPopAttrib();
+
+	return 0;
+}
+
+int gl_capture_init_scale(gl_capture_t gl_capture)
+{
+	if (gl_capture_init_fbo(gl_capture))
+		return ENOTSUP;
+
+	glc_log(gl_capture->glc, GLC_INFORMATION, "gl_capture",
+		 "scaling frames with framebuffer blit");
+	return 0;
+}
+
+int gl_capture_create_scale(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video)
+{
+	GLint read_fbo, draw_fbo, rb;
+	GLenum status;
+
+	glc_log(gl_capture->glc, GLC_DEBUG, "gl_capture",
+		 "creating %ux%u scale framebuffer for video %d",
+		 video->ow, video->oh, video->id);
+
+	if ((!video->ow) | (!video->oh))
+		return EINVAL;
+
+	glGetIntegerv(GL_RENDERBUFFER_BINDING, &rb);
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &read_fbo);
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &draw_fbo);
+
+	gl_capture->glGenRenderbuffers(1, &video->scale_rb);
+	gl_capture->glBindRenderbuffer(GL_RENDERBUFFER, video->scale_rb);
+	gl_capture->glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, video->ow, video->oh);
+
+	gl_capture->glGenFramebuffers(1, &video->scale_fbo);
+	gl_capture->glBindFramebuffer(GL_FRAMEBUFFER, video->scale_fbo);
+	gl_capture->glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+					      GL_RENDERBUFFER, video->scale_rb);
+	status = gl_capture->glCheckFramebufferStatus(GL_FRAMEBUFFER);
+
+	gl_capture->glBindFramebuffer(GL_READ_FRAMEBUFFER, read_fbo);
+	gl_capture->glBindFramebuffer(GL_DRAW_FRAMEBUFFER, draw_fbo);
+	gl_capture->glBindRenderbuffer(GL_RENDERBUFFER, rb);
+
+	if (status != GL_FRAMEBUFFER_COMPLETE) {
+		glc_log(gl_capture->glc, GLC_ERROR, "gl_capture",
+			 "scale framebuffer is not complete (0x%04x)", status);
+		gl_capture_destroy_scale(gl_capture, video);
+		return ENOTSUP;
+	}
+
+	return 0;
+}
+
+int gl_capture_destroy_scale(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video)
+{
+	glc_log(gl_capture->glc, GLC_DEBUG, "gl_capture",
+		 "destroying scale framebuffer for video %d", video->id);
+
+	if (video->scale_fbo)
+		gl_capture->glDeleteFramebuffers(1, &video->scale_fbo);
+	if (video->scale_rb)
+		gl_capture->glDeleteRenderbuffers(1, &video->scale_rb);
+
+	video->scale_fbo = video->scale_rb = 0;
+	return 0;
+}
+
+int gl_capture_get_scaled_pixels(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video,
+				 char *to)
+{
+	GLint read_fbo, draw_fbo;
+
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &read_fbo);
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &draw_fbo);
+
+	glPushAttrib(GL_PIXEL_MODE_BIT | GL_ENABLE_BIT);
+	glPushClientAttrib(GL_CLIENT_PIXEL_STORE_BIT);
+
+	/* blit is affected by scissor test */
+	glDisable(GL_SCISSOR_TEST);
+
+	glReadBuffer(gl_capture->capture_buffer);
+	gl_capture->glBindFramebuffer(GL_DRAW_FRAMEBUFFER, video->scale_fbo);
+	gl_capture->glBlitFramebuffer(video->cx, video->cy,
+				      video->cx + video->cw, video->cy + video->ch,
+				      0, 0, video->ow, video->oh,
+				      GL_COLOR_BUFFER_BIT, GL_LINEAR);
+
+	gl_capture->glBindFramebuffer(GL_READ_FRAMEBUFFER, video->scale_fbo);
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	glPixelStorei(GL_PACK_ALIGNMENT, gl_capture->pack_alignment);
+	glReadPixels(0, 0, video->ow, video->oh, gl_capture->format, GL_UNSIGNED_BYTE, to);
+
+	/* read buffer state is popped into application's framebuffer */
+	gl_capture->glBindFramebuffer(GL_READ_FRAMEBUFFER, read_fbo);
+	gl_capture->glBindFramebuffer(GL_DRAW_FRAMEBUFFER, draw_fbo);
+
+	glPopClientAttrib();
+	glPopAttrib();
+
+	return 0;
+}
+
+int gl_capture_get_video_stream(gl_capture_t gl_capture, struct gl_capture_video_stream_s **video, Display *dpy, GLXDrawable drawable)
+{
+	struct gl_capture_video_stream_s *fvideo;
+
+	pthread_rwlock_rdlock(&gl_capture->videolist_lock);
+	fvideo = gl_capture->video;
+	while (fvideo != NULL) {
+		if ((fvideo->drawable == drawable) && (fvideo->dpy == dpy))
+			break;
+		
+		fvideo = fvideo->next;
+	}
+	pthread_rwlock_unlock(&gl_capture->videolist_lock);
+	
+	if (fvideo == NULL) {
+		fvideo = (struct gl_capture_video_stream_s *) malloc(sizeof(struct gl_capture_video_stream_s));
+		memset(fvideo, 0, sizeof(struct gl_capture_video_stream_s));
+
+		fvideo->dpy = dpy;
+		fvideo->drawable = drawable;
+		fvideo->ctx = glXGetCurrentContext();
+		ps_packet_init(&fvideo->packet, gl_capture->to);
+		ps_packet_init(&fvideo->copy_packet, gl_capture->to);
+		fvideo->to = gl_capture->to;
+
+		glc_state_video_new(gl_capture->glc, &fvideo->id, &fvideo->state_video);
+
+		/* these functions need to be thread-safe */
+		pthread_rwlock_wrlock(&gl_capture->videolist_lock);
+
+		fvideo->next = gl_capture->video;
+		gl_capture->video = fvideo;
+
+		pthread_rwlock_unlock(&gl_capture->videolist_lock);
+	}
+	
+	*video = fvideo;
 	return 0;
 }
 
@@ -669,18 +2027,90 @@ int gl_capture_update_video_stream(gl_capture_t gl_capture,
 	glc_message_header_t msg;
 	glc_video_format_message_t format_msg;
 	unsigned int w, h;
+	int ret;
 
 	/* initialize PBO if not already done */
 	if ((!(gl_capture->flags & GL_CAPTURE_USE_PBO)) &&
 	    (gl_capture->flags & GL_CAPTURE_TRY_PBO)) {
-		pthread_mutex_lock(&gl_capture->init_pbo_mutex);
+		pthread_mutex_lock(&gl_capture->init_mutex);
 
-		if (!gl_capture_init_pbo(gl_capture))
+		if (!gl_capture_init_pbo(gl_capture)) {
 			gl_capture->flags |= GL_CAPTURE_USE_PBO;
-		else
+
+			if ((gl_capture->flags & GL_CAPTURE_TRY_WORKER) &&
+			    (!(gl_capture->flags & GL_CAPTURE_COPYING))) {
+				if (!gl_capture_init_worker(gl_capture, video->dpy))
+					gl_capture->flags |= GL_CAPTURE_USE_WORKER;
+				else
+					glc_log(gl_capture->glc, GLC_WARNING, "gl_capture",
+						 "capture worker not supported, finishing PBO transfers in render thread");
+			}
+
+			if (!(gl_capture->flags & GL_CAPTURE_COPYING)) {
+				gl_capture->flags |= GL_CAPTURE_COPYING;
+				if ((ret = pthread_create(&gl_capture->copy_thread, NULL,
+							  gl_capture_copy_thread, gl_capture))) {
+					glc_log(gl_capture->glc, GLC_WARNING, "gl_capture",
+						 "can't create copy thread: %s (%d), not using PBO",
+						 strerror(ret), ret);
+					gl_capture->flags &= ~(GL_CAPTURE_COPYING | GL_CAPTURE_TRY_PBO |
+							       GL_CAPTURE_USE_PBO | GL_CAPTURE_USE_WORKER);
+
+					/* render thread reads pixels itself */
+					if (gl_capture->worker_ctx) {
+						glXDestroyPbuffer(gl_capture->worker_dpy, gl_capture->worker_pbuffer);
+						glXDestroyContext(gl_capture->worker_dpy, gl_capture->worker_ctx);
+						gl_capture->worker_pbuffer = 0;
+						gl_capture->worker_ctx = NULL;
+					}
+				}
+			}
+
+			/* wait until worker has made its context current */
+			pthread_mutex_lock(&gl_capture->copy_mutex);
+			while ((gl_capture->flags & GL_CAPTURE_USE_WORKER) &&
+			       (!(gl_capture->flags & GL_CAPTURE_WORKER_READY)))
+				pthread_cond_wait(&gl_capture->done_cond, &gl_capture->copy_mutex);
+			pthread_mutex_unlock(&gl_capture->copy_mutex);
+		} else
 			gl_capture->flags &= ~GL_CAPTURE_TRY_PBO;
 
-		pthread_mutex_unlock(&gl_capture->init_pbo_mutex);
+		pthread_mutex_unlock(&gl_capture->init_mutex);
+	}
+
+	/* same for Y'CbCr conversion */
+	if ((!(gl_capture->flags & GL_CAPTURE_USE_YCBCR)) &&
+	    (gl_capture->flags & GL_CAPTURE_TRY_YCBCR)) {
+		pthread_mutex_lock(&gl_capture->init_mutex);
+
+		if (!gl_capture_init_ycbcr(gl_capture))
+			gl_capture->flags |= GL_CAPTURE_USE_YCBCR;
+		else {
+			glc_log(gl_capture->glc, GLC_WARNING, "gl_capture",
+				 "Y'CbCr conversion not supported, capturing RGB data");
+			gl_capture->flags &= ~GL_CAPTURE_TRY_YCBCR;
+			/* fallback path both converts and scales */
+			if (gl_capture->fallback_callback)
+				gl_capture->flags &= ~GL_CAPTURE_TRY_SCALE;
+		}
+
+		pthread_mutex_unlock(&gl_capture->init_mutex);
+	}
+
+	/* Y'CbCr conversion scales frames too, otherwise blit is needed */
+	if ((!(gl_capture->flags & (GL_CAPTURE_USE_SCALE | GL_CAPTURE_USE_YCBCR))) &&
+	    (gl_capture->flags & GL_CAPTURE_TRY_SCALE)) {
+		pthread_mutex_lock(&gl_capture->init_mutex);
+
+		if (!gl_capture_init_scale(gl_capture))
+			gl_capture->flags |= GL_CAPTURE_USE_SCALE;
+		else {
+			glc_log(gl_capture->glc, GLC_WARNING, "gl_capture",
+				 "framebuffer blit not supported, frames are not scaled");
+			gl_capture->flags &= ~GL_CAPTURE_TRY_SCALE;
+		}
+
+		pthread_mutex_unlock(&gl_capture->init_mutex);
 	}
 
 	gl_capture_get_geometry(gl_capture, video->dpy,
@@ -694,6 +2124,9 @@ int gl_capture_update_video_stream(gl_capture_t gl_capture,
 		/* reset gamma values */
 		video->gamma_red = video->gamma_green = video->gamma_blue = 1.0;
 
+		/* stream stays on CPU path if GPU setup fails for it */
+		video->gpu = gl_capture->flags & (GL_CAPTURE_USE_YCBCR | GL_CAPTURE_USE_SCALE);
+
 		if (gl_capture->format == GL_BGRA)
 			video->format = GLC_VIDEO_BGRA;
 		else if (gl_capture->format == GL_BGR)
@@ -706,17 +2139,58 @@ int gl_capture_update_video_stream(gl_capture_t gl_capture,
 	}
 
 	if ((w != video->w) | (h != video->h)) {
+		/* old frames must be in buffer before new format message */
+		if (video->pbo_active)
+			gl_capture_finish_pbo(gl_capture, video);
+
 		gl_capture_calc_geometry(gl_capture, video, w, h);
+		video->hash_valid = 0;
 
 		glc_log(gl_capture->glc, GLC_INFORMATION, "gl_capture",
 			 "creating/updating configuration for video %d", video->id);
 
+		/* format depends on whether conversion can be done */
+		if (video->gpu & GL_CAPTURE_USE_YCBCR) {
+			if (video->ycbcr_program)
+				gl_capture_destroy_ycbcr(gl_capture, video);
+
+			if (gl_capture_create_ycbcr(gl_capture, video)) {
+				glc_log(gl_capture->glc, GLC_WARNING, "gl_capture",
+					 "Y'CbCr conversion failed for video %d, capturing RGB data",
+					 video->id);
+				video->gpu = 0;
+				gl_capture_calc_geometry(gl_capture, video, w, h);
+			}
+		} else if (video->gpu & GL_CAPTURE_USE_SCALE) {
+			if (video->scale_fbo)
+				gl_capture_destroy_scale(gl_capture, video);
+
+			if (gl_capture_create_scale(gl_capture, video)) {
+				glc_log(gl_capture->glc, GLC_WARNING, "gl_capture",
+					 "scaling failed for video %d, frames are not scaled",
+					 video->id);
+				video->gpu = 0;
+				gl_capture_calc_geometry(gl_capture, video, w, h);
+			}
+		}
+
+		/* format message goes to same buffer as frames */
+		if (gl_capture_update_target(gl_capture, video))
+			glc_log(gl_capture->glc, GLC_WARNING, "gl_capture",
+				 "video %d: fallback path not available, frames are not processed",
+				 video->id);
+
 		msg.type = GLC_MESSAGE_VIDEO_FORMAT;
-		format_msg.flags = video->flags;
-		format_msg.format = video->format;
 		format_msg.id = video->id;
-		format_msg.width = video->cw;
-		format_msg.height = video->ch;
+		format_msg.width = video->ow;
+		format_msg.height = video->oh;
+		if (video->gpu & GL_CAPTURE_USE_YCBCR) {
+			format_msg.flags = 0;
+			format_msg.format = GLC_VIDEO_YCBCR_420JPEG;
+		} else {
+			format_msg.flags = video->flags;
+			format_msg.format = video->format;
+		}
 
 		ps_packet_open(&video->packet, PS_PACKET_WRITE);
 		ps_packet_write(&video->packet, &msg, sizeof(glc_message_header_t));
@@ -725,7 +2199,7 @@ int gl_capture_update_video_stream(gl_capture_t gl_capture,
 
 		glc_log(gl_capture->glc, GLC_DEBUG, "gl_capture",
 			 "video %d: %ux%u (%ux%u), 0x%02x flags", video->id,
-			 video->cw, video->ch, video->w, video->h, video->flags);
+			 video->ow, video->oh, video->w, video->h, format_msg.flags);
 
 		/* how about color correction? */
 		gl_capture_update_color(gl_capture, video);
@@ -756,6 +2230,7 @@ int gl_capture_frame(gl_capture_t gl_capture, Display *dpy, GLXDrawable drawable
 	glc_message_header_t msg;
 	glc_video_frame_header_t pic;
 	glc_utime_t now;
+	u_int64_t hash;
 	char *dma;
 	int ret = 0;
 
@@ -773,11 +2248,10 @@ int gl_capture_frame(gl_capture_t gl_capture, Display *dpy, GLXDrawable drawable
 	else
 		now = glc_state_time(gl_capture->glc);
 
-	/* if we are using PBO we will actually write previous picture to buffer */
-	if (gl_capture->flags & GL_CAPTURE_USE_PBO)
-		pic.time = video->pbo_time;
-	else
-		pic.time = now;
+	/* hand finished PBO transfers over to copy thread */
+	if ((video->pbo_active) &&
+	    ((ret = gl_capture_write_pbo(gl_capture, video, 0))))
+		goto finish;
 
 	/* has gl_capture->fps microseconds elapsed since last capture */
 	if ((now - video->last < gl_capture->fps) &&
@@ -789,42 +2263,54 @@ int gl_capture_frame(gl_capture_t gl_capture, Display *dpy, GLXDrawable drawable
 	if ((ret = gl_capture_update_video_stream(gl_capture, video)))
 		goto finish;
 
-	/* if PBO is not active, just start transfer and finish */
-	if ((gl_capture->flags & GL_CAPTURE_USE_PBO) && (!video->pbo_active)) {
-		ret = gl_capture_start_pbo(gl_capture, video);
-		video->pbo_time = now;
+	if (video->color_pending)
+		gl_capture_update_color(gl_capture, video);
 
-		goto finish;
-	}
+	if (gl_capture->flags & GL_CAPTURE_USE_PBO) {
+		/* frames can't be dropped, wait for the oldest transfer instead */
+		if ((gl_capture->flags & GL_CAPTURE_LOCK_FPS) |
+		    (gl_capture->flags & GL_CAPTURE_IGNORE_TIME)) {
+			if ((ret = gl_capture_write_pbo(gl_capture, video, 1)))
+				goto finish;
+		}
 
-	if (ps_packet_open(&video->packet, ((gl_capture->flags & GL_CAPTURE_LOCK_FPS) |
-					    (gl_capture->flags & GL_CAPTURE_IGNORE_TIME)) ?
-					   (PS_PACKET_WRITE) :
-					   (PS_PACKET_WRITE | PS_PACKET_TRY)))
-		goto finish;
-	if ((ret = ps_packet_write(&video->packet, &msg, sizeof(glc_message_header_t))))
-		goto cancel;
-	if ((ret = ps_packet_write(&video->packet, &pic, sizeof(glc_video_frame_header_t))))
-		goto cancel;
+		/* just start transfer, picture is written when it is finished */
+		if (gl_capture_start_pbo(gl_capture, video, now) == EAGAIN) {
+			glc_log(gl_capture->glc, GLC_INFORMATION, "gl_capture",
+				 "dropped frame, all PBOs in use");
+			goto finish;
+		}
+	} else {
+		pic.time = now;
 
-	if (gl_capture->flags & GL_CAPTURE_USE_PBO) {
-		/* is this safe, what happens if this is called simultaneously? */
-		if ((ret = ps_packet_setsize(&video->packet, video->row * video->ch
-								+ sizeof(glc_message_header_t)
-								+ sizeof(glc_video_frame_header_t))))
+		if (ps_packet_open(&video->packet, ((gl_capture->flags & GL_CAPTURE_LOCK_FPS) |
+						    (gl_capture->flags & GL_CAPTURE_IGNORE_TIME)) ?
+						   (PS_PACKET_WRITE) :
+						   (PS_PACKET_WRITE | PS_PACKET_TRY)))
+			goto finish;
+		if ((ret = ps_packet_write(&video->packet, &msg, sizeof(glc_message_header_t))))
 			goto cancel;
-
-		if ((ret = gl_capture_read_pbo(gl_capture, video)))
+		if ((ret = ps_packet_write(&video->packet, &pic, sizeof(glc_video_frame_header_t))))
 			goto cancel;
-
-		ret = gl_capture_start_pbo(gl_capture, video);
-		video->pbo_time = now;
-	} else {
 		if ((ret = ps_packet_dma(&video->packet, (void *) &dma,
-					video->row * video->ch, PS_ACCEPT_FAKE_DMA)))
-		goto cancel;
+					video->size, PS_ACCEPT_FAKE_DMA)))
+			goto cancel;
+		if ((ret = gl_capture_get_pixels(gl_capture, video, dma)))
+			goto cancel;
 
-		ret = gl_capture_get_pixels(gl_capture, video, dma);
+		if (gl_capture_is_repeat(gl_capture, video, dma, &hash)) {
+			ps_packet_cancel(&video->packet);
+			if ((ret = gl_capture_write_repeat(gl_capture, video, &video->packet, now)))
+				goto finish;
+		} else {
+			if ((ret = ps_packet_close(&video->packet)))
+				goto finish;
+
+			if (gl_capture->flags & GL_CAPTURE_DETECT_REPEAT) {
+				video->hash = hash;
+				video->hash_valid = 1;
+			}
+		}
 	}
 
 	if ((gl_capture->flags & GL_CAPTURE_LOCK_FPS) &&
@@ -849,8 +2335,6 @@ int gl_capture_frame(gl_capture_t gl_capture, Display *dpy, GLXDrawable drawable
 			video->last = now - 0.5 * gl_capture->fps;
 	}
 
-	ps_packet_close(&video->packet);
-
 finish:
 	if (ret != 0)
 		gl_capture_error(gl_capture, ret);
@@ -879,10 +2363,14 @@ int gl_capture_refresh_color_correction(gl_capture_t gl_capture)
 	glc_log(gl_capture->glc, GLC_INFORMATION, "gl_capture",
 		 "refreshing color correction");
 
+	/*
+	 Gamma may be set from any thread. PBO transfers can be finished
+	 only in render thread, so color is updated at next frame.
+	*/
 	pthread_rwlock_rdlock(&gl_capture->videolist_lock);
 	video = gl_capture->video;
 	while (video != NULL) {
-		gl_capture_update_color(gl_capture, video);
+		video->color_pending = 1;
 		
 		video = video->next;
 	}
@@ -891,6 +2379,39 @@ int gl_capture_refresh_color_correction(gl_capture_t gl_capture)
 	return 0;
 }
 
+int gl_capture_update_target(gl_capture_t gl_capture,
+			     struct gl_capture_video_stream_s *video)
+{
+	ps_buffer_t *to = gl_capture->to;
+	int ret = 0;
+
+	if ((gl_capture->fallback_callback) && (!video->gpu)) {
+		/* CPU path is started when first stream needs it */
+		pthread_mutex_lock(&gl_capture->init_mutex);
+		if (!gl_capture->fallback)
+			ret = gl_capture->fallback_callback(&gl_capture->fallback);
+		pthread_mutex_unlock(&gl_capture->init_mutex);
+
+		if (!ret)
+			to = gl_capture->fallback;
+	}
+
+	if (video->to == to)
+		return ret;
+
+	glc_log(gl_capture->glc, GLC_INFORMATION, "gl_capture",
+		 "video %d: frames are %s", video->id,
+		 to == gl_capture->fallback ? "processed in fallback path" : "processed on GPU");
+
+	/* copy thread is done with this stream, PBOs were flushed */
+	ps_packet_destroy(&video->packet);
+	ps_packet_destroy(&video->copy_packet);
+	ps_packet_init(&video->packet, to);
+	ps_packet_init(&video->copy_packet, to);
+	video->to = to;
+	return ret;
+}
+
 /** \todo support GammaRamp */
 int gl_capture_update_color(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video)
 {
@@ -899,6 +2420,7 @@ int gl_capture_update_color(gl_capture_t gl_capture, struct gl_capture_video_str
 	XF86VidModeGamma gamma;
 	int ret = 0;
 
+	video->color_pending = 0;
 	XF86VidModeGetGamma(video->dpy, video->screen, &gamma);
 
 	if ((gamma.red == video->gamma_red) &&
@@ -906,6 +2428,15 @@ int gl_capture_update_color(gl_capture_t gl_capture, struct gl_capture_video_str
 	    (gamma.blue == video->gamma_blue))
 		return 0; /* nothing to update */
 
+	/* frames captured before change must be in buffer before color message */
+	if ((video->pbo_active) && ((ret = gl_capture_finish_pbo(gl_capture, video))))
+		glc_log(gl_capture->glc, GLC_WARNING, "gl_capture",
+			 "can't finish PBO transfers before color message: %s (%d)",
+			 strerror(ret), ret);
+
+	/* repeated frame would be corrected with old values */
+	video->hash_valid = 0;
+
 	msg_hdr.type = GLC_MESSAGE_COLOR;
 	msg.id = video->id;
 	msg.red = gamma.red;
@@ -48,6 +48,22 @@ __PUBLIC int gl_capture_init(gl_capture_t *gl_capture, glc_t *glc);
  */
 __PUBLIC int gl_capture_set_buffer(gl_capture_t gl_capture, ps_buffer_t *buffer);
 
+/**
+ * \brief set fallback callback
+ *
+ * Scaling and Y'CbCr conversion on GPU are set up when first frame
+ * of a stream is captured. If set up fails, frames of that stream are
+ * written unscaled and unconverted to fallback buffer instead of target
+ * buffer, so they can be processed on CPU. Callback is called once,
+ * when first stream needs fallback buffer, and should start CPU
+ * processing and return the buffer. Other streams stay on GPU.
+ * \param gl_capture gl_capture object
+ * \param callback callback returning fallback buffer
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int gl_capture_set_fallback_callback(gl_capture_t gl_capture,
+					      int (*callback)(ps_buffer_t **));
+
 /**
  * \brief set OpenGL read buffer for capturing
  *
@@ -84,6 +100,33 @@ __PUBLIC int gl_capture_set_pack_alignment(gl_capture_t gl_capture,
  */
 __PUBLIC int gl_capture_try_pbo(gl_capture_t gl_capture, int try_pbo);
 
+/**
+ * \brief set number of PBOs per video stream
+ *
+ * PBO transfers are queued into a ring and collected when GL_ARB_sync
+ * reports them finished. If all PBOs are in use, frame is dropped
+ * unless fps is locked or time is ignored. Default is 3.
+ * \param gl_capture gl_capture object
+ * \param count number of PBOs
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int gl_capture_set_pbo_count(gl_capture_t gl_capture, unsigned int count);
+
+/**
+ * \brief finish PBO transfers in a capture worker
+ *
+ * Copy thread gets its own GLX context sharing objects with the
+ * application's context, so it can wait for transfers and map PBOs
+ * by itself. Render thread then only starts readback and flushes.
+ * Needs PBO and GL_ARB_sync, otherwise transfers are finished in
+ * render thread as usual.
+ * \param gl_capture gl_capture object
+ * \param use_worker 1 means worker is used if supported,
+ *                   0 disables worker
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int gl_capture_use_worker(gl_capture_t gl_capture, int use_worker);
+
 /**
  * \brief set pixel format
  *
@@ -94,6 +137,57 @@ __PUBLIC int gl_capture_try_pbo(gl_capture_t gl_capture, int try_pbo);
  */
 __PUBLIC int gl_capture_set_pixel_format(gl_capture_t gl_capture, GLenum format);
 
+/**
+ * \brief scale frames before reading them
+ *
+ * Capture area is blitted into a smaller framebuffer with linear
+ * filtering, so only the scaled picture is read back. Only downscaling
+ * is supported. If framebuffer blit is not supported by the OpenGL
+ * implementation, frames are captured in original size.
+ * \param gl_capture gl_capture object
+ * \param scale scale factor, 1.0 disables scaling
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int gl_capture_set_scale(gl_capture_t gl_capture, double scale);
+
+/**
+ * \brief convert frames to Y'CbCr 4:2:0 before reading them
+ *
+ * Frames are converted with a fragment shader and written as
+ * GLC_VIDEO_YCBCR_420JPEG, which makes a separate ycbcr stage
+ * unnecessary. If conversion is not supported by the OpenGL
+ * implementation, frames are captured in selected pixel format.
+ * \param gl_capture gl_capture object
+ * \param convert 1 means frames are converted to Y'CbCr,
+ *                0 disables conversion
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int gl_capture_convert_ycbcr_420jpeg(gl_capture_t gl_capture, int convert);
+
+/**
+ * \brief detect repeated frames
+ *
+ * Each frame is fingerprinted and if it is identical to previous
+ * frame in the same stream, only a small GLC_MESSAGE_VIDEO_REPEAT
+ * message is written. Fingerprinting reads whole frame in the
+ * capturing thread, so this is disabled by default.
+ * \param gl_capture gl_capture object
+ * \param detect_repeat 1 means repeated frames are detected,
+ *                      0 writes every frame in full
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int gl_capture_detect_repeat(gl_capture_t gl_capture, int detect_repeat);
+
+/**
+ * \brief forget previous frames
+ *
+ * Next frame of every stream is written in full even if it is
+ * repeated, so stream can be entered there.
+ * \param gl_capture gl_capture object
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int gl_capture_refresh(gl_capture_t gl_capture);
+
 /**
  * \brief draw indicator when capturing
  *
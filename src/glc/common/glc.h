@@ -66,7 +66,7 @@ extern "C" {
  */
 
 /** stream version */
-#define GLC_STREAM_VERSION                  0x4
+#define GLC_STREAM_VERSION                  0x5
 /** file signature = "GLC" */
 #define GLC_SIGNATURE                0x00434c47
 
@@ -166,6 +166,77 @@ typedef struct {
 	u_int64_t reserved2;
 } __attribute__((packed)) glc_stream_info_t;
 
+/** stream index signature */
+#define GLC_INDEX_SIGNATURE          0x49434c47
+
+/**
+ * \brief stream index footer
+ *
+ * Index of random access points is written after GLC_MESSAGE_CLOSE
+ * and footer is the last thing in stream file. [size] bytes before
+ * footer contain index records. If stream was not closed properly,
+ * same records are found from sidecar file named like stream file
+ * with ".idx" appended.
+ *
+ * Records use same format as stream messages, glc_size_t and
+ * glc_message_header_t followed by [size] bytes of data.
+ * Header type is GLC_INDEX_STATE or GLC_INDEX_ENTRY.
+ */
+typedef struct {
+	/** index signature */
+	u_int32_t signature;
+	/** size of index records */
+	u_int64_t size;
+} __attribute__((packed)) glc_index_footer_t;
+
+/** state snapshot, data is format and color messages in stream format */
+#define GLC_INDEX_STATE              0x01
+/** random access point, data is glc_index_entry_t */
+#define GLC_INDEX_ENTRY              0x02
+/** random access point needs no state snapshot */
+#define GLC_INDEX_NO_STATE           0xffffffff
+
+/**
+ * \brief random access point
+ *
+ * Offset points to a keyframe, to a video frame if stream has no
+ * delta frames, or to audio data if stream has no video. In streams
+ * with tiles or repeated frames only points where capture restarted
+ * inter-frame coding are used. Time is capture time of the message
+ * at offset and entries are in time order.
+ */
+typedef struct {
+	/** time */
+	glc_utime_t time;
+	/** file offset of message */
+	u_int64_t offset;
+	/** number of state snapshot to apply before reading from offset */
+	u_int32_t state;
+} __attribute__((packed)) glc_index_entry_t;
+
+/** stripe file signature */
+#define GLC_STRIPE_SIGNATURE         0x53434c47
+
+/**
+ * \brief stripe file header
+ *
+ * Stream can be striped over several files, usually on different
+ * disks. Stream is split into chunks of [chunk_size] bytes and
+ * chunk n is stored in stripe n % [count] at offset
+ * (n / [count]) * [chunk_size] after this header. Chunk number
+ * is the global sequence number used to reassemble the stream.
+ */
+typedef struct {
+	/** stripe signature */
+	u_int32_t signature;
+	/** number of this stripe */
+	u_int32_t index;
+	/** number of stripes */
+	u_int32_t count;
+	/** chunk size */
+	u_int64_t chunk_size;
+} __attribute__((packed)) glc_stripe_header_t;
+
 /** stream message type */
 typedef u_int8_t glc_message_type_t;
 /** end of stream */
@@ -190,6 +261,28 @@ typedef u_int8_t glc_message_type_t;
 #define GLC_MESSAGE_LZJB               0x0a
 /** callback request */
 #define GLC_CALLBACK_REQUEST           0x0b
+/** previous video frame repeated */
+#define GLC_MESSAGE_VIDEO_REPEAT       0x0c
+/** changed tiles of video frame */
+#define GLC_MESSAGE_VIDEO_TILES        0x0d
+/** video frame XORed with previous frame */
+#define GLC_MESSAGE_VIDEO_DELTA        0x0e
+/** video frame that following deltas refer to, random access point */
+#define GLC_MESSAGE_VIDEO_KEYFRAME     0x0f
+/** lz4-compressed packet */
+#define GLC_MESSAGE_LZ4                0x10
+/** zstd-compressed packet */
+#define GLC_MESSAGE_ZSTD               0x11
+/** packet compressed in independent slices */
+#define GLC_MESSAGE_SLICES             0x12
+/** video frame compressed using predictive coding */
+#define GLC_MESSAGE_PREDICTED          0x13
+/** audio data compressed using linear prediction and Rice coding */
+#define GLC_MESSAGE_RICE               0x14
+/** video frame compressed using lossy DCT coding */
+#define GLC_MESSAGE_DCT                0x15
+/** keyframe that is not a random access point */
+#define GLC_MESSAGE_VIDEO_REFRESH      0x16
 
 /**
  * \brief stream message header
@@ -229,6 +322,54 @@ typedef struct {
 	glc_message_header_t header;
 } __attribute__((packed)) glc_lzjb_header_t;
 
+/**
+ * \brief lz4-compressed message header
+ */
+typedef struct {
+	/** uncompressed data size */
+	glc_size_t size;
+	/** original message header */
+	glc_message_header_t header;
+} __attribute__((packed)) glc_lz4_header_t;
+
+/**
+ * \brief zstd-compressed message header
+ */
+typedef struct {
+	/** uncompressed data size */
+	glc_size_t size;
+	/** original message header */
+	glc_message_header_t header;
+} __attribute__((packed)) glc_zstd_header_t;
+
+/**
+ * \brief sliced message header
+ *
+ * Header is followed by count glc_slice_t entries and then
+ * compressed slices in same order. Uncompressed slices are
+ * concatenated to get original message.
+ */
+typedef struct {
+	/** uncompressed data size */
+	glc_size_t size;
+	/** original message header */
+	glc_message_header_t header;
+	/** compression used for slices, eg. GLC_MESSAGE_LZ4 */
+	glc_message_header_t compression;
+	/** number of slices */
+	u_int32_t count;
+} __attribute__((packed)) glc_slices_header_t;
+
+/**
+ * \brief compressed slice
+ */
+typedef struct {
+	/** uncompressed slice size */
+	glc_size_t size;
+	/** compressed slice size */
+	glc_size_t compressed_size;
+} __attribute__((packed)) glc_slice_t;
+
 /** video format type */
 typedef u_int8_t glc_video_format_t;
 /** 24bit BGR, last row first */
@@ -269,6 +410,103 @@ typedef struct {
 	glc_utime_t time;
 } __attribute__((packed)) glc_video_frame_header_t;
 
+/*
+ GLC_MESSAGE_VIDEO_DELTA, GLC_MESSAGE_VIDEO_KEYFRAME and
+ GLC_MESSAGE_VIDEO_REFRESH use glc_video_frame_header_t too. They are
+ found only inside compressed messages. Delta frame data is XORed with
+ previous delta, keyframe or refresh frame in the same stream, header
+ is not.
+
+ After a keyframe the next delta coded frame of every other stream
+ is a refresh frame, so stream can be entered at any keyframe.
+ Refresh frames decode like keyframes but other streams may still
+ refer to frames before them. Video frames between are not delta
+ coded and don't change the reference.
+*/
+
+/**
+ * \brief predictive-coded video frame header
+ *
+ * Header is followed by compressed glc_video_frame_header_t and
+ * filtered frame. Each row of each plane is stored as a filter
+ * type byte and residuals of row pixels, without row padding.
+ * BGR(A) pixels are converted to YCoCg-R before filtering.
+ */
+typedef struct {
+	/** uncompressed data size */
+	glc_size_t size;
+	/** original message header */
+	glc_message_header_t header;
+	/** compression used for filtered frame, eg. GLC_MESSAGE_LZ4 */
+	glc_message_header_t compression;
+	/** video format flags */
+	glc_flags_t flags;
+	/** width */
+	u_int32_t width;
+	/** height */
+	u_int32_t height;
+	/** format */
+	glc_video_format_t format;
+} __attribute__((packed)) glc_predicted_header_t;
+
+/**
+ * \brief DCT-coded video frame header
+ *
+ * Header is followed by compressed glc_video_frame_header_t and
+ * coded frame. Frame is always GLC_VIDEO_YCBCR_420JPEG. Each plane
+ * is coded in 8x8 blocks like in baseline JPEG, but coefficients are
+ * stored as run-length tokens instead of Huffman codes.
+ */
+typedef struct {
+	/** uncompressed data size */
+	glc_size_t size;
+	/** original message header */
+	glc_message_header_t header;
+	/** compression used for coded frame, eg. GLC_MESSAGE_LZ4 */
+	glc_message_header_t compression;
+	/** coded frame size, including glc_video_frame_header_t */
+	glc_size_t coded_size;
+	/** width */
+	u_int32_t width;
+	/** height */
+	u_int32_t height;
+	/** quality, from 1 to 100 */
+	u_int32_t quality;
+} __attribute__((packed)) glc_dct_header_t;
+
+/**
+ * \brief video repeat message
+ *
+ * Sent instead of a frame identical to the previous one
+ * in the same stream.
+ */
+typedef struct {
+	/** stream identifier */
+	glc_stream_id_t id;
+	/** time */
+	glc_utime_t time;
+} __attribute__((packed)) glc_video_repeat_message_t;
+
+/**
+ * \brief video tiles header
+ *
+ * Frame is divided into a grid of size x size tiles in row-major
+ * order. Header is followed by count tile indices (u_int32_t) and
+ * then data of each tile in same order. Tile data is stored row by
+ * row, in Y'CbCr 4:2:0 Y' rows first and then Cb and Cr rows of
+ * half-size tile. Tiles not listed are same as in previous frame.
+ */
+typedef struct {
+	/** stream identifier */
+	glc_stream_id_t id;
+	/** time */
+	glc_utime_t time;
+	/** tile width and height */
+	u_int32_t size;
+	/** number of tiles */
+	u_int32_t count;
+} __attribute__((packed)) glc_video_tiles_header_t;
+
 /** audio format type */
 typedef u_int8_t glc_audio_format_t;
 /** signed 16bit little-endian */
@@ -309,6 +547,24 @@ typedef struct {
 	glc_size_t size;
 } __attribute__((packed)) glc_audio_data_header_t;
 
+/**
+ * \brief Rice-coded audio data header
+ *
+ * Followed by audio data header and coded audio data.
+ */
+typedef struct {
+	/** uncompressed data size */
+	glc_size_t size;
+	/** original message header */
+	glc_message_header_t header;
+	/** audio flags */
+	glc_flags_t flags;
+	/** number of channels */
+	u_int32_t channels;
+	/** audio format */
+	glc_audio_format_t format;
+} __attribute__((packed)) glc_rice_header_t;
+
 /**
  * \brief color correction information message
  */
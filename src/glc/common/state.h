@@ -24,6 +24,9 @@ extern "C" {
 
 /** all stream operations should cancel */
 #define GLC_STATE_CANCEL     0x1
+/** stream writer needs a random access point, capture should send
+    a callback request, see file_set_callback() */
+#define GLC_STATE_REFRESH    0x2
 
 /**
  * \brief video stream object
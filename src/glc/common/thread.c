@@ -35,6 +35,11 @@ struct glc_thread_private_s {
 	pthread_t *pthread_thread;
 	pthread_mutex_t open, finish;
 
+	pthread_mutex_t turn_mutex;
+	pthread_cond_t turn_cond;
+	u_int64_t seq, read_turn, write_turn;
+	int turn_cancel;
+
 	glc_thread_t *thread;
 	size_t running_threads;
 
@@ -44,6 +49,11 @@ struct glc_thread_private_s {
 
 void *glc_thread(void *argptr);
 
+int glc_thread_turn_wait(struct glc_thread_private_s *private, u_int64_t *turn, u_int64_t seq);
+void glc_thread_turn_pass(struct glc_thread_private_s *private, u_int64_t *turn);
+void glc_thread_turn_cancel(struct glc_thread_private_s *private);
+int glc_thread_open_read(glc_thread_t *thread, glc_thread_state_t *state, ps_packet_t *read);
+
 int glc_thread_create(glc_t *glc, glc_thread_t *thread, ps_buffer_t *from, ps_buffer_t *to)
 {
 	int ret;
@@ -66,6 +76,8 @@ int glc_thread_create(glc_t *glc, glc_thread_t *thread, ps_buffer_t *from, ps_bu
 
 	pthread_mutex_init(&private->open, NULL);
 	pthread_mutex_init(&private->finish, NULL);
+	pthread_mutex_init(&private->turn_mutex, NULL);
+	pthread_cond_init(&private->turn_cond, NULL);
 
 	pthread_attr_init(&attr);
 	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
@@ -100,6 +112,8 @@ int glc_thread_wait(glc_thread_t *thread)
 	}
 
 	free(private->pthread_thread);
+	pthread_cond_destroy(&private->turn_cond);
+	pthread_mutex_destroy(&private->turn_mutex);
 	pthread_mutex_destroy(&private->finish);
 	pthread_mutex_destroy(&private->open);
 	free(private);
@@ -108,6 +122,52 @@ int glc_thread_wait(glc_thread_t *thread)
 	return 0;
 }
 
+/**
+ * \brief wait until it is packet's turn
+ * \param private thread private variables
+ * \param turn turn counter
+ * \param seq packet sequence number
+ * \return 0 on success, EINTR if threads are stopping
+ */
+int glc_thread_turn_wait(struct glc_thread_private_s *private, u_int64_t *turn, u_int64_t seq)
+{
+	int ret = 0;
+
+	pthread_mutex_lock(&private->turn_mutex);
+	while ((*turn != seq) && (!private->turn_cancel))
+		pthread_cond_wait(&private->turn_cond, &private->turn_mutex);
+	if (private->turn_cancel)
+		ret = EINTR;
+	pthread_mutex_unlock(&private->turn_mutex);
+
+	return ret;
+}
+
+/**
+ * \brief give turn to next packet
+ * \param private thread private variables
+ * \param turn turn counter
+ */
+void glc_thread_turn_pass(struct glc_thread_private_s *private, u_int64_t *turn)
+{
+	pthread_mutex_lock(&private->turn_mutex);
+	(*turn)++;
+	pthread_cond_broadcast(&private->turn_cond);
+	pthread_mutex_unlock(&private->turn_mutex);
+}
+
+/**
+ * \brief wake up all threads waiting for their turn
+ * \param private thread private variables
+ */
+void glc_thread_turn_cancel(struct glc_thread_private_s *private)
+{
+	pthread_mutex_lock(&private->turn_mutex);
+	private->turn_cancel = 1;
+	pthread_cond_broadcast(&private->turn_cond);
+	pthread_mutex_unlock(&private->turn_mutex);
+}
+
 /**
  * \brief thread loop
  *
@@ -116,9 +176,27 @@ int glc_thread_wait(glc_thread_t *thread)
  * \param argptr pointer to thread state structure
  * \return always NULL
  */
+int glc_thread_open_read(glc_thread_t *thread, glc_thread_state_t *state, ps_packet_t *read)
+{
+	int ret;
+
+	if (!thread->idle_callback)
+		return ps_packet_open(read, PS_PACKET_READ);
+
+	while ((ret = ps_packet_open(read, PS_PACKET_READ | PS_PACKET_TRY)) == EBUSY) {
+		if (!(ret = thread->idle_callback(state)))
+			return ps_packet_open(read, PS_PACKET_READ);
+		else if (ret != EAGAIN)
+			return ret;
+	}
+
+	return ret;
+}
+
 void *glc_thread(void *argptr)
 {
-	int has_locked, ret, write_size_set, packets_init;
+	int has_locked, ret, write_size_set, packets_init, reorder;
+	u_int64_t seq = 0;
 
 	struct glc_thread_private_s *private = (struct glc_thread_private_s *) argptr;
 	glc_thread_t *thread = private->thread;
@@ -132,6 +210,10 @@ void *glc_thread(void *argptr)
 	state.flags = state.read_size = state.write_size = 0;
 	state.ptr = thread->ptr;
 
+	reorder = (thread->flags & GLC_THREAD_REORDER) &&
+		  (thread->flags & GLC_THREAD_READ) &&
+		  (thread->flags & GLC_THREAD_WRITE);
+
 	if (thread->flags & GLC_THREAD_READ) {
 		if ((ret = ps_packet_init(&read, private->from)))
 			goto err;
@@ -164,8 +246,17 @@ void *glc_thread(void *argptr)
 		}
 
 		if ((thread->flags & GLC_THREAD_READ) && (!(state.flags & GLC_THREAD_STATE_SKIP_READ))) {
-			if ((ret = ps_packet_open(&read, PS_PACKET_READ)))
+			if ((ret = glc_thread_open_read(thread, &state, &read)))
 				goto err;
+
+			if (reorder) {
+				/* packet order is known now, header and read callbacks
+				   still wait for their turn */
+				seq = private->seq++;
+				has_locked = 0;
+				pthread_mutex_unlock(&private->open);
+			}
+
 			if ((ret = ps_packet_read(&read, &state.header, sizeof(glc_message_header_t))))
 				goto err;
 			if ((ret = ps_packet_getsize(&read, &state.read_size)))
@@ -173,27 +264,64 @@ void *glc_thread(void *argptr)
 			state.read_size -= sizeof(glc_message_header_t);
 			state.write_size = state.read_size;
 
+			if (reorder) {
+				/* fake dma might copy data so do it before waiting */
+				if ((ret = ps_packet_dma(&read, (void *) &state.read_data,
+							 state.read_size, PS_ACCEPT_FAKE_DMA)))
+					goto err;
+				if ((ret = glc_thread_turn_wait(private, &private->read_turn, seq)))
+					goto err;
+			}
+
 			/* header callback */
 			if (thread->header_callback) {
 				if ((ret = thread->header_callback(&state)))
 					goto err;
 			}
 
-			if ((ret = ps_packet_dma(&read, (void *) &state.read_data,
-						 state.read_size, PS_ACCEPT_FAKE_DMA)))
-				goto err;
+			if (!reorder) {
+				if ((ret = ps_packet_dma(&read, (void *) &state.read_data,
+							 state.read_size, PS_ACCEPT_FAKE_DMA)))
+					goto err;
+			}
 
 			/* read callback */
 			if (thread->read_callback) {
 				if ((ret = thread->read_callback(&state)))
 					goto err;
 			}
+
+			if (reorder)
+				glc_thread_turn_pass(private, &private->read_turn);
+		} else if (reorder) {
+			seq = private->seq++;
+			has_locked = 0;
+			pthread_mutex_unlock(&private->open);
+
+			if ((ret = glc_thread_turn_wait(private, &private->read_turn, seq)))
+				goto err;
+			glc_thread_turn_pass(private, &private->read_turn);
+		}
+
+		/* process callback */
+		if ((thread->process_callback) && (!(state.flags & GLC_THREAD_COPY))) {
+			if ((ret = thread->process_callback(&state)))
+				goto err;
 		}
 
 		if ((thread->flags & GLC_THREAD_WRITE) && (!(state.flags & GLC_THREAD_STATE_SKIP_WRITE))) {
+			/* write packets must be opened in stream order */
+			if (reorder) {
+				if ((ret = glc_thread_turn_wait(private, &private->write_turn, seq)))
+					goto err;
+			}
+
 			if ((ret = ps_packet_open(&write, PS_PACKET_WRITE)))
 				goto err;
 
+			if (reorder)
+				glc_thread_turn_pass(private, &private->write_turn);
+
 			if (has_locked) {
 				has_locked = 0;
 				pthread_mutex_unlock(&private->open);
@@ -240,6 +368,12 @@ void *glc_thread(void *argptr)
 			pthread_mutex_unlock(&private->open);
 		}
 
+		if (reorder && (state.flags & GLC_THREAD_STATE_SKIP_WRITE)) {
+			if ((ret = glc_thread_turn_wait(private, &private->write_turn, seq)))
+				goto err;
+			glc_thread_turn_pass(private, &private->write_turn);
+		}
+
 		if ((thread->flags & GLC_THREAD_READ) && (!(state.flags & GLC_THREAD_STATE_SKIP_READ))) {
 			ps_packet_close(&read);
 			state.read_data = NULL;
@@ -292,6 +426,10 @@ finish:
 			ps_buffer_cancel(private->to);
 	}
 
+	/* nobody is going to pass turns any more */
+	if (reorder)
+		glc_thread_turn_cancel(private);
+
 	/* thread finish callback */
 	if (thread->thread_finish_callback)
 		thread->thread_finish_callback(state.ptr, state.threadptr, ret);
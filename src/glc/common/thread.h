@@ -71,12 +71,32 @@ typedef struct {
 #define GLC_THREAD_READ                       1
 /** thread does write operations */
 #define GLC_THREAD_WRITE                      2
+/** header and read callbacks run in stream order, process
+    and write callbacks run in parallel and write packets
+    are opened in stream order */
+#define GLC_THREAD_REORDER                    4
 /**
  * \brief thread vtable
  *
  * glc_thread_t holds information about thread callbacks
  * and features. Mandatory values are flags, and threads.
  * If callback is NULL, it is ignored.
+ *
+ * By default read and write threads hold a common lock from opening
+ * read packet until write packet is opened. With GLC_THREAD_REORDER
+ * each packet is stamped with a sequence number when read packet is
+ * opened and the lock is released immediately. Packet data is fetched
+ * in parallel, but header and read callbacks are serialized and called
+ * in stream order. Only process and write callbacks run in parallel.
+ * Write packets are opened in sequence number order, so
+ * a thread waiting for output buffer space doesn't block other
+ * threads from reading.
+ *
+ * Process callback is called after read callback but before write
+ * packet is opened. With GLC_THREAD_REORDER it is called in parallel,
+ * outside stream order. It may change write_size, so work whose output
+ * size isn't known beforehand can be done there and only the final
+ * size reserved from output buffer.
  */
 typedef struct {
 	/** flags, GLC_THREAD_READ or GLC_THREAD_WRITE or both */
@@ -99,9 +119,15 @@ typedef struct {
 	/** header callback is called when thread has read
 	    header from packet */
 	int (*header_callback)(glc_thread_state_t *);
+	/** idle callback is called when there is nothing to read,
+	    thread polls again while it returns EAGAIN and blocks
+	    until next packet when it returns 0 */
+	int (*idle_callback)(glc_thread_state_t *);
 	/** read callback is called when thread has read the
-	    whole packet */
+	    whole packet, in stream order with GLC_THREAD_REORDER */
 	int (*read_callback)(glc_thread_state_t *);
+	/** process callback is called before write packet is opened */
+	int (*process_callback)(glc_thread_state_t *);
 	/** write callback is called when thread has opened
 	    dma to write packet */
 	int (*write_callback)(glc_thread_state_t *);
@@ -0,0 +1,416 @@
+/**
+ * \file glc/core/dct.c
+ * \brief lossy intra-frame coding of video frames
+ * \author Pyry Haulos <pyry.haulos@gmail.com>
+ * \date 2007-2008
+ * For conditions of distribution and use, see copyright notice in glc.h
+ */
+
+/**
+ * \addtogroup dct
+ *  \{
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <glc/common/glc.h>
+
+#include "dct.h"
+
+/*
+ Like baseline JPEG without Huffman coding, the result is compressed
+ with a general purpose algorithm instead. Each block starts with
+ zigzag-coded DC difference as a varint. AC tokens are bytes with
+ run of zeros in the high nibble and value + 8 in the low nibble.
+ Value 8 (zero) means that the value follows as a varint. 0x00 ends
+ block and 0xf0 skips 15 zeros.
+*/
+
+#define DCT_EOB                 0x00
+#define DCT_ZRL                 0xf0
+#define DCT_LONG                   8
+/* keeps varints in two bytes */
+#define DCT_MAX_VALUE           2047
+
+void dct_load(float *block, const unsigned char *plane, unsigned int w,
+	      unsigned int h, unsigned int x0, unsigned int y0);
+void dct_store(unsigned char *plane, const float *block, unsigned int w,
+	       unsigned int h, unsigned int x0, unsigned int y0);
+void dct_forward(float *coef, const float *block);
+void dct_inverse(float *block, const float *coef);
+unsigned char *dct_encode_block(unsigned char *out, const float *coef,
+				const float *scale, int *dc);
+int dct_decode_block(const unsigned char **in, const unsigned char *end,
+		     float *coef, const float *step, int *dc);
+
+static const unsigned char dct_zigzag[64] = {
+	 0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+	12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+	35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+	58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63
+};
+
+/* JPEG Annex K tables */
+static const unsigned char dct_table[2][64] = {
+	{
+		16,  11,  10,  16,  24,  40,  51,  61,
+		12,  12,  14,  19,  26,  58,  60,  55,
+		14,  13,  16,  24,  40,  57,  69,  56,
+		14,  17,  22,  29,  51,  87,  80,  62,
+		18,  22,  37,  56,  68, 109, 103,  77,
+		24,  35,  55,  64,  81, 104, 113,  92,
+		49,  64,  78,  87, 103, 121, 120, 101,
+		72,  92,  95,  98, 112, 100, 103,  99
+	}, {
+		17,  18,  24,  47,  99,  99,  99,  99,
+		18,  21,  26,  66,  99,  99,  99,  99,
+		24,  26,  56,  99,  99,  99,  99,  99,
+		47,  66,  99,  99,  99,  99,  99,  99,
+		99,  99,  99,  99,  99,  99,  99,  99,
+		99,  99,  99,  99,  99,  99,  99,  99,
+		99,  99,  99,  99,  99,  99,  99,  99,
+		99,  99,  99,  99,  99,  99,  99,  99
+	}
+};
+
+/* orthonormal DCT-II basis, dct_basis[u][x] */
+static const float dct_basis[8][8] = {
+	{0.353553391f, 0.353553391f, 0.353553391f, 0.353553391f, 0.353553391f, 0.353553391f, 0.353553391f, 0.353553391f},
+	{0.490392640f, 0.415734806f, 0.277785117f, 0.097545161f, -0.097545161f, -0.277785117f, -0.415734806f, -0.490392640f},
+	{0.461939766f, 0.191341716f, -0.191341716f, -0.461939766f, -0.461939766f, -0.191341716f, 0.191341716f, 0.461939766f},
+	{0.415734806f, -0.097545161f, -0.490392640f, -0.277785117f, 0.277785117f, 0.490392640f, 0.097545161f, -0.415734806f},
+	{0.353553391f, -0.353553391f, -0.353553391f, 0.353553391f, 0.353553391f, -0.353553391f, -0.353553391f, 0.353553391f},
+	{0.277785117f, -0.490392640f, 0.097545161f, 0.415734806f, -0.415734806f, -0.097545161f, 0.490392640f, -0.277785117f},
+	{0.191341716f, -0.461939766f, 0.461939766f, -0.191341716f, -0.191341716f, 0.461939766f, -0.461939766f, 0.191341716f},
+	{0.097545161f, -0.277785117f, 0.415734806f, -0.490392640f, 0.490392640f, -0.415734806f, 0.277785117f, -0.097545161f}
+};
+
+/* transposed basis, dct_basis_t[x][u] */
+static const float dct_basis_t[8][8] = {
+	{0.353553391f, 0.490392640f, 0.461939766f, 0.415734806f, 0.353553391f, 0.277785117f, 0.191341716f, 0.097545161f},
+	{0.353553391f, 0.415734806f, 0.191341716f, -0.097545161f, -0.353553391f, -0.490392640f, -0.461939766f, -0.277785117f},
+	{0.353553391f, 0.277785117f, -0.191341716f, -0.490392640f, -0.353553391f, 0.097545161f, 0.461939766f, 0.415734806f},
+	{0.353553391f, 0.097545161f, -0.461939766f, -0.277785117f, 0.353553391f, 0.415734806f, -0.191341716f, -0.490392640f},
+	{0.353553391f, -0.097545161f, -0.461939766f, 0.277785117f, 0.353553391f, -0.415734806f, -0.191341716f, 0.490392640f},
+	{0.353553391f, -0.277785117f, -0.191341716f, 0.490392640f, -0.353553391f, -0.097545161f, 0.461939766f, -0.415734806f},
+	{0.353553391f, -0.415734806f, 0.191341716f, 0.097545161f, -0.353553391f, 0.490392640f, -0.461939766f, 0.277785117f},
+	{0.353553391f, -0.490392640f, 0.461939766f, -0.415734806f, 0.353553391f, -0.277785117f, 0.191341716f, -0.097545161f}
+};
+
+static inline unsigned char *dct_put_varint(unsigned char *out, unsigned int value)
+{
+	while (value >= 0x80) {
+		*out++ = (value & 0x7f) | 0x80;
+		value >>= 7;
+	}
+	*out++ = value;
+	return out;
+}
+
+static inline int dct_get_varint(const unsigned char **in, const unsigned char *end,
+				 int *value)
+{
+	unsigned int u = 0, shift;
+
+	for (shift = 0; shift < 14; shift += 7) {
+		if (*in >= end)
+			return EINVAL;
+		u |= (**in & 0x7f) << shift;
+		if (!(*(*in)++ & 0x80)) {
+			*value = (u >> 1) ^ -(int) (u & 1);
+			return 0;
+		}
+	}
+
+	return EINVAL;
+}
+
+int dct_geometry(struct dct_geometry_s *geom, unsigned int width,
+		 unsigned int height, unsigned int quality)
+{
+	unsigned int scale, step;
+	int p, t, i;
+
+	memset(geom, 0, sizeof(struct dct_geometry_s));
+
+	if ((!width) || (!height) || (quality < 1) || (quality > 100))
+		return EINVAL;
+
+	/* same layout as GLC_VIDEO_YCBCR_420JPEG */
+	geom->plane[0].w = width;
+	geom->plane[0].h = height;
+	geom->plane[1].w = geom->plane[2].w = width / 2;
+	geom->plane[1].h = geom->plane[2].h = height / 2;
+	geom->plane[1].offset = width * height;
+	geom->plane[2].offset = geom->plane[1].offset +
+				geom->plane[1].w * geom->plane[1].h;
+	geom->plane[1].table = geom->plane[2].table = 1;
+	geom->frame_size = geom->plane[2].offset +
+			   geom->plane[2].w * geom->plane[2].h;
+
+	for (p = 0; p < 3; p++) {
+		geom->plane[p].bw = (geom->plane[p].w + 7) / 8;
+		geom->plane[p].bh = (geom->plane[p].h + 7) / 8;
+		geom->max_size += (size_t) geom->plane[p].bw * geom->plane[p].bh * DCT_BLOCK_MAX;
+	}
+
+	/* quality scaling from libjpeg */
+	scale = quality < 50 ? 5000 / quality : 200 - quality * 2;
+	for (t = 0; t < 2; t++) {
+		for (i = 0; i < 64; i++) {
+			step = (dct_table[t][i] * scale + 50) / 100;
+			if (step < 1)
+				step = 1;
+			else if (step > 255)
+				step = 255;
+			geom->step[t][i] = step;
+			geom->scale[t][i] = 1.0f / step;
+		}
+	}
+
+	return 0;
+}
+
+size_t dct_encode(struct dct_geometry_s *geom, const char *frame, char *dst)
+{
+	unsigned char *out = (unsigned char *) dst;
+	const unsigned char *plane;
+	struct dct_plane_s *p;
+	float block[64], coef[64];
+	unsigned int bx, by;
+	int i, dc;
+
+	for (i = 0; i < 3; i++) {
+		p = &geom->plane[i];
+		plane = (const unsigned char *) &frame[p->offset];
+		dc = 0;
+
+		for (by = 0; by < p->bh; by++) {
+			for (bx = 0; bx < p->bw; bx++) {
+				dct_load(block, plane, p->w, p->h, bx * 8, by * 8);
+				dct_forward(coef, block);
+				out = dct_encode_block(out, coef, geom->scale[p->table], &dc);
+			}
+		}
+	}
+
+	return (char *) out - dst;
+}
+
+int dct_decode(struct dct_geometry_s *geom, const char *src, size_t size,
+	       char *frame)
+{
+	const unsigned char *in = (const unsigned char *) src;
+	const unsigned char *end = &in[size];
+	unsigned char *plane;
+	struct dct_plane_s *p;
+	float block[64], coef[64];
+	unsigned int bx, by;
+	int i, dc, ret;
+
+	for (i = 0; i < 3; i++) {
+		p = &geom->plane[i];
+		plane = (unsigned char *) &frame[p->offset];
+		dc = 0;
+
+		for (by = 0; by < p->bh; by++) {
+			for (bx = 0; bx < p->bw; bx++) {
+				if ((ret = dct_decode_block(&in, end, coef,
+							    geom->step[p->table], &dc)))
+					return ret;
+				dct_inverse(block, coef);
+				dct_store(plane, block, p->w, p->h, bx * 8, by * 8);
+			}
+		}
+	}
+
+	return 0;
+}
+
+void dct_load(float *block, const unsigned char *plane, unsigned int w,
+	      unsigned int h, unsigned int x0, unsigned int y0)
+{
+	const unsigned char *row;
+	unsigned int x, y, sx, sy;
+
+	if ((x0 + 8 <= w) && (y0 + 8 <= h)) {
+		for (y = 0; y < 8; y++) {
+			row = &plane[(y0 + y) * w + x0];
+			for (x = 0; x < 8; x++)
+				block[y * 8 + x] = (float) row[x] - 128.0f;
+		}
+		return;
+	}
+
+	/* replicate edge pixels to fill partial blocks */
+	for (y = 0; y < 8; y++) {
+		sy = y0 + y < h ? y0 + y : h - 1;
+		for (x = 0; x < 8; x++) {
+			sx = x0 + x < w ? x0 + x : w - 1;
+			block[y * 8 + x] = (float) plane[sy * w + sx] - 128.0f;
+		}
+	}
+}
+
+void dct_store(unsigned char *plane, const float *block, unsigned int w,
+	       unsigned int h, unsigned int x0, unsigned int y0)
+{
+	unsigned int x, y, bw, bh;
+	unsigned char *row;
+	float v;
+
+	bw = w - x0 < 8 ? w - x0 : 8;
+	bh = h - y0 < 8 ? h - y0 : 8;
+
+	for (y = 0; y < bh; y++) {
+		row = &plane[(y0 + y) * w + x0];
+		for (x = 0; x < bw; x++) {
+			v = block[y * 8 + x] + 128.5f;
+			row[x] = v < 0.0f ? 0 : (v > 255.0f ? 255 : (unsigned char) v);
+		}
+	}
+}
+
+/*
+ Separable transforms as matrix products. Inner loops run over a row,
+ so the compiler can vectorize them.
+*/
+void dct_forward(float *coef, const float *block)
+{
+	float tmp[64], acc[8];
+	int u, x, y;
+
+	/* columns: tmp[u][x] = sum_y basis[u][y] * block[y][x] */
+	for (u = 0; u < 8; u++) {
+		memset(acc, 0, sizeof(acc));
+		for (y = 0; y < 8; y++) {
+			for (x = 0; x < 8; x++)
+				acc[x] += dct_basis[u][y] * block[y * 8 + x];
+		}
+		memcpy(&tmp[u * 8], acc, sizeof(acc));
+	}
+
+	/* rows: coef[u][v] = sum_x tmp[u][x] * basis[v][x] */
+	for (u = 0; u < 8; u++) {
+		memset(acc, 0, sizeof(acc));
+		for (x = 0; x < 8; x++) {
+			for (y = 0; y < 8; y++)
+				acc[y] += tmp[u * 8 + x] * dct_basis_t[x][y];
+		}
+		memcpy(&coef[u * 8], acc, sizeof(acc));
+	}
+}
+
+void dct_inverse(float *block, const float *coef)
+{
+	float tmp[64], acc[8];
+	int u, v, x, y;
+
+	/* columns: tmp[y][v] = sum_u basis[u][y] * coef[u][v] */
+	for (y = 0; y < 8; y++) {
+		memset(acc, 0, sizeof(acc));
+		for (u = 0; u < 8; u++) {
+			for (v = 0; v < 8; v++)
+				acc[v] += dct_basis[u][y] * coef[u * 8 + v];
+		}
+		memcpy(&tmp[y * 8], acc, sizeof(acc));
+	}
+
+	/* rows: block[y][x] = sum_v tmp[y][v] * basis[v][x] */
+	for (y = 0; y < 8; y++) {
+		memset(acc, 0, sizeof(acc));
+		for (v = 0; v < 8; v++) {
+			for (x = 0; x < 8; x++)
+				acc[x] += tmp[y * 8 + v] * dct_basis[v][x];
+		}
+		memcpy(&block[y * 8], acc, sizeof(acc));
+	}
+}
+
+unsigned char *dct_encode_block(unsigned char *out, const float *coef,
+				const float *scale, int *dc)
+{
+	int q[64];
+	float c;
+	int i, run, value;
+
+	/* round to nearest and clamp, branchless so that it vectorizes */
+	for (i = 0; i < 64; i++) {
+		c = coef[i] * scale[i];
+		c = c < -DCT_MAX_VALUE ? -DCT_MAX_VALUE : (c > DCT_MAX_VALUE ? DCT_MAX_VALUE : c);
+		q[i] = (int) (c + (c < 0.0f ? -0.5f : 0.5f));
+	}
+
+	value = q[0] - *dc;
+	*dc = q[0];
+	out = dct_put_varint(out, ((unsigned int) value << 1) ^ (unsigned int) (value >> 31));
+
+	for (i = 1, run = 0; i < 64; i++) {
+		value = q[dct_zigzag[i]];
+		if (!value) {
+			run++;
+			continue;
+		}
+
+		while (run > 14) {
+			*out++ = DCT_ZRL;
+			run -= 15;
+		}
+
+		if ((value >= -7) && (value <= 7))
+			*out++ = (run << 4) | (value + 8);
+		else {
+			*out++ = (run << 4) | DCT_LONG;
+			out = dct_put_varint(out, ((unsigned int) value << 1) ^
+						  (unsigned int) (value >> 31));
+		}
+		run = 0;
+	}
+
+	*out++ = DCT_EOB;
+	return out;
+}
+
+int dct_decode_block(const unsigned char **in, const unsigned char *end,
+		     float *coef, const float *step, int *dc)
+{
+	int i, value, ret;
+	unsigned char token;
+
+	memset(coef, 0, sizeof(float) * 64);
+
+	if ((ret = dct_get_varint(in, end, &value)))
+		return ret;
+	*dc += value;
+	coef[0] = *dc * step[0];
+
+	for (i = 1;;) {
+		if (*in >= end)
+			return EINVAL;
+		token = *(*in)++;
+
+		if (token == DCT_EOB)
+			return 0;
+		else if (token == DCT_ZRL) {
+			i += 15;
+			continue;
+		}
+
+		i += token >> 4;
+		if ((i > 63) || (!(token & 0xf)))
+			return EINVAL;
+
+		if ((token & 0xf) == DCT_LONG) {
+			if ((ret = dct_get_varint(in, end, &value)))
+				return ret;
+		} else
+			value = (token & 0xf) - 8;
+
+		coef[dct_zigzag[i]] = value * step[dct_zigzag[i]];
+		i++;
+	}
+}
+
+/**  \} */
@@ -0,0 +1,103 @@
+/**
+ * \file glc/core/dct.h
+ * \brief lossy intra-frame coding of video frames
+ * \author Pyry Haulos <pyry.haulos@gmail.com>
+ * \date 2007-2008
+ * For conditions of distribution and use, see copyright notice in glc.h
+ */
+
+/**
+ * \addtogroup core
+ *  \{
+ * \defgroup dct lossy intra-frame coding of video frames
+ *  \{
+ */
+
+#ifndef _DCT_H
+#define _DCT_H
+
+#include <sys/types.h>
+#include <glc/common/glc.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** maximum size of a coded 8x8 block */
+#define DCT_BLOCK_MAX              256
+
+/**
+ * \brief plane geometry
+ */
+struct dct_plane_s {
+	/** plane offset in frame */
+	size_t offset;
+	/** plane size in pixels */
+	unsigned int w, h;
+	/** plane size in 8x8 blocks */
+	unsigned int bw, bh;
+	/** quantization table, 0 for luma and 1 for chroma */
+	int table;
+};
+
+/**
+ * \brief frame geometry
+ */
+struct dct_geometry_s {
+	/** Y, Cb and Cr planes */
+	struct dct_plane_s plane[3];
+	/** frame size */
+	size_t frame_size;
+	/** maximum size of coded frame */
+	size_t max_size;
+	/** quantizer steps in natural order */
+	float step[2][64];
+	/** reciprocals of quantizer steps */
+	float scale[2][64];
+};
+
+/**
+ * \brief calculate frame geometry
+ *
+ * Only Y'CbCr 4:2:0 frames are supported.
+ * \param geom geometry
+ * \param width frame width
+ * \param height frame height
+ * \param quality quality, from 1 to 100 like in libjpeg
+ * \return 0 on success, EINVAL if arguments are invalid
+ */
+int dct_geometry(struct dct_geometry_s *geom, unsigned int width,
+		 unsigned int height, unsigned int quality);
+
+/**
+ * \brief code frame
+ *
+ * Each plane is split into 8x8 blocks, which are transformed with
+ * DCT and quantized. Coefficients are written in zigzag order as
+ * run-length tokens, DC coefficients as differences to previous block.
+ * \param geom geometry
+ * \param frame frame data, geom->frame_size bytes
+ * \param dst coded frame, at most geom->max_size bytes
+ * \return coded frame size
+ */
+size_t dct_encode(struct dct_geometry_s *geom, const char *frame, char *dst);
+
+/**
+ * \brief decode frame
+ * \param geom geometry
+ * \param src coded frame
+ * \param size coded frame size
+ * \param frame frame data, geom->frame_size bytes
+ * \return 0 on success, EINVAL if data is corrupted
+ */
+int dct_decode(struct dct_geometry_s *geom, const char *src, size_t size,
+	       char *frame);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/**  \} */
+/**  \} */
@@ -0,0 +1,382 @@
+/**
+ * \file glc/core/direct.c
+ * \brief asynchronous direct io writer
+ * \author Pyry Haulos <pyry.haulos@gmail.com>
+ * \date 2007-2008
+ * For conditions of distribution and use, see copyright notice in glc.h
+ */
+
+/**
+ * \addtogroup direct
+ *  \{
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <errno.h>
+#include <unistd.h>
+
+#ifdef __URING
+# include <liburing.h>
+#endif
+
+#include <glc/common/glc.h>
+#include <glc/common/core.h>
+#include <glc/common/log.h>
+
+#include "direct.h"
+
+struct direct_buffer_s {
+	char *data;
+	/* file offset, always aligned */
+	off_t offset;
+	/* bytes of data in buffer */
+	size_t used;
+	/* bytes submitted */
+	size_t size;
+	int busy;
+};
+
+struct direct_s {
+	glc_t *glc;
+	int fd;
+	int err;
+	int dirty;
+
+	struct direct_buffer_s buffer[DIRECT_BUFFERS];
+	unsigned int cur;
+
+#ifdef __URING
+	int uring;
+	struct io_uring ring;
+#endif
+
+	/* thread pool, used when io_uring is not available */
+	pthread_t thread[DIRECT_BUFFERS];
+	unsigned int threads;
+	pthread_mutex_t mutex;
+	pthread_cond_t queue_cond, done_cond;
+	struct direct_buffer_s *queue[DIRECT_BUFFERS];
+	unsigned int queue_head, queue_count;
+	int stop;
+};
+
+int direct_submit(direct_t direct, struct direct_buffer_s *buffer);
+int direct_wait(direct_t direct, struct direct_buffer_s *buffer);
+int direct_pwrite(int fd, const char *data, size_t size, off_t offset);
+void *direct_thread(void *argptr);
+int direct_threads_start(direct_t direct);
+
+int direct_init(direct_t *direct, glc_t *glc, int fd)
+{
+	unsigned int i;
+	int ret;
+
+	*direct = (direct_t) malloc(sizeof(struct direct_s));
+	memset(*direct, 0, sizeof(struct direct_s));
+
+	(*direct)->glc = glc;
+	(*direct)->fd = fd;
+
+	pthread_mutex_init(&(*direct)->mutex, NULL);
+	pthread_cond_init(&(*direct)->queue_cond, NULL);
+	pthread_cond_init(&(*direct)->done_cond, NULL);
+
+	for (i = 0; i < DIRECT_BUFFERS; i++) {
+		if ((ret = posix_memalign((void **) &(*direct)->buffer[i].data,
+					  DIRECT_ALIGN, DIRECT_BUFFER_SIZE)))
+			goto err;
+	}
+
+#ifdef __URING
+	if (!(ret = -io_uring_queue_init(DIRECT_BUFFERS, &(*direct)->ring, 0))) {
+		(*direct)->uring = 1;
+		glc_log(glc, GLC_INFORMATION, "direct", "writing using io_uring");
+		return 0;
+	}
+
+	glc_log(glc, GLC_WARNING, "direct",
+		 "io_uring not available: %s (%d)", strerror(ret), ret);
+#endif
+
+	if ((ret = direct_threads_start(*direct)))
+		goto err;
+
+	glc_log(glc, GLC_INFORMATION, "direct",
+		 "writing using %u threads", (*direct)->threads);
+	return 0;
+err:
+	/* no threads are running, buffers not allocated yet are NULL */
+	pthread_cond_destroy(&(*direct)->done_cond);
+	pthread_cond_destroy(&(*direct)->queue_cond);
+	pthread_mutex_destroy(&(*direct)->mutex);
+
+	for (i = 0; i < DIRECT_BUFFERS; i++)
+		free((*direct)->buffer[i].data);
+	free(*direct);
+	*direct = NULL;
+	return ret;
+}
+
+int direct_write(direct_t direct, const void *data, size_t size)
+{
+	struct direct_buffer_s *buffer = &direct->buffer[direct->cur];
+	const char *src = (const char *) data;
+	off_t offset;
+	size_t len;
+	int ret;
+
+	direct->dirty = 1;
+	while (size) {
+		len = DIRECT_BUFFER_SIZE - buffer->used;
+		if (len > size)
+			len = size;
+
+		memcpy(&buffer->data[buffer->used], src, len);
+		buffer->used += len;
+		src += len;
+		size -= len;
+
+		if (buffer->used < DIRECT_BUFFER_SIZE)
+			break;
+
+		/* buffer is full, write it and continue in next one */
+		offset = buffer->offset + DIRECT_BUFFER_SIZE;
+		buffer->size = DIRECT_BUFFER_SIZE;
+		if ((ret = direct_submit(direct, buffer)))
+			return ret;
+
+		direct->cur = (direct->cur + 1) % DIRECT_BUFFERS;
+		buffer = &direct->buffer[direct->cur];
+		if ((ret = direct_wait(direct, buffer)))
+			return ret;
+
+		buffer->offset = offset;
+		buffer->used = 0;
+	}
+
+	return direct->err;
+}
+
+int direct_flush(direct_t direct)
+{
+	struct direct_buffer_s *buffer = &direct->buffer[direct->cur];
+	size_t keep;
+	unsigned int i;
+	int ret;
+
+	for (i = 0; i < DIRECT_BUFFERS; i++) {
+		if ((ret = direct_wait(direct, &direct->buffer[i])))
+			return ret;
+	}
+
+	/* nothing written since last flush */
+	if ((!direct->dirty) || (!buffer->used))
+		return direct->err;
+
+	/* pad partial buffer, extra bytes are truncated away */
+	buffer->size = buffer->used + DIRECT_ALIGN - 1;
+	buffer->size -= buffer->size % DIRECT_ALIGN;
+	memset(&buffer->data[buffer->used], 0, buffer->size - buffer->used);
+
+	if ((ret = direct_submit(direct, buffer)))
+		return ret;
+	if ((ret = direct_wait(direct, buffer)))
+		return ret;
+
+	if (ftruncate(direct->fd, buffer->offset + buffer->used) == -1)
+		return direct->err = errno;
+
+	/* partial last block is written again with following data */
+	keep = buffer->used % DIRECT_ALIGN;
+	memmove(buffer->data, &buffer->data[buffer->used - keep], keep);
+	buffer->offset += buffer->used - keep;
+	buffer->used = keep;
+	direct->dirty = 0;
+
+	return 0;
+}
+
+int direct_destroy(direct_t direct)
+{
+	unsigned int i;
+	int ret;
+
+	ret = direct_flush(direct);
+
+	pthread_mutex_lock(&direct->mutex);
+	direct->stop = 1;
+	pthread_cond_broadcast(&direct->queue_cond);
+	pthread_mutex_unlock(&direct->mutex);
+
+	for (i = 0; i < direct->threads; i++)
+		pthread_join(direct->thread[i], NULL);
+
+#ifdef __URING
+	if (direct->uring)
+		io_uring_queue_exit(&direct->ring);
+#endif
+
+	pthread_cond_destroy(&direct->done_cond);
+	pthread_cond_destroy(&direct->queue_cond);
+	pthread_mutex_destroy(&direct->mutex);
+
+	for (i = 0; i < DIRECT_BUFFERS; i++)
+		free(direct->buffer[i].data);
+	free(direct);
+
+	return ret;
+}
+
+int direct_submit(direct_t direct, struct direct_buffer_s *buffer)
+{
+#ifdef __URING
+	struct io_uring_sqe *sqe;
+	int ret;
+
+	if (direct->uring) {
+		/* queue has room for all buffers */
+		if (!(sqe = io_uring_get_sqe(&direct->ring)))
+			return direct->err = EAGAIN;
+		io_uring_prep_write(sqe, direct->fd, buffer->data, buffer->size,
+				    buffer->offset);
+		io_uring_sqe_set_data(sqe, buffer);
+
+		if ((ret = io_uring_submit(&direct->ring)) < 0)
+			return direct->err = -ret;
+		buffer->busy = 1;
+		return 0;
+	}
+#endif
+
+	pthread_mutex_lock(&direct->mutex);
+	buffer->busy = 1;
+	direct->queue[(direct->queue_head + direct->queue_count++) % DIRECT_BUFFERS] = buffer;
+	pthread_cond_signal(&direct->queue_cond);
+	pthread_mutex_unlock(&direct->mutex);
+
+	return 0;
+}
+
+int direct_wait(direct_t direct, struct direct_buffer_s *buffer)
+{
+#ifdef __URING
+	struct direct_buffer_s *done;
+	struct io_uring_cqe *cqe;
+	size_t res;
+#endif
+	int ret;
+
+#ifdef __URING
+	if (direct->uring) {
+		while (buffer->busy) {
+			if ((ret = io_uring_wait_cqe(&direct->ring, &cqe)) < 0) {
+				if (ret == -EINTR)
+					continue;
+				return direct->err = -ret;
+			}
+
+			done = (struct direct_buffer_s *) io_uring_cqe_get_data(cqe);
+			if (cqe->res < 0)
+				direct->err = -cqe->res;
+			else if ((size_t) cqe->res < done->size) {
+				/* finish short write synchronously from last whole block */
+				res = cqe->res - cqe->res % DIRECT_ALIGN;
+				if ((ret = direct_pwrite(direct->fd, &done->data[res],
+							 done->size - res, done->offset + res)))
+					direct->err = ret;
+			}
+
+			done->busy = 0;
+			io_uring_cqe_seen(&direct->ring, cqe);
+		}
+
+		return direct->err;
+	}
+#endif
+
+	pthread_mutex_lock(&direct->mutex);
+	while (buffer->busy)
+		pthread_cond_wait(&direct->done_cond, &direct->mutex);
+	ret = direct->err;
+	pthread_mutex_unlock(&direct->mutex);
+
+	return ret;
+}
+
+int direct_pwrite(int fd, const char *data, size_t size, off_t offset)
+{
+	ssize_t ret;
+
+	while (size) {
+		if ((ret = pwrite(fd, data, size, offset)) == -1) {
+			if (errno == EINTR)
+				continue;
+			return errno;
+		} else if (!ret)
+			return EIO;
+
+		/* offset must stay aligned, partial block is written again */
+		ret -= ret % DIRECT_ALIGN;
+		data += ret;
+		size -= ret;
+		offset += ret;
+	}
+
+	return 0;
+}
+
+int direct_threads_start(direct_t direct)
+{
+	pthread_attr_t attr;
+	int ret = 0;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+
+	/* one thread per buffer keeps every buffer in flight */
+	for (direct->threads = 0; direct->threads < DIRECT_BUFFERS; direct->threads++) {
+		if ((ret = pthread_create(&direct->thread[direct->threads], &attr,
+					  direct_thread, direct)))
+			break;
+	}
+
+	pthread_attr_destroy(&attr);
+
+	/* fewer threads just means fewer writes in flight */
+	return direct->threads ? 0 : ret;
+}
+
+void *direct_thread(void *argptr)
+{
+	direct_t direct = (direct_t) argptr;
+	struct direct_buffer_s *buffer;
+	int ret;
+
+	pthread_mutex_lock(&direct->mutex);
+	for (;;) {
+		while ((!direct->queue_count) && (!direct->stop))
+			pthread_cond_wait(&direct->queue_cond, &direct->mutex);
+		if (!direct->queue_count)
+			break;
+
+		buffer = direct->queue[direct->queue_head];
+		direct->queue_head = (direct->queue_head + 1) % DIRECT_BUFFERS;
+		direct->queue_count--;
+		pthread_mutex_unlock(&direct->mutex);
+
+		ret = direct_pwrite(direct->fd, buffer->data, buffer->size, buffer->offset);
+
+		pthread_mutex_lock(&direct->mutex);
+		if (ret)
+			direct->err = ret;
+		buffer->busy = 0;
+		pthread_cond_broadcast(&direct->done_cond);
+	}
+	pthread_mutex_unlock(&direct->mutex);
+
+	return NULL;
+}
+
+/**  \} */
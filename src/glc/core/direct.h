@@ -0,0 +1,87 @@
+/**
+ * \file glc/core/direct.h
+ * \brief asynchronous direct io writer
+ * \author Pyry Haulos <pyry.haulos@gmail.com>
+ * \date 2007-2008
+ * For conditions of distribution and use, see copyright notice in glc.h
+ */
+
+/**
+ * \addtogroup core
+ *  \{
+ * \defgroup direct asynchronous direct io writer
+ *  \{
+ */
+
+#ifndef _DIRECT_H
+#define _DIRECT_H
+
+#include <sys/types.h>
+#include <glc/common/glc.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** alignment of O_DIRECT buffers, offsets and sizes */
+#define DIRECT_ALIGN               4096
+/** size of one staging buffer */
+#define DIRECT_BUFFER_SIZE         (1024 * 1024)
+/** number of staging buffers, also maximum number of writes in flight */
+#define DIRECT_BUFFERS             4
+
+/**
+ * \brief direct writer object
+ */
+typedef struct direct_s* direct_t;
+
+/**
+ * \brief initialize direct writer
+ *
+ * Data is collected into aligned staging buffers and full buffers
+ * are written asynchronously using io_uring, or a pool of writer
+ * threads if io_uring is not available. Writing starts at the
+ * beginning of file.
+ * \param direct direct writer
+ * \param glc glc
+ * \param fd file descriptor opened with O_DIRECT
+ * \return 0 on success otherwise an error code
+ */
+int direct_init(direct_t *direct, glc_t *glc, int fd);
+
+/**
+ * \brief write data
+ * \param direct direct writer
+ * \param data data
+ * \param size data size
+ * \return 0 on success, otherwise error code of this or any earlier write
+ */
+int direct_write(direct_t direct, const void *data, size_t size);
+
+/**
+ * \brief write all data to file
+ *
+ * Waits for writes in flight, writes partial staging buffer padded
+ * to alignment and truncates file to actual size.
+ * \param direct direct writer
+ * \return 0 on success otherwise an error code
+ */
+int direct_flush(direct_t direct);
+
+/**
+ * \brief flush and destroy direct writer
+ *
+ * File descriptor is not closed.
+ * \param direct direct writer
+ * \return 0 on success otherwise an error code
+ */
+int direct_destroy(direct_t direct);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/**  \} */
+/**  \} */
@@ -23,6 +23,8 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/file.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 
 #include <glc/common/glc.h>
@@ -35,6 +37,8 @@
 #include <glc/core/tracker.h>
 
 #include "file.h"
+#include "direct.h"
+#include "stripe.h"
 
 #define FILE_READING       0x1
 #define FILE_WRITING       0x2
@@ -42,6 +46,42 @@
 #define FILE_INFO_WRITTEN  0x8
 #define FILE_INFO_READ    0x10
 #define FILE_INFO_VALID   0x20
+#define FILE_EOF_WRITTEN  0x40
+#define FILE_INDEX_READ   0x80
+
+/* minimum time between random access points */
+#define FILE_INDEX_INTERVAL     100000
+/* refresh is requested if tiled stream has no random access point in this time */
+#define FILE_REFRESH_INTERVAL  5000000
+/* index records are appended to sidecar file in chunks of this size */
+#define FILE_INDEX_SYNC_SIZE      4096
+/* size of source file window mapped at once */
+#define FILE_MAP_SIZE      (256 * 1024 * 1024)
+/* readahead is issued in chunks of this size */
+#define FILE_READAHEAD_CHUNK (4 * 1024 * 1024)
+
+#define FILE_SEGMENT_NONE       0
+#define FILE_SEGMENT_REQUESTED  1
+#define FILE_SEGMENT_READY      2
+#define FILE_SEGMENT_FAILED     3
+
+/* file system doesn't support preallocation */
+#define FILE_NO_PREALLOC        ((u_int64_t) -1)
+
+struct file_target_s {
+	int fd;
+	direct_t writer;
+	/* stripe writer, fd is first stripe */
+	stripe_t stripe;
+	/* bytes preallocated */
+	u_int64_t allocated;
+	/* file name, NULL if target was set using file_set_target() */
+	char *name;
+	char *index_name;
+	int index_fd;
+	/* next target in close queue */
+	struct file_target_s *close_next;
+};
 
 struct file_s {
 	glc_t *glc;
@@ -49,15 +89,145 @@ struct file_s {
 	glc_thread_t thread;
 	int fd;
 	int sync;
+	int direct;
+	/* asynchronous writer when target is opened with O_DIRECT */
+	direct_t writer;
+	/* stream is striped over several files, fd is first stripe */
+	stripe_t stripe;
+	size_t stripe_size;
+	/* position in striped source */
+	u_int64_t stripe_pos;
 	u_int32_t stream_version;
 	callback_request_func_t callback;
 	tracker_t state_tracker;
+
+	/* small packets are collected here and written with one writev() */
+	char *batch;
+	size_t batch_size, batch_used;
+	glc_utime_t batch_time, batch_start;
+
+	/* offset of next byte written to target */
+	u_int64_t offset;
+
+	/* target is preallocated in extents of prealloc bytes */
+	size_t prealloc;
+	u_int64_t allocated;
+	/* written data is pushed out and dropped from page cache in writeback sized ranges */
+	size_t writeback;
+	u_int64_t written, writeback_start;
+
+	/* index records, also used when reading index */
+	char *index;
+	size_t index_size, index_used, index_synced;
+	/* sidecar index file */
+	char *index_name;
+	int index_fd;
+	glc_utime_t index_time;
+	u_int32_t index_states, index_entries;
+	int index_state_changed, index_video, index_delta, index_tiles;
+	/* next packet follows a callback request, refresh asked from capture */
+	int index_refresh, refresh_requested;
+
+	/* random access points of source file */
+	u_int64_t data_offset;
+	glc_index_entry_t *entries;
+	size_t entry_count;
+	size_t *states;
+	size_t state_count;
+	u_int32_t seek_state;
+	/* how far ahead of reader source file is read */
+	size_t readahead;
+
+	/* copy of stream information for new segments */
+	glc_stream_info_t info;
+	char *info_name, *info_date;
+
+	/* segment files are opened and closed in helper thread */
+	u_int64_t segment_size;
+	glc_utime_t segment_time, segment_start;
+	file_segment_name_func_t segment_name;
+	void *segment_arg;
+	unsigned int segment;
+	int segment_running, segment_stop, segment_reset;
+	pthread_t segment_thread;
+	pthread_mutex_t segment_mutex;
+	pthread_cond_t segment_cond;
+	struct file_target_s next;
+	int next_state;
+	/* finished segments waiting to be closed */
+	struct file_target_s *old, *old_last;
+};
+
+struct file_map_s {
+	char *addr;
+	off_t offset;
+	size_t size;
+	off_t file_size;
+};
+
+struct file_readahead_s {
+	int fd;
+	/* reader position, readahead position and end of file */
+	off_t pos, done, end;
+	size_t depth;
+	int stop;
+
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
 };
 
 void file_finish_callback(void *ptr, int err);
 int file_read_callback(glc_thread_state_t *state);
+int file_idle_callback(glc_thread_state_t *state);
 int file_write_message(file_t file, glc_message_header_t *header, void *message, size_t message_size);
 int file_write_state_callback(glc_message_header_t *header, void *message, size_t message_size, void *arg);
+int file_write_packet(file_t file, struct iovec *iov, int iovcnt);
+int file_flush(file_t file);
+int file_writev(int fd, struct iovec *iov, int iovcnt);
+int file_write_vec(file_t file, struct iovec *iov, int iovcnt);
+int file_write_target(file_t file, struct iovec *iov, int iovcnt);
+void file_preallocate(file_t file, u_int64_t end);
+int file_sync_flags(file_t file);
+void file_writeback(file_t file);
+char *file_index_alloc(file_t file, size_t size);
+int file_index_record(file_t file, glc_message_type_t type, const void *data, size_t size);
+int file_index_state_callback(glc_message_header_t *header, void *message, size_t message_size, void *arg);
+int file_index_state(file_t file);
+glc_message_type_t file_packet_type(glc_message_header_t *header, char *data);
+glc_utime_t file_packet_time(file_t file, glc_thread_state_t *state);
+int file_random_access(file_t file, glc_message_type_t type);
+int file_index_packet(file_t file, glc_utime_t time);
+void file_index_reset(file_t file);
+int file_index_sync(file_t file);
+int file_write_index(file_t file);
+int file_read_index(file_t file);
+int file_read_state(file_t file, ps_packet_t *packet);
+int file_open_stripes(file_t file, const char *filename);
+const char *file_stripe_names(const char *filename);
+ssize_t file_source_read(file_t file, void *buf, size_t size);
+ssize_t file_source_pread(file_t file, int fd, void *buf, size_t size, off_t offset);
+off_t file_source_seek(file_t file, off_t offset, int whence);
+int file_source_size(file_t file, u_int64_t *size);
+char *file_map(file_t file, struct file_map_s *map, off_t offset, size_t size);
+int file_read_map(file_t file, ps_packet_t *packet);
+int file_readahead_start(struct file_readahead_s *ahead, int fd, size_t depth,
+			 off_t pos, off_t end);
+void file_readahead_update(struct file_readahead_s *ahead, off_t pos);
+void file_readahead_stop(struct file_readahead_s *ahead);
+void *file_readahead_thread(void *argptr);
+int file_target_open(file_t file, struct file_target_s *target, const char *filename);
+int file_target_open_stripes(file_t file, struct file_target_s *target, const char *filename);
+void file_target_unlink(struct file_target_s *target);
+int file_target_lock(file_t file, struct file_target_s *target, int fd);
+void file_target_set(file_t file, struct file_target_s *target);
+void file_target_close(file_t file, struct file_target_s *target, int indexed);
+int file_segment_start(file_t file);
+void file_segment_stop(file_t file);
+int file_segment_due(file_t file);
+int file_refresh_due(file_t file);
+int file_segment_switch(file_t file);
+void *file_segment_thread(void *argptr);
 
 int file_init(file_t *file, glc_t *glc)
 {
@@ -66,11 +236,19 @@ int file_init(file_t *file, glc_t *glc)
 
 	(*file)->glc = glc;
 	(*file)->fd = -1;
+	(*file)->index_fd = -1;
+	(*file)->seek_state = GLC_INDEX_NO_STATE;
 	(*file)->sync = 0;
+	(*file)->batch_size = 256 * 1024;
+	(*file)->batch_time = 50000;
+	(*file)->readahead = 32 * 1024 * 1024;
+	(*file)->prealloc = 64 * 1024 * 1024;
+	(*file)->stripe_size = 1024 * 1024;
 
 	(*file)->thread.flags = GLC_THREAD_READ;
 	(*file)->thread.ptr = *file;
 	(*file)->thread.read_callback = &file_read_callback;
+	(*file)->thread.idle_callback = &file_idle_callback;
 	(*file)->thread.finish_callback = &file_finish_callback;
 	(*file)->thread.threads = 1;
 
@@ -82,6 +260,14 @@ int file_init(file_t *file, glc_t *glc)
 int file_destroy(file_t file)
 {
 	tracker_destroy(file->state_tracker);
+	if (file->batch)
+		free(file->batch);
+	if (file->index)
+		free(file->index);
+	if (file->info_name)
+		free(file->info_name);
+	if (file->info_date)
+		free(file->info_date);
 	free(file);
 	return 0;
 }
@@ -92,6 +278,68 @@ int file_set_sync(file_t file, int sync)
 	return 0;
 }
 
+int file_set_direct(file_t file, int direct)
+{
+	file->direct = direct;
+	return 0;
+}
+
+int file_set_preallocate(file_t file, size_t size)
+{
+	if (file->flags & FILE_RUNNING)
+		return EALREADY;
+
+	file->prealloc = size;
+	return 0;
+}
+
+int file_set_writeback(file_t file, size_t size)
+{
+	if (file->flags & FILE_RUNNING)
+		return EALREADY;
+
+	file->writeback = size;
+	return 0;
+}
+
+int file_set_stripe_size(file_t file, size_t size)
+{
+	if (!size)
+		return EINVAL;
+
+	file->stripe_size = size;
+	return 0;
+}
+
+int file_set_write_batch(file_t file, size_t size, glc_utime_t time)
+{
+	if (file->flags & FILE_RUNNING)
+		return EALREADY;
+
+	file->batch_size = size;
+	file->batch_time = time;
+	return 0;
+}
+
+int file_set_readahead(file_t file, size_t size)
+{
+	file->readahead = size;
+	return 0;
+}
+
+int file_set_segment(file_t file, u_int64_t size, glc_utime_t time,
+		     file_segment_name_func_t name, void *arg)
+{
+	if (file->flags & FILE_RUNNING)
+		return EALREADY;
+
+	file->segment_size = size;
+	file->segment_time = time;
+	file->segment_name = name;
+	file->segment_arg = arg;
+	return 0;
+}
+
 int file_set_callback(file_t file, callback_request_func_t callback)
 {
 	file->callback = callback;
@@ -100,16 +348,95 @@ int file_set_callback(file_t file, callback_request_func_t callback)
 
 int file_open_target(file_t file, const char *filename)
 {
-	int fd, ret = 0;
+	struct file_target_s target;
+	int ret;
+
+	if (file->fd >= 0)
+		return EBUSY;
+
+	if ((ret = file_target_open(file, &target, filename)))
+		return ret;
+
+	file_target_set(file, &target);
+	return 0;
+}
+
+int file_set_target(file_t file, int fd)
+{
+	struct file_target_s target;
+	int ret;
+
 	if (file->fd >= 0)
 		return EBUSY;
 
+	if ((ret = file_target_lock(file, &target, fd)))
+		return ret;
+
+	file_target_set(file, &target);
+	return 0;
+}
+
+int file_close_target(file_t file)
+{
+	struct file_target_s target;
+	int ret, indexed = 0;
+
+	if ((file->fd < 0) | (file->flags & FILE_RUNNING) |
+	    (!(file->flags & FILE_WRITING)))
+		return EAGAIN;
+
+	/* index footer is written only into complete streams */
+	if (file->flags & FILE_EOF_WRITTEN) {
+		if ((ret = file_write_index(file)))
+			glc_log(file->glc, GLC_ERROR, "file",
+				 "can't write index: %s (%d)", strerror(ret), ret);
+		else
+			indexed = 1;
+	}
+
+	target.fd = file->fd;
+	target.writer = file->writer;
+	target.stripe = file->stripe;
+	target.allocated = file->allocated;
+	target.name = NULL;
+	target.index_name = file->index_name;
+	target.index_fd = file->index_fd;
+	file_target_close(file, &target, indexed);
+
+	file->fd = -1;
+	file->writer = NULL;
+	file->stripe = NULL;
+	file->index_name = NULL;
+	file->index_fd = -1;
+	file->flags &= ~(FILE_RUNNING | FILE_WRITING | FILE_INFO_WRITTEN |
+			 FILE_EOF_WRITTEN);
+
+	return 0;
+}
+
+int file_target_open(file_t file, struct file_target_s *target, const char *filename)
+{
+	int fd, ret;
+
+	/* stripe:a,b,... is a list of files, one stripe per file */
+	if (file_stripe_names(filename))
+		return file_target_open_stripes(file, target, filename);
+
 	glc_log(file->glc, GLC_INFORMATION, "file",
-		 "opening %s for writing stream (%s)",
+		 "opening %s for writing stream (%s%s)",
 		 filename,
-		 file->sync ? "sync" : "no sync");
+		 file->sync ? "sync" : "no sync",
+		 file->direct ? ", direct" : "");
 
-	fd = open(filename, O_CREAT | O_WRONLY | (file->sync ? O_SYNC : 0), 0644);
+	fd = open(filename, O_CREAT | O_WRONLY | file_sync_flags(file) |
+		  (file->direct ? O_DIRECT : 0), 0644);
+
+	/* not all file systems support O_DIRECT */
+	if ((fd == -1) && (file->direct) && (errno == EINVAL)) {
+		glc_log(file->glc, GLC_WARNING, "file",
+			 "O_DIRECT not supported, writing through page cache");
+		fd = open(filename, O_CREAT | O_WRONLY | file_sync_flags(file), 0644);
+	}
 
 	if (fd == -1) {
 		glc_log(file->glc, GLC_ERROR, "file", "can't open %s: %s (%d)",
@@ -117,16 +444,140 @@ int file_open_target(file_t file, const char *filename)
 		return errno;
 	}
 
-	if ((ret = file_set_target(file, fd)))
+	if ((ret = file_target_lock(file, target, fd))) {
 		close(fd);
+		return ret;
+	}
+
+	target->name = strdup(filename);
+
+	/* first extent is allocated before any data is written */
+	if (file->prealloc) {
+		if (fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, file->prealloc) == -1) {
+			glc_log(file->glc, GLC_INFORMATION, "file",
+				 "can't preallocate: %s (%d)", strerror(errno), errno);
+			target->allocated = FILE_NO_PREALLOC;
+		} else
+			target->allocated = file->prealloc;
+	}
+
+	/* index is kept in sidecar file until footer is written */
+	target->index_name = (char *) malloc(strlen(filename) + 5);
+	sprintf(target->index_name, "%s.idx", filename);
+
+	return 0;
+}
+
+int file_target_open_stripes(file_t file, struct file_target_s *target, const char *filename)
+{
+	int fd[STRIPE_MAX];
+	unsigned int count = 0;
+	char *names, *name, *save;
+	int ret = 0;
+
+	memset(target, 0, sizeof(struct file_target_s));
+	target->fd = -1;
+	target->index_fd = -1;
+
+	glc_log(file->glc, GLC_INFORMATION, "file",
+		 "opening %s for writing striped stream (%s)",
+		 filename, file->sync ? "sync" : "no sync");
+	if (file->direct)
+		glc_log(file->glc, GLC_WARNING, "file",
+			 "striped stream is written through page cache");
+
+	names = strdup(file_stripe_names(filename));
+	for (name = strtok_r(names, ",", &save); name; name = strtok_r(NULL, ",", &save)) {
+		if (count == STRIPE_MAX) {
+			glc_log(file->glc, GLC_ERROR, "file",
+				 "too many stripes, maximum is %d", STRIPE_MAX);
+			ret = EINVAL;
+			goto err;
+		}
+
+		if ((fd[count] = open(name, O_CREAT | O_WRONLY | file_sync_flags(file), 0644)) == -1) {
+			ret = errno;
+			glc_log(file->glc, GLC_ERROR, "file", "can't open %s: %s (%d)",
+				 name, strerror(ret), ret);
+			goto err;
+		}
 
+		if (flock(fd[count], LOCK_EX | LOCK_NB) == -1) {
+			ret = errno;
+			glc_log(file->glc, GLC_ERROR, "file",
+				 "can't lock %s: %s (%d)", name, strerror(ret), ret);
+			close(fd[count]);
+			goto err;
+		}
+		ftruncate(fd[count], 0);
+
+		/* index is kept in sidecar of first stripe */
+		if (!count) {
+			target->index_name = (char *) malloc(strlen(name) + 5);
+			sprintf(target->index_name, "%s.idx", name);
+		}
+		count++;
+	}
+
+	if ((ret = stripe_init(&target->stripe, file->glc, fd, count, file->stripe_size)))
+		goto err;
+
+	free(names);
+	target->fd = fd[0];
+	target->name = strdup(filename);
+	return 0;
+err:
+	while (count--) {
+		flock(fd[count], LOCK_UN);
+		close(fd[count]);
+	}
+	if (target->index_name) {
+		free(target->index_name);
+		target->index_name = NULL;
+	}
+	free(names);
 	return ret;
 }
 
-int file_set_target(file_t file, int fd)
+int file_sync_flags(file_t file)
 {
-	if (file->fd >= 0)
-		return EBUSY;
+	/* without writeback ranges there is nothing to wait for, so sync every write */
+	if ((file->sync) && ((!file->writeback) || (file->direct)))
+		return O_SYNC;
+	return 0;
+}
+
+void file_target_unlink(struct file_target_s *target)
+{
+	char *names, *name, *save;
+
+	if (!file_stripe_names(target->name)) {
+		unlink(target->name);
+		return;
+	}
+
+	/* names of striped target are separated by commas */
+	names = strdup(file_stripe_names(target->name));
+	for (name = strtok_r(names, ",", &save); name; name = strtok_r(NULL, ",", &save))
+		unlink(name);
+	free(names);
+}
+
+const char *file_stripe_names(const char *filename)
+{
+	/* only explicitly prefixed names are striped, plain names can contain commas */
+	if (strncmp(filename, FILE_STRIPE_PREFIX, strlen(FILE_STRIPE_PREFIX)))
+		return NULL;
+	return &filename[strlen(FILE_STRIPE_PREFIX)];
+}
+
+int file_target_lock(file_t file, struct file_target_s *target, int fd)
+{
+	int ret;
+
+	memset(target, 0, sizeof(struct file_target_s));
+	target->fd = -1;
+	target->index_fd = -1;
 
 	if (flock(fd, LOCK_EX | LOCK_NB) == -1) {
 		glc_log(file->glc, GLC_ERROR, "file",
@@ -135,77 +586,378 @@ int file_set_target(file_t file, int fd)
 	}
 
 	/* truncate file when we have locked it */
-	lseek(file->fd, 0, SEEK_SET);
-	ftruncate(file->fd, 0);
+	lseek(fd, 0, SEEK_SET);
+	ftruncate(fd, 0);
 
-	file->fd = fd;
-	file->flags |= FILE_WRITING;
+	if (fcntl(fd, F_GETFL) & O_DIRECT) {
+		if ((ret = direct_init(&target->writer, file->glc, fd))) {
+			flock(fd, LOCK_UN);
+			return ret;
+		}
+	}
+
+	target->fd = fd;
 	return 0;
 }
 
-int file_close_target(file_t file)
+void file_target_set(file_t file, struct file_target_s *target)
 {
-	if ((file->fd < 0) | (file->flags & FILE_RUNNING) |
-	    (!(file->flags & FILE_WRITING)))
-		return EAGAIN;
+	file->fd = target->fd;
+	file->writer = target->writer;
+	file->stripe = target->stripe;
+	file->allocated = target->allocated;
+	file->written = file->writeback_start = 0;
+	file->index_name = target->index_name;
+	file->index_fd = target->index_fd;
+	if (target->name)
+		free(target->name);
+
+	file->flags |= FILE_WRITING;
+	file_index_reset(file);
+
+	/* segment prepared for previous target has wrong name */
+	if (file->segment_running) {
+		pthread_mutex_lock(&file->segment_mutex);
+		file->segment = 0;
+		file->segment_reset = 1;
+		pthread_cond_broadcast(&file->segment_cond);
+		pthread_mutex_unlock(&file->segment_mutex);
+	}
+}
+
+void file_target_close(file_t file, struct file_target_s *target, int indexed)
+{
+	int fd[STRIPE_MAX];
+	unsigned int i, count = 0;
+	struct stat st;
+	int ret;
+
+	if (target->writer) {
+		if ((ret = direct_destroy(target->writer)))
+			glc_log(file->glc, GLC_ERROR, "file",
+				 "can't write file: %s (%d)", strerror(ret), ret);
+		target->writer = NULL;
+	}
+
+	if (target->stripe) {
+		count = stripe_count(target->stripe);
+		for (i = 1; i < count; i++)
+			fd[i] = stripe_fd(target->stripe, i);
+
+		if ((ret = stripe_destroy(target->stripe)))
+			glc_log(file->glc, GLC_ERROR, "file",
+				 "can't write stripes: %s (%d)", strerror(ret), ret);
+		target->stripe = NULL;
+
+		/* first stripe is closed like any other target */
+		for (i = 1; i < count; i++) {
+			if ((file->sync) && (fdatasync(fd[i]) == -1))
+				glc_log(file->glc, GLC_ERROR, "file",
+					 "can't sync stripe %u: %s (%d)", i, strerror(errno), errno);
+			flock(fd[i], LOCK_UN);
+			if (close(fd[i]))
+				glc_log(file->glc, GLC_ERROR, "file",
+					 "can't close stripe %u: %s (%d)", i, strerror(errno), errno);
+		}
+	}
+
+	/* truncating to current size releases preallocated space after end of file */
+	if ((target->allocated) && (target->allocated != FILE_NO_PREALLOC) &&
+	    (!fstat(target->fd, &st)) && (target->allocated > (u_int64_t) st.st_size))
+		ftruncate(target->fd, st.st_size);
+
+	if ((file->sync) && (fdatasync(target->fd) == -1))
+		glc_log(file->glc, GLC_ERROR, "file",
+			 "can't sync file: %s (%d)", strerror(errno), errno);
 
 	/* try to remove lock */
-	if (flock(file->fd, LOCK_UN) == -1)
+	if (flock(target->fd, LOCK_UN) == -1)
 		glc_log(file->glc, GLC_WARNING,
 			 "file", "can't unlock file: %s (%d)",
 			 strerror(errno), errno);
 
-	if (close(file->fd))
+	if (close(target->fd))
 		glc_log(file->glc, GLC_ERROR, "file",
 			 "can't close file: %s (%d)",
 			 strerror(errno), errno);
+	target->fd = -1;
 
-	file->fd = -1;
-	file->flags &= ~(FILE_RUNNING | FILE_WRITING | FILE_INFO_WRITTEN);
+	if (target->index_fd >= 0) {
+		close(target->index_fd);
+		target->index_fd = -1;
+	}
 
-	return 0;
+	if (target->index_name) {
+		if (indexed)
+			unlink(target->index_name);
+		free(target->index_name);
+		target->index_name = NULL;
+	}
+
+	if (target->name) {
+		free(target->name);
+		target->name = NULL;
+	}
 }
 
 int file_write_info(file_t file, glc_stream_info_t *info,
 		    const char *info_name, const char *info_date)
 {
+	struct iovec iov[3];
+	int ret;
+
 	if ((file->fd < 0) | (file->flags & FILE_RUNNING) |
 	    (!(file->flags & FILE_WRITING)))
 		return EAGAIN;
 
-	if (write(file->fd, info, sizeof(glc_stream_info_t)) != sizeof(glc_stream_info_t))
-		goto err;
-	if (write(file->fd, info_name, info->name_size) != info->name_size)
-		goto err;
-	if (write(file->fd, info_date, info->date_size) != info->date_size)
+	iov[0].iov_base = info;
+	iov[0].iov_len = sizeof(glc_stream_info_t);
+	iov[1].iov_base = (void *) info_name;
+	iov[1].iov_len = info->name_size;
+	iov[2].iov_base = (void *) info_date;
+	iov[2].iov_len = info->date_size;
+
+	if ((ret = file_write_vec(file, iov, 3)))
 		goto err;
 
+	/* segments start with same information */
+	if (info != &file->info) {
+		memcpy(&file->info, info, sizeof(glc_stream_info_t));
+		file->info_name = (char *) realloc(file->info_name, info->name_size);
+		memcpy(file->info_name, info_name, info->name_size);
+		file->info_date = (char *) realloc(file->info_date, info->date_size);
+		memcpy(file->info_date, info_date, info->date_size);
+	}
+
 	file->flags |= FILE_INFO_WRITTEN;
 	return 0;
 err:
 	glc_log(file->glc, GLC_ERROR, "file",
 		 "can't write stream information: %s (%d)",
-		 strerror(errno), errno);
-	return errno;
+		 strerror(ret), ret);
+	return ret;
 }
 
 int file_write_message(file_t file, glc_message_header_t *header, void *message, size_t message_size)
 {
 	glc_size_t glc_size = (glc_size_t) message_size;
+	struct iovec iov[3];
 
-	if (write(file->fd, &glc_size, sizeof(glc_size_t)) != sizeof(glc_size_t))
-		goto err;
-	if (write(file->fd, header, sizeof(glc_message_header_t))
-		!= sizeof(glc_message_header_t))
-		goto err;
-	if (message_size > 0) {
-		if (write(file->fd, message, message_size) != message_size)
-			goto err;
+	iov[0].iov_base = &glc_size;
+	iov[0].iov_len = sizeof(glc_size_t);
+	iov[1].iov_base = header;
+	iov[1].iov_len = sizeof(glc_message_header_t);
+	iov[2].iov_base = message;
+	iov[2].iov_len = message_size;
+
+	return file_write_vec(file, iov, message_size > 0 ? 3 : 2);
+}
+
+int file_write_packet(file_t file, struct iovec *iov, int iovcnt)
+{
+	struct iovec vec[4];
+	size_t size = 0;
+	int i, ret;
+
+	/* staging buffers of direct and stripe writers already batch writes */
+	if ((file->writer) || (file->stripe))
+		return file_write_vec(file, iov, iovcnt);
+
+	for (i = 0; i < iovcnt; i++)
+		size += iov[i].iov_len;
+	file->offset += size;
+
+	if (file->batch_used + size <= file->batch_size) {
+		if (!file->batch_used)
+			file->batch_start = glc_state_time(file->glc);
+
+		for (i = 0; i < iovcnt; i++) {
+			memcpy(&file->batch[file->batch_used], iov[i].iov_base, iov[i].iov_len);
+			file->batch_used += iov[i].iov_len;
+		}
+
+		if (glc_state_time(file->glc) - file->batch_start >= file->batch_time)
+			return file_flush(file);
+		return 0;
+	}
+
+	/* packet doesn't fit, write it and queued packets with one call */
+	vec[0].iov_base = file->batch;
+	vec[0].iov_len = file->batch_used;
+	memcpy(&vec[1], iov, sizeof(struct iovec) * iovcnt);
+
+	if (file->batch_used)
+		ret = file_write_target(file, vec, iovcnt + 1);
+	else
+		ret = file_write_target(file, &vec[1], iovcnt);
+	file->batch_used = 0;
+
+	return ret;
+}
+
+int file_flush(file_t file)
+{
+	struct iovec iov;
+	int ret;
+
+	file_index_sync(file);
+
+	if (file->writer) {
+		ret = direct_flush(file->writer);
+
+		/* truncating released preallocated extents too */
+		if ((file->allocated != FILE_NO_PREALLOC) && (file->allocated > file->offset))
+			file->allocated = file->offset;
+		return ret;
+	}
+	if (file->stripe)
+		return stripe_flush(file->stripe);
+
+	if (!file->batch_used)
+		return 0;
+
+	iov.iov_base = file->batch;
+	iov.iov_len = file->batch_used;
+	file->batch_used = 0;
+
+	return file_write_target(file, &iov, 1);
+}
+
+int file_idle_callback(glc_thread_state_t *state)
+{
+	file_t file = (file_t) state->ptr;
+	glc_utime_t elapsed;
+
+	if (!file->batch_used)
+		return 0;
+
+	/* no packet arrived in time, write queued packets now */
+	elapsed = glc_state_time(file->glc) - file->batch_start;
+	if (elapsed >= file->batch_time)
+		return file_flush(file);
+
+	usleep(file->batch_time - elapsed);
+	return EAGAIN;
+}
+
+int file_write_vec(file_t file, struct iovec *iov, int iovcnt)
+{
+	int i, ret;
+
+	for (i = 0; i < iovcnt; i++)
+		file->offset += iov[i].iov_len;
+
+	if (file->stripe) {
+		for (i = 0; i < iovcnt; i++) {
+			if ((ret = stripe_write(file->stripe, iov[i].iov_base, iov[i].iov_len)))
+				return ret;
+		}
+		return 0;
+	}
+
+	if (!file->writer)
+		return file_write_target(file, iov, iovcnt);
+
+	file_preallocate(file, file->offset);
+	for (i = 0; i < iovcnt; i++) {
+		if ((ret = direct_write(file->writer, iov[i].iov_base, iov[i].iov_len)))
+			return ret;
+	}
+
+	return 0;
+}
+
+int file_write_target(file_t file, struct iovec *iov, int iovcnt)
+{
+	size_t size = 0;
+	int i, ret;
+
+	for (i = 0; i < iovcnt; i++)
+		size += iov[i].iov_len;
+
+	file_preallocate(file, file->written + size);
+	if ((ret = file_writev(file->fd, iov, iovcnt)))
+		return ret;
+
+	file->written += size;
+	file_writeback(file);
+	return 0;
+}
+
+void file_preallocate(file_t file, u_int64_t end)
+{
+	u_int64_t size = 0;
+
+	if ((!file->prealloc) || (file->allocated == FILE_NO_PREALLOC) ||
+	    (end <= file->allocated))
+		return;
+
+	/* allocate next extents, keeping file size unchanged */
+	while (file->allocated + size < end)
+		size += file->prealloc;
+
+	if (fallocate(file->fd, FALLOC_FL_KEEP_SIZE, file->allocated, size) == -1) {
+		glc_log(file->glc, GLC_INFORMATION, "file",
+			 "can't preallocate: %s (%d)", strerror(errno), errno);
+		file->allocated = FILE_NO_PREALLOC;
+		return;
+	}
+
+	file->allocated += size;
+}
+
+void file_writeback(file_t file)
+{
+	u_int64_t start;
+
+	if (!file->writeback)
+		return;
+
+	while (file->written - file->writeback_start >= file->writeback) {
+		start = file->writeback_start;
+
+		/* start writing finished range, sync mode waits until it is written */
+		sync_file_range(file->fd, start, file->writeback, SYNC_FILE_RANGE_WRITE |
+				(file->sync ? SYNC_FILE_RANGE_WAIT_AFTER : 0));
+
+		/* previous range is usually written by now, drop it from page cache */
+		if (start >= file->writeback) {
+			sync_file_range(file->fd, start - file->writeback, file->writeback,
+					SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE |
+					SYNC_FILE_RANGE_WAIT_AFTER);
+			posix_fadvise(file->fd, start - file->writeback, file->writeback,
+				      POSIX_FADV_DONTNEED);
+		}
+
+		file->writeback_start += file->writeback;
+	}
+}
+
+int file_writev(int fd, struct iovec *iov, int iovcnt)
+{
+	ssize_t ret;
+
+	while (iovcnt) {
+		if ((ret = writev(fd, iov, iovcnt)) == -1) {
+			if (errno == EINTR)
+				continue;
+			return errno;
+		}
+
+		/* skip written buffers and continue short write */
+		while ((iovcnt) && ((size_t) ret >= iov->iov_len)) {
+			ret -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+
+		if (iovcnt) {
+			iov->iov_base = (char *) iov->iov_base + ret;
+			iov->iov_len -= ret;
+		}
 	}
 
 	return 0;
-err:
-	return errno;
 }
 
 int file_write_eof(file_t file)
@@ -223,6 +975,7 @@ int file_write_eof(file_t file)
 	if ((ret = file_write_message(file, &hdr, NULL, 0)))
 		goto err;
 
+	file->flags |= FILE_EOF_WRITTEN;
 	return 0;
 err:
 	glc_log(file->glc, GLC_ERROR, "file",
@@ -257,16 +1010,290 @@ err:
 	return ret;
 }
 
+char *file_index_alloc(file_t file, size_t size)
+{
+	size_t index_size = file->index_size ? file->index_size : FILE_INDEX_SYNC_SIZE;
+	char *index;
+
+	while (file->index_used + size > index_size)
+		index_size *= 2;
+
+	if (index_size != file->index_size) {
+		if (!(index = (char *) realloc(file->index, index_size)))
+			return NULL;
+		file->index = index;
+		file->index_size = index_size;
+	}
+
+	index = &file->index[file->index_used];
+	file->index_used += size;
+	return index;
+}
+
+int file_index_record(file_t file, glc_message_type_t type, const void *data, size_t size)
+{
+	glc_size_t glc_size = (glc_size_t) size;
+	glc_message_header_t header;
+	char *record;
+
+	if (!(record = file_index_alloc(file, sizeof(glc_size_t) +
+					      sizeof(glc_message_header_t) + size)))
+		return ENOMEM;
+
+	header.type = type;
+	memcpy(record, &glc_size, sizeof(glc_size_t));
+	memcpy(&record[sizeof(glc_size_t)], &header, sizeof(glc_message_header_t));
+	if (size)
+		memcpy(&record[sizeof(glc_size_t) + sizeof(glc_message_header_t)], data, size);
+
+	return 0;
+}
+
+int file_index_state_callback(glc_message_header_t *header, void *message, size_t message_size, void *arg)
+{
+	file_t file = arg;
+	return file_index_record(file, header->type, message, message_size);
+}
+
+int file_index_state(file_t file)
+{
+	size_t start = file->index_used;
+	glc_size_t glc_size;
+	int ret;
+
+	/* snapshot record contains state messages as its data */
+	if ((ret = file_index_record(file, GLC_INDEX_STATE, NULL, 0)))
+		return ret;
+	if ((ret = tracker_iterate_state(file->state_tracker, &file_index_state_callback, file))) {
+		file->index_used = start;
+		return ret;
+	}
+
+	glc_size = file->index_used - start - sizeof(glc_size_t) - sizeof(glc_message_header_t);
+	memcpy(&file->index[start], &glc_size, sizeof(glc_size_t));
+	file->index_states++;
+
+	return 0;
+}
+
+glc_message_type_t file_packet_type(glc_message_header_t *header, char *data)
+{
+	glc_message_type_t type = header->type;
+
+	if (type == GLC_MESSAGE_CONTAINER) {
+		type = ((glc_container_message_header_t *) data)->header.type;
+		data = &data[sizeof(glc_container_message_header_t)];
+	}
+
+	/* all compressed message headers start with size and original header */
+	if ((type == GLC_MESSAGE_LZO) | (type == GLC_MESSAGE_QUICKLZ) |
+	    (type == GLC_MESSAGE_LZJB) | (type == GLC_MESSAGE_LZ4) |
+	    (type == GLC_MESSAGE_ZSTD) | (type == GLC_MESSAGE_SLICES) |
+	    (type == GLC_MESSAGE_PREDICTED) | (type == GLC_MESSAGE_RICE) |
+	    (type == GLC_MESSAGE_DCT))
+		type = ((glc_lz4_header_t *) data)->header.type;
+
+	return type;
+}
+
+glc_utime_t file_packet_time(file_t file, glc_thread_state_t *state)
+{
+	glc_container_message_header_t *container;
+	glc_utime_t time;
+
+	if (state->header.type == GLC_MESSAGE_CONTAINER) {
+		/* pack passes packet time after compressed message */
+		container = (glc_container_message_header_t *) state->read_data;
+		if (state->read_size >= sizeof(glc_container_message_header_t)
+					+ container->size + sizeof(glc_utime_t)) {
+			memcpy(&time, &state->read_data[sizeof(glc_container_message_header_t)
+							+ container->size],
+			       sizeof(glc_utime_t));
+			return time;
+		}
+	} else if (state->header.type == GLC_MESSAGE_VIDEO_FRAME)
+		return ((glc_video_frame_header_t *) state->read_data)->time;
+	else if (state->header.type == GLC_MESSAGE_VIDEO_TILES)
+		return ((glc_video_tiles_header_t *) state->read_data)->time;
+	else if (state->header.type == GLC_MESSAGE_VIDEO_REPEAT)
+		return ((glc_video_repeat_message_t *) state->read_data)->time;
+	else if (state->header.type == GLC_MESSAGE_AUDIO_DATA)
+		return ((glc_audio_data_header_t *) state->read_data)->time;
+
+	/* message was captured before it is written */
+	return glc_state_time(file->glc);
+}
+
+int file_random_access(file_t file, glc_message_type_t type)
+{
+	int ret;
+
+	/*
+	 Keyframe is a random access point for all streams. Once delta
+	 coded frames are seen, other video frames aren't: deltas after
+	 them may still refer to earlier frames of any stream. Tiles and
+	 repeats refer to earlier frames too, but keyframes don't restart
+	 them, so then only points following a callback request are safe.
+	*/
+	if ((type == GLC_MESSAGE_VIDEO_TILES) | (type == GLC_MESSAGE_VIDEO_REPEAT)) {
+		file->index_video = file->index_delta = file->index_tiles = 1;
+		ret = 0;
+	} else if ((type == GLC_MESSAGE_VIDEO_KEYFRAME) | (type == GLC_MESSAGE_VIDEO_REFRESH) |
+		   (type == GLC_MESSAGE_VIDEO_DELTA)) {
+		file->index_video = file->index_delta = 1;
+		ret = (type == GLC_MESSAGE_VIDEO_KEYFRAME) && (!file->index_tiles);
+	} else if (type == GLC_MESSAGE_VIDEO_FRAME) {
+		file->index_video = 1;
+		ret = !file->index_delta;
+	} else {
+		/* audio data is used only if stream has no video */
+		ret = (type == GLC_MESSAGE_AUDIO_DATA) && (!file->index_video);
+	}
+
+	/* filters restart inter-frame coding at callback requests */
+	if (file->index_refresh) {
+		file->index_refresh = 0;
+		ret = 1;
+	}
+
+	return ret;
+}
+
+int file_refresh_due(file_t file)
+{
+	/* segment must start at a random access point */
+	if ((file->segment_running) && (file_segment_due(file)))
+		return 1;
+
+	/* tiles have no keyframes, without refresh index would stop growing */
+	return (file->index_tiles) &&
+	       (glc_state_time(file->glc) - file->index_time >= FILE_REFRESH_INTERVAL);
+}
+
+int file_index_packet(file_t file, glc_utime_t time)
+{
+	glc_index_entry_t entry;
+	int ret;
+
+	/* streams are interleaved, file_seek_time() needs entries in time order */
+	entry.time = time;
+	if ((file->index_entries) &&
+	    ((entry.time < file->index_time) ||
+	     ((!file->index_state_changed) &&
+	      (entry.time - file->index_time < FILE_INDEX_INTERVAL))))
+		return 0;
+
+	if (file->index_state_changed) {
+		if ((ret = file_index_state(file)))
+			return ret;
+		file->index_state_changed = 0;
+	}
+
+	entry.offset = file->offset;
+	entry.state = file->index_states ? file->index_states - 1 : GLC_INDEX_NO_STATE;
+	if ((ret = file_index_record(file, GLC_INDEX_ENTRY, &entry, sizeof(glc_index_entry_t))))
+		return ret;
+
+	file->index_time = entry.time;
+	file->index_entries++;
+
+	if (file->index_used - file->index_synced >= FILE_INDEX_SYNC_SIZE)
+		return file_index_sync(file);
+	return 0;
+}
+
+void file_index_reset(file_t file)
+{
+	file->offset = 0;
+	file->index_used = file->index_synced = 0;
+	file->index_states = file->index_entries = 0;
+	/* first random access point carries state snapshot */
+	file->index_state_changed = 1;
+}
+
+int file_index_sync(file_t file)
+{
+	struct iovec iov;
+	int ret;
+
+	if ((!file->index_name) || (file->index_synced == file->index_used))
+		return 0;
+
+	if (file->index_fd < 0) {
+		file->index_fd = open(file->index_name, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+		if (file->index_fd == -1) {
+			ret = errno;
+			goto err;
+		}
+	}
+
+	iov.iov_base = &file->index[file->index_synced];
+	iov.iov_len = file->index_used - file->index_synced;
+	if ((ret = file_writev(file->index_fd, &iov, 1)))
+		goto err;
+
+	file->index_synced = file->index_used;
+	return 0;
+err:
+	/* stream itself is fine without sidecar index */
+	glc_log(file->glc, GLC_WARNING, "file", "can't write index to %s: %s (%d)",
+		 file->index_name, strerror(ret), ret);
+
+	if (file->index_fd >= 0) {
+		close(file->index_fd);
+		file->index_fd = -1;
+	}
+	unlink(file->index_name);
+	free(file->index_name);
+	file->index_name = NULL;
+
+	return 0;
+}
+
+int file_write_index(file_t file)
+{
+	glc_index_footer_t footer;
+	struct iovec iov[2];
+
+	footer.signature = GLC_INDEX_SIGNATURE;
+	footer.size = file->index_used;
+
+	iov[0].iov_base = file->index;
+	iov[0].iov_len = file->index_used;
+	iov[1].iov_base = &footer;
+	iov[1].iov_len = sizeof(glc_index_footer_t);
+
+	return file_write_vec(file, file->index_used ? iov : &iov[1],
+			      file->index_used ? 2 : 1);
+}
+
 int file_write_process_start(file_t file, ps_buffer_t *from)
 {
+	char *batch;
 	int ret;
 	if ((file->fd < 0) | (file->flags & FILE_RUNNING) |
 	    (!(file->flags & FILE_WRITING)) |
 	    (!(file->flags & FILE_INFO_WRITTEN)))
 		return EAGAIN;
 
-	if ((ret = glc_thread_create(file->glc, &file->thread, from, NULL)))
+	/* batch size may have changed since last capture */
+	if (file->batch_size) {
+		if (!(batch = (char *) realloc(file->batch, file->batch_size)))
+			return ENOMEM;
+		file->batch = batch;
+	}
+	file->batch_used = 0;
+
+	if ((file->segment_name) && ((file->segment_size) || (file->segment_time))) {
+		if ((ret = file_segment_start(file)))
+			return ret;
+	}
+
+	if ((ret = glc_thread_create(file->glc, &file->thread, from, NULL))) {
+		if (file->segment_running)
+			file_segment_stop(file);
 		return ret;
+	}
 	/** \todo cancel buffer if this fails? */
 	file->flags |= FILE_RUNNING;
 
@@ -283,15 +1310,227 @@ int file_write_process_wait(file_t file)
 	glc_thread_wait(&file->thread);
 	file->flags &= ~(FILE_RUNNING | FILE_INFO_WRITTEN);
 
+	if (file->segment_running)
+		file_segment_stop(file);
+
+	return 0;
+}
+
+int file_segment_start(file_t file)
+{
+	int ret;
+
+	file->segment = 0;
+	file->segment_stop = file->segment_reset = 0;
+	file->old = file->old_last = NULL;
+	file->segment_start = glc_state_time(file->glc);
+	/* open next segment right away */
+	file->next_state = FILE_SEGMENT_REQUESTED;
+
+	pthread_mutex_init(&file->segment_mutex, NULL);
+	pthread_cond_init(&file->segment_cond, NULL);
+
+	if ((ret = pthread_create(&file->segment_thread, NULL, file_segment_thread, file))) {
+		pthread_cond_destroy(&file->segment_cond);
+		pthread_mutex_destroy(&file->segment_mutex);
+		return ret;
+	}
+
+	file->segment_running = 1;
+	return 0;
+}
+
+void file_segment_stop(file_t file)
+{
+	pthread_mutex_lock(&file->segment_mutex);
+	file->segment_stop = 1;
+	pthread_cond_broadcast(&file->segment_cond);
+	pthread_mutex_unlock(&file->segment_mutex);
+
+	pthread_join(file->segment_thread, NULL);
+
+	/* remove unused segment */
+	if (file->next_state == FILE_SEGMENT_READY) {
+		file_target_unlink(&file->next);
+		file_target_close(file, &file->next, 0);
+	}
+	file->next_state = FILE_SEGMENT_NONE;
+
+	pthread_cond_destroy(&file->segment_cond);
+	pthread_mutex_destroy(&file->segment_mutex);
+	file->segment_running = 0;
+}
+
+int file_segment_due(file_t file)
+{
+	if ((file->segment_size) && (file->offset >= file->segment_size))
+		return 1;
+	if ((file->segment_time) &&
+	    (glc_state_time(file->glc) - file->segment_start >= file->segment_time))
+		return 1;
 	return 0;
 }
 
+int file_segment_switch(file_t file)
+{
+	struct file_target_s *old;
+	glc_message_header_t hdr;
+	struct iovec iov[3];
+	int ret;
+
+	pthread_mutex_lock(&file->segment_mutex);
+	if (file->next_state == FILE_SEGMENT_REQUESTED)
+		glc_log(file->glc, GLC_WARNING, "file",
+			 "next segment is not ready, waiting");
+	while ((file->next_state == FILE_SEGMENT_REQUESTED) ||
+	       (file->segment_reset))
+		pthread_cond_wait(&file->segment_cond, &file->segment_mutex);
+
+	if (file->next_state != FILE_SEGMENT_READY) {
+		pthread_mutex_unlock(&file->segment_mutex);
+		glc_log(file->glc, GLC_ERROR, "file",
+			 "can't open next segment, segmentation disabled");
+		file->segment_size = 0;
+		file->segment_time = 0;
+		return 0;
+	}
+	pthread_mutex_unlock(&file->segment_mutex);
+
+	if (!(old = (struct file_target_s *) malloc(sizeof(struct file_target_s))))
+		return ENOMEM;
+
+	/* finish current segment, direct and stripe writers flush when closed */
+	if ((!file->writer) && (!file->stripe) && (ret = file_flush(file)))
+		goto err;
+	hdr.type = GLC_MESSAGE_CLOSE;
+	if ((ret = file_write_message(file, &hdr, NULL, 0)))
+		goto err;
+	if ((ret = file_write_index(file)))
+		goto err;
+
+	old->fd = file->fd;
+	old->writer = file->writer;
+	old->stripe = file->stripe;
+	old->allocated = file->allocated;
+	old->name = NULL;
+	old->index_name = file->index_name;
+	old->index_fd = file->index_fd;
+	old->close_next = NULL;
+
+	/* swap targets, closing is queued to helper thread */
+	pthread_mutex_lock(&file->segment_mutex);
+	if (file->old_last)
+		file->old_last->close_next = old;
+	else
+		file->old = old;
+	file->old_last = old;
+
+	file->fd = file->next.fd;
+	file->writer = file->next.writer;
+	file->stripe = file->next.stripe;
+	file->allocated = file->next.allocated;
+	file->written = file->writeback_start = 0;
+	file->index_name = file->next.index_name;
+	file->index_fd = file->next.index_fd;
+	free(file->next.name);
+	file->next_state = FILE_SEGMENT_REQUESTED;
+	file->segment++;
+
+	pthread_cond_broadcast(&file->segment_cond);
+	pthread_mutex_unlock(&file->segment_mutex);
+
+	file_index_reset(file);
+	file->segment_start = glc_state_time(file->glc);
+
+	glc_log(file->glc, GLC_INFORMATION, "file", "started segment %u", file->segment);
+
+	/* segment starts with stream information and current state */
+	iov[0].iov_base = &file->info;
+	iov[0].iov_len = sizeof(glc_stream_info_t);
+	iov[1].iov_base = file->info_name;
+	iov[1].iov_len = file->info.name_size;
+	iov[2].iov_base = file->info_date;
+	iov[2].iov_len = file->info.date_size;
+	if ((ret = file_write_vec(file, iov, 3)))
+		return ret;
+
+	return tracker_iterate_state(file->state_tracker, &file_write_state_callback, file);
+err:
+	free(old);
+	return ret;
+}
+
+void *file_segment_thread(void *argptr)
+{
+	file_t file = (file_t) argptr;
+	struct file_target_s target, *old;
+	unsigned int segment;
+	char *filename;
+	int ret;
+
+	pthread_mutex_lock(&file->segment_mutex);
+	for (;;) {
+		while ((!file->segment_stop) && (!file->old) && (!file->segment_reset) &&
+		       (file->next_state != FILE_SEGMENT_REQUESTED))
+			pthread_cond_wait(&file->segment_cond, &file->segment_mutex);
+
+		if (file->old) {
+			/* writer keeps going while old segments are closed */
+			old = file->old;
+			if (!(file->old = old->close_next))
+				file->old_last = NULL;
+			pthread_mutex_unlock(&file->segment_mutex);
+			file_target_close(file, old, 1);
+			free(old);
+			pthread_mutex_lock(&file->segment_mutex);
+		} else if (file->segment_reset) {
+			if (file->next_state == FILE_SEGMENT_READY) {
+				target = file->next;
+				pthread_mutex_unlock(&file->segment_mutex);
+				file_target_unlink(&target);
+				file_target_close(file, &target, 0);
+				pthread_mutex_lock(&file->segment_mutex);
+			}
+
+			file->next_state = FILE_SEGMENT_REQUESTED;
+			file->segment_reset = 0;
+			pthread_cond_broadcast(&file->segment_cond);
+		} else if (file->segment_stop)
+			break;
+		else {
+			segment = file->segment + 1;
+			pthread_mutex_unlock(&file->segment_mutex);
+
+			filename = file->segment_name(file->segment_arg, segment);
+			ret = file_target_open(file, &target, filename);
+			free(filename);
+
+			pthread_mutex_lock(&file->segment_mutex);
+			if (ret)
+				file->next_state = FILE_SEGMENT_FAILED;
+			else {
+				file->next = target;
+				file->next_state = FILE_SEGMENT_READY;
+			}
+			pthread_cond_broadcast(&file->segment_cond);
+		}
+	}
+	pthread_mutex_unlock(&file->segment_mutex);
+
+	return NULL;
+}
+
 void file_finish_callback(void *ptr, int err)
 {
 	file_t file = (file_t) ptr;
+	int ret;
 
 	if (err)
 		glc_log(file->glc, GLC_ERROR, "file", "%s (%d)", strerror(err), err);
+
+	if ((ret = file_flush(file)))
+		glc_log(file->glc, GLC_ERROR, "file", "can't flush: %s (%d)",
+			 strerror(ret), ret);
 }
 
 int file_read_callback(glc_thread_state_t *state)
@@ -300,41 +1539,77 @@ int file_read_callback(glc_thread_state_t *state)
 	glc_container_message_header_t *container;
 	glc_size_t glc_size;
 	glc_callback_request_t *callback_req;
+	glc_message_type_t type;
+	struct iovec iov[3];
+	int ret;
 
 	/* let state tracker to process this message */
 	tracker_submit(file->state_tracker, &state->header, state->read_data, state->read_size);
 
+	if ((state->header.type == GLC_MESSAGE_VIDEO_FORMAT) |
+	    (state->header.type == GLC_MESSAGE_AUDIO_FORMAT) |
+	    (state->header.type == GLC_MESSAGE_COLOR))
+		file->index_state_changed = 1;
+	else if (state->header.type == GLC_MESSAGE_CLOSE)
+		file->flags |= FILE_EOF_WRITTEN;
+	else if (state->header.type != GLC_CALLBACK_REQUEST) {
+		type = file_packet_type(&state->header, state->read_data);
+		if (file_random_access(file, type)) {
+			/* each segment starts with random access point */
+			if ((file->segment_running) && (file_segment_due(file))) {
+				if ((ret = file_segment_switch(file)))
+					goto err;
+			}
+
+			if ((ret = file_index_packet(file, file_packet_time(file, state))))
+				goto err;
+		} else if ((!file->refresh_requested) && (file_refresh_due(file))) {
+			/* tiles or deltas may not end on their own, ask for a refresh */
+			file->refresh_requested = 1;
+			glc_state_set(file->glc, GLC_STATE_REFRESH);
+		}
+	}
+
 	if (state->header.type == GLC_CALLBACK_REQUEST) {
+		file->index_refresh = 1;
+		file->refresh_requested = 0;
+
 		/* callback request messages are never written to disk */
-		if (file->callback != NULL) {
+		callback_req = (glc_callback_request_t *) state->read_data;
+		if ((file->callback != NULL) && (callback_req->arg != file)) {
+			/* queued packets belong to current target file */
+			if ((ret = file_flush(file)))
+				goto err;
+
 			/* callbacks may manipulate target file so remove FILE_RUNNING flag */
 			file->flags &= ~FILE_RUNNING;
-			callback_req = (glc_callback_request_t *) state->read_data;
 			file->callback(callback_req->arg);
 			file->flags |= FILE_RUNNING;
 		}
 	} else if (state->header.type == GLC_MESSAGE_CONTAINER) {
 		container = (glc_container_message_header_t *) state->read_data;
-		if (write(file->fd, state->read_data, sizeof(glc_container_message_header_t) + container->size)
-		    != (sizeof(glc_container_message_header_t) + container->size))
+		iov[0].iov_base = state->read_data;
+		iov[0].iov_len = sizeof(glc_container_message_header_t) + container->size;
+		if ((ret = file_write_packet(file, iov, 1)))
 			goto err;
 	} else {
 		/* emulate container message */
 		glc_size = state->read_size;
-		if (write(file->fd, &glc_size, sizeof(glc_size_t)) != sizeof(glc_size_t))
-			goto err;
-		if (write(file->fd, &state->header, sizeof(glc_message_header_t))
-		    != sizeof(glc_message_header_t))
-			goto err;
-		if (write(file->fd, state->read_data, state->read_size) != state->read_size)
+		iov[0].iov_base = &glc_size;
+		iov[0].iov_len = sizeof(glc_size_t);
+		iov[1].iov_base = &state->header;
+		iov[1].iov_len = sizeof(glc_message_header_t);
+		iov[2].iov_base = state->read_data;
+		iov[2].iov_len = state->read_size;
+		if ((ret = file_write_packet(file, iov, 3)))
 			goto err;
 	}
 
 	return 0;
 
 err:
-	glc_log(file->glc, GLC_ERROR, "file", "%s (%d)", strerror(errno), errno);
-	return errno;
+	glc_log(file->glc, GLC_ERROR, "file", "%s (%d)", strerror(ret), ret);
+	return ret;
 }
 
 int file_open_source(file_t file, const char *filename)
@@ -343,6 +1618,9 @@ int file_open_source(file_t file, const char *filename)
 	if (file->fd >= 0)
 		return EBUSY;
 
+	if (file_stripe_names(filename))
+		return file_open_stripes(file, filename);
+
 	glc_log(file->glc, GLC_INFORMATION, "file",
 		 "opening %s for reading stream", filename);
 
@@ -354,9 +1632,67 @@ int file_open_source(file_t file, const char *filename)
 		return errno;
 	}
 
-	if ((ret = file_set_source(file, fd)))
+	if ((ret = file_set_source(file, fd))) {
 		close(fd);
+		return ret;
+	}
+
+	/* sidecar index is used if stream has no index footer */
+	file->index_name = (char *) malloc(strlen(filename) + 5);
+	sprintf(file->index_name, "%s.idx", filename);
+
+	return 0;
+}
+
+int file_open_stripes(file_t file, const char *filename)
+{
+	int fd[STRIPE_MAX];
+	char *name[STRIPE_MAX + 1];
+	unsigned int i, count = 0;
+	char *names, *save;
+	int ret = 0;
+
+	glc_log(file->glc, GLC_INFORMATION, "file",
+		 "opening %s for reading striped stream", filename);
+
+	names = strdup(file_stripe_names(filename));
+	for (name[0] = strtok_r(names, ",", &save); name[count];
+	     name[count] = strtok_r(NULL, ",", &save)) {
+		if (count == STRIPE_MAX) {
+			glc_log(file->glc, GLC_ERROR, "file",
+				 "too many stripes, maximum is %d", STRIPE_MAX);
+			ret = EINVAL;
+			goto err;
+		}
 
+		if ((fd[count] = open(name[count], file->sync ? O_SYNC : 0)) == -1) {
+			ret = errno;
+			glc_log(file->glc, GLC_ERROR, "file", "can't open %s: %s (%d)",
+				 name[count], strerror(ret), ret);
+			goto err;
+		}
+		count++;
+	}
+
+	/* stripes are reassembled in order given by their headers */
+	if ((ret = stripe_open(&file->stripe, file->glc, fd, count)))
+		goto err;
+
+	file->fd = stripe_fd(file->stripe, 0);
+	file->stripe_pos = 0;
+	file->flags |= FILE_READING;
+
+	/* sidecar index is next to first stripe */
+	for (i = 0; fd[i] != file->fd; i++);
+	file->index_name = (char *) malloc(strlen(name[i]) + 5);
+	sprintf(file->index_name, "%s.idx", name[i]);
+
+	free(names);
+	return 0;
+err:
+	while (count--)
+		close(fd[count]);
+	free(names);
 	return ret;
 }
 
@@ -375,18 +1711,47 @@ int file_set_source(file_t file, int fd)
 
 int file_close_source(file_t file)
 {
+	unsigned int i;
+
 	if ((file->fd < 0) | (!(file->flags & FILE_READING)))
 		return EAGAIN;
 
+	if (file->stripe) {
+		for (i = 1; i < stripe_count(file->stripe); i++)
+			close(stripe_fd(file->stripe, i));
+		stripe_destroy(file->stripe);
+		file->stripe = NULL;
+	}
+
 	if (close(file->fd))
 		glc_log(file->glc, GLC_ERROR, "file",
 			 "can't close file: %s (%d)",
 			 strerror(errno), errno);
 
 	file->fd = -1;
-	file->flags &= ~(FILE_READING | FILE_INFO_READ | FILE_INFO_VALID);
+	file->flags &= ~(FILE_READING | FILE_INFO_READ | FILE_INFO_VALID |
+			 FILE_INDEX_READ);
+
+	if (file->index_name) {
+		free(file->index_name);
+		file->index_name = NULL;
+	}
 
-	return 0;	
+	if (file->entries) {
+		free(file->entries);
+		file->entries = NULL;
+	}
+
+	if (file->states) {
+		free(file->states);
+		file->states = NULL;
+	}
+
+	file->entry_count = file->state_count = 0;
+	file->index_used = 0;
+	file->seek_state = GLC_INDEX_NO_STATE;
+
+	return 0;
 }
 
 int file_test_stream_version(u_int32_t version)
@@ -394,6 +1759,12 @@ int file_test_stream_version(u_int32_t version)
 	/* current version is always supported */
 	if (version == GLC_STREAM_VERSION) {
 		return 0;
+	} else if (version == 0x04) {
+		/*
+		 0x05 only adds message types: video repeat, tiles, delta and
+		 refresh frames, GLC_MESSAGE_SLICES container and new codecs.
+		*/
+		return 0;
 	} else if (version == 0x03) {
 		/*
 		 0.5.5 was last version to use 0x03.
@@ -411,7 +1782,7 @@ int file_read_info(file_t file, glc_stream_info_t *info,
 	if ((file->fd < 0) | (!(file->flags & FILE_READING)))
 		return EAGAIN;
 
-	if (read(file->fd, info, sizeof(glc_stream_info_t)) != sizeof(glc_stream_info_t)) {
+	if (file_source_read(file, info, sizeof(glc_stream_info_t)) != sizeof(glc_stream_info_t)) {
 		glc_log(file->glc, GLC_ERROR, "file",
 			 "can't read stream info header");
 		return errno;
@@ -435,20 +1806,469 @@ int file_read_info(file_t file, glc_stream_info_t *info,
 
 	if (info->name_size > 0) {
 		*info_name = (char *) malloc(info->name_size);
-		if (read(file->fd, *info_name, info->name_size) != info->name_size)
+		if (file_source_read(file, *info_name, info->name_size) != info->name_size)
 			return errno;
 	}
 
 	if (info->date_size > 0) {
 		*info_date = (char *) malloc(info->date_size);
-		if (read(file->fd, *info_date, info->date_size) != info->date_size)
+		if (file_source_read(file, *info_date, info->date_size) != info->date_size)
 			return errno;
 	}
 
+	/* stream messages start here */
+	file->data_offset = file_source_seek(file, 0, SEEK_CUR);
+	file->seek_state = GLC_INDEX_NO_STATE;
+
 	file->flags |= FILE_INFO_VALID;
 	return 0;
 }
 
+int file_read_index(file_t file)
+{
+	glc_index_footer_t footer;
+	glc_index_entry_t entry;
+	glc_message_header_t header;
+	glc_size_t glc_size;
+	struct stat st;
+	u_int64_t limit, file_size;
+	size_t pos, data, size, max;
+	off_t offset;
+	char *index;
+	int fd, ret = 0;
+
+	if ((ret = file_source_size(file, &file_size)))
+		return ret;
+
+	if ((file_size >= file->data_offset + sizeof(glc_index_footer_t)) &&
+	    (file_source_pread(file, file->fd, &footer, sizeof(glc_index_footer_t),
+			       file_size - sizeof(glc_index_footer_t)) == sizeof(glc_index_footer_t)) &&
+	    (footer.signature == GLC_INDEX_SIGNATURE) &&
+	    (footer.size <= file_size - sizeof(glc_index_footer_t) - file->data_offset)) {
+		fd = file->fd;
+		size = footer.size;
+		offset = file_size - sizeof(glc_index_footer_t) - footer.size;
+		limit = offset;
+	} else if ((file->index_name) &&
+		   ((fd = open(file->index_name, O_RDONLY)) != -1)) {
+		glc_log(file->glc, GLC_INFORMATION, "file",
+			 "stream has no index, using %s", file->index_name);
+		if (fstat(fd, &st) == -1) {
+			ret = errno;
+			goto err;
+		}
+		size = st.st_size;
+		offset = 0;
+		/* stream may be longer than index */
+		limit = ~0;
+	} else
+		return ENOENT;
+
+	if (size > file->index_size) {
+		if (!(index = (char *) realloc(file->index, size))) {
+			ret = ENOMEM;
+			goto err;
+		}
+		file->index = index;
+		file->index_size = size;
+	}
+
+	if (file_source_pread(file, fd, file->index, size, offset) != size) {
+		ret = EBADMSG;
+		goto err;
+	}
+	file->index_used = size;
+
+	max = size / (sizeof(glc_size_t) + sizeof(glc_message_header_t)) + 1;
+	file->states = (size_t *) malloc(sizeof(size_t) * max);
+	file->entries = (glc_index_entry_t *) malloc(sizeof(glc_index_entry_t) * max);
+	file->state_count = file->entry_count = 0;
+
+	pos = 0;
+	while (pos + sizeof(glc_size_t) + sizeof(glc_message_header_t) <= size) {
+		memcpy(&glc_size, &file->index[pos], sizeof(glc_size_t));
+		memcpy(&header, &file->index[pos + sizeof(glc_size_t)], sizeof(glc_message_header_t));
+		data = pos + sizeof(glc_size_t) + sizeof(glc_message_header_t);
+
+		/* sidecar index may end with partial record */
+		if (glc_size > size - data)
+			break;
+
+		if (header.type == GLC_INDEX_STATE)
+			file->states[file->state_count++] = pos;
+		else if ((header.type == GLC_INDEX_ENTRY) &&
+			 (glc_size == sizeof(glc_index_entry_t))) {
+			memcpy(&entry, &file->index[data], sizeof(glc_index_entry_t));
+
+			/* skip entries pointing to data that never reached the file */
+			if ((entry.offset >= file->data_offset) && (entry.offset < limit) &&
+			    ((entry.state == GLC_INDEX_NO_STATE) || (entry.state < file->state_count)) &&
+			    ((!file->entry_count) ||
+			     ((entry.time >= file->entries[file->entry_count - 1].time) &&
+			      (entry.offset > file->entries[file->entry_count - 1].offset))))
+				memcpy(&file->entries[file->entry_count++], &entry,
+				       sizeof(glc_index_entry_t));
+		}
+
+		pos = data + glc_size;
+	}
+
+	if (limit == ~0) {
+		/* entry pointing beyond end of stream file is useless */
+		if ((ret = file_source_size(file, &file_size)))
+			goto err;
+		while ((file->entry_count) &&
+		       (file->entries[file->entry_count - 1].offset >= file_size))
+			file->entry_count--;
+		close(fd);
+	}
+
+	return 0;
+err:
+	if (fd != file->fd)
+		close(fd);
+	return ret;
+}
+
+int file_seek_time(file_t file, glc_utime_t time)
+{
+	size_t lo = 0, hi, mid;
+	u_int64_t offset;
+	int ret;
+
+	if ((file->fd < 0) | (!(file->flags & FILE_READING)))
+		return EAGAIN;
+
+	if (!(file->flags & FILE_INFO_VALID)) {
+		glc_log(file->glc, GLC_ERROR, "file",
+			 "stream info header not read");
+		return EAGAIN;
+	}
+
+	if (!(file->flags & FILE_INDEX_READ)) {
+		if ((ret = file_read_index(file))) {
+			glc_log(file->glc, GLC_ERROR, "file",
+				 "can't read index: %s (%d)", strerror(ret), ret);
+			return ret;
+		}
+
+		glc_log(file->glc, GLC_INFORMATION, "file",
+			 "index has %zd random access points", file->entry_count);
+		file->flags |= FILE_INDEX_READ;
+	}
+
+	/* last random access point at or before given time */
+	hi = file->entry_count;
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (file->entries[mid].time <= time)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo) {
+		offset = file->entries[lo - 1].offset;
+		file->seek_state = file->entries[lo - 1].state;
+	} else {
+		offset = file->data_offset;
+		file->seek_state = GLC_INDEX_NO_STATE;
+	}
+
+	glc_log(file->glc, GLC_DEBUG, "file",
+		 "seeking to %llu for time %llu",
+		 (unsigned long long) offset, (unsigned long long) time);
+
+	if (file_source_seek(file, offset, SEEK_SET) == (off_t) -1)
+		return errno;
+	return 0;
+}
+
+int file_read_state(file_t file, ps_packet_t *packet)
+{
+	size_t pos = file->states[file->seek_state];
+	glc_size_t glc_size;
+	size_t end;
+	int ret;
+
+	memcpy(&glc_size, &file->index[pos], sizeof(glc_size_t));
+	pos += sizeof(glc_size_t) + sizeof(glc_message_header_t);
+	end = pos + glc_size;
+
+	/* snapshot holds messages in stream format */
+	while (pos + sizeof(glc_size_t) + sizeof(glc_message_header_t) <= end) {
+		memcpy(&glc_size, &file->index[pos], sizeof(glc_size_t));
+		pos += sizeof(glc_size_t);
+		if (glc_size > end - pos - sizeof(glc_message_header_t))
+			return EBADMSG;
+
+		if ((ret = ps_packet_open(packet, PS_PACKET_WRITE)))
+			return ret;
+		if ((ret = ps_packet_write(packet, &file->index[pos],
+					   sizeof(glc_message_header_t) + glc_size)))
+			return ret;
+		if ((ret = ps_packet_close(packet)))
+			return ret;
+
+		pos += sizeof(glc_message_header_t) + glc_size;
+	}
+
+	return 0;
+}
+
+char *file_map(file_t file, struct file_map_s *map, off_t offset, size_t size)
+{
+	off_t start;
+	size_t len;
+
+	if ((map->addr) && (offset >= map->offset) &&
+	    (offset + size <= map->offset + map->size))
+		return &map->addr[offset - map->offset];
+
+	/* slide window forward, large packets get larger window */
+	if (map->addr)
+		munmap(map->addr, map->size);
+	map->addr = NULL;
+
+	start = offset - offset % sysconf(_SC_PAGESIZE);
+	len = FILE_MAP_SIZE;
+	if (len < offset - start + size)
+		len = offset - start + size;
+	if (len > map->file_size - start)
+		len = map->file_size - start;
+
+	map->addr = (char *) mmap(NULL, len, PROT_READ, MAP_SHARED, file->fd, start);
+	if (map->addr == MAP_FAILED) {
+		map->addr = NULL;
+		return NULL;
+	}
+	madvise(map->addr, len, MADV_SEQUENTIAL);
+
+	map->offset = start;
+	map->size = len;
+	return &map->addr[offset - start];
+}
+
+int file_read_map(file_t file, ps_packet_t *packet)
+{
+	struct file_map_s map;
+	struct file_readahead_s ahead;
+	glc_message_header_t header;
+	glc_size_t glc_ps;
+	struct stat st;
+	off_t pos, start, ahead_pos;
+	int ahead_running = 0;
+	char *data;
+	const size_t header_size = sizeof(glc_size_t) + sizeof(glc_message_header_t);
+	int ret = 0;
+
+	/* striped stream is not contiguous in any file */
+	if (file->stripe)
+		return ENOTSUP;
+	if ((fstat(file->fd, &st) == -1) || (!S_ISREG(st.st_mode)))
+		return ENOTSUP;
+	if ((start = pos = lseek(file->fd, 0, SEEK_CUR)) == (off_t) -1)
+		return ENOTSUP;
+
+	memset(&map, 0, sizeof(struct file_map_s));
+	map.file_size = st.st_size;
+
+	/* keep disk busy while consumers are working */
+	if ((file->readahead) &&
+	    (!file_readahead_start(&ahead, file->fd, file->readahead, pos, st.st_size)))
+		ahead_running = 1;
+	ahead_pos = pos;
+
+	do {
+		if (pos + header_size > map.file_size) {
+			ret = ENODATA;
+			break;
+		}
+
+		if (!(data = file_map(file, &map, pos, header_size))) {
+			ret = (pos == start) ? ENOTSUP : errno;
+			break;
+		}
+
+		if (file->stream_version == 0x03) {
+			/* old order */
+			memcpy(&header, data, sizeof(glc_message_header_t));
+			memcpy(&glc_ps, &data[sizeof(glc_message_header_t)], sizeof(glc_size_t));
+		} else {
+			memcpy(&glc_ps, data, sizeof(glc_size_t));
+			memcpy(&header, &data[sizeof(glc_size_t)], sizeof(glc_message_header_t));
+		}
+		pos += header_size;
+
+		if (glc_ps > map.file_size - pos) {
+			ret = ENODATA;
+			break;
+		}
+
+		if (!(data = file_map(file, &map, pos, glc_ps))) {
+			ret = errno;
+			break;
+		}
+
+		/* payload is copied directly from page cache */
+		if ((ret = ps_packet_open(packet, PS_PACKET_WRITE)))
+			break;
+		if ((ret = ps_packet_write(packet, &header, sizeof(glc_message_header_t))))
+			break;
+		if ((glc_ps) && (ret = ps_packet_write(packet, data, glc_ps)))
+			break;
+		if ((ret = ps_packet_close(packet)))
+			break;
+
+		pos += glc_ps;
+
+		if ((ahead_running) && (pos - ahead_pos >= FILE_READAHEAD_CHUNK)) {
+			file_readahead_update(&ahead, pos);
+			ahead_pos = pos;
+		}
+	} while ((header.type != GLC_MESSAGE_CLOSE) &&
+		 (!glc_state_test(file->glc, GLC_STATE_CANCEL)));
+
+	if (ahead_running)
+		file_readahead_stop(&ahead);
+
+	if (map.addr)
+		munmap(map.addr, map.size);
+
+	/* continue from here if file holds more streams */
+	if (ret != ENOTSUP)
+		lseek(file->fd, pos, SEEK_SET);
+
+	return ret;
+}
+
+int file_readahead_start(struct file_readahead_s *ahead, int fd, size_t depth,
+			 off_t pos, off_t end)
+{
+	int ret;
+
+	memset(ahead, 0, sizeof(struct file_readahead_s));
+	ahead->fd = fd;
+	ahead->depth = depth;
+	ahead->pos = ahead->done = pos;
+	ahead->end = end;
+
+	pthread_mutex_init(&ahead->mutex, NULL);
+	pthread_cond_init(&ahead->cond, NULL);
+
+	if ((ret = pthread_create(&ahead->thread, NULL, file_readahead_thread, ahead))) {
+		pthread_cond_destroy(&ahead->cond);
+		pthread_mutex_destroy(&ahead->mutex);
+	}
+
+	return ret;
+}
+
+void file_readahead_update(struct file_readahead_s *ahead, off_t pos)
+{
+	pthread_mutex_lock(&ahead->mutex);
+	ahead->pos = pos;
+	pthread_cond_signal(&ahead->cond);
+	pthread_mutex_unlock(&ahead->mutex);
+}
+
+void file_readahead_stop(struct file_readahead_s *ahead)
+{
+	pthread_mutex_lock(&ahead->mutex);
+	ahead->stop = 1;
+	pthread_cond_signal(&ahead->cond);
+	pthread_mutex_unlock(&ahead->mutex);
+
+	pthread_join(ahead->thread, NULL);
+	pthread_cond_destroy(&ahead->cond);
+	pthread_mutex_destroy(&ahead->mutex);
+}
+
+void *file_readahead_thread(void *argptr)
+{
+	struct file_readahead_s *ahead = (struct file_readahead_s *) argptr;
+	off_t offset;
+	size_t len;
+
+	pthread_mutex_lock(&ahead->mutex);
+	for (;;) {
+		while ((!ahead->stop) && ((ahead->done >= ahead->end) ||
+					  (ahead->done >= ahead->pos + (off_t) ahead->depth)))
+			pthread_cond_wait(&ahead->cond, &ahead->mutex);
+		if (ahead->stop)
+			break;
+
+		/* reader may have caught up */
+		if (ahead->done < ahead->pos)
+			ahead->done = ahead->pos;
+
+		offset = ahead->done;
+		len = FILE_READAHEAD_CHUNK;
+		if (len > ahead->end - offset)
+			len = ahead->end - offset;
+		ahead->done += len;
+		pthread_mutex_unlock(&ahead->mutex);
+
+		/* readahead() returns when pages are read, WILLNEED only queues them */
+		if (readahead(ahead->fd, offset, len) == -1)
+			posix_fadvise(ahead->fd, offset, len, POSIX_FADV_WILLNEED);
+
+		pthread_mutex_lock(&ahead->mutex);
+	}
+	pthread_mutex_unlock(&ahead->mutex);
+
+	return NULL;
+}
+
+ssize_t file_source_read(file_t file, void *buf, size_t size)
+{
+	ssize_t ret;
+
+	if (!file->stripe)
+		return read(file->fd, buf, size);
+
+	if ((ret = stripe_pread(file->stripe, buf, size, file->stripe_pos)) > 0)
+		file->stripe_pos += ret;
+	return ret;
+}
+
+ssize_t file_source_pread(file_t file, int fd, void *buf, size_t size, off_t offset)
+{
+	/* sidecar index is never striped */
+	if ((file->stripe) && (fd == file->fd))
+		return stripe_pread(file->stripe, buf, size, offset);
+	return pread(fd, buf, size, offset);
+}
+
+off_t file_source_seek(file_t file, off_t offset, int whence)
+{
+	if (!file->stripe)
+		return lseek(file->fd, offset, whence);
+
+	if (whence == SEEK_SET)
+		file->stripe_pos = offset;
+	else if (whence == SEEK_CUR)
+		file->stripe_pos += offset;
+	else {
+		errno = EINVAL;
+		return (off_t) -1;
+	}
+	return file->stripe_pos;
+}
+
+int file_source_size(file_t file, u_int64_t *size)
+{
+	struct stat st;
+
+	if (file->stripe)
+		return stripe_size(file->stripe, size);
+
+	if (fstat(file->fd, &st) == -1)
+		return errno;
+	*size = st.st_size;
+	return 0;
+}
+
 int file_read(file_t file, ps_buffer_t *to)
 {
 	int ret = 0;
@@ -476,18 +2296,35 @@ int file_read(file_t file, ps_buffer_t *to)
 
 	ps_packet_init(&packet, to);
 
+	/* state at random access point we seeked to */
+	if (file->seek_state != GLC_INDEX_NO_STATE) {
+		if ((ret = file_read_state(file, &packet)))
+			goto err;
+		file->seek_state = GLC_INDEX_NO_STATE;
+	}
+
+	/* regular files are read from memory mapping */
+	ret = file_read_map(file, &packet);
+	if (!ret)
+		goto finish;
+	else if (ret == ENODATA)
+		goto send_eof;
+	else if (ret != ENOTSUP)
+		goto err;
+	ret = 0;
+
 	do {
 		if (file->stream_version == 0x03) {
 			/* old order */
-			if (read(file->fd, &header, sizeof(glc_message_header_t)) != sizeof(glc_message_header_t))
+			if (file_source_read(file, &header, sizeof(glc_message_header_t)) != sizeof(glc_message_header_t))
 				goto send_eof;
-			if (read(file->fd, &glc_ps, sizeof(glc_size_t)) != sizeof(glc_size_t))
+			if (file_source_read(file, &glc_ps, sizeof(glc_size_t)) != sizeof(glc_size_t))
 				goto send_eof;
 		} else {
 			/* same header format as in container messages */
-			if (read(file->fd, &glc_ps, sizeof(glc_size_t)) != sizeof(glc_size_t))
+			if (file_source_read(file, &glc_ps, sizeof(glc_size_t)) != sizeof(glc_size_t))
 				goto send_eof;
-			if (read(file->fd, &header, sizeof(glc_message_header_t)) != sizeof(glc_message_header_t))
+			if (file_source_read(file, &header, sizeof(glc_message_header_t)) != sizeof(glc_message_header_t))
 				goto send_eof;
 		}
 
@@ -500,7 +2337,7 @@ int file_read(file_t file, ps_buffer_t *to)
 		if ((ret = ps_packet_dma(&packet, (void *) &dma, packet_size, PS_ACCEPT_FAKE_DMA)))
 			goto err;
 
-		if (read(file->fd, dma, packet_size) != packet_size)
+		if (file_source_read(file, dma, packet_size) != packet_size)
 			goto read_fail;
 
 		if ((ret = ps_packet_close(&packet)))
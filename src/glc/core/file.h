@@ -23,11 +23,23 @@
 extern "C" {
 #endif
 
+/** prefix of striped file name, "stripe:a.glc,b.glc" */
+#define FILE_STRIPE_PREFIX         "stripe:"
+
 /**
  * \brief file object
  */
 typedef struct file_s* file_t;
 
+/**
+ * \brief segment file name callback
+ * \param arg custom argument
+ * \param segment segment number, first segment following target
+ *                opened with file_open_target() is 1
+ * \return file name allocated with malloc()
+ */
+typedef char *(*file_segment_name_func_t)(void *arg, unsigned int segment);
+
 /**
  * \brief initialize file object
  * Writing is done in its own thread.
@@ -75,28 +87,116 @@ __PUBLIC int file_init(file_t *file, glc_t *glc);
 
 /**
  * \brief set sync mode
+ *
+ * In sync mode writer waits until each writeback range is written
+ * to device, and file is synchronized when it is closed. If writeback
+ * ranges are not used, file is opened with O_SYNC instead.
  * \note this must be set before opening file
  * \param file file object
- * \param sync 0 = no forced synchronization, 1 = force writing immediately to device
+ * \param sync 0 = no forced synchronization, 1 = wait for writeback
  * \return 0 on success otherwise an error code
  */
 __PUBLIC int file_set_sync(file_t file, int sync);
 
+/**
+ * \brief set preallocation extent size
+ *
+ * Space for target file is allocated with fallocate() in extents of
+ * size bytes ahead of writing, without changing file size. This
+ * keeps long recordings from fragmenting. Unused space is released
+ * when target is closed. Default is 64 MiB, 0 disables preallocation.
+ * \note this must be set before opening file
+ * \param file file object
+ * \param size extent size in bytes
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int file_set_preallocate(file_t file, size_t size);
+
+/**
+ * \brief set writeback range size
+ *
+ * Whenever size bytes have been written, writeback of that range
+ * is started with sync_file_range() and previous range is waited
+ * for and dropped from page cache, so capture doesn't fill memory
+ * with dirty pages. Not used with O_DIRECT. Default is 0, which
+ * leaves writeback to kernel.
+ * \note this must be set before opening file
+ * \param file file object
+ * \param size range size in bytes
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int file_set_writeback(file_t file, size_t size);
+
+/**
+ * \brief set direct io mode
+ *
+ * Target file is opened with O_DIRECT, so that stream doesn't fill
+ * page cache. Data is collected into aligned staging buffers which
+ * are written asynchronously using io_uring, or a pool of threads
+ * when io_uring is not available. If file system doesn't support
+ * O_DIRECT, file is written normally.
+ * \note this must be set before opening file
+ * \param file file object
+ * \param direct 0 = normal writes, 1 = direct io
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int file_set_direct(file_t file, int direct);
+
 /**
  * \brief set callback function
  * Callback is called when callback_request message is encountered
  * in stream.
+ *
+ * Filters restart inter-frame coding at callback requests, so the
+ * next packet is a random access point. When a segment is due, or a
+ * stream with tiles has had none for a while, GLC_STATE_REFRESH is
+ * set and capture should answer with a callback request whose arg
+ * is the file object. Such requests only mark random access points
+ * and are not passed to callback.
  * \param file file object
  * \param callback callback function address
  * \return 0 on success otherwise an error code
  */
 __PUBLIC int file_set_callback(file_t file, callback_request_func_t callback);
 
+/**
+ * \brief set write batching
+ *
+ * Packets are written with writev(). Packets that fit into batch
+ * buffer are queued and written together once the buffer fills up
+ * or the oldest queued packet is older than time, even if no more
+ * packets arrive. Larger packets are written with queued packets
+ * in a single call. Queue is flushed
+ * before callbacks and when write process finishes. Default is
+ * 256 KiB and 50 ms. Size 0 disables batching.
+ * \param file file object
+ * \param size batch buffer size in bytes
+ * \param time maximum time to hold packets, in microseconds
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int file_set_write_batch(file_t file, size_t size, glc_utime_t time);
+
+/**
+ * \brief set stripe chunk size
+ *
+ * Stream opened with FILE_STRIPE_PREFIX followed by a comma-separated
+ * list of files is striped over them in chunks of size bytes, see glc_stripe_header_t. Each file
+ * is written by its own thread, so putting files on different disks
+ * adds up their bandwidth. Striped target is always written through
+ * page cache and without preallocation. Default is 1 MiB.
+ * \note this must be set before opening file
+ * \param file file object
+ * \param size chunk size in bytes
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int file_set_stripe_size(file_t file, size_t size);
+
 /**
  * \brief open file for writing
  * \note this calls file_set_target()
  * \param file file object
- * \param filename target file
+ * \param filename target file, or FILE_STRIPE_PREFIX and comma-separated
+ *                 list of stripe files
  * \return 0 on success otherwise an error code
  */
 __PUBLIC int file_open_target(file_t file, const char *filename);
@@ -119,6 +219,31 @@ __PUBLIC int file_set_target(file_t file, int fd);
  */
 __PUBLIC int file_close_target(file_t file);
 
+/**
+ * \brief set automatic segmentation
+ *
+ * When current target has grown over size bytes or time
+ * microseconds have passed since it was opened, writing continues
+ * into next segment file at next video frame that doesn't depend on
+ * earlier frames. If no such frame comes, a refresh is requested
+ * from capture, see file_set_callback(). Segment is closed with EOF
+ * message and index like any complete stream, and next one starts
+ * with stream information and current state.
+ *
+ * Next segment file is opened in helper thread ahead of time and
+ * finished segment is closed there too, so writing only stalls if
+ * opening takes longer than a whole segment.
+ * \note this must be set before starting write process
+ * \param file file object
+ * \param size maximum segment size in bytes, 0 = no limit
+ * \param time maximum segment duration in microseconds, 0 = no limit
+ * \param name callback that returns file name for each segment
+ * \param arg custom argument to callback
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int file_set_segment(file_t file, u_int64_t size, glc_utime_t time,
+			      file_segment_name_func_t name, void *arg);
+
 /**
  * \brief write stream information header to file
  * \param file file object
@@ -166,7 +291,8 @@ __PUBLIC int file_write_process_wait(file_t file);
  *
  * \note this calls file_set_source()
  * \param file file object
- * \param filename source file
+ * \param filename source file, or FILE_STRIPE_PREFIX and comma-separated
+ *                 list of stripe files in any order
  * \return 0 on success otherwise an error code
  */
 __PUBLIC int file_open_source(file_t file, const char *filename);
@@ -199,6 +325,22 @@ __PUBLIC int file_close_source(file_t file);
 __PUBLIC int file_read_info(file_t file, glc_stream_info_t *info,
 			    char **info_name, char **info_date);
 
+/**
+ * \brief seek to random access point
+ *
+ * Index is read from footer, or from sidecar file if stream was
+ * not closed properly. Reading continues from last random access
+ * point at or before given time, state at that point is written
+ * into buffer first by file_read(). If there is no such point,
+ * reading continues from first message.
+ * \note file_read_info() must be called first
+ * \param file file object
+ * \param time time
+ * \return 0 on success, ENOENT if stream has no index, otherwise
+ *         an error code
+ */
+__PUBLIC int file_seek_time(file_t file, glc_utime_t time);
+
 /**
  * \brief test if given stream version is supported
  * \param version version to test
@@ -206,8 +348,25 @@ __PUBLIC int file_read_info(file_t file, glc_stream_info_t *info,
  */
 __PUBLIC int file_test_stream_version(u_int32_t version);
 
+/**
+ * \brief set readahead depth
+ *
+ * While reading regular files, a separate thread reads file
+ * into page cache up to size bytes ahead of file_read(), so disk
+ * io overlaps with processing of stream. Default is 32 MiB.
+ * Size 0 disables readahead.
+ * \param file file object
+ * \param size readahead depth in bytes
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int file_set_readahead(file_t file, size_t size);
+
 /**
  * \brief read stream from file and write it into buffer
+ *
+ * Regular files are mapped into memory in windows of 256 MiB and
+ * packets are copied from mapping into buffer without read() calls.
+ * Other files, like pipes, are read with read().
  * \param file file object
  * \param to buffer
  * \return 0 on success otherwise an error code
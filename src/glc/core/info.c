@@ -39,7 +39,7 @@ struct info_video_stream_s {
 	glc_video_format_t format;
 	unsigned int w, h;
 
-	unsigned long pictures;
+	unsigned long pictures, repeats, tiled;
 	size_t bytes;
 
 	unsigned long fps;
@@ -79,6 +79,9 @@ int info_read_callback();
 
 void video_format_info(info_t info, glc_video_format_message_t *video_message);
 void video_frame_info(info_t info, glc_video_frame_header_t *pic_header);
+void video_repeat_info(info_t info, glc_video_repeat_message_t *repeat_msg);
+void video_tiles_info(info_t info, glc_video_tiles_header_t *tiles_header);
+void video_frame_count(info_t info, struct info_video_stream_s *video, glc_utime_t time);
 void audio_format_info(info_t info, glc_audio_format_message_t *fmt_message);
 void audio_data_info(info_t info, glc_audio_data_header_t *audio_header);
 void color_info(info_t info, glc_color_message_t *color_msg);
@@ -168,6 +171,8 @@ void info_finish_callback(void *ptr, int err)
 
 		fprintf(info->stream, "video stream %d\n", video->id);
 		fprintf(info->stream, "  frames      = %lu\n", video->pictures);
+		fprintf(info->stream, "  repeated    = %lu\n", video->repeats);
+		fprintf(info->stream, "  tiled       = %lu\n", video->tiled);
 		fprintf(info->stream, "  fps         = %04.2f\n",
 		       (double) (video->pictures * 1000000) / (double) (info->time));
 		fprintf(info->stream, "  bytes       = ");
@@ -203,6 +208,10 @@ int info_read_callback(glc_thread_state_t *state)
 		video_format_info(info, (glc_video_format_message_t *) state->read_data);
 	else if (state->header.type == GLC_MESSAGE_VIDEO_FRAME)
 		video_frame_info(info, (glc_video_frame_header_t *) state->read_data);
+	else if (state->header.type == GLC_MESSAGE_VIDEO_REPEAT)
+		video_repeat_info(info, (glc_video_repeat_message_t *) state->read_data);
+	else if (state->header.type == GLC_MESSAGE_VIDEO_TILES)
+		video_tiles_info(info, (glc_video_tiles_header_t *) state->read_data);
 	else if (state->header.type == GLC_MESSAGE_AUDIO_FORMAT)
 		audio_format_info(info, (glc_audio_format_message_t *) state->read_data);
 	else if (state->header.type == GLC_MESSAGE_AUDIO_DATA)
@@ -334,6 +343,59 @@ void video_frame_info(info_t info, glc_video_frame_header_t *pic_header)
 		fprintf(info->stream, "picture (video %d)\n", pic_header->id);
 	}
 
+	video_frame_count(info, video, pic_header->time);
+}
+
+void video_repeat_info(info_t info, glc_video_repeat_message_t *repeat_msg)
+{
+	struct info_video_stream_s *video;
+	info->time = repeat_msg->time;
+
+	info_get_video_stream(info, &video, repeat_msg->id);
+
+	if (info->level >= INFO_DETAILED_PICTURE) {
+		print_time(info->stream, info->time);
+		fprintf(info->stream, "repeated picture\n");
+
+		fprintf(info->stream, "  stream id   = %d\n", repeat_msg->id);
+		fprintf(info->stream, "  time        = %lu\n", repeat_msg->time);
+	} else if (info->level >= INFO_PICTURE) {
+		print_time(info->stream, info->time);
+		fprintf(info->stream, "repeated picture (video %d)\n", repeat_msg->id);
+	}
+
+	/* repeated picture is a picture in output too */
+	video->repeats++;
+	video_frame_count(info, video, repeat_msg->time);
+}
+
+void video_tiles_info(info_t info, glc_video_tiles_header_t *tiles_header)
+{
+	struct info_video_stream_s *video;
+	info->time = tiles_header->time;
+
+	info_get_video_stream(info, &video, tiles_header->id);
+
+	if (info->level >= INFO_DETAILED_PICTURE) {
+		print_time(info->stream, info->time);
+		fprintf(info->stream, "picture tiles\n");
+
+		fprintf(info->stream, "  stream id   = %d\n", tiles_header->id);
+		fprintf(info->stream, "  time        = %lu\n", tiles_header->time);
+		fprintf(info->stream, "  tile size   = %ux%u\n", tiles_header->size,
+			tiles_header->size);
+		fprintf(info->stream, "  tiles       = %u\n", tiles_header->count);
+	} else if (info->level >= INFO_PICTURE) {
+		print_time(info->stream, info->time);
+		fprintf(info->stream, "picture tiles (video %d)\n", tiles_header->id);
+	}
+
+	video->tiled++;
+	video_frame_count(info, video, tiles_header->time);
+}
+
+void video_frame_count(info_t info, struct info_video_stream_s *video, glc_utime_t time)
+{
 	video->pictures++;
 	video->fps++;
 
@@ -348,11 +410,11 @@ void video_frame_info(info_t info, glc_video_frame_header_t *pic_header)
 	} else if (video->format == GLC_VIDEO_YCBCR_420JPEG)
 		video->bytes += (video->w * video->h * 3) / 2;
 
-	if ((info->level >= INFO_FPS) && (pic_header->time - video->fps_time >= 1000000)) {
+	if ((info->level >= INFO_FPS) && (time - video->fps_time >= 1000000)) {
 		print_time(info->stream, info->time);
 		fprintf(info->stream, "video %d: %04.2f fps\n", video->id,
-			(double) (video->fps * 1000000) / (double) (pic_header->time - video->last_fps_time));
-		video->last_fps_time = pic_header->time;
+			(double) (video->fps * 1000000) / (double) (time - video->last_fps_time));
+		video->last_fps_time = time;
 		video->fps_time += 1000000;
 		video->fps = 0;
 	}
@@ -17,14 +17,19 @@
 #include <unistd.h>
 #include <errno.h>
 #include <stdint.h>
+#include <pthread.h>
 
 #include <glc/common/glc.h>
 #include <glc/common/core.h>
 #include <glc/common/log.h>
 #include <glc/common/thread.h>
 #include <glc/common/util.h>
+#include <glc/common/state.h>
 
 #include "pack.h"
+#include "dct.h"
+#include "predict.h"
+#include "rice.h"
 
 #ifdef __MINILZO
 # include <minilzo.h>
@@ -49,32 +54,296 @@
 # include <lzjb.h>
 #endif
 
+#ifdef __LZ4
+# include <lz4.h>
+#endif
+
+#ifdef __ZSTD
+# include <zstd.h>
+#endif
+
+struct pack_pool_job_s {
+	int (*func)(struct pack_pool_job_s *job, unsigned int index, void *threadptr);
+	void *ptr;
+
+	unsigned int count, next, done;
+	int ret;
+
+	struct pack_pool_job_s *next_job;
+};
+
+/* helper threads for compressing slices of one message */
+struct pack_pool_s {
+	int running, quit;
+	pthread_t *threads;
+	size_t threads_count;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t job_cond, done_cond;
+	struct pack_pool_job_s *jobs;
+
+	int (*thread_create_callback)(void *ptr, void **threadptr);
+	void (*thread_finish_callback)(void *ptr, void *threadptr, int err);
+	void *ptr;
+};
+
+struct pack_slices_s {
+	int compression;
+	const char *data;
+	const size_t *offset;
+
+	/* each slice has reserved worst-case space */
+	char *dst;
+	const size_t *dst_offset;
+	glc_slice_t *slice;
+};
+
+struct unpack_slices_s {
+	glc_message_type_t compression;
+	const char *src;
+	char *dst;
+	glc_slice_t *slice;
+	size_t *src_offset, *dst_offset;
+};
+
+struct pack_video_stream_s {
+	glc_stream_id_t id;
+	unsigned int frames;
+	/* next delta coded frame must be a refresh frame */
+	int refresh;
+
+	/* last frame written, deltas are computed against this */
+	char *prev;
+	size_t size;
+
+	glc_video_format_message_t format;
+	int has_format;
+
+	struct pack_video_stream_s *next;
+};
+
+/* codecs are indexed by PACK_* */
+#define PACK_CODECS                    (PACK_ZSTD + 1)
+
+/* adaptive mode trial-compresses this much of each packet */
+#define PACK_ADAPTIVE_TRIAL_SIZE       4096
+/* switch to faster codec when packets are this late (us) */
+#define PACK_ADAPTIVE_LAG_HIGH         200000
+/* and to stronger one if they have been at most this late */
+#define PACK_ADAPTIVE_LAG_LOW           40000
+/* minimum time between switches */
+#define PACK_ADAPTIVE_SWITCH_INTERVAL 2000000
+
+struct pack_audio_stream_s {
+	glc_stream_id_t id;
+	glc_audio_format_message_t format;
+
+	struct pack_audio_stream_s *next;
+};
+
+struct pack_thread_s {
+	int compression;
+	void *work[PACK_CODECS];
+	char *trial;
+
+	/* packet is compressed here and copied to output
+	   buffer once its final size is known */
+	char *scratch;
+	size_t scratch_size;
+
+	/* delta of current frame */
+	char *delta;
+	size_t delta_size;
+
+	struct pack_video_stream_s *video;
+	unsigned long seq;
+	/* keyframe or refresh frame type, 0 for delta */
+	glc_message_type_t keyframe;
+	/* delta turn is taken but not yet passed */
+	int delta_pending;
+
+	/* slice offsets in message and worst-case offsets
+	   in compressed message, both have slices + 1 entries */
+	unsigned int slices;
+	size_t *slice_offset;
+	unsigned int slice_offset_count;
+
+	/* predictive coding of current frame */
+	int predict;
+	glc_video_format_message_t format;
+	struct predict_geometry_s geom;
+	char *predicted, *predict_work;
+	size_t predicted_size, predict_work_size;
+
+	/* lossy coding of current frame */
+	int dct;
+	struct dct_geometry_s dct_geom;
+	char *coded;
+	size_t coded_size;
+
+	/* lossless audio coding of current packet */
+	int rice;
+	struct rice_layout_s layout;
+	glc_audio_format_t audio_format;
+	char *rice_work;
+	size_t rice_work_size;
+};
+
 struct pack_s {
 	glc_t *glc;
 	glc_thread_t thread;
 	size_t compress_min;
 	int running;
 	int compression;
+	int level;
+	int (*compress_callback)(glc_thread_state_t *);
+	/* compression used after predictive coding */
+	int predict_compression;
+	int audio_compression;
+	unsigned int quality;
+	struct pack_audio_stream_s *audio;
+
+	unsigned int keyframe_interval;
+	struct pack_video_stream_s *video;
+
+	/* deltas must be computed in stream order */
+	pthread_mutex_t delta_mutex;
+	pthread_cond_t delta_cond;
+	unsigned long delta_seq, delta_turn;
+	int delta_cancel;
+
+	size_t slice_size;
+	struct pack_pool_s pool;
+
+	/* adaptive mode, codecs from fastest to strongest */
+	int ladder[PACK_CODECS];
+	unsigned int ladder_size, ladder_pos;
+	glc_utime_t switch_time, max_lag;
+	unsigned long packets, raw_packets;
+};
+
+struct unpack_video_stream_s {
+	glc_stream_id_t id;
+
+	char *prev;
+	size_t size;
+
+	struct unpack_video_stream_s *next;
+};
+
+struct unpack_thread_s {
+	unsigned long seq;
+	/* delta turn is taken but not yet passed */
+	int delta;
+
+	void *zstd;
+
+	size_t *offset;
+	unsigned int offset_count;
+
+	char *predicted, *predict_work;
+	size_t predicted_size, predict_work_size;
 };
 
 struct unpack_s {
 	glc_t *glc;
 	glc_thread_t thread;
 	int running;
+
+	struct unpack_video_stream_s *video;
+
+	pthread_mutex_t delta_mutex;
+	pthread_cond_t delta_cond;
+	unsigned long delta_seq, delta_turn;
+	int delta_cancel;
+
+	struct pack_pool_s pool;
 };
 
+int pack_pool_start(struct pack_pool_s *pool, size_t threads,
+		    int (*thread_create_callback)(void *, void **),
+		    void (*thread_finish_callback)(void *, void *, int),
+		    void *ptr);
+void pack_pool_stop(struct pack_pool_s *pool);
+int pack_pool_run(struct pack_pool_s *pool, struct pack_pool_job_s *job,
+		  void *threadptr);
+void *pack_pool_thread(void *argptr);
+unsigned int pack_pool_take(struct pack_pool_s *pool, struct pack_pool_job_s *job);
+void pack_pool_done(struct pack_pool_s *pool, struct pack_pool_job_s *job, int ret);
+
 int pack_thread_create_callback(void *ptr, void **threadptr);
 void pack_thread_finish_callback(void *ptr, void *threadptr, int err);
 int pack_read_callback(glc_thread_state_t *state);
+int pack_process_callback(glc_thread_state_t *state);
+int pack_write_callback(glc_thread_state_t *state);
+glc_utime_t pack_packet_time(glc_thread_state_t *state);
 int pack_quicklz_write_callback(glc_thread_state_t *state);
 int pack_lzo_write_callback(glc_thread_state_t *state);
 int pack_lzjb_write_callback(glc_thread_state_t *state);
+int pack_lz4_write_callback(glc_thread_state_t *state);
+int pack_zstd_write_callback(glc_thread_state_t *state);
 void pack_finish_callback(void *ptr, int err);
 
+void pack_get_video_stream(pack_t pack, glc_stream_id_t id,
+			   struct pack_video_stream_s **video);
+int pack_video_format(pack_t pack, glc_thread_state_t *state,
+		      struct pack_video_stream_s **video);
+void pack_delta_prepare(pack_t pack, glc_thread_state_t *state);
+int pack_delta(pack_t pack, glc_thread_state_t *state, char **data);
+int pack_delta_wait(pack_t pack, struct pack_thread_s *thread);
+void pack_delta_pass(pack_t pack, struct pack_thread_s *thread);
+void pack_delta_cancel(pack_t pack);
+void pack_delta_encode(char *delta, const char *frame, char *prev, size_t size);
+
+void *pack_work_create(pack_t pack, int compression);
+void pack_work_destroy(int compression, void *work);
+const char *pack_compression_name(int compression);
+size_t pack_worstcase(int compression, size_t size);
+glc_message_type_t pack_compression_message(int compression);
+int pack_compress(int compression, void *work, const char *src, size_t size,
+		  char *dst, size_t dst_size, size_t *compressed_size);
+
+int pack_codec_write_callback(glc_thread_state_t *state);
+int pack_adaptive_select(pack_t pack, glc_thread_state_t *state);
+int pack_adaptive_trial(pack_t pack, glc_thread_state_t *state);
+int pack_slices_prepare(pack_t pack, glc_thread_state_t *state);
+int pack_slices_write(pack_t pack, glc_thread_state_t *state, char *data);
+int pack_slice_compress(struct pack_pool_job_s *job, unsigned int index, void *threadptr);
+int pack_predict_prepare(pack_t pack, glc_thread_state_t *state);
+int pack_predict_write_callback(glc_thread_state_t *state);
+int pack_buffer(char **buffer, size_t *buffer_size, size_t size);
+void pack_get_audio_stream(pack_t pack, glc_stream_id_t id,
+			   struct pack_audio_stream_s **audio);
+int pack_rice_prepare(pack_t pack, glc_thread_state_t *state);
+int pack_dct_prepare(pack_t pack, glc_thread_state_t *state);
+int pack_dct_write_callback(glc_thread_state_t *state);
+int pack_rice_write_callback(glc_thread_state_t *state);
+
+int unpack_thread_create_callback(void *ptr, void **threadptr);
+void unpack_thread_finish_callback(void *ptr, void *threadptr, int err);
 int unpack_read_callback(glc_thread_state_t *state);
 int unpack_write_callback(glc_thread_state_t *state);
 void unpack_finish_callback(void *ptr, int err);
 
+void unpack_get_video_stream(unpack_t unpack, glc_stream_id_t id,
+			     struct unpack_video_stream_s **video);
+void unpack_delta_prepare(unpack_t unpack, glc_thread_state_t *state,
+			  glc_message_header_t *header);
+int unpack_delta(unpack_t unpack, glc_thread_state_t *state);
+int unpack_write_message(glc_thread_state_t *state);
+int unpack_delta_wait(unpack_t unpack, struct unpack_thread_s *thread);
+void unpack_delta_pass(unpack_t unpack, struct unpack_thread_s *thread);
+void unpack_delta_cancel(unpack_t unpack);
+void unpack_delta_decode(char *frame, char *prev, size_t size);
+
+int unpack_decompress(glc_message_type_t compression, struct unpack_thread_s *thread,
+		      const char *src, size_t size, char *dst, size_t dst_size);
+int unpack_slices(unpack_t unpack, glc_thread_state_t *state);
+int unpack_slice_decompress(struct pack_pool_job_s *job, unsigned int index, void *threadptr);
+int unpack_predicted(unpack_t unpack, glc_thread_state_t *state);
+int unpack_rice(unpack_t unpack, glc_thread_state_t *state);
+int unpack_dct(unpack_t unpack, glc_thread_state_t *state);
+
 int pack_init(pack_t *pack, glc_t *glc)
 {
 	*pack = (pack_t) malloc(sizeof(struct pack_s));
@@ -82,15 +351,21 @@ int pack_init(pack_t *pack, glc_t *glc)
 
 	(*pack)->glc = glc;
 	(*pack)->compress_min = 1024;
+	(*pack)->quality = 75;
 
-	(*pack)->thread.flags = GLC_THREAD_WRITE | GLC_THREAD_READ;
+	(*pack)->thread.flags = GLC_THREAD_WRITE | GLC_THREAD_READ | GLC_THREAD_REORDER;
 	(*pack)->thread.ptr = *pack;
 	(*pack)->thread.thread_create_callback = &pack_thread_create_callback;
 	(*pack)->thread.thread_finish_callback = &pack_thread_finish_callback;
 	(*pack)->thread.read_callback = &pack_read_callback;
+	(*pack)->thread.process_callback = &pack_process_callback;
+	(*pack)->thread.write_callback = &pack_write_callback;
 	(*pack)->thread.finish_callback = &pack_finish_callback;
 	(*pack)->thread.threads = glc_threads_hint(glc);
 
+	pthread_mutex_init(&(*pack)->delta_mutex, NULL);
+	pthread_cond_init(&(*pack)->delta_cond, NULL);
+
 #ifdef __QUICKLZ
 	pack_set_compression(*pack, PACK_QUICKLZ);
 #elif defined __LZO
@@ -113,7 +388,7 @@ int pack_set_compression(pack_t pack, int compression)
 
 	if (compression == PACK_QUICKLZ) {
 #ifdef __QUICKLZ
-		pack->thread.write_callback = &pack_quicklz_write_callback;
+		pack->compress_callback = &pack_quicklz_write_callback;
 		glc_log(pack->glc, GLC_INFORMATION, "pack",
 			 "compressing using QuickLZ");
 #else
@@ -123,7 +398,7 @@ int pack_set_compression(pack_t pack, int compression)
 #endif
 	} else if (compression == PACK_LZO) {
 #ifdef __LZO
-		pack->thread.write_callback = &pack_lzo_write_callback;
+		pack->compress_callback = &pack_lzo_write_callback;
 		glc_log(pack->glc, GLC_INFORMATION, "pack",
 			 "compressing using LZO");
 		lzo_init();
@@ -134,7 +409,7 @@ int pack_set_compression(pack_t pack, int compression)
 #endif
 	} else if (compression == PACK_LZJB) {
 #ifdef __LZJB
-		pack->thread.write_callback = &pack_lzjb_write_callback;
+		pack->compress_callback = &pack_lzjb_write_callback;
 		glc_log(pack->glc, GLC_INFORMATION, "pack",
 			"compressing using LZJB");
 #else
@@ -142,6 +417,78 @@ int pack_set_compression(pack_t pack, int compression)
 			"LZJB not supported");
 		return ENOTSUP;
 #endif
+	} else if (compression == PACK_LZ4) {
+#ifdef __LZ4
+		pack->compress_callback = &pack_lz4_write_callback;
+		glc_log(pack->glc, GLC_INFORMATION, "pack",
+			 "compressing using LZ4");
+#else
+		glc_log(pack->glc, GLC_ERROR, "pack",
+			 "LZ4 not supported");
+		return ENOTSUP;
+#endif
+	} else if (compression == PACK_ZSTD) {
+#ifdef __ZSTD
+		pack->compress_callback = &pack_zstd_write_callback;
+		glc_log(pack->glc, GLC_INFORMATION, "pack",
+			 "compressing using Zstandard");
+#else
+		glc_log(pack->glc, GLC_ERROR, "pack",
+			 "Zstandard not supported");
+		return ENOTSUP;
+#endif
+	} else if (compression == PACK_ADAPTIVE) {
+		pack->ladder_size = 0;
+#ifdef __LZ4
+		pack->ladder[pack->ladder_size++] = PACK_LZ4;
+#endif
+#ifdef __QUICKLZ
+		pack->ladder[pack->ladder_size++] = PACK_QUICKLZ;
+#endif
+#ifdef __LZO
+		pack->ladder[pack->ladder_size++] = PACK_LZO;
+#endif
+#ifdef __ZSTD
+		pack->ladder[pack->ladder_size++] = PACK_ZSTD;
+#endif
+		if (!pack->ladder_size) {
+			glc_log(pack->glc, GLC_ERROR, "pack",
+				 "no compression algorithms for adaptive mode");
+			return ENOTSUP;
+		}
+
+		pack->compress_callback = &pack_codec_write_callback;
+		glc_log(pack->glc, GLC_INFORMATION, "pack",
+			 "compressing adaptively, starting with %s",
+			 pack_compression_name(pack->ladder[0]));
+	} else if ((compression == PACK_PREDICT) || (compression == PACK_DCT)) {
+#if defined __ZSTD
+		pack->predict_compression = PACK_ZSTD;
+#elif defined __LZ4
+		pack->predict_compression = PACK_LZ4;
+#elif defined __QUICKLZ
+		pack->predict_compression = PACK_QUICKLZ;
+#elif defined __LZO
+		pack->predict_compression = PACK_LZO;
+		lzo_init();
+#elif defined __LZJB
+		pack->predict_compression = PACK_LZJB;
+#else
+		glc_log(pack->glc, GLC_ERROR, "pack",
+			 "no compression algorithms for predictive coding");
+		return ENOTSUP;
+#endif
+		if (compression == PACK_DCT) {
+			pack->compress_callback = &pack_dct_write_callback;
+			glc_log(pack->glc, GLC_INFORMATION, "pack",
+				 "compressing using lossy DCT coding and %s",
+				 pack_compression_name(pack->predict_compression));
+		} else {
+			pack->compress_callback = &pack_predict_write_callback;
+			glc_log(pack->glc, GLC_INFORMATION, "pack",
+				 "compressing using predictive coding and %s",
+				 pack_compression_name(pack->predict_compression));
+		}
 	} else {
 		glc_log(pack->glc, GLC_ERROR, "pack",
 			 "unknown/unsupported compression algorithm 0x%02x",
@@ -153,6 +500,46 @@ int pack_set_compression(pack_t pack, int compression)
 	return 0;
 }
 
+int pack_set_audio_compression(pack_t pack, int compression)
+{
+	if (pack->running)
+		return EALREADY;
+
+	if (compression == PACK_RICE)
+		glc_log(pack->glc, GLC_INFORMATION, "pack",
+			 "compressing audio using linear prediction and Rice coding");
+	else if (compression) {
+		glc_log(pack->glc, GLC_ERROR, "pack",
+			 "unknown/unsupported audio compression algorithm 0x%02x",
+			 compression);
+		return ENOTSUP;
+	}
+
+	pack->audio_compression = compression;
+	return 0;
+}
+
+int pack_set_compression_level(pack_t pack, int level)
+{
+	if (pack->running)
+		return EALREADY;
+
+	pack->level = level;
+	return 0;
+}
+
+int pack_set_quality(pack_t pack, unsigned int quality)
+{
+	if (pack->running)
+		return EALREADY;
+
+	if ((quality < 1) || (quality > 100))
+		return EINVAL;
+
+	pack->quality = quality;
+	return 0;
+}
+
 int pack_set_minimum_size(pack_t pack, size_t min_size)
 {
 	if (pack->running)
@@ -165,6 +552,24 @@ int pack_set_minimum_size(pack_t pack, size_t min_size)
 	return 0;
 }
 
+int pack_set_slice_size(pack_t pack, size_t slice_size)
+{
+	if (pack->running)
+		return EALREADY;
+
+	pack->slice_size = slice_size;
+	return 0;
+}
+
+int pack_set_keyframe_interval(pack_t pack, unsigned int interval)
+{
+	if (pack->running)
+		return EALREADY;
+
+	pack->keyframe_interval = interval;
+	return 0;
+}
+
 int pack_process_start(pack_t pack, ps_buffer_t *from, ps_buffer_t *to)
 {
 	int ret;
@@ -184,6 +589,7 @@ int pack_process_wait(pack_t pack)
 		return EAGAIN;
 
 	glc_thread_wait(&pack->thread);
+	pack_pool_stop(&pack->pool);
 	pack->running = 0;
 
 	return 0;
@@ -191,6 +597,8 @@ int pack_process_wait(pack_t pack)
 
 int pack_destroy(pack_t pack)
 {
+	pthread_mutex_destroy(&pack->delta_mutex);
+	pthread_cond_destroy(&pack->delta_cond);
 	free(pack);
 	return 0;
 }
@@ -198,43 +606,189 @@ int pack_destroy(pack_t pack)
 void pack_finish_callback(void *ptr, int err)
 {
 	pack_t pack = (pack_t) ptr;
+	struct pack_video_stream_s *del;
+	struct pack_audio_stream_s *del_audio;
 
 	if (err)
 		glc_log(pack->glc, GLC_ERROR, "pack", "%s (%d)", strerror(err), err);
+
+	while (pack->video != NULL) {
+		del = pack->video;
+		pack->video = pack->video->next;
+
+		if (del->prev)
+			free(del->prev);
+		free(del);
+	}
+
+	while (pack->audio != NULL) {
+		del_audio = pack->audio;
+		pack->audio = pack->audio->next;
+		free(del_audio);
+	}
+
+	pack->delta_seq = pack->delta_turn = 0;
+	pack->delta_cancel = 0;
+
+	if ((pack->compression == PACK_ADAPTIVE) && (pack->packets))
+		glc_log(pack->glc, GLC_PERFORMANCE, "pack",
+			 "%lu of %lu packets were not compressible",
+			 pack->raw_packets, pack->packets);
+	pack->packets = pack->raw_packets = 0;
 }
 
 int pack_thread_create_callback(void *ptr, void **threadptr)
 {
 	pack_t pack = (pack_t) ptr;
+	struct pack_thread_s *thread;
+
+	unsigned int i;
+
+	thread = (struct pack_thread_s *) malloc(sizeof(struct pack_thread_s));
+	memset(thread, 0, sizeof(struct pack_thread_s));
+	*threadptr = thread;
+
+	if (pack->compression == PACK_ADAPTIVE) {
+		for (i = 0; i < pack->ladder_size; i++) {
+			if (!(thread->work[pack->ladder[i]] = pack_work_create(pack, pack->ladder[i])))
+				return ENOMEM;
+		}
+
+		thread->trial = (char *) malloc(pack_worstcase(pack->ladder[0],
+							       PACK_ADAPTIVE_TRIAL_SIZE));
+	} else if ((pack->compression == PACK_PREDICT) || (pack->compression == PACK_DCT))
+		thread->work[pack->predict_compression] =
+			pack_work_create(pack, pack->predict_compression);
+	else
+		thread->work[pack->compression] = pack_work_create(pack, pack->compression);
+
+	return 0;
+}
+
+void pack_thread_finish_callback(void *ptr, void *threadptr, int err)
+{
+	struct pack_thread_s *thread = (struct pack_thread_s *) threadptr;
+	int compression;
+
+	/* turns of failed thread are never passed, don't leave others waiting */
+	if (err)
+		pack_delta_cancel((pack_t) ptr);
+
+	for (compression = 0; compression < PACK_CODECS; compression++) {
+		if (thread->work[compression])
+			pack_work_destroy(compression, thread->work[compression]);
+	}
+
+	if (thread->trial)
+		free(thread->trial);
+	if (thread->scratch)
+		free(thread->scratch);
+	if (thread->predicted)
+		free(thread->predicted);
+	if (thread->predict_work)
+		free(thread->predict_work);
+	if (thread->delta)
+		free(thread->delta);
+	if (thread->slice_offset)
+		free(thread->slice_offset);
+	if (thread->rice_work)
+		free(thread->rice_work);
+	if (thread->coded)
+		free(thread->coded);
+	free(thread);
+}
+
+void *pack_work_create(pack_t pack, int compression)
+{
+	void *work = NULL;
 
-	if (pack->compression == PACK_QUICKLZ) {
+	if (compression == PACK_QUICKLZ) {
 #ifdef __QUICKLZ
-		*threadptr = malloc(__quicklz_hashtable);
+		work = malloc(__quicklz_hashtable);
 #endif
-	} else if (pack->compression == PACK_LZO) {
+	} else if (compression == PACK_LZO) {
 #ifdef __LZO
-		*threadptr = malloc(__lzo_wrk_mem);
+		work = malloc(__lzo_wrk_mem);
+#endif
+	} else if (compression == PACK_LZ4) {
+#ifdef __LZ4
+		work = malloc(LZ4_sizeofState());
+#endif
+	} else if (compression == PACK_ZSTD) {
+#ifdef __ZSTD
+		work = ZSTD_createCCtx();
+		if ((work) && (pack->level))
+			ZSTD_CCtx_setParameter((ZSTD_CCtx *) work,
+					       ZSTD_c_compressionLevel, pack->level);
 #endif
 	}
 
-	return 0;
+	return work;
 }
 
-void pack_thread_finish_callback(void *ptr, void *threadptr, int err)
+void pack_work_destroy(int compression, void *work)
 {
-	if (threadptr)
-		free(threadptr);
+	if (compression == PACK_ZSTD) {
+#ifdef __ZSTD
+		ZSTD_freeCCtx((ZSTD_CCtx *) work);
+#endif
+	} else
+		free(work);
 }
 
 int pack_read_callback(glc_thread_state_t *state)
 {
 	pack_t pack = (pack_t) state->ptr;
+	struct pack_thread_s *thread = (struct pack_thread_s *) state->threadptr;
+	struct pack_video_stream_s *video;
+	struct pack_audio_stream_s *audio;
+	int ret;
+
+	thread->video = NULL;
+	thread->delta_pending = 0;
+	thread->slices = 0;
+	thread->predict = 0;
+	thread->dct = 0;
+	thread->rice = 0;
+
+	if (state->header.type == GLC_MESSAGE_VIDEO_FORMAT) {
+		/* format change always starts with a keyframe */
+		pack_get_video_stream(pack, ((glc_video_format_message_t *) state->read_data)->id,
+				      &video);
+		video->frames = 0;
+		memcpy(&video->format, state->read_data, sizeof(glc_video_format_message_t));
+		video->has_format = 1;
+	} else if (state->header.type == GLC_MESSAGE_AUDIO_FORMAT) {
+		pack_get_audio_stream(pack, ((glc_audio_format_message_t *) state->read_data)->id,
+				      &audio);
+		memcpy(&audio->format, state->read_data, sizeof(glc_audio_format_message_t));
+	} else if (state->header.type == GLC_CALLBACK_REQUEST) {
+		/* stream file might be reopened */
+		for (video = pack->video; video != NULL; video = video->next)
+			video->frames = 0;
+	}
 
 	/* compress only audio and pictures */
 	if ((state->read_size > pack->compress_min) &&
 	    ((state->header.type == GLC_MESSAGE_VIDEO_FRAME) |
+	     (state->header.type == GLC_MESSAGE_VIDEO_TILES) |
 	     (state->header.type == GLC_MESSAGE_AUDIO_DATA))) {
-		if (pack->compression == PACK_QUICKLZ) {
+		if ((pack->audio_compression == PACK_RICE) &&
+		    (state->header.type == GLC_MESSAGE_AUDIO_DATA))
+			pack_rice_prepare(pack, state);
+
+		if (pack->compression == PACK_ADAPTIVE) {
+			/* other algorithm is needed only as a fallback */
+			if (thread->rice)
+				thread->compression = pack->ladder[pack->ladder_pos];
+			else if (pack_adaptive_select(pack, state))
+				goto copy;
+		} else if ((pack->compression == PACK_PREDICT) || (pack->compression == PACK_DCT))
+			thread->compression = pack->predict_compression;
+		else
+			thread->compression = pack->compression;
+
+		if (thread->compression == PACK_QUICKLZ) {
 #ifdef __QUICKLZ
 			state->write_size = sizeof(glc_container_message_header_t)
 					    + sizeof(glc_quicklz_header_t)
@@ -242,7 +796,7 @@ int pack_read_callback(glc_thread_state_t *state)
 #else
 			goto copy;
 #endif
-		} else if (pack->compression == PACK_LZO) {
+		} else if (thread->compression == PACK_LZO) {
 #ifdef __LZO
 			state->write_size = sizeof(glc_container_message_header_t)
 					    + sizeof(glc_lzo_header_t)
@@ -250,17 +804,69 @@ int pack_read_callback(glc_thread_state_t *state)
 #else
 			goto copy;
 #endif
-		} else if (pack->compression == PACK_LZJB) {
+		} else if (thread->compression == PACK_LZJB) {
 #ifdef __LZJB
 			state->write_size = sizeof(glc_container_message_header_t)
 					    + sizeof(glc_lzjb_header_t)
 					    + __lzjb_worstcase(state->read_size);
 #else
 			goto copy;
+#endif
+		} else if (thread->compression == PACK_LZ4) {
+#ifdef __LZ4
+			state->write_size = sizeof(glc_container_message_header_t)
+					    + sizeof(glc_lz4_header_t)
+					    + LZ4_compressBound(state->read_size);
+#else
+			goto copy;
+#endif
+		} else if (thread->compression == PACK_ZSTD) {
+#ifdef __ZSTD
+			state->write_size = sizeof(glc_container_message_header_t)
+					    + sizeof(glc_zstd_header_t)
+					    + ZSTD_compressBound(state->read_size);
+#else
+			goto copy;
 #endif
 		} else
 			goto copy;
 
+		if (thread->rice) {
+			/* write size is also scratch size for fallback */
+			if (state->write_size < sizeof(glc_container_message_header_t)
+						+ sizeof(glc_rice_header_t)
+						+ sizeof(glc_audio_data_header_t)
+						+ thread->layout.max_size)
+				state->write_size = sizeof(glc_container_message_header_t)
+						    + sizeof(glc_rice_header_t)
+						    + sizeof(glc_audio_data_header_t)
+						    + thread->layout.max_size;
+		} else if ((pack->compression == PACK_DCT) &&
+			   (state->header.type == GLC_MESSAGE_VIDEO_FRAME) &&
+			   (!pack_dct_prepare(pack, state))) {
+			state->write_size = sizeof(glc_container_message_header_t)
+					    + sizeof(glc_dct_header_t)
+					    + pack_worstcase(thread->compression,
+							     sizeof(glc_video_frame_header_t)
+							     + thread->dct_geom.max_size);
+		} else if (((pack->compression == PACK_PREDICT) || (pack->compression == PACK_DCT)) &&
+			   (state->header.type == GLC_MESSAGE_VIDEO_FRAME) &&
+			   (!pack_predict_prepare(pack, state))) {
+			state->write_size = sizeof(glc_container_message_header_t)
+					    + sizeof(glc_predicted_header_t)
+					    + pack_worstcase(thread->compression,
+							     sizeof(glc_video_frame_header_t)
+							     + thread->geom.size);
+		} else if (state->header.type == GLC_MESSAGE_VIDEO_FRAME) {
+			if ((ret = pack_slices_prepare(pack, state)))
+				return ret;
+		}
+
+		/* lossy frames can't be XORed with previous original frame */
+		if ((pack->keyframe_interval) && (!thread->dct) &&
+		    (state->header.type == GLC_MESSAGE_VIDEO_FRAME))
+			pack_delta_prepare(pack, state);
+
 		return 0;
 	}
 copy:
@@ -268,127 +874,1033 @@ copy:
 	return 0;
 }
 
-int pack_lzo_write_callback(glc_thread_state_t *state)
+int pack_process_callback(glc_thread_state_t *state)
 {
-#ifdef __LZO
-	glc_container_message_header_t *container = (glc_container_message_header_t *) state->write_data;
-	glc_lzo_header_t *lzo_header =
-		(glc_lzo_header_t *) &state->write_data[sizeof(glc_container_message_header_t)];
-	lzo_uint compressed_size;
-
-	__lzo_compress((unsigned char *) state->read_data, state->read_size,
-		       (unsigned char *) &state->write_data[sizeof(glc_lzo_header_t) +
-		       					    sizeof(glc_container_message_header_t)],
-		       &compressed_size, (lzo_voidp) state->threadptr);
+	pack_t pack = (pack_t) state->ptr;
+	struct pack_thread_s *thread = (struct pack_thread_s *) state->threadptr;
+	glc_container_message_header_t *container;
+	glc_utime_t time;
+	char *scratch;
+	int ret;
 
-	lzo_header->size = (glc_size_t) state->read_size;
-	memcpy(&lzo_header->header, &state->header, sizeof(glc_message_header_t));
+	/*
+	 Write size is the worst case at this point. Compressing before
+	 write packet is opened means only the actual compressed size
+	 is reserved from output buffer, without holding other writers
+	 like GLC_THREAD_STATE_UNKNOWN_FINAL_SIZE would.
+	*/
+	if (thread->scratch_size < state->write_size + sizeof(glc_utime_t)) {
+		if (!(scratch = (char *) realloc(thread->scratch,
+						 state->write_size + sizeof(glc_utime_t)))) {
+			ret = ENOMEM;
+			goto finish;
+		}
+		thread->scratch = scratch;
+		thread->scratch_size = state->write_size + sizeof(glc_utime_t);
+	}
 
-	container->size = compressed_size + sizeof(glc_lzo_header_t);
-	container->header.type = GLC_MESSAGE_LZO;
+	state->write_data = thread->scratch;
+	if (thread->rice)
+		ret = pack_rice_write_callback(state);
+	else
+		ret = pack->compress_callback(state);
+	state->write_data = NULL;
+	if (ret)
+		goto finish;
+
+	/*
+	 Packet time is hidden in compressed data. It follows container
+	 message in output buffer so stream file can index packet by its
+	 time, but it isn't part of the message and is not written.
+	*/
+	container = (glc_container_message_header_t *) thread->scratch;
+	time = pack_packet_time(state);
+	memcpy(&thread->scratch[sizeof(glc_container_message_header_t) + container->size],
+	       &time, sizeof(glc_utime_t));
+	state->write_size = sizeof(glc_container_message_header_t) + container->size
+			    + sizeof(glc_utime_t);
+
+finish:
+	/* following frames are waiting for this frame's delta turn */
+	if ((thread->delta_pending) && (!pack_delta_wait(pack, thread)))
+		pack_delta_pass(pack, thread);
+	return ret;
+}
 
-	state->header.type = GLC_MESSAGE_CONTAINER;
+int pack_write_callback(glc_thread_state_t *state)
+{
+	struct pack_thread_s *thread = (struct pack_thread_s *) state->threadptr;
 
+	memcpy(state->write_data, thread->scratch, state->write_size);
 	return 0;
-#else
-	return ENOTSUP;
-#endif
 }
 
-int pack_quicklz_write_callback(glc_thread_state_t *state)
+glc_utime_t pack_packet_time(glc_thread_state_t *state)
 {
-#ifdef __QUICKLZ
-	glc_container_message_header_t *container = (glc_container_message_header_t *) state->write_data;
-	glc_quicklz_header_t *quicklz_header =
-		(glc_quicklz_header_t *) &state->write_data[sizeof(glc_container_message_header_t)];
-	size_t compressed_size;
-
-	quicklz_compress((const unsigned char *) state->read_data,
-			 (unsigned char *) &state->write_data[sizeof(glc_quicklz_header_t) +
-			 				      sizeof(glc_container_message_header_t)],
-			 state->read_size, &compressed_size,
-			 (uintptr_t *) state->threadptr);
+	/* only video frames, tiles and audio data are compressed */
+	if (state->header.type == GLC_MESSAGE_VIDEO_FRAME)
+		return ((glc_video_frame_header_t *) state->read_data)->time;
+	else if (state->header.type == GLC_MESSAGE_VIDEO_TILES)
+		return ((glc_video_tiles_header_t *) state->read_data)->time;
+	return ((glc_audio_data_header_t *) state->read_data)->time;
+}
 
-	quicklz_header->size = (glc_size_t) state->read_size;
-	memcpy(&quicklz_header->header, &state->header, sizeof(glc_message_header_t));
+int pack_predict_prepare(pack_t pack, glc_thread_state_t *state)
+{
+	struct pack_thread_s *thread = (struct pack_thread_s *) state->threadptr;
+	struct pack_video_stream_s *video;
+	int ret;
 
-	container->size = compressed_size + sizeof(glc_quicklz_header_t);
-	container->header.type = GLC_MESSAGE_QUICKLZ;
+	if ((ret = pack_video_format(pack, state, &video)))
+		return ret;
 
-	state->header.type = GLC_MESSAGE_CONTAINER;
+	if ((ret = predict_geometry(&thread->geom, video->format.format, video->format.flags,
+				    video->format.width, video->format.height)))
+		return ret;
+	if (thread->geom.frame_size != state->read_size - sizeof(glc_video_frame_header_t))
+		return EINVAL;
 
+	memcpy(&thread->format, &video->format, sizeof(glc_video_format_message_t));
+	thread->predict = 1;
 	return 0;
-#else
-	return ENOTSUP;
-#endif
 }
 
-int pack_lzjb_write_callback(glc_thread_state_t *state)
+int pack_predict_write_callback(glc_thread_state_t *state)
 {
-#ifdef __LZJB
+	pack_t pack = (pack_t) state->ptr;
+	struct pack_thread_s *thread = (struct pack_thread_s *) state->threadptr;
 	glc_container_message_header_t *container = (glc_container_message_header_t *) state->write_data;
-	glc_lzjb_header_t *lzjb_header =
-		(glc_lzjb_header_t *) &state->write_data[sizeof(glc_container_message_header_t)];
-
-	size_t compressed_size = lzjb_compress(state->read_data,
-					       &state->write_data[sizeof(glc_lzjb_header_t) +
-					       			  sizeof(glc_container_message_header_t)],
-					       state->read_size);
+	glc_predicted_header_t *predicted_header =
+		(glc_predicted_header_t *) &state->write_data[sizeof(glc_container_message_header_t)];
+	size_t header_size = sizeof(glc_container_message_header_t) + sizeof(glc_predicted_header_t);
+	size_t size = sizeof(glc_video_frame_header_t) + thread->geom.size;
+	size_t compressed_size;
+	char *data;
+	int ret;
 
-	lzjb_header->size = (glc_size_t) state->read_size;
-	memcpy(&lzjb_header->header, &state->header, sizeof(glc_message_header_t));
+	/* audio and tiles */
+	if (!thread->predict)
+		return pack_codec_write_callback(state);
 
-	container->size = compressed_size + sizeof(glc_lzjb_header_t);
-	container->header.type = GLC_MESSAGE_LZJB;
+	if ((ret = pack_delta(pack, state, &data)))
+		return ret;
 
-	state->header.type = GLC_MESSAGE_CONTAINER;
+	if ((ret = pack_buffer(&thread->predicted, &thread->predicted_size, size)) ||
+	    (ret = pack_buffer(&thread->predict_work, &thread->predict_work_size,
+			       thread->geom.work_size)))
+		return ret;
 
-	return 0;
-#else
-	return ENOTSUP;
-#endif
-}
+	memcpy(thread->predicted, data, sizeof(glc_video_frame_header_t));
+	predict_encode(&thread->geom, &data[sizeof(glc_video_frame_header_t)],
+		       &thread->predicted[sizeof(glc_video_frame_header_t)],
+		       thread->predict_work);
 
-int unpack_init(unpack_t *unpack, glc_t *glc)
-{
-	*unpack = (unpack_t) malloc(sizeof(struct unpack_s));
-	memset(*unpack, 0, sizeof(struct unpack_s));
+	if ((ret = pack_compress(thread->compression, thread->work[thread->compression],
+				 thread->predicted, size, &state->write_data[header_size],
+				 state->write_size - header_size, &compressed_size)))
+		return ret;
 
-	(*unpack)->glc = glc;
+	predicted_header->size = (glc_size_t) state->read_size;
+	memcpy(&predicted_header->header, &state->header, sizeof(glc_message_header_t));
+	predicted_header->compression.type = pack_compression_message(thread->compression);
+	predicted_header->flags = thread->format.flags;
+	predicted_header->width = thread->format.width;
+	predicted_header->height = thread->format.height;
+	predicted_header->format = thread->format.format;
 
-	(*unpack)->thread.flags = GLC_THREAD_WRITE | GLC_THREAD_READ;
-	(*unpack)->thread.ptr = *unpack;
-	(*unpack)->thread.read_callback = &unpack_read_callback;
-	(*unpack)->thread.write_callback = &unpack_write_callback;
-	(*unpack)->thread.finish_callback = &unpack_finish_callback;
-	(*unpack)->thread.threads = glc_threads_hint(glc);
+	container->size = compressed_size + sizeof(glc_predicted_header_t);
+	container->header.type = GLC_MESSAGE_PREDICTED;
 
-#ifdef __LZO
-	lzo_init();
-#endif
+	state->header.type = GLC_MESSAGE_CONTAINER;
 
 	return 0;
 }
 
-int unpack_process_start(unpack_t unpack, ps_buffer_t *from, ps_buffer_t *to)
+int pack_dct_prepare(pack_t pack, glc_thread_state_t *state)
 {
+	struct pack_thread_s *thread = (struct pack_thread_s *) state->threadptr;
+	struct pack_video_stream_s *video;
 	int ret;
-	if (unpack->running)
-		return EAGAIN;
 
-	if ((ret = glc_thread_create(unpack->glc, &unpack->thread, from, to)))
+	if ((pack_video_format(pack, state, &video)) ||
+	    (video->format.format != GLC_VIDEO_YCBCR_420JPEG))
+		return ENOTSUP;
+
+	if ((ret = dct_geometry(&thread->dct_geom, video->format.width,
+				video->format.height, pack->quality)))
 		return ret;
-	unpack->running = 1;
+	if (thread->dct_geom.frame_size != state->read_size - sizeof(glc_video_frame_header_t))
+		return EINVAL;
 
+	memcpy(&thread->format, &video->format, sizeof(glc_video_format_message_t));
+	thread->dct = 1;
 	return 0;
 }
 
-int unpack_process_wait(unpack_t unpack)
+int pack_dct_write_callback(glc_thread_state_t *state)
 {
-	if (!unpack->running)
-		return EAGAIN;
-
+	pack_t pack = (pack_t) state->ptr;
+	struct pack_thread_s *thread = (struct pack_thread_s *) state->threadptr;
+	glc_container_message_header_t *container = (glc_container_message_header_t *) state->write_data;
+	glc_dct_header_t *dct_header =
+		(glc_dct_header_t *) &state->write_data[sizeof(glc_container_message_header_t)];
+	size_t header_size = sizeof(glc_container_message_header_t) + sizeof(glc_dct_header_t);
+	size_t size, compressed_size;
+	int ret;
+
+	/* audio, tiles and frames in other formats */
+	if (!thread->dct)
+		return pack_predict_write_callback(state);
+
+	if ((ret = pack_buffer(&thread->coded, &thread->coded_size,
+			       sizeof(glc_video_frame_header_t) + thread->dct_geom.max_size)))
+		return ret;
+
+	memcpy(thread->coded, state->read_data, sizeof(glc_video_frame_header_t));
+	size = sizeof(glc_video_frame_header_t) +
+	       dct_encode(&thread->dct_geom, &state->read_data[sizeof(glc_video_frame_header_t)],
+			  &thread->coded[sizeof(glc_video_frame_header_t)]);
+
+	if ((ret = pack_compress(thread->compression, thread->work[thread->compression],
+				 thread->coded, size, &state->write_data[header_size],
+				 state->write_size - header_size, &compressed_size)))
+		return ret;
+
+	dct_header->size = (glc_size_t) state->read_size;
+	memcpy(&dct_header->header, &state->header, sizeof(glc_message_header_t));
+	dct_header->compression.type = pack_compression_message(thread->compression);
+	dct_header->coded_size = (glc_size_t) size;
+	dct_header->width = thread->format.width;
+	dct_header->height = thread->format.height;
+	dct_header->quality = pack->quality;
+
+	container->size = compressed_size + sizeof(glc_dct_header_t);
+	container->header.type = GLC_MESSAGE_DCT;
+
+	state->header.type = GLC_MESSAGE_CONTAINER;
+
+	return 0;
+}
+
+int pack_rice_prepare(pack_t pack, glc_thread_state_t *state)
+{
+	struct pack_thread_s *thread = (struct pack_thread_s *) state->threadptr;
+	glc_audio_data_header_t *audio_header = (glc_audio_data_header_t *) state->read_data;
+	struct pack_audio_stream_s *audio;
+	int ret;
+
+	pack_get_audio_stream(pack, audio_header->id, &audio);
+
+	if (audio_header->size != state->read_size - sizeof(glc_audio_data_header_t))
+		return EINVAL;
+	if ((ret = rice_layout(&thread->layout, audio->format.format, audio->format.flags,
+			       audio->format.channels, audio_header->size)))
+		return ret;
+
+	thread->audio_format = audio->format.format;
+	thread->rice = 1;
+	return 0;
+}
+
+int pack_rice_write_callback(glc_thread_state_t *state)
+{
+	pack_t pack = (pack_t) state->ptr;
+	struct pack_thread_s *thread = (struct pack_thread_s *) state->threadptr;
+	glc_container_message_header_t *container = (glc_container_message_header_t *) state->write_data;
+	glc_rice_header_t *rice_header =
+		(glc_rice_header_t *) &state->write_data[sizeof(glc_container_message_header_t)];
+	size_t header_size = sizeof(glc_container_message_header_t) + sizeof(glc_rice_header_t);
+	size_t size;
+	int ret;
+
+	if ((ret = pack_buffer(&thread->rice_work, &thread->rice_work_size,
+			       thread->layout.work_size)))
+		return ret;
+
+	memcpy(&state->write_data[header_size], state->read_data, sizeof(glc_audio_data_header_t));
+
+	/* fall back to normal compression if coding isn't lossless or doesn't pay off */
+	if ((rice_encode(&thread->layout, &state->read_data[sizeof(glc_audio_data_header_t)],
+			 &state->write_data[header_size + sizeof(glc_audio_data_header_t)],
+			 &size, thread->rice_work)) ||
+	    (size >= thread->layout.size))
+		return pack->compress_callback(state);
+
+	rice_header->size = (glc_size_t) state->read_size;
+	memcpy(&rice_header->header, &state->header, sizeof(glc_message_header_t));
+	rice_header->flags = thread->layout.interleaved ? GLC_AUDIO_INTERLEAVED : 0;
+	rice_header->channels = thread->layout.channels;
+	rice_header->format = thread->audio_format;
+
+	container->size = sizeof(glc_rice_header_t) + sizeof(glc_audio_data_header_t) + size;
+	container->header.type = GLC_MESSAGE_RICE;
+
+	state->header.type = GLC_MESSAGE_CONTAINER;
+
+	return 0;
+}
+
+void pack_get_audio_stream(pack_t pack, glc_stream_id_t id,
+			   struct pack_audio_stream_s **audio)
+{
+	*audio = pack->audio;
+
+	while (*audio != NULL) {
+		if ((*audio)->id == id)
+			break;
+		*audio = (*audio)->next;
+	}
+
+	if (*audio == NULL) {
+		*audio = (struct pack_audio_stream_s *)
+			malloc(sizeof(struct pack_audio_stream_s));
+		memset(*audio, 0, sizeof(struct pack_audio_stream_s));
+
+		(*audio)->id = id;
+
+		(*audio)->next = pack->audio;
+		pack->audio = *audio;
+	}
+}
+
+int pack_buffer(char **buffer, size_t *buffer_size, size_t size)
+{
+	char *new_buffer;
+
+	if (*buffer_size >= size)
+		return 0;
+
+	if (!(new_buffer = (char *) realloc(*buffer, size)))
+		return ENOMEM;
+	*buffer = new_buffer;
+	*buffer_size = size;
+
+	return 0;
+}
+
+int pack_adaptive_select(pack_t pack, glc_thread_state_t *state)
+{
+	struct pack_thread_s *thread = (struct pack_thread_s *) state->threadptr;
+	glc_utime_t now, time, lag;
+
+	pack->packets++;
+	if (pack_adaptive_trial(pack, state)) {
+		pack->raw_packets++;
+		return 1;
+	}
+
+	time = pack_packet_time(state);
+
+	/*
+	 Time packets have spent waiting reflects both uncompressed buffer
+	 filling up and pack blocking on full compressed buffer.
+	*/
+	now = glc_state_time(pack->glc);
+	lag = now > time ? now - time : 0;
+	if (lag > pack->max_lag)
+		pack->max_lag = lag;
+
+	if (now - pack->switch_time >= PACK_ADAPTIVE_SWITCH_INTERVAL) {
+		if ((lag > PACK_ADAPTIVE_LAG_HIGH) && (pack->ladder_pos > 0)) {
+			pack->ladder_pos--;
+			glc_log(pack->glc, GLC_PERFORMANCE, "pack",
+				 "packets are %lu ms late, switching to %s",
+				 lag / 1000, pack_compression_name(pack->ladder[pack->ladder_pos]));
+			pack->switch_time = now;
+			pack->max_lag = 0;
+		} else if ((pack->max_lag < PACK_ADAPTIVE_LAG_LOW) &&
+			   (pack->ladder_pos + 1 < pack->ladder_size)) {
+			pack->ladder_pos++;
+			glc_log(pack->glc, GLC_PERFORMANCE, "pack",
+				 "packets are at most %lu ms late, switching to %s",
+				 pack->max_lag / 1000,
+				 pack_compression_name(pack->ladder[pack->ladder_pos]));
+			pack->switch_time = now;
+			pack->max_lag = 0;
+		}
+	}
+
+	thread->compression = pack->ladder[pack->ladder_pos];
+	return 0;
+}
+
+int pack_adaptive_trial(pack_t pack, glc_thread_state_t *state)
+{
+	struct pack_thread_s *thread = (struct pack_thread_s *) state->threadptr;
+	size_t size = PACK_ADAPTIVE_TRIAL_SIZE;
+	size_t compressed_size;
+
+	if (size > state->read_size)
+		size = state->read_size;
+
+	/* middle of the packet is a better sample than header and top rows */
+	if (pack_compress(pack->ladder[0], thread->work[pack->ladder[0]],
+			  &state->read_data[(state->read_size - size) / 2], size,
+			  thread->trial, pack_worstcase(pack->ladder[0], size),
+			  &compressed_size))
+		return 0;
+
+	/* saving less than 5% isn't worth the time */
+	return compressed_size * 20 >= size * 19;
+}
+
+int pack_codec_write_callback(glc_thread_state_t *state)
+{
+	struct pack_thread_s *thread = (struct pack_thread_s *) state->threadptr;
+
+	if (thread->compression == PACK_QUICKLZ)
+		return pack_quicklz_write_callback(state);
+	else if (thread->compression == PACK_LZO)
+		return pack_lzo_write_callback(state);
+	else if (thread->compression == PACK_LZJB)
+		return pack_lzjb_write_callback(state);
+	else if (thread->compression == PACK_LZ4)
+		return pack_lz4_write_callback(state);
+	else if (thread->compression == PACK_ZSTD)
+		return pack_zstd_write_callback(state);
+
+	return ENOTSUP;
+}
+
+void pack_delta_prepare(pack_t pack, glc_thread_state_t *state)
+{
+	struct pack_thread_s *thread = (struct pack_thread_s *) state->threadptr;
+	glc_video_frame_header_t *pic_header = (glc_video_frame_header_t *) state->read_data;
+	struct pack_video_stream_s *video;
+
+	/* read callbacks are called in stream order */
+	pack_get_video_stream(pack, pic_header->id, &thread->video);
+	thread->seq = pack->delta_seq++;
+	thread->delta_pending = 1;
+	thread->keyframe = 0;
+
+	if (!(thread->video->frames++ % pack->keyframe_interval)) {
+		/* other streams must not refer to frames before keyframe */
+		for (video = pack->video; video != NULL; video = video->next)
+			video->refresh = (video != thread->video);
+		thread->keyframe = GLC_MESSAGE_VIDEO_KEYFRAME;
+	} else if (thread->video->refresh) {
+		thread->video->refresh = 0;
+		thread->keyframe = GLC_MESSAGE_VIDEO_REFRESH;
+	}
+}
+
+int pack_delta(pack_t pack, glc_thread_state_t *state, char **data)
+{
+	struct pack_thread_s *thread = (struct pack_thread_s *) state->threadptr;
+	struct pack_video_stream_s *video = thread->video;
+	size_t size = state->read_size - sizeof(glc_video_frame_header_t);
+	char *delta, *prev;
+	int ret = 0;
+
+	*data = state->read_data;
+	if (!thread->delta_pending)
+		return 0;
+
+	if (thread->delta_size < state->read_size) {
+		if ((delta = (char *) realloc(thread->delta, state->read_size))) {
+			thread->delta = delta;
+			thread->delta_size = state->read_size;
+		} else
+			ret = ENOMEM;
+	}
+
+	if (pack_delta_wait(pack, thread))
+		return EINTR;
+
+	if (ret)
+		goto finish;
+
+	if ((thread->keyframe) || (video->size != size)) {
+		if (video->size != size) {
+			video->size = size;
+			if (!(prev = (char *) realloc(video->prev, size))) {
+				ret = ENOMEM;
+				goto finish;
+			}
+			video->prev = prev;
+			video->size = size;
+		}
+
+		memcpy(video->prev, &state->read_data[sizeof(glc_video_frame_header_t)], size);
+		/* size change alone doesn't make a random access point */
+		state->header.type = thread->keyframe ? thread->keyframe
+						      : GLC_MESSAGE_VIDEO_REFRESH;
+	} else {
+		memcpy(thread->delta, state->read_data, sizeof(glc_video_frame_header_t));
+		pack_delta_encode(&thread->delta[sizeof(glc_video_frame_header_t)],
+				  &state->read_data[sizeof(glc_video_frame_header_t)],
+				  video->prev, size);
+		state->header.type = GLC_MESSAGE_VIDEO_DELTA;
+		*data = thread->delta;
+	}
+
+finish:
+	pack_delta_pass(pack, thread);
+	return ret;
+}
+
+int pack_delta_wait(pack_t pack, struct pack_thread_s *thread)
+{
+	int ret = 0;
+
+	pthread_mutex_lock(&pack->delta_mutex);
+	while ((pack->delta_turn != thread->seq) && (!pack->delta_cancel))
+		pthread_cond_wait(&pack->delta_cond, &pack->delta_mutex);
+	if (pack->delta_cancel)
+		ret = EINTR;
+	pthread_mutex_unlock(&pack->delta_mutex);
+
+	return ret;
+}
+
+void pack_delta_pass(pack_t pack, struct pack_thread_s *thread)
+{
+	pthread_mutex_lock(&pack->delta_mutex);
+	pack->delta_turn++;
+	thread->delta_pending = 0;
+	pthread_cond_broadcast(&pack->delta_cond);
+	pthread_mutex_unlock(&pack->delta_mutex);
+}
+
+void pack_delta_cancel(pack_t pack)
+{
+	pthread_mutex_lock(&pack->delta_mutex);
+	pack->delta_cancel = 1;
+	pthread_cond_broadcast(&pack->delta_cond);
+	pthread_mutex_unlock(&pack->delta_mutex);
+}
+
+void pack_delta_encode(char *delta, const char *frame, char *prev, size_t size)
+{
+	u_int64_t f, p;
+	size_t i;
+
+	/* simple enough for the compiler to vectorize */
+	for (i = 0; i + sizeof(u_int64_t) <= size; i += sizeof(u_int64_t)) {
+		memcpy(&f, &frame[i], sizeof(u_int64_t));
+		memcpy(&p, &prev[i], sizeof(u_int64_t));
+		p ^= f;
+		memcpy(&delta[i], &p, sizeof(u_int64_t));
+		memcpy(&prev[i], &f, sizeof(u_int64_t));
+	}
+
+	for (; i < size; i++) {
+		delta[i] = frame[i] ^ prev[i];
+		prev[i] = frame[i];
+	}
+}
+
+size_t pack_worstcase(int compression, size_t size)
+{
+	if (compression == PACK_QUICKLZ) {
+#ifdef __QUICKLZ
+		return __quicklz_worstcase(size);
+#endif
+	} else if (compression == PACK_LZO) {
+#ifdef __LZO
+		return __lzo_worstcase(size);
+#endif
+	} else if (compression == PACK_LZJB) {
+#ifdef __LZJB
+		return __lzjb_worstcase(size);
+#endif
+	} else if (compression == PACK_LZ4) {
+#ifdef __LZ4
+		return LZ4_compressBound(size);
+#endif
+	} else if (compression == PACK_ZSTD) {
+#ifdef __ZSTD
+		return ZSTD_compressBound(size);
+#endif
+	}
+
+	return size;
+}
+
+const char *pack_compression_name(int compression)
+{
+	if (compression == PACK_QUICKLZ)
+		return "QuickLZ";
+	else if (compression == PACK_LZO)
+		return "LZO";
+	else if (compression == PACK_LZJB)
+		return "LZJB";
+	else if (compression == PACK_LZ4)
+		return "LZ4";
+	else if (compression == PACK_ZSTD)
+		return "Zstandard";
+	return "none";
+}
+
+glc_message_type_t pack_compression_message(int compression)
+{
+	if (compression == PACK_QUICKLZ)
+		return GLC_MESSAGE_QUICKLZ;
+	else if (compression == PACK_LZO)
+		return GLC_MESSAGE_LZO;
+	else if (compression == PACK_LZJB)
+		return GLC_MESSAGE_LZJB;
+	else if (compression == PACK_LZ4)
+		return GLC_MESSAGE_LZ4;
+	return GLC_MESSAGE_ZSTD;
+}
+
+int pack_compress(int compression, void *work, const char *src, size_t size,
+		  char *dst, size_t dst_size, size_t *compressed_size)
+{
+	if (compression == PACK_QUICKLZ) {
+#ifdef __QUICKLZ
+		quicklz_compress((const unsigned char *) src, (unsigned char *) dst,
+				 size, compressed_size, (uintptr_t *) work);
+		return 0;
+#endif
+	} else if (compression == PACK_LZO) {
+#ifdef __LZO
+		lzo_uint lzo_size;
+		__lzo_compress((unsigned char *) src, size, (unsigned char *) dst,
+			       &lzo_size, (lzo_voidp) work);
+		*compressed_size = lzo_size;
+		return 0;
+#endif
+	} else if (compression == PACK_LZJB) {
+#ifdef __LZJB
+		*compressed_size = lzjb_compress((void *) src, dst, size);
+		return 0;
+#endif
+	} else if (compression == PACK_LZ4) {
+#ifdef __LZ4
+		int lz4_size = LZ4_compress_fast_extState(work, src, dst, size, dst_size, 1);
+		if (lz4_size <= 0)
+			return EINVAL;
+		*compressed_size = lz4_size;
+		return 0;
+#endif
+	} else if (compression == PACK_ZSTD) {
+#ifdef __ZSTD
+		*compressed_size = ZSTD_compress2((ZSTD_CCtx *) work, dst, dst_size, src, size);
+		if (ZSTD_isError(*compressed_size))
+			return EINVAL;
+		return 0;
+#endif
+	}
+
+	return ENOTSUP;
+}
+
+int pack_slices_prepare(pack_t pack, glc_thread_state_t *state)
+{
+	struct pack_thread_s *thread = (struct pack_thread_s *) state->threadptr;
+	struct pack_video_stream_s *video;
+	struct predict_geometry_s geom;
+	size_t bound[4], slice_size, offset, size, dst_size;
+	unsigned int parts, p, i;
+	int ret;
+
+	if (!(slice_size = pack->slice_size))
+		return 0;
+	bound[0] = 0;
+	bound[1] = state->read_size;
+	parts = 1;
+
+	/*
+	 Y', Cb and Cr planes have very different statistics so they are
+	 compressed separately.
+	*/
+	if ((!pack_video_format(pack, state, &video)) &&
+	    (video->format.format == GLC_VIDEO_YCBCR_420JPEG) &&
+	    (!predict_geometry(&geom, video->format.format, video->format.flags,
+			       video->format.width, video->format.height)) &&
+	    (geom.frame_size == state->read_size - sizeof(glc_video_frame_header_t))) {
+		parts = 3;
+		bound[1] = sizeof(glc_video_frame_header_t) + geom.plane[1].offset;
+		bound[2] = sizeof(glc_video_frame_header_t) + geom.plane[2].offset;
+		bound[3] = state->read_size;
+	} else if (state->read_size < slice_size * 2)
+		return 0;
+
+	thread->slices = 0;
+	for (p = 0; p < parts; p++)
+		thread->slices += (bound[p + 1] - bound[p] + slice_size - 1) / slice_size;
+
+	if (thread->slice_offset_count < thread->slices + 1) {
+		thread->slice_offset_count = thread->slices + 1;
+		if (!(thread->slice_offset = (size_t *) realloc(thread->slice_offset,
+								 sizeof(size_t) * 2 *
+								 thread->slice_offset_count)))
+			return ENOMEM;
+	}
+
+	i = 0;
+	dst_size = 0;
+	for (p = 0; p < parts; p++) {
+		for (offset = bound[p]; offset < bound[p + 1]; offset += size) {
+			size = bound[p + 1] - offset;
+			if (size > slice_size)
+				size = slice_size;
+
+			thread->slice_offset[i] = offset;
+			thread->slice_offset[thread->slices + 1 + i] = dst_size;
+			dst_size += pack_worstcase(thread->compression, size);
+			i++;
+		}
+	}
+	thread->slice_offset[thread->slices] = state->read_size;
+	thread->slice_offset[thread->slices * 2 + 1] = dst_size;
+
+	state->write_size = sizeof(glc_container_message_header_t)
+			    + sizeof(glc_slices_header_t)
+			    + sizeof(glc_slice_t) * thread->slices
+			    + dst_size;
+
+	/* read callbacks are serialized so this is safe */
+	if ((!pack->pool.running) &&
+	    (ret = pack_pool_start(&pack->pool, glc_threads_hint(pack->glc),
+				   &pack_thread_create_callback,
+				   &pack_thread_finish_callback, pack)))
+		return ret;
+
+	return 0;
+}
+
+int pack_slices_write(pack_t pack, glc_thread_state_t *state, char *data)
+{
+	struct pack_thread_s *thread = (struct pack_thread_s *) state->threadptr;
+	glc_container_message_header_t *container = (glc_container_message_header_t *) state->write_data;
+	glc_slices_header_t *slices_header =
+		(glc_slices_header_t *) &state->write_data[sizeof(glc_container_message_header_t)];
+	struct pack_slices_s slices;
+	struct pack_pool_job_s job;
+	size_t compressed_size;
+	unsigned int i;
+	int ret;
+
+	slices.compression = thread->compression;
+	slices.data = data;
+	slices.offset = thread->slice_offset;
+	slices.slice = (glc_slice_t *) &slices_header[1];
+	slices.dst = (char *) &slices.slice[thread->slices];
+	slices.dst_offset = &thread->slice_offset[thread->slices + 1];
+
+	job.func = &pack_slice_compress;
+	job.ptr = &slices;
+	job.count = thread->slices;
+
+	if ((ret = pack_pool_run(&pack->pool, &job, thread)))
+		return ret;
+
+	/* pack compressed slices together */
+	compressed_size = slices.slice[0].compressed_size;
+	for (i = 1; i < thread->slices; i++) {
+		memmove(&slices.dst[compressed_size], &slices.dst[slices.dst_offset[i]],
+			slices.slice[i].compressed_size);
+		compressed_size += slices.slice[i].compressed_size;
+	}
+
+	slices_header->size = (glc_size_t) state->read_size;
+	memcpy(&slices_header->header, &state->header, sizeof(glc_message_header_t));
+	slices_header->compression.type = pack_compression_message(thread->compression);
+	slices_header->count = thread->slices;
+
+	container->size = sizeof(glc_slices_header_t) +
+			  sizeof(glc_slice_t) * thread->slices + compressed_size;
+	container->header.type = GLC_MESSAGE_SLICES;
+
+	state->header.type = GLC_MESSAGE_CONTAINER;
+
+	return 0;
+}
+
+int pack_slice_compress(struct pack_pool_job_s *job, unsigned int index, void *threadptr)
+{
+	struct pack_slices_s *slices = (struct pack_slices_s *) job->ptr;
+	size_t compressed_size;
+	int ret;
+
+	slices->slice[index].size = slices->offset[index + 1] - slices->offset[index];
+
+	if ((ret = pack_compress(slices->compression,
+				 ((struct pack_thread_s *) threadptr)->work[slices->compression],
+				 &slices->data[slices->offset[index]], slices->slice[index].size,
+				 &slices->dst[slices->dst_offset[index]],
+				 slices->dst_offset[index + 1] - slices->dst_offset[index],
+				 &compressed_size)))
+		return ret;
+
+	slices->slice[index].compressed_size = compressed_size;
+	return 0;
+}
+
+void pack_get_video_stream(pack_t pack, glc_stream_id_t id,
+			   struct pack_video_stream_s **video)
+{
+	*video = pack->video;
+
+	while (*video != NULL) {
+		if ((*video)->id == id)
+			break;
+		*video = (*video)->next;
+	}
+
+	if (*video == NULL) {
+		*video = (struct pack_video_stream_s *)
+			malloc(sizeof(struct pack_video_stream_s));
+		memset(*video, 0, sizeof(struct pack_video_stream_s));
+
+		(*video)->id = id;
+
+		(*video)->next = pack->video;
+		pack->video = *video;
+	}
+}
+
+int pack_video_format(pack_t pack, glc_thread_state_t *state,
+		      struct pack_video_stream_s **video)
+{
+	/* read callbacks are called in stream order, format is up to date */
+	pack_get_video_stream(pack, ((glc_video_frame_header_t *) state->read_data)->id,
+			      video);
+	if (!(*video)->has_format)
+		return EINVAL;
+	return 0;
+}
+
+int pack_lzo_write_callback(glc_thread_state_t *state)
+{
+#ifdef __LZO
+	glc_container_message_header_t *container = (glc_container_message_header_t *) state->write_data;
+	glc_lzo_header_t *lzo_header =
+		(glc_lzo_header_t *) &state->write_data[sizeof(glc_container_message_header_t)];
+	struct pack_thread_s *thread = (struct pack_thread_s *) state->threadptr;
+	lzo_uint compressed_size;
+	char *data;
+	int ret;
+
+	if ((ret = pack_delta((pack_t) state->ptr, state, &data)))
+		return ret;
+
+	if (((struct pack_thread_s *) state->threadptr)->slices)
+		return pack_slices_write((pack_t) state->ptr, state, data);
+
+	__lzo_compress((unsigned char *) data, state->read_size,
+		       (unsigned char *) &state->write_data[sizeof(glc_lzo_header_t) +
+		       					    sizeof(glc_container_message_header_t)],
+		       &compressed_size, (lzo_voidp) thread->work[PACK_LZO]);
+
+	lzo_header->size = (glc_size_t) state->read_size;
+	memcpy(&lzo_header->header, &state->header, sizeof(glc_message_header_t));
+
+	container->size = compressed_size + sizeof(glc_lzo_header_t);
+	container->header.type = GLC_MESSAGE_LZO;
+
+	state->header.type = GLC_MESSAGE_CONTAINER;
+
+	return 0;
+#else
+	return ENOTSUP;
+#endif
+}
+
+int pack_quicklz_write_callback(glc_thread_state_t *state)
+{
+#ifdef __QUICKLZ
+	glc_container_message_header_t *container = (glc_container_message_header_t *) state->write_data;
+	glc_quicklz_header_t *quicklz_header =
+		(glc_quicklz_header_t *) &state->write_data[sizeof(glc_container_message_header_t)];
+	struct pack_thread_s *thread = (struct pack_thread_s *) state->threadptr;
+	size_t compressed_size;
+	char *data;
+	int ret;
+
+	if ((ret = pack_delta((pack_t) state->ptr, state, &data)))
+		return ret;
+
+	if (((struct pack_thread_s *) state->threadptr)->slices)
+		return pack_slices_write((pack_t) state->ptr, state, data);
+
+	quicklz_compress((const unsigned char *) data,
+			 (unsigned char *) &state->write_data[sizeof(glc_quicklz_header_t) +
+			 				      sizeof(glc_container_message_header_t)],
+			 state->read_size, &compressed_size,
+			 (uintptr_t *) thread->work[PACK_QUICKLZ]);
+
+	quicklz_header->size = (glc_size_t) state->read_size;
+	memcpy(&quicklz_header->header, &state->header, sizeof(glc_message_header_t));
+
+	container->size = compressed_size + sizeof(glc_quicklz_header_t);
+	container->header.type = GLC_MESSAGE_QUICKLZ;
+
+	state->header.type = GLC_MESSAGE_CONTAINER;
+
+	return 0;
+#else
+	return ENOTSUP;
+#endif
+}
+
+int pack_lzjb_write_callback(glc_thread_state_t *state)
+{
+#ifdef __LZJB
+	glc_container_message_header_t *container = (glc_container_message_header_t *) state->write_data;
+	glc_lzjb_header_t *lzjb_header =
+		(glc_lzjb_header_t *) &state->write_data[sizeof(glc_container_message_header_t)];
+	size_t compressed_size;
+	char *data;
+	int ret;
+
+	if ((ret = pack_delta((pack_t) state->ptr, state, &data)))
+		return ret;
+
+	if (((struct pack_thread_s *) state->threadptr)->slices)
+		return pack_slices_write((pack_t) state->ptr, state, data);
+
+	compressed_size = lzjb_compress(data,
+					&state->write_data[sizeof(glc_lzjb_header_t) +
+							   sizeof(glc_container_message_header_t)],
+					state->read_size);
+
+	lzjb_header->size = (glc_size_t) state->read_size;
+	memcpy(&lzjb_header->header, &state->header, sizeof(glc_message_header_t));
+
+	container->size = compressed_size + sizeof(glc_lzjb_header_t);
+	container->header.type = GLC_MESSAGE_LZJB;
+
+	state->header.type = GLC_MESSAGE_CONTAINER;
+
+	return 0;
+#else
+	return ENOTSUP;
+#endif
+}
+
+int pack_lz4_write_callback(glc_thread_state_t *state)
+{
+#ifdef __LZ4
+	glc_container_message_header_t *container = (glc_container_message_header_t *) state->write_data;
+	glc_lz4_header_t *lz4_header =
+		(glc_lz4_header_t *) &state->write_data[sizeof(glc_container_message_header_t)];
+	struct pack_thread_s *thread = (struct pack_thread_s *) state->threadptr;
+	size_t header_size = sizeof(glc_container_message_header_t) + sizeof(glc_lz4_header_t);
+	int compressed_size;
+	char *data;
+	int ret;
+
+	if ((ret = pack_delta((pack_t) state->ptr, state, &data)))
+		return ret;
+
+	if (((struct pack_thread_s *) state->threadptr)->slices)
+		return pack_slices_write((pack_t) state->ptr, state, data);
+
+	compressed_size = LZ4_compress_fast_extState(thread->work[PACK_LZ4], data,
+						     &state->write_data[header_size],
+						     state->read_size,
+						     state->write_size - header_size, 1);
+	if (compressed_size <= 0)
+		return EINVAL;
+
+	lz4_header->size = (glc_size_t) state->read_size;
+	memcpy(&lz4_header->header, &state->header, sizeof(glc_message_header_t));
+
+	container->size = compressed_size + sizeof(glc_lz4_header_t);
+	container->header.type = GLC_MESSAGE_LZ4;
+
+	state->header.type = GLC_MESSAGE_CONTAINER;
+
+	return 0;
+#else
+	return ENOTSUP;
+#endif
+}
+
+int pack_zstd_write_callback(glc_thread_state_t *state)
+{
+#ifdef __ZSTD
+	glc_container_message_header_t *container = (glc_container_message_header_t *) state->write_data;
+	glc_zstd_header_t *zstd_header =
+		(glc_zstd_header_t *) &state->write_data[sizeof(glc_container_message_header_t)];
+	struct pack_thread_s *thread = (struct pack_thread_s *) state->threadptr;
+	size_t header_size = sizeof(glc_container_message_header_t) + sizeof(glc_zstd_header_t);
+	size_t compressed_size;
+	char *data;
+	int ret;
+
+	if ((ret = pack_delta((pack_t) state->ptr, state, &data)))
+		return ret;
+
+	if (((struct pack_thread_s *) state->threadptr)->slices)
+		return pack_slices_write((pack_t) state->ptr, state, data);
+
+	compressed_size = ZSTD_compress2((ZSTD_CCtx *) thread->work[PACK_ZSTD],
+					 &state->write_data[header_size],
+					 state->write_size - header_size,
+					 data, state->read_size);
+	if (ZSTD_isError(compressed_size)) {
+		glc_log(((pack_t) state->ptr)->glc, GLC_ERROR, "pack",
+			 "Zstandard compression failed: %s",
+			 ZSTD_getErrorName(compressed_size));
+		return EINVAL;
+	}
+
+	zstd_header->size = (glc_size_t) state->read_size;
+	memcpy(&zstd_header->header, &state->header, sizeof(glc_message_header_t));
+
+	container->size = compressed_size + sizeof(glc_zstd_header_t);
+	container->header.type = GLC_MESSAGE_ZSTD;
+
+	state->header.type = GLC_MESSAGE_CONTAINER;
+
+	return 0;
+#else
+	return ENOTSUP;
+#endif
+}
+
+int unpack_init(unpack_t *unpack, glc_t *glc)
+{
+	*unpack = (unpack_t) malloc(sizeof(struct unpack_s));
+	memset(*unpack, 0, sizeof(struct unpack_s));
+
+	(*unpack)->glc = glc;
+
+	(*unpack)->thread.flags = GLC_THREAD_WRITE | GLC_THREAD_READ | GLC_THREAD_REORDER;
+	(*unpack)->thread.ptr = *unpack;
+	(*unpack)->thread.thread_create_callback = &unpack_thread_create_callback;
+	(*unpack)->thread.thread_finish_callback = &unpack_thread_finish_callback;
+	(*unpack)->thread.read_callback = &unpack_read_callback;
+	(*unpack)->thread.write_callback = &unpack_write_callback;
+	(*unpack)->thread.finish_callback = &unpack_finish_callback;
+	(*unpack)->thread.threads = glc_threads_hint(glc);
+
+	pthread_mutex_init(&(*unpack)->delta_mutex, NULL);
+	pthread_cond_init(&(*unpack)->delta_cond, NULL);
+
+#ifdef __LZO
+	lzo_init();
+#endif
+
+	return 0;
+}
+
+int unpack_process_start(unpack_t unpack, ps_buffer_t *from, ps_buffer_t *to)
+{
+	int ret;
+	if (unpack->running)
+		return EAGAIN;
+
+	if ((ret = glc_thread_create(unpack->glc, &unpack->thread, from, to)))
+		return ret;
+	unpack->running = 1;
+
+	return 0;
+}
+
+int unpack_process_wait(unpack_t unpack)
+{
+	if (!unpack->running)
+		return EAGAIN;
+
 	glc_thread_wait(&unpack->thread);
+	pack_pool_stop(&unpack->pool);
 	unpack->running = 0;
 
 	return 0;
@@ -396,6 +1908,8 @@ int unpack_process_wait(unpack_t unpack)
 
 int unpack_destroy(unpack_t unpack)
 {
+	pthread_mutex_destroy(&unpack->delta_mutex);
+	pthread_cond_destroy(&unpack->delta_cond);
 	free(unpack);
 	return 0;
 }
@@ -403,16 +1917,62 @@ int unpack_destroy(unpack_t unpack)
 void unpack_finish_callback(void *ptr, int err)
 {
 	unpack_t unpack = (unpack_t) ptr;
+	struct unpack_video_stream_s *del;
 
 	if (err)
 		glc_log(unpack->glc, GLC_ERROR, "unpack", "%s (%d)", strerror(err), err);
+
+	while (unpack->video != NULL) {
+		del = unpack->video;
+		unpack->video = unpack->video->next;
+
+		if (del->prev)
+			free(del->prev);
+		free(del);
+	}
+
+	unpack->delta_seq = unpack->delta_turn = 0;
+	unpack->delta_cancel = 0;
+}
+
+int unpack_thread_create_callback(void *ptr, void **threadptr)
+{
+	*threadptr = malloc(sizeof(struct unpack_thread_s));
+	memset(*threadptr, 0, sizeof(struct unpack_thread_s));
+	return 0;
+}
+
+void unpack_thread_finish_callback(void *ptr, void *threadptr, int err)
+{
+	/* turns of failed thread are never passed, don't leave others waiting */
+	if (err)
+		unpack_delta_cancel((unpack_t) ptr);
+
+#ifdef __ZSTD
+	if (((struct unpack_thread_s *) threadptr)->zstd)
+		ZSTD_freeDCtx((ZSTD_DCtx *) ((struct unpack_thread_s *) threadptr)->zstd);
+#endif
+	if (((struct unpack_thread_s *) threadptr)->offset)
+		free(((struct unpack_thread_s *) threadptr)->offset);
+	if (((struct unpack_thread_s *) threadptr)->predicted)
+		free(((struct unpack_thread_s *) threadptr)->predicted);
+	if (((struct unpack_thread_s *) threadptr)->predict_work)
+		free(((struct unpack_thread_s *) threadptr)->predict_work);
+	free(threadptr);
 }
 
 int unpack_read_callback(glc_thread_state_t *state)
 {
+	unpack_t unpack = (unpack_t) state->ptr;
+	int ret;
+
+	((struct unpack_thread_s *) state->threadptr)->delta = 0;
+
 	if (state->header.type == GLC_MESSAGE_LZO) {
 #ifdef __LZO
 		state->write_size = ((glc_lzo_header_t *) state->read_data)->size;
+		unpack_delta_prepare(unpack, state,
+				     &((glc_lzo_header_t *) state->read_data)->header);
 		return 0;
 #else
 		glc_log(((unpack_t) state->ptr)->glc,
@@ -422,6 +1982,8 @@ int unpack_read_callback(glc_thread_state_t *state)
 	} else if (state->header.type == GLC_MESSAGE_QUICKLZ) {
 #ifdef __QUICKLZ
 		state->write_size = ((glc_quicklz_header_t *) state->read_data)->size;
+		unpack_delta_prepare(unpack, state,
+				     &((glc_quicklz_header_t *) state->read_data)->header);
 		return 0;
 #else
 		glc_log(((unpack_t) state->ptr)->glc,
@@ -431,12 +1993,59 @@ int unpack_read_callback(glc_thread_state_t *state)
 	} else if (state->header.type == GLC_MESSAGE_LZJB) {
 #ifdef __LZJB
 		state->write_size = ((glc_lzjb_header_t *) state->read_data)->size;
+		unpack_delta_prepare(unpack, state,
+				     &((glc_lzjb_header_t *) state->read_data)->header);
 		return 0;
 #else
 		glc_log(((unpack_t) state->ptr)->glc,
 			GLC_ERROR, "unpack", "LZJB not supported");
 		return ENOTSUP;
 #endif
+	} else if (state->header.type == GLC_MESSAGE_LZ4) {
+#ifdef __LZ4
+		state->write_size = ((glc_lz4_header_t *) state->read_data)->size;
+		unpack_delta_prepare(unpack, state,
+				     &((glc_lz4_header_t *) state->read_data)->header);
+		return 0;
+#else
+		glc_log(((unpack_t) state->ptr)->glc,
+			 GLC_ERROR, "unpack", "LZ4 not supported");
+		return ENOTSUP;
+#endif
+	} else if (state->header.type == GLC_MESSAGE_ZSTD) {
+#ifdef __ZSTD
+		state->write_size = ((glc_zstd_header_t *) state->read_data)->size;
+		unpack_delta_prepare(unpack, state,
+				     &((glc_zstd_header_t *) state->read_data)->header);
+		return 0;
+#else
+		glc_log(((unpack_t) state->ptr)->glc,
+			 GLC_ERROR, "unpack", "Zstandard not supported");
+		return ENOTSUP;
+#endif
+	} else if (state->header.type == GLC_MESSAGE_SLICES) {
+		/* read callbacks are serialized so this is safe */
+		if ((!unpack->pool.running) &&
+		    (ret = pack_pool_start(&unpack->pool, glc_threads_hint(unpack->glc),
+					   &unpack_thread_create_callback,
+					   &unpack_thread_finish_callback, unpack)))
+			return ret;
+
+		state->write_size = ((glc_slices_header_t *) state->read_data)->size;
+		unpack_delta_prepare(unpack, state,
+				     &((glc_slices_header_t *) state->read_data)->header);
+		return 0;
+	} else if (state->header.type == GLC_MESSAGE_PREDICTED) {
+		state->write_size = ((glc_predicted_header_t *) state->read_data)->size;
+		unpack_delta_prepare(unpack, state,
+				     &((glc_predicted_header_t *) state->read_data)->header);
+		return 0;
+	} else if (state->header.type == GLC_MESSAGE_RICE) {
+		state->write_size = ((glc_rice_header_t *) state->read_data)->size;
+		return 0;
+	} else if (state->header.type == GLC_MESSAGE_DCT) {
+		state->write_size = ((glc_dct_header_t *) state->read_data)->size;
+		return 0;
 	}
 
 	state->flags |= GLC_THREAD_COPY;
@@ -444,6 +2053,24 @@ int unpack_read_callback(glc_thread_state_t *state)
 }
 
 int unpack_write_callback(glc_thread_state_t *state)
+{
+	unpack_t unpack = (unpack_t) state->ptr;
+	struct unpack_thread_s *thread = (struct unpack_thread_s *) state->threadptr;
+	int ret;
+
+	ret = unpack_write_message(state);
+	if (!thread->delta)
+		return ret;
+
+	/* turn is passed even if packet is corrupted, following frames wait for it */
+	if (!ret)
+		return unpack_delta(unpack, state);
+	if (!unpack_delta_wait(unpack, thread))
+		unpack_delta_pass(unpack, thread);
+	return ret;
+}
+
+int unpack_write_message(glc_thread_state_t *state)
 {
 	if (state->header.type == GLC_MESSAGE_LZO) {
 #ifdef __LZO
@@ -478,10 +2105,519 @@ int unpack_write_callback(glc_thread_state_t *state)
 #else
 		return ENOTSUP;
 #endif
+	} else if (state->header.type == GLC_MESSAGE_LZ4) {
+#ifdef __LZ4
+		memcpy(&state->header, &((glc_lz4_header_t *) state->read_data)->header,
+		       sizeof(glc_message_header_t));
+		if (LZ4_decompress_safe(&state->read_data[sizeof(glc_lz4_header_t)],
+					state->write_data,
+					state->read_size - sizeof(glc_lz4_header_t),
+					state->write_size) != state->write_size)
+			return EINVAL;
+#else
+		return ENOTSUP;
+#endif
+	} else if (state->header.type == GLC_MESSAGE_ZSTD) {
+#ifdef __ZSTD
+		struct unpack_thread_s *thread = (struct unpack_thread_s *) state->threadptr;
+		size_t size;
+
+		if ((!thread->zstd) && (!(thread->zstd = ZSTD_createDCtx())))
+			return ENOMEM;
+
+		memcpy(&state->header, &((glc_zstd_header_t *) state->read_data)->header,
+		       sizeof(glc_message_header_t));
+		size = ZSTD_decompressDCtx((ZSTD_DCtx *) thread->zstd,
+					   state->write_data, state->write_size,
+					   &state->read_data[sizeof(glc_zstd_header_t)],
+					   state->read_size - sizeof(glc_zstd_header_t));
+		if (size != state->write_size)
+			return EINVAL;
+#else
+		return ENOTSUP;
+#endif
+	} else if (state->header.type == GLC_MESSAGE_SLICES) {
+		int ret;
+
+		memcpy(&state->header, &((glc_slices_header_t *) state->read_data)->header,
+		       sizeof(glc_message_header_t));
+		if ((ret = unpack_slices((unpack_t) state->ptr, state)))
+			return ret;
+	} else if (state->header.type == GLC_MESSAGE_PREDICTED) {
+		int ret;
+
+		memcpy(&state->header, &((glc_predicted_header_t *) state->read_data)->header,
+		       sizeof(glc_message_header_t));
+		if ((ret = unpack_predicted((unpack_t) state->ptr, state)))
+			return ret;
+	} else if (state->header.type == GLC_MESSAGE_RICE) {
+		memcpy(&state->header, &((glc_rice_header_t *) state->read_data)->header,
+		       sizeof(glc_message_header_t));
+		return unpack_rice((unpack_t) state->ptr, state);
+	} else if (state->header.type == GLC_MESSAGE_DCT) {
+		memcpy(&state->header, &((glc_dct_header_t *) state->read_data)->header,
+		       sizeof(glc_message_header_t));
+		return unpack_dct((unpack_t) state->ptr, state);
 	} else
 		return ENOTSUP;
 
 	return 0;
 }
 
+void unpack_delta_prepare(unpack_t unpack, glc_thread_state_t *state,
+			  glc_message_header_t *header)
+{
+	struct unpack_thread_s *thread = (struct unpack_thread_s *) state->threadptr;
+
+	if ((header->type != GLC_MESSAGE_VIDEO_DELTA) &&
+	    (header->type != GLC_MESSAGE_VIDEO_KEYFRAME) &&
+	    (header->type != GLC_MESSAGE_VIDEO_REFRESH))
+		return;
+
+	/* stream id is known only after decompression */
+	thread->delta = 1;
+	thread->seq = unpack->delta_seq++;
+}
+
+int unpack_delta(unpack_t unpack, glc_thread_state_t *state)
+{
+	struct unpack_thread_s *thread = (struct unpack_thread_s *) state->threadptr;
+	glc_video_frame_header_t *pic_header = (glc_video_frame_header_t *) state->write_data;
+	char *frame = &state->write_data[sizeof(glc_video_frame_header_t)];
+	size_t size = state->write_size - sizeof(glc_video_frame_header_t);
+	struct unpack_video_stream_s *video;
+	char *prev;
+	int ret = 0;
+
+	if (unpack_delta_wait(unpack, thread))
+		return EINTR;
+
+	unpack_get_video_stream(unpack, pic_header->id, &video);
+
+	if ((state->header.type == GLC_MESSAGE_VIDEO_KEYFRAME) |
+	    (state->header.type == GLC_MESSAGE_VIDEO_REFRESH)) {
+		if (video->size != size) {
+			if (!(prev = (char *) realloc(video->prev, size))) {
+				ret = ENOMEM;
+				goto finish;
+			}
+			video->prev = prev;
+			video->size = size;
+		}
+		memcpy(video->prev, frame, size);
+	} else if (video->size == size)
+		unpack_delta_decode(frame, video->prev, size);
+	else {
+		glc_log(unpack->glc, GLC_ERROR, "unpack",
+			 "delta frame without keyframe in video stream %d", pic_header->id);
+		ret = EINVAL;
+		goto finish;
+	}
+
+	state->header.type = GLC_MESSAGE_VIDEO_FRAME;
+
+finish:
+	unpack_delta_pass(unpack, thread);
+	return ret;
+}
+
+int unpack_delta_wait(unpack_t unpack, struct unpack_thread_s *thread)
+{
+	int ret = 0;
+
+	pthread_mutex_lock(&unpack->delta_mutex);
+	while ((unpack->delta_turn != thread->seq) && (!unpack->delta_cancel))
+		pthread_cond_wait(&unpack->delta_cond, &unpack->delta_mutex);
+	if (unpack->delta_cancel)
+		ret = EINTR;
+	pthread_mutex_unlock(&unpack->delta_mutex);
+
+	return ret;
+}
+
+void unpack_delta_pass(unpack_t unpack, struct unpack_thread_s *thread)
+{
+	pthread_mutex_lock(&unpack->delta_mutex);
+	unpack->delta_turn++;
+	thread->delta = 0;
+	pthread_cond_broadcast(&unpack->delta_cond);
+	pthread_mutex_unlock(&unpack->delta_mutex);
+}
+
+void unpack_delta_cancel(unpack_t unpack)
+{
+	pthread_mutex_lock(&unpack->delta_mutex);
+	unpack->delta_cancel = 1;
+	pthread_cond_broadcast(&unpack->delta_cond);
+	pthread_mutex_unlock(&unpack->delta_mutex);
+}
+
+void unpack_delta_decode(char *frame, char *prev, size_t size)
+{
+	u_int64_t f, p;
+	size_t i;
+
+	for (i = 0; i + sizeof(u_int64_t) <= size; i += sizeof(u_int64_t)) {
+		memcpy(&f, &frame[i], sizeof(u_int64_t));
+		memcpy(&p, &prev[i], sizeof(u_int64_t));
+		p ^= f;
+		memcpy(&frame[i], &p, sizeof(u_int64_t));
+		memcpy(&prev[i], &p, sizeof(u_int64_t));
+	}
+
+	for (; i < size; i++) {
+		frame[i] ^= prev[i];
+		prev[i] = frame[i];
+	}
+}
+
+int unpack_predicted(unpack_t unpack, glc_thread_state_t *state)
+{
+	struct unpack_thread_s *thread = (struct unpack_thread_s *) state->threadptr;
+	glc_predicted_header_t *predicted_header = (glc_predicted_header_t *) state->read_data;
+	struct predict_geometry_s geom;
+	size_t size;
+	int ret;
+
+	if ((ret = predict_geometry(&geom, predicted_header->format, predicted_header->flags,
+				    predicted_header->width, predicted_header->height)))
+		return ret;
+	if (state->write_size != sizeof(glc_video_frame_header_t) + geom.frame_size)
+		return EINVAL;
+
+	size = sizeof(glc_video_frame_header_t) + geom.size;
+	if ((ret = pack_buffer(&thread->predicted, &thread->predicted_size, size)) ||
+	    (ret = pack_buffer(&thread->predict_work, &thread->predict_work_size,
+			       geom.work_size)))
+		return ret;
+
+	if ((ret = unpack_decompress(predicted_header->compression.type, thread,
+				     &state->read_data[sizeof(glc_predicted_header_t)],
+				     state->read_size - sizeof(glc_predicted_header_t),
+				     thread->predicted, size)))
+		return ret;
+
+	memcpy(state->write_data, thread->predicted, sizeof(glc_video_frame_header_t));
+	return predict_decode(&geom, &thread->predicted[sizeof(glc_video_frame_header_t)],
+			      &state->write_data[sizeof(glc_video_frame_header_t)],
+			      thread->predict_work);
+}
+
+int unpack_dct(unpack_t unpack, glc_thread_state_t *state)
+{
+	struct unpack_thread_s *thread = (struct unpack_thread_s *) state->threadptr;
+	glc_dct_header_t *dct_header = (glc_dct_header_t *) state->read_data;
+	struct dct_geometry_s geom;
+	size_t size = dct_header->coded_size;
+	int ret;
+
+	if ((ret = dct_geometry(&geom, dct_header->width, dct_header->height,
+				dct_header->quality)))
+		return ret;
+	if ((state->write_size != sizeof(glc_video_frame_header_t) + geom.frame_size) ||
+	    (size < sizeof(glc_video_frame_header_t)))
+		return EINVAL;
+
+	/* coded frame is decompressed to the same buffer as filtered frames */
+	if ((ret = pack_buffer(&thread->predicted, &thread->predicted_size, size)))
+		return ret;
+
+	if ((ret = unpack_decompress(dct_header->compression.type, thread,
+				     &state->read_data[sizeof(glc_dct_header_t)],
+				     state->read_size - sizeof(glc_dct_header_t),
+				     thread->predicted, size)))
+		return ret;
+
+	memcpy(state->write_data, thread->predicted, sizeof(glc_video_frame_header_t));
+	return dct_decode(&geom, &thread->predicted[sizeof(glc_video_frame_header_t)],
+			  size - sizeof(glc_video_frame_header_t),
+			  &state->write_data[sizeof(glc_video_frame_header_t)]);
+}
+
+int unpack_rice(unpack_t unpack, glc_thread_state_t *state)
+{
+	glc_rice_header_t *rice_header = (glc_rice_header_t *) state->read_data;
+	glc_audio_data_header_t *audio_header =
+		(glc_audio_data_header_t *) &state->read_data[sizeof(glc_rice_header_t)];
+	size_t header_size = sizeof(glc_rice_header_t) + sizeof(glc_audio_data_header_t);
+	struct rice_layout_s layout;
+	int ret;
+
+	if (state->read_size < header_size)
+		return EINVAL;
+	if ((ret = rice_layout(&layout, rice_header->format, rice_header->flags,
+			       rice_header->channels, audio_header->size)))
+		return ret;
+	if (state->write_size != sizeof(glc_audio_data_header_t) + layout.size)
+		return EINVAL;
+
+	memcpy(state->write_data, audio_header, sizeof(glc_audio_data_header_t));
+	return rice_decode(&layout, &state->read_data[header_size],
+			   state->read_size - header_size,
+			   &state->write_data[sizeof(glc_audio_data_header_t)]);
+}
+
+int unpack_decompress(glc_message_type_t compression, struct unpack_thread_s *thread,
+		      const char *src, size_t size, char *dst, size_t dst_size)
+{
+	if (compression == GLC_MESSAGE_QUICKLZ) {
+#ifdef __QUICKLZ
+		quicklz_decompress((const unsigned char *) src, (unsigned char *) dst, dst_size);
+		return 0;
+#endif
+	} else if (compression == GLC_MESSAGE_LZO) {
+#ifdef __LZO
+		lzo_uint lzo_size = dst_size;
+		__lzo_decompress((unsigned char *) src, size, (unsigned char *) dst,
+				 &lzo_size, NULL);
+		return lzo_size == dst_size ? 0 : EINVAL;
+#endif
+	} else if (compression == GLC_MESSAGE_LZJB) {
+#ifdef __LZJB
+		lzjb_decompress((void *) src, dst, size, dst_size);
+		return 0;
+#endif
+	} else if (compression == GLC_MESSAGE_LZ4) {
+#ifdef __LZ4
+		if (LZ4_decompress_safe(src, dst, size, dst_size) != dst_size)
+			return EINVAL;
+		return 0;
+#endif
+	} else if (compression == GLC_MESSAGE_ZSTD) {
+#ifdef __ZSTD
+		if ((!thread->zstd) && (!(thread->zstd = ZSTD_createDCtx())))
+			return ENOMEM;
+		if (ZSTD_decompressDCtx((ZSTD_DCtx *) thread->zstd, dst, dst_size,
+					src, size) != dst_size)
+			return EINVAL;
+		return 0;
+#endif
+	}
+
+	return ENOTSUP;
+}
+
+int unpack_slices(unpack_t unpack, glc_thread_state_t *state)
+{
+	struct unpack_thread_s *thread = (struct unpack_thread_s *) state->threadptr;
+	glc_slices_header_t *slices_header = (glc_slices_header_t *) state->read_data;
+	struct unpack_slices_s slices;
+	struct pack_pool_job_s job;
+	size_t src_size, dst_size;
+	unsigned int i;
+
+	if (state->read_size < sizeof(glc_slices_header_t) +
+			       sizeof(glc_slice_t) * slices_header->count)
+		goto invalid;
+
+	if (thread->offset_count < slices_header->count) {
+		thread->offset_count = slices_header->count;
+		if (!(thread->offset = (size_t *) realloc(thread->offset,
+							  sizeof(size_t) * 2 * thread->offset_count)))
+			return ENOMEM;
+	}
+
+	slices.compression = slices_header->compression.type;
+	slices.slice = (glc_slice_t *) &slices_header[1];
+	slices.src = (const char *) &slices.slice[slices_header->count];
+	slices.dst = state->write_data;
+	slices.src_offset = thread->offset;
+	slices.dst_offset = &thread->offset[slices_header->count];
+
+	src_size = dst_size = 0;
+	for (i = 0; i < slices_header->count; i++) {
+		slices.src_offset[i] = src_size;
+		slices.dst_offset[i] = dst_size;
+		src_size += slices.slice[i].compressed_size;
+		dst_size += slices.slice[i].size;
+	}
+
+	if ((dst_size != state->write_size) ||
+	    (&slices.src[src_size] > &state->read_data[state->read_size]))
+		goto invalid;
+
+	job.func = &unpack_slice_decompress;
+	job.ptr = &slices;
+	job.count = slices_header->count;
+
+	return pack_pool_run(&unpack->pool, &job, thread);
+
+invalid:
+	glc_log(unpack->glc, GLC_ERROR, "unpack", "invalid sliced message");
+	return EINVAL;
+}
+
+int unpack_slice_decompress(struct pack_pool_job_s *job, unsigned int index, void *threadptr)
+{
+	struct unpack_slices_s *slices = (struct unpack_slices_s *) job->ptr;
+
+	return unpack_decompress(slices->compression, (struct unpack_thread_s *) threadptr,
+				 &slices->src[slices->src_offset[index]],
+				 slices->slice[index].compressed_size,
+				 &slices->dst[slices->dst_offset[index]],
+				 slices->slice[index].size);
+}
+
+int pack_pool_start(struct pack_pool_s *pool, size_t threads,
+		    int (*thread_create_callback)(void *, void **),
+		    void (*thread_finish_callback)(void *, void *, int),
+		    void *ptr)
+{
+	int ret;
+
+	pool->thread_create_callback = thread_create_callback;
+	pool->thread_finish_callback = thread_finish_callback;
+	pool->ptr = ptr;
+	pool->jobs = NULL;
+	pool->quit = 0;
+
+	pthread_mutex_init(&pool->mutex, NULL);
+	pthread_cond_init(&pool->job_cond, NULL);
+	pthread_cond_init(&pool->done_cond, NULL);
+
+	pool->threads = (pthread_t *) malloc(sizeof(pthread_t) * threads);
+	pool->running = 1;
+
+	for (pool->threads_count = 0; pool->threads_count < threads; pool->threads_count++) {
+		if ((ret = pthread_create(&pool->threads[pool->threads_count], NULL,
+					  &pack_pool_thread, pool))) {
+			pack_pool_stop(pool);
+			return ret;
+		}
+	}
+
+	return 0;
+}
+
+void pack_pool_stop(struct pack_pool_s *pool)
+{
+	size_t t;
+
+	if (!pool->running)
+		return;
+
+	pthread_mutex_lock(&pool->mutex);
+	pool->quit = 1;
+	pthread_cond_broadcast(&pool->job_cond);
+	pthread_mutex_unlock(&pool->mutex);
+
+	for (t = 0; t < pool->threads_count; t++)
+		pthread_join(pool->threads[t], NULL);
+	free(pool->threads);
+
+	pthread_mutex_destroy(&pool->mutex);
+	pthread_cond_destroy(&pool->job_cond);
+	pthread_cond_destroy(&pool->done_cond);
+	pool->running = 0;
+}
+
+int pack_pool_run(struct pack_pool_s *pool, struct pack_pool_job_s *job,
+		  void *threadptr)
+{
+	struct pack_pool_job_s **last;
+	unsigned int index;
+	int ret;
+
+	job->next = job->done = 0;
+	job->ret = 0;
+	job->next_job = NULL;
+
+	pthread_mutex_lock(&pool->mutex);
+	for (last = &pool->jobs; *last != NULL; last = &(*last)->next_job);
+	*last = job;
+	pthread_cond_broadcast(&pool->job_cond);
+
+	/* calling thread works on its own job too */
+	while (job->next < job->count) {
+		index = pack_pool_take(pool, job);
+		pthread_mutex_unlock(&pool->mutex);
+		ret = job->func(job, index, threadptr);
+		pthread_mutex_lock(&pool->mutex);
+		pack_pool_done(pool, job, ret);
+	}
+
+	while (job->done < job->count)
+		pthread_cond_wait(&pool->done_cond, &pool->mutex);
+	pthread_mutex_unlock(&pool->mutex);
+
+	return job->ret;
+}
+
+void *pack_pool_thread(void *argptr)
+{
+	struct pack_pool_s *pool = (struct pack_pool_s *) argptr;
+	struct pack_pool_job_s *job;
+	void *threadptr = NULL;
+	unsigned int index;
+	int ret;
+
+	/* without thread state jobs are left for others */
+	if (pool->thread_create_callback(pool->ptr, &threadptr))
+		return NULL;
+
+	pthread_mutex_lock(&pool->mutex);
+	while (1) {
+		while ((!pool->quit) && (pool->jobs == NULL))
+			pthread_cond_wait(&pool->job_cond, &pool->mutex);
+		if (pool->quit)
+			break;
+
+		job = pool->jobs;
+		index = pack_pool_take(pool, job);
+		pthread_mutex_unlock(&pool->mutex);
+		ret = job->func(job, index, threadptr);
+		pthread_mutex_lock(&pool->mutex);
+		pack_pool_done(pool, job, ret);
+	}
+	pthread_mutex_unlock(&pool->mutex);
+
+	pool->thread_finish_callback(pool->ptr, threadptr, 0);
+	return NULL;
+}
+
+unsigned int pack_pool_take(struct pack_pool_s *pool, struct pack_pool_job_s *job)
+{
+	struct pack_pool_job_s **prev;
+	unsigned int index = job->next++;
+
+	/* all slices taken, remove from queue */
+	if (job->next == job->count) {
+		for (prev = &pool->jobs; *prev != job; prev = &(*prev)->next_job);
+		*prev = job->next_job;
+	}
+
+	return index;
+}
+
+void pack_pool_done(struct pack_pool_s *pool, struct pack_pool_job_s *job, int ret)
+{
+	if (ret)
+		job->ret = ret;
+	if (++job->done == job->count)
+		pthread_cond_broadcast(&pool->done_cond);
+}
+
+void unpack_get_video_stream(unpack_t unpack, glc_stream_id_t id,
+			     struct unpack_video_stream_s **video)
+{
+	*video = unpack->video;
+
+	while (*video != NULL) {
+		if ((*video)->id == id)
+			break;
+		*video = (*video)->next;
+	}
+
+	if (*video == NULL) {
+		*video = (struct unpack_video_stream_s *)
+			malloc(sizeof(struct unpack_video_stream_s));
+		memset(*video, 0, sizeof(struct unpack_video_stream_s));
+
+		(*video)->id = id;
+
+		(*video)->next = unpack->video;
+		unpack->video = *video;
+	}
+}
+
 /**  \} */
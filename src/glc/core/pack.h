@@ -34,6 +34,18 @@ typedef struct pack_s* pack_t;
 #define PACK_LZO           0x2
 /** LZJB compression */
 #define PACK_LZJB          0x3
+/** LZ4 compression */
+#define PACK_LZ4           0x4
+/** Zstandard compression */
+#define PACK_ZSTD          0x5
+/** choose compression per packet */
+#define PACK_ADAPTIVE      0x6
+/** predictive coding of video frames */
+#define PACK_PREDICT       0x7
+/** linear prediction and Rice coding of audio */
+#define PACK_RICE          0x8
+/** lossy DCT coding of video frames */
+#define PACK_DCT           0x9
 
 /**
  * \brief unpack object
@@ -51,15 +63,73 @@ __PUBLIC int pack_init(pack_t *pack, glc_t *glc);
 /**
  * \brief set compression
  *
- * QuickLZ (PACK_QUICKLZ) and LZO (PACK_LZO) are currently supported.
- * Both are fast enough for stream compression.
- * LZO compresses marginally better but is slower. QuickLZ is default.
+ * QuickLZ (PACK_QUICKLZ), LZO (PACK_LZO), LZJB (PACK_LZJB),
+ * LZ4 (PACK_LZ4) and Zstandard (PACK_ZSTD) are supported if glc
+ * was built with them. QuickLZ is default. LZ4 is the fastest one.
+ * Zstandard compresses much better but is slower, which makes it
+ * better suited for archiving than for capturing.
+ *
+ * PACK_ADAPTIVE chooses from available algorithms except LZJB. Packets
+ * that don't compress are written as they are. Algorithm is switched
+ * to a faster one when packets start lagging behind and to a stronger
+ * one when there is headroom. Lag is time from capture to compression,
+ * used in place of buffer fill level: it grows as input buffer fills
+ * up and also when output buffer blocks pack. Decisions are logged at
+ * GLC_PERFORMANCE.
+ *
+ * PACK_PREDICT is a lossless codec for video frames. Rows are filtered
+ * like in PNG, BGR(A) pixels are converted to YCoCg-R first, and result
+ * is compressed using Zstandard, or the best other available algorithm.
+ * Other packets are compressed using the same algorithm as they are.
+ *
+ * PACK_DCT is a lossy intra-frame codec for Y'CbCr 4:2:0 video frames.
+ * Planes are coded in 8x8 blocks like in JPEG, see pack_set_quality(),
+ * and result is compressed like in PACK_PREDICT. Frames still decode
+ * independently and unpack restores ordinary video frames. Frames in
+ * other formats are compressed losslessly. Delta frames are not used.
  * \param pack pack object
  * \param compression compression algorithm
  * \return 0 on success otherwise an error code
  */
 __PUBLIC int pack_set_compression(pack_t pack, int compression);
 
+/**
+ * \brief set compression level
+ *
+ * Currently only Zstandard uses compression level. 0 selects
+ * library default, which is also default here.
+ * \param pack pack object
+ * \param level compression level
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int pack_set_compression_level(pack_t pack, int level);
+
+/**
+ * \brief set quality of lossy coding
+ *
+ * Quality is used by PACK_DCT and scales quantization tables like
+ * in libjpeg. 100 is nearly lossless, lower values produce smaller
+ * files. Default is 75.
+ * \param pack pack object
+ * \param quality quality, from 1 to 100
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int pack_set_quality(pack_t pack, unsigned int quality);
+
+/**
+ * \brief set audio compression algorithm
+ *
+ * By default audio data is compressed with the same algorithm as
+ * everything else. PACK_RICE codes audio losslessly using fixed
+ * linear predictors and Rice codes, like FLAC. Packets that can't be
+ * coded, or don't get smaller, fall back to normal compression, so
+ * pack_set_compression() must also be set.
+ * \param pack pack object
+ * \param compression 0 or PACK_RICE
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int pack_set_audio_compression(pack_t pack, int compression);
+
 /**
  * \brief set compression threshold
  *
@@ -71,6 +141,37 @@ __PUBLIC int pack_set_compression(pack_t pack, int compression);
  */
 __PUBLIC int pack_set_minimum_size(pack_t pack, size_t min_size);
 
+/**
+ * \brief set keyframe interval
+ *
+ * When set, each compressed video frame is XORed with previous
+ * frame in the same stream before compression. Static areas turn
+ * into zeros which compress very well. Every interval'th frame
+ * and first frame after format change or callback request is
+ * written as a keyframe. 0 disables delta frames, which is default.
+ * \param pack pack object
+ * \param interval frames between keyframes
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int pack_set_keyframe_interval(pack_t pack, unsigned int interval);
+
+/**
+ * \brief set slice size
+ *
+ * Video frames larger than two slices are split into slices which
+ * are compressed in parallel by a pool of glc_threads_hint(glc)
+ * threads. This keeps a single large frame from being compressed
+ * by only one thread. 0 disables slicing, which is default.
+ *
+ * When slicing is enabled, Y'CbCr 4:2:0 frames are also split
+ * into planes, since planes have very different statistics.
+ * Slices never span two planes.
+ * \param pack pack object
+ * \param slice_size slice size in bytes
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int pack_set_slice_size(pack_t pack, size_t slice_size);
+
 /**
  * \brief start processing threads
  *
@@ -110,7 +211,8 @@ __PUBLIC int unpack_init(unpack_t *unpack, glc_t *glc);
 /**
  * \brief start processing threads
  *
- * unpack decompresses all supported compressed messages.
+ * unpack decompresses all supported compressed messages
+ * and reconstructs delta frames.
  * \param unpack unpack object
  * \param from source buffer
  * \param to target buffer
@@ -0,0 +1,345 @@
+/**
+ * \file glc/core/predict.c
+ * \brief lossless predictive coding of video frames
+ * \author Pyry Haulos <pyry.haulos@gmail.com>
+ * \date 2007-2008
+ * For conditions of distribution and use, see copyright notice in glc.h
+ */
+
+/**
+ * \addtogroup predict
+ *  \{
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <glc/common/glc.h>
+
+#include "predict.h"
+
+/*
+ Filters are the same as in PNG except that average isn't used. Row
+ loops are kept simple so that the compiler can vectorize them.
+*/
+
+unsigned int predict_cost(const unsigned char *residual, unsigned int n);
+unsigned int predict_sub(unsigned char *residual, const unsigned char *cur,
+			 unsigned int n, unsigned int bpp);
+unsigned int predict_up(unsigned char *residual, const unsigned char *cur,
+			const unsigned char *prev, unsigned int n);
+unsigned int predict_paeth(unsigned char *residual, const unsigned char *cur,
+			   const unsigned char *prev, unsigned int n, unsigned int bpp);
+unsigned int predict_filter_row(unsigned char *dst, const unsigned char *cur,
+				const unsigned char *prev, unsigned int n,
+				unsigned int bpp, unsigned char *candidates);
+int predict_unfilter_row(unsigned char *cur, const unsigned char *src,
+			 const unsigned char *prev, unsigned int n, unsigned int bpp);
+
+void predict_ycocg_encode(unsigned char *dst, const unsigned char *src,
+			  unsigned int w, unsigned int bpp);
+void predict_ycocg_decode(unsigned char *dst, const unsigned char *src,
+			  unsigned int w, unsigned int bpp);
+
+static inline unsigned char predict_paeth_pixel(int a, int b, int c)
+{
+	int pa = abs(b - c);
+	int pb = abs(a - c);
+	int pc = abs(a + b - c - c);
+
+	if ((pa <= pb) && (pa <= pc))
+		return a;
+	else if (pb <= pc)
+		return b;
+	return c;
+}
+
+int predict_geometry(struct predict_geometry_s *geom, glc_video_format_t format,
+		     glc_flags_t flags, unsigned int width, unsigned int height)
+{
+	unsigned int bpp;
+	int p;
+
+	memset(geom, 0, sizeof(struct predict_geometry_s));
+
+	if ((!width) || (!height))
+		return EINVAL;
+
+	if (format == GLC_VIDEO_YCBCR_420JPEG) {
+		geom->planes = 3;
+
+		geom->plane[0].w = geom->plane[0].row = width;
+		geom->plane[0].h = height;
+
+		geom->plane[1].w = geom->plane[1].row = geom->plane[2].w =
+			geom->plane[2].row = width / 2;
+		geom->plane[1].h = geom->plane[2].h = height / 2;
+		geom->plane[1].offset = width * height;
+		geom->plane[2].offset = geom->plane[1].offset +
+					geom->plane[1].w * geom->plane[1].h;
+
+		geom->plane[0].bpp = geom->plane[1].bpp = geom->plane[2].bpp = 1;
+		geom->frame_size = geom->plane[2].offset +
+				   geom->plane[2].w * geom->plane[2].h;
+	} else {
+		if ((format == GLC_VIDEO_BGR) || (format == GLC_VIDEO_RGB))
+			bpp = 3;
+		else if (format == GLC_VIDEO_BGRA)
+			bpp = 4;
+		else
+			return ENOTSUP;
+
+		geom->planes = 1;
+		geom->ycocg = 1;
+		geom->plane[0].w = width;
+		geom->plane[0].h = height;
+		geom->plane[0].bpp = bpp;
+		geom->plane[0].row = width * bpp;
+		if ((flags & GLC_VIDEO_DWORD_ALIGNED) && (geom->plane[0].row % 8))
+			geom->plane[0].row += 8 - geom->plane[0].row % 8;
+		geom->frame_size = geom->plane[0].row * height;
+	}
+
+	for (p = 0; p < geom->planes; p++)
+		geom->size += (1 + geom->plane[p].w * geom->plane[p].bpp) *
+			      (size_t) geom->plane[p].h;
+
+	/* zero row, previous and current row and three candidates */
+	geom->work_size = geom->plane[0].w * geom->plane[0].bpp * 6;
+
+	return 0;
+}
+
+void predict_encode(struct predict_geometry_s *geom, const char *frame,
+		    char *dst, char *work)
+{
+	unsigned int len = geom->plane[0].w * geom->plane[0].bpp;
+	unsigned char *zero = (unsigned char *) work;
+	unsigned char *prev_buf = &zero[len];
+	unsigned char *cur_buf = &prev_buf[len];
+	unsigned char *candidates = &cur_buf[len];
+	unsigned char *out = (unsigned char *) dst;
+	const unsigned char *row, *cur, *prev;
+	struct predict_plane_s *plane;
+	unsigned char *tmp;
+	unsigned int y;
+	int p;
+
+	memset(zero, 0, len);
+
+	for (p = 0; p < geom->planes; p++) {
+		plane = &geom->plane[p];
+		prev = zero;
+
+		for (y = 0; y < plane->h; y++) {
+			row = (const unsigned char *) &frame[plane->offset + plane->row * y];
+
+			if (geom->ycocg) {
+				predict_ycocg_encode(cur_buf, row, plane->w, plane->bpp);
+				cur = cur_buf;
+				tmp = prev_buf;
+				prev_buf = cur_buf;
+				cur_buf = tmp;
+			} else
+				cur = row;
+
+			out += predict_filter_row(out, cur, prev, plane->w * plane->bpp,
+						  plane->bpp, candidates);
+			prev = cur;
+		}
+	}
+}
+
+int predict_decode(struct predict_geometry_s *geom, const char *src,
+		   char *frame, char *work)
+{
+	unsigned int len = geom->plane[0].w * geom->plane[0].bpp;
+	unsigned char *zero = (unsigned char *) work;
+	unsigned char *prev_buf = &zero[len];
+	unsigned char *cur_buf = &prev_buf[len];
+	const unsigned char *in = (const unsigned char *) src;
+	const unsigned char *prev;
+	struct predict_plane_s *plane;
+	unsigned char *row, *cur, *tmp;
+	unsigned int y, n;
+	int p, ret;
+
+	memset(zero, 0, len);
+
+	for (p = 0; p < geom->planes; p++) {
+		plane = &geom->plane[p];
+		n = plane->w * plane->bpp;
+		prev = zero;
+
+		for (y = 0; y < plane->h; y++) {
+			row = (unsigned char *) &frame[plane->offset + plane->row * y];
+			cur = geom->ycocg ? cur_buf : row;
+
+			if ((ret = predict_unfilter_row(cur, in, prev, n, plane->bpp)))
+				return ret;
+			in += n + 1;
+
+			if (geom->ycocg) {
+				predict_ycocg_decode(row, cur, plane->w, plane->bpp);
+				tmp = prev_buf;
+				prev_buf = cur_buf;
+				cur_buf = tmp;
+			}
+
+			if (plane->row > n)
+				memset(&row[n], 0, plane->row - n);
+			prev = cur;
+		}
+	}
+
+	return 0;
+}
+
+unsigned int predict_filter_row(unsigned char *dst, const unsigned char *cur,
+				const unsigned char *prev, unsigned int n,
+				unsigned int bpp, unsigned char *candidates)
+{
+	unsigned char *sub = candidates;
+	unsigned char *up = &candidates[n];
+	unsigned char *paeth = &candidates[n * 2];
+	unsigned int cost, best_cost;
+	const unsigned char *best;
+
+	/* pick filter with smallest sum of absolute residuals */
+	best_cost = predict_sub(sub, cur, n, bpp);
+	best = sub;
+	dst[0] = PREDICT_FILTER_SUB;
+
+	if ((cost = predict_up(up, cur, prev, n)) < best_cost) {
+		best_cost = cost;
+		best = up;
+		dst[0] = PREDICT_FILTER_UP;
+	}
+
+	if ((cost = predict_paeth(paeth, cur, prev, n, bpp)) < best_cost) {
+		best_cost = cost;
+		best = paeth;
+		dst[0] = PREDICT_FILTER_PAETH;
+	}
+
+	memcpy(&dst[1], best, n);
+	return n + 1;
+}
+
+unsigned int predict_cost(const unsigned char *residual, unsigned int n)
+{
+	unsigned int i, cost = 0;
+
+	for (i = 0; i < n; i++)
+		cost += abs((signed char) residual[i]);
+
+	return cost;
+}
+
+unsigned int predict_sub(unsigned char *residual, const unsigned char *cur,
+			 unsigned int n, unsigned int bpp)
+{
+	unsigned int i;
+
+	for (i = 0; i < bpp; i++)
+		residual[i] = cur[i];
+	for (; i < n; i++)
+		residual[i] = cur[i] - cur[i - bpp];
+
+	return predict_cost(residual, n);
+}
+
+unsigned int predict_up(unsigned char *residual, const unsigned char *cur,
+			const unsigned char *prev, unsigned int n)
+{
+	unsigned int i;
+
+	for (i = 0; i < n; i++)
+		residual[i] = cur[i] - prev[i];
+
+	return predict_cost(residual, n);
+}
+
+unsigned int predict_paeth(unsigned char *residual, const unsigned char *cur,
+			   const unsigned char *prev, unsigned int n, unsigned int bpp)
+{
+	unsigned int i;
+
+	/* left and upper left are zero, predictor is the pixel above */
+	for (i = 0; i < bpp; i++)
+		residual[i] = cur[i] - prev[i];
+	for (; i < n; i++)
+		residual[i] = cur[i] - predict_paeth_pixel(cur[i - bpp], prev[i],
+							   prev[i - bpp]);
+
+	return predict_cost(residual, n);
+}
+
+int predict_unfilter_row(unsigned char *cur, const unsigned char *src,
+			 const unsigned char *prev, unsigned int n, unsigned int bpp)
+{
+	const unsigned char *residual = &src[1];
+	unsigned int i;
+
+	if (src[0] == PREDICT_FILTER_NONE)
+		memcpy(cur, residual, n);
+	else if (src[0] == PREDICT_FILTER_SUB) {
+		for (i = 0; i < bpp; i++)
+			cur[i] = residual[i];
+		for (; i < n; i++)
+			cur[i] = residual[i] + cur[i - bpp];
+	} else if (src[0] == PREDICT_FILTER_UP) {
+		for (i = 0; i < n; i++)
+			cur[i] = residual[i] + prev[i];
+	} else if (src[0] == PREDICT_FILTER_PAETH) {
+		for (i = 0; i < bpp; i++)
+			cur[i] = residual[i] + prev[i];
+		for (; i < n; i++)
+			cur[i] = residual[i] + predict_paeth_pixel(cur[i - bpp], prev[i],
+								   prev[i - bpp]);
+	} else
+		return EINVAL;
+
+	return 0;
+}
+
+/*
+ YCoCg-R lifting steps are reversible in 8-bit arithmetic too, Co and
+ Cg just wrap around. Alpha is stored as it is.
+*/
+void predict_ycocg_encode(unsigned char *dst, const unsigned char *src,
+			  unsigned int w, unsigned int bpp)
+{
+	unsigned char co, cg, t;
+	unsigned int x;
+
+	for (x = 0; x < w; x++, src += bpp, dst += bpp) {
+		co = src[2] - src[0];
+		t = src[0] + ((signed char) co >> 1);
+		cg = src[1] - t;
+		dst[0] = t + ((signed char) cg >> 1);
+		dst[1] = cg;
+		dst[2] = co;
+		if (bpp == 4)
+			dst[3] = src[3];
+	}
+}
+
+void predict_ycocg_decode(unsigned char *dst, const unsigned char *src,
+			  unsigned int w, unsigned int bpp)
+{
+	unsigned char t;
+	unsigned int x;
+
+	for (x = 0; x < w; x++, src += bpp, dst += bpp) {
+		t = src[0] - ((signed char) src[1] >> 1);
+		dst[1] = src[1] + t;
+		dst[0] = t - ((signed char) src[2] >> 1);
+		dst[2] = dst[0] + src[2];
+		if (bpp == 4)
+			dst[3] = src[3];
+	}
+}
+
+/**  \} */
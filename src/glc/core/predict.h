@@ -0,0 +1,112 @@
+/**
+ * \file glc/core/predict.h
+ * \brief lossless predictive coding of video frames
+ * \author Pyry Haulos <pyry.haulos@gmail.com>
+ * \date 2007-2008
+ * For conditions of distribution and use, see copyright notice in glc.h
+ */
+
+/**
+ * \addtogroup core
+ *  \{
+ * \defgroup predict lossless predictive coding of video frames
+ *  \{
+ */
+
+#ifndef _PREDICT_H
+#define _PREDICT_H
+
+#include <sys/types.h>
+#include <glc/common/glc.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** row is stored as it is */
+#define PREDICT_FILTER_NONE        0x0
+/** difference to pixel on the left */
+#define PREDICT_FILTER_SUB         0x1
+/** difference to pixel above */
+#define PREDICT_FILTER_UP          0x2
+/** difference to Paeth predictor */
+#define PREDICT_FILTER_PAETH       0x3
+
+/**
+ * \brief plane geometry
+ */
+struct predict_plane_s {
+	/** plane offset in frame */
+	size_t offset;
+	/** bytes per row in frame, including padding */
+	unsigned int row;
+	/** plane size in pixels */
+	unsigned int w, h;
+	/** bytes per pixel */
+	unsigned int bpp;
+};
+
+/**
+ * \brief frame geometry
+ */
+struct predict_geometry_s {
+	/** planes */
+	struct predict_plane_s plane[3];
+	/** number of planes */
+	int planes;
+	/** BGR(A) pixels are converted to YCoCg-R before prediction */
+	int ycocg;
+	/** frame size */
+	size_t frame_size;
+	/** filtered frame size */
+	size_t size;
+	/** size of work area needed by predict_encode() and predict_decode() */
+	size_t work_size;
+};
+
+/**
+ * \brief calculate frame geometry
+ * \param geom geometry
+ * \param format video format
+ * \param flags video flags
+ * \param width frame width
+ * \param height frame height
+ * \return 0 on success, ENOTSUP if format can't be predicted
+ */
+int predict_geometry(struct predict_geometry_s *geom, glc_video_format_t format,
+		     glc_flags_t flags, unsigned int width, unsigned int height);
+
+/**
+ * \brief filter frame
+ *
+ * Each row of each plane is written as a filter type byte followed
+ * by residuals of row pixels. Row padding is dropped.
+ * \param geom geometry
+ * \param frame frame data, geom->frame_size bytes
+ * \param dst filtered frame, geom->size bytes
+ * \param work work area, geom->work_size bytes
+ */
+void predict_encode(struct predict_geometry_s *geom, const char *frame,
+		    char *dst, char *work);
+
+/**
+ * \brief restore filtered frame
+ *
+ * Row padding is zeroed.
+ * \param geom geometry
+ * \param src filtered frame, geom->size bytes
+ * \param frame frame data, geom->frame_size bytes
+ * \param work work area, geom->work_size bytes
+ * \return 0 on success, EINVAL if data is corrupted
+ */
+int predict_decode(struct predict_geometry_s *geom, const char *src,
+		   char *frame, char *work);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/**  \} */
+/**  \} */
@@ -0,0 +1,379 @@
+/**
+ * \file glc/core/rice.c
+ * \brief lossless audio coding
+ * \author Pyry Haulos <pyry.haulos@gmail.com>
+ * \date 2007-2008
+ * For conditions of distribution and use, see copyright notice in glc.h
+ */
+
+/**
+ * \addtogroup rice
+ *  \{
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+
+#include <glc/common/glc.h>
+
+#include "rice.h"
+
+/*
+ Like FLAC with only fixed predictors. Samples before the packet are
+ taken to be zero, so packets decode independently. Block header is
+ predictor order (3 bits) and Rice parameter (6 bits). Quotients of
+ RICE_ESCAPE or more are written as RICE_ESCAPE zero bits followed by
+ the zigzag-coded residual in bits + 5 bits.
+*/
+
+#define RICE_MAX_ORDER             4
+#define RICE_ESCAPE               24
+
+struct rice_writer_s {
+	unsigned char *p;
+	u_int64_t acc;
+	unsigned int n;
+};
+
+struct rice_reader_s {
+	const unsigned char *p, *end;
+	u_int64_t acc;
+	unsigned int n;
+	size_t consumed, size;
+};
+
+void rice_load(struct rice_layout_s *layout, const char *data, unsigned int c,
+	       int64_t *x, int *lossless);
+void rice_store(struct rice_layout_s *layout, char *data, unsigned int c,
+		size_t i, int64_t x);
+void rice_residual(int64_t **residual, const int64_t *x, size_t frames);
+void rice_encode_block(struct rice_layout_s *layout, struct rice_writer_s *writer,
+		       int64_t **residual, size_t start, size_t count);
+int rice_decode_block(struct rice_layout_s *layout, struct rice_reader_s *reader,
+		      int64_t *h, char *data, unsigned int c, size_t start, size_t count);
+
+static inline void rice_write(struct rice_writer_s *writer, u_int64_t value,
+			      unsigned int bits)
+{
+	if (!bits)
+		return;
+
+	writer->acc |= value << (64 - writer->n - bits);
+	writer->n += bits;
+
+	while (writer->n >= 8) {
+		*writer->p++ = writer->acc >> 56;
+		writer->acc <<= 8;
+		writer->n -= 8;
+	}
+}
+
+static inline void rice_refill(struct rice_reader_s *reader)
+{
+	while (reader->n <= 56) {
+		if (reader->p < reader->end)
+			reader->acc |= (u_int64_t) *reader->p++ << (56 - reader->n);
+		reader->n += 8;
+	}
+}
+
+static inline u_int64_t rice_read(struct rice_reader_s *reader, unsigned int bits)
+{
+	u_int64_t value;
+
+	if (!bits)
+		return 0;
+
+	rice_refill(reader);
+	value = reader->acc >> (64 - bits);
+	reader->acc <<= bits;
+	reader->n -= bits;
+	reader->consumed += bits;
+
+	return value;
+}
+
+int rice_layout(struct rice_layout_s *layout, glc_audio_format_t format,
+		glc_flags_t flags, unsigned int channels, size_t size)
+{
+	size_t blocks;
+
+	memset(layout, 0, sizeof(struct rice_layout_s));
+
+	if (format == GLC_AUDIO_S16_LE) {
+		layout->bytes = 2;
+		layout->bits = 16;
+	} else if (format == GLC_AUDIO_S24_LE) {
+		/* 24 bits in 32 bit container, like in ALSA */
+		layout->bytes = 4;
+		layout->bits = 24;
+	} else if (format == GLC_AUDIO_S32_LE) {
+		layout->bytes = 4;
+		layout->bits = 32;
+	} else
+		return ENOTSUP;
+
+	if ((!channels) || (size % (layout->bytes * channels)))
+		return EINVAL;
+
+	layout->channels = channels;
+	layout->interleaved = (flags & GLC_AUDIO_INTERLEAVED) ? 1 : 0;
+	layout->size = size;
+	layout->frames = size / (layout->bytes * channels);
+
+	blocks = (layout->frames + RICE_BLOCK_SIZE - 1) / RICE_BLOCK_SIZE;
+	layout->max_size = (layout->frames * (RICE_ESCAPE + layout->bits + 5) +
+			    blocks * 9) * channels / 8 + 8;
+
+	/* samples with zero history and residuals of each order */
+	layout->work_size = sizeof(int64_t) * (layout->frames + RICE_MAX_ORDER +
+					       layout->frames * (RICE_MAX_ORDER + 1));
+
+	return 0;
+}
+
+int rice_encode(struct rice_layout_s *layout, const char *data, char *dst,
+		size_t *dst_size, char *work)
+{
+	struct rice_writer_s writer;
+	int64_t *residual[RICE_MAX_ORDER + 1];
+	int64_t *x = (int64_t *) work;
+	unsigned int c, o;
+	size_t start, count;
+	int lossless = 1;
+
+	memset(x, 0, sizeof(int64_t) * RICE_MAX_ORDER);
+	for (o = 0; o <= RICE_MAX_ORDER; o++)
+		residual[o] = &x[layout->frames + RICE_MAX_ORDER + layout->frames * o];
+
+	writer.p = (unsigned char *) dst;
+	writer.acc = 0;
+	writer.n = 0;
+
+	for (c = 0; c < layout->channels; c++) {
+		rice_load(layout, data, c, &x[RICE_MAX_ORDER], &lossless);
+		if (!lossless)
+			return EINVAL;
+
+		rice_residual(residual, &x[RICE_MAX_ORDER], layout->frames);
+
+		for (start = 0; start < layout->frames; start += RICE_BLOCK_SIZE) {
+			count = layout->frames - start;
+			if (count > RICE_BLOCK_SIZE)
+				count = RICE_BLOCK_SIZE;
+			rice_encode_block(layout, &writer, residual, start, count);
+		}
+	}
+
+	/* flush */
+	if (writer.n)
+		*writer.p++ = writer.acc >> 56;
+
+	*dst_size = (char *) writer.p - dst;
+	return 0;
+}
+
+int rice_decode(struct rice_layout_s *layout, const char *src, size_t src_size,
+		char *data)
+{
+	struct rice_reader_s reader;
+	int64_t h[RICE_MAX_ORDER];
+	size_t start, count;
+	unsigned int c;
+	int ret;
+
+	reader.p = (const unsigned char *) src;
+	reader.end = &reader.p[src_size];
+	reader.acc = 0;
+	reader.n = 0;
+	reader.consumed = 0;
+	reader.size = src_size * 8;
+
+	for (c = 0; c < layout->channels; c++) {
+		memset(h, 0, sizeof(h));
+
+		for (start = 0; start < layout->frames; start += RICE_BLOCK_SIZE) {
+			count = layout->frames - start;
+			if (count > RICE_BLOCK_SIZE)
+				count = RICE_BLOCK_SIZE;
+			if ((ret = rice_decode_block(layout, &reader, h, data, c, start, count)))
+				return ret;
+		}
+	}
+
+	return 0;
+}
+
+void rice_load(struct rice_layout_s *layout, const char *data, unsigned int c,
+	       int64_t *x, int *lossless)
+{
+	size_t i, offset, stride;
+	int16_t s16;
+	int32_t s32;
+
+	if (layout->interleaved) {
+		offset = c * layout->bytes;
+		stride = layout->channels * layout->bytes;
+	} else {
+		offset = c * layout->frames * layout->bytes;
+		stride = layout->bytes;
+	}
+
+	if (layout->bits == 16) {
+		for (i = 0; i < layout->frames; i++, offset += stride) {
+			memcpy(&s16, &data[offset], sizeof(int16_t));
+			x[i] = s16;
+		}
+	} else {
+		for (i = 0; i < layout->frames; i++, offset += stride) {
+			memcpy(&s32, &data[offset], sizeof(int32_t));
+			x[i] = s32;
+		}
+
+		/* top byte of 24 bit samples must be sign extension */
+		if (layout->bits == 24) {
+			for (i = 0; i < layout->frames; i++) {
+				if (x[i] != (((int32_t) ((u_int32_t) x[i] << 8)) >> 8))
+					*lossless = 0;
+			}
+		}
+	}
+}
+
+void rice_store(struct rice_layout_s *layout, char *data, unsigned int c,
+		size_t i, int64_t x)
+{
+	size_t offset;
+	int16_t s16;
+	int32_t s32;
+
+	if (layout->interleaved)
+		offset = (i * layout->channels + c) * layout->bytes;
+	else
+		offset = (c * layout->frames + i) * layout->bytes;
+
+	if (layout->bits == 16) {
+		s16 = x;
+		memcpy(&data[offset], &s16, sizeof(int16_t));
+	} else {
+		s32 = x;
+		memcpy(&data[offset], &s32, sizeof(int32_t));
+	}
+}
+
+void rice_residual(int64_t **residual, const int64_t *x, size_t frames)
+{
+	const int64_t *x1 = x - 1, *x2 = x - 2, *x3 = x - 3, *x4 = x - 4;
+	size_t i;
+
+	/* x[-1] ... x[-4] are zero, loops are simple enough to vectorize */
+	for (i = 0; i < frames; i++)
+		residual[0][i] = x[i];
+	for (i = 0; i < frames; i++)
+		residual[1][i] = x[i] - x1[i];
+	for (i = 0; i < frames; i++)
+		residual[2][i] = x[i] - 2 * x1[i] + x2[i];
+	for (i = 0; i < frames; i++)
+		residual[3][i] = x[i] - 3 * x1[i] + 3 * x2[i] - x3[i];
+	for (i = 0; i < frames; i++)
+		residual[4][i] = x[i] - 4 * x1[i] + 6 * x2[i] - 4 * x3[i] + x4[i];
+}
+
+void rice_encode_block(struct rice_layout_s *layout, struct rice_writer_s *writer,
+		       int64_t **residual, size_t start, size_t count)
+{
+	unsigned int o, order = 0, k;
+	u_int64_t sum, best_sum = 0, u, q;
+	const int64_t *r;
+	size_t i;
+
+	/* order with smallest sum of absolute residuals */
+	for (o = 0; o <= RICE_MAX_ORDER; o++) {
+		r = &residual[o][start];
+		sum = 0;
+		for (i = 0; i < count; i++)
+			sum += r[i] < 0 ? -r[i] : r[i];
+
+		if ((o == 0) || (sum < best_sum)) {
+			best_sum = sum;
+			order = o;
+		}
+	}
+
+	/* parameter is about log2 of mean zigzag-coded residual */
+	best_sum *= 2;
+	for (k = 0; (k < layout->bits + 4) && (((u_int64_t) count << (k + 1)) <= best_sum); k++);
+
+	rice_write(writer, order, 3);
+	rice_write(writer, k, 6);
+
+	r = &residual[order][start];
+	for (i = 0; i < count; i++) {
+		u = ((u_int64_t) r[i] << 1) ^ (u_int64_t) (r[i] >> 63);
+		q = u >> k;
+
+		if (q < RICE_ESCAPE) {
+			rice_write(writer, 1, q + 1);
+			rice_write(writer, u & ((1ULL << k) - 1), k);
+		} else {
+			rice_write(writer, 0, RICE_ESCAPE);
+			rice_write(writer, u, layout->bits + 5);
+		}
+	}
+}
+
+int rice_decode_block(struct rice_layout_s *layout, struct rice_reader_s *reader,
+		      int64_t *h, char *data, unsigned int c, size_t start, size_t count)
+{
+	unsigned int order, k, zeros;
+	int64_t r, x;
+	u_int64_t u;
+	size_t i;
+
+	order = rice_read(reader, 3);
+	k = rice_read(reader, 6);
+	if ((order > RICE_MAX_ORDER) || (k > layout->bits + 4))
+		return EINVAL;
+
+	for (i = 0; i < count; i++) {
+		rice_refill(reader);
+		zeros = reader->acc ? __builtin_clzll(reader->acc) : 64;
+
+		if (zeros < RICE_ESCAPE) {
+			rice_read(reader, zeros + 1);
+			u = ((u_int64_t) zeros << k) | rice_read(reader, k);
+		} else {
+			rice_read(reader, RICE_ESCAPE);
+			u = rice_read(reader, layout->bits + 5);
+		}
+
+		r = (int64_t) (u >> 1) ^ -(int64_t) (u & 1);
+
+		if (order == 0)
+			x = r;
+		else if (order == 1)
+			x = r + h[0];
+		else if (order == 2)
+			x = r + 2 * h[0] - h[1];
+		else if (order == 3)
+			x = r + 3 * h[0] - 3 * h[1] + h[2];
+		else
+			x = r + 4 * h[0] - 6 * h[1] + 4 * h[2] - h[3];
+
+		h[3] = h[2];
+		h[2] = h[1];
+		h[1] = h[0];
+		h[0] = x;
+
+		rice_store(layout, data, c, start + i, x);
+	}
+
+	if (reader->consumed > reader->size)
+		return EINVAL;
+
+	return 0;
+}
+
+/**  \} */
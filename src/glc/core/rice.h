@@ -0,0 +1,97 @@
+/**
+ * \file glc/core/rice.h
+ * \brief lossless audio coding
+ * \author Pyry Haulos <pyry.haulos@gmail.com>
+ * \date 2007-2008
+ * For conditions of distribution and use, see copyright notice in glc.h
+ */
+
+/**
+ * \addtogroup core
+ *  \{
+ * \defgroup rice lossless audio coding
+ *  \{
+ */
+
+#ifndef _RICE_H
+#define _RICE_H
+
+#include <sys/types.h>
+#include <glc/common/glc.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** samples per channel in a block, each block has own predictor and parameter */
+#define RICE_BLOCK_SIZE            4096
+
+/**
+ * \brief audio data layout
+ */
+struct rice_layout_s {
+	/** number of channels */
+	unsigned int channels;
+	/** bytes per sample in data */
+	unsigned int bytes;
+	/** significant bits per sample */
+	unsigned int bits;
+	/** samples are interleaved */
+	int interleaved;
+	/** samples per channel */
+	size_t frames;
+	/** audio data size */
+	size_t size;
+	/** maximum size of encoded data */
+	size_t max_size;
+	/** size of work area needed by rice_encode() */
+	size_t work_size;
+};
+
+/**
+ * \brief calculate audio data layout
+ * \param layout layout
+ * \param format audio format
+ * \param flags audio flags
+ * \param channels number of channels
+ * \param size audio data size in bytes
+ * \return 0 on success, ENOTSUP if format isn't supported
+ */
+int rice_layout(struct rice_layout_s *layout, glc_audio_format_t format,
+		glc_flags_t flags, unsigned int channels, size_t size);
+
+/**
+ * \brief encode audio data
+ *
+ * Each channel is split into blocks of RICE_BLOCK_SIZE samples.
+ * Each block is predicted with a fixed polynomial predictor of order
+ * 0 to 4 and residuals are Rice-coded.
+ * \param layout layout
+ * \param data audio data, layout->size bytes
+ * \param dst encoded data, at most layout->max_size bytes
+ * \param dst_size returns encoded size
+ * \param work work area, layout->work_size bytes
+ * \return 0 on success, EINVAL if data can't be coded losslessly
+ */
+int rice_encode(struct rice_layout_s *layout, const char *data, char *dst,
+		size_t *dst_size, char *work);
+
+/**
+ * \brief decode audio data
+ * \param layout layout
+ * \param src encoded data
+ * \param src_size encoded data size
+ * \param data audio data, layout->size bytes
+ * \return 0 on success, EINVAL if data is corrupted
+ */
+int rice_decode(struct rice_layout_s *layout, const char *src, size_t src_size,
+		char *data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/**  \} */
+/**  \} */
@@ -97,7 +97,7 @@ int scale_init(scale_t *scale, glc_t *glc)
 
 	(*scale)->glc = glc;
 
-	(*scale)->thread.flags = GLC_THREAD_READ | GLC_THREAD_WRITE;
+	(*scale)->thread.flags = GLC_THREAD_READ | GLC_THREAD_WRITE | GLC_THREAD_REORDER;
 	(*scale)->thread.read_callback = &scale_read_callback;
 	(*scale)->thread.write_callback = &scale_write_callback;
 	(*scale)->thread.finish_callback = &scale_finish_callback;
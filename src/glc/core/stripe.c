@@ -0,0 +1,488 @@
+/**
+ * \file glc/core/stripe.c
+ * \brief stream striping over several files
+ * \author Pyry Haulos <pyry.haulos@gmail.com>
+ * \date 2007-2008
+ * For conditions of distribution and use, see copyright notice in glc.h
+ */
+
+/**
+ * \addtogroup stripe
+ *  \{
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <glc/common/glc.h>
+#include <glc/common/core.h>
+#include <glc/common/log.h>
+
+#include "stripe.h"
+
+struct stripe_device_s;
+
+struct stripe_buffer_s {
+	struct stripe_device_s *device;
+	char *data;
+	/* file offset of chunk */
+	off_t offset;
+	/* bytes of data in buffer */
+	size_t used;
+	/* bytes submitted */
+	size_t size;
+	int busy;
+};
+
+struct stripe_device_s {
+	stripe_t stripe;
+	int fd;
+
+	struct stripe_buffer_s buffer[STRIPE_BUFFERS];
+	unsigned int cur;
+
+	pthread_t thread;
+	int running;
+	pthread_cond_t queue_cond;
+	struct stripe_buffer_s *queue[STRIPE_BUFFERS];
+	unsigned int queue_head, queue_count;
+};
+
+struct stripe_s {
+	glc_t *glc;
+	unsigned int count;
+	size_t chunk_size;
+	int err;
+	int dirty;
+
+	struct stripe_device_s device[STRIPE_MAX];
+
+	/* sequence number of chunk being filled */
+	u_int64_t chunk;
+	struct stripe_buffer_s *buffer;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t done_cond;
+	int writing;
+	int stop;
+};
+
+int stripe_submit(stripe_t stripe, struct stripe_buffer_s *buffer);
+int stripe_wait(stripe_t stripe, struct stripe_buffer_s *buffer);
+int stripe_next(stripe_t stripe);
+int stripe_pwrite(int fd, const char *data, size_t size, off_t offset);
+void *stripe_thread(void *argptr);
+
+int stripe_init(stripe_t *stripe, glc_t *glc, int *fd, unsigned int count,
+		size_t chunk_size)
+{
+	glc_stripe_header_t header;
+	struct stripe_device_s *device;
+	pthread_attr_t attr;
+	unsigned int i, j;
+	int ret = 0;
+
+	if ((!count) || (count > STRIPE_MAX) || (!chunk_size))
+		return EINVAL;
+
+	*stripe = (stripe_t) malloc(sizeof(struct stripe_s));
+	memset(*stripe, 0, sizeof(struct stripe_s));
+
+	(*stripe)->glc = glc;
+	(*stripe)->count = count;
+	(*stripe)->chunk_size = chunk_size;
+
+	pthread_mutex_init(&(*stripe)->mutex, NULL);
+	pthread_cond_init(&(*stripe)->done_cond, NULL);
+	(*stripe)->writing = 1;
+
+	header.signature = GLC_STRIPE_SIGNATURE;
+	header.count = count;
+	header.chunk_size = chunk_size;
+
+	for (i = 0; i < count; i++) {
+		device = &(*stripe)->device[i];
+		device->stripe = *stripe;
+		device->fd = fd[i];
+		pthread_cond_init(&device->queue_cond, NULL);
+
+		header.index = i;
+		if ((ret = stripe_pwrite(fd[i], (const char *) &header,
+					 sizeof(glc_stripe_header_t), 0)))
+			goto err;
+
+		for (j = 0; j < STRIPE_BUFFERS; j++) {
+			device->buffer[j].device = device;
+			if (!(device->buffer[j].data = (char *) malloc(chunk_size))) {
+				ret = ENOMEM;
+				goto err;
+			}
+		}
+	}
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+
+	/* one writer thread per stripe keeps every disk busy */
+	for (i = 0; i < count; i++) {
+		device = &(*stripe)->device[i];
+		if ((ret = pthread_create(&device->thread, &attr, stripe_thread, device)))
+			break;
+		device->running = 1;
+	}
+
+	pthread_attr_destroy(&attr);
+	if (ret)
+		goto err;
+
+	/* first chunk goes to first stripe */
+	(*stripe)->buffer = &(*stripe)->device[0].buffer[0];
+	(*stripe)->buffer->offset = sizeof(glc_stripe_header_t);
+	(*stripe)->device[0].cur = 1;
+
+	glc_log(glc, GLC_INFORMATION, "stripe",
+		 "writing %u stripes in %zd byte chunks", count, chunk_size);
+	return 0;
+err:
+	stripe_destroy(*stripe);
+	return ret;
+}
+
+int stripe_open(stripe_t *stripe, glc_t *glc, int *fd, unsigned int count)
+{
+	glc_stripe_header_t header;
+	unsigned int i;
+	int ret = EINVAL;
+
+	if ((!count) || (count > STRIPE_MAX))
+		return EINVAL;
+
+	*stripe = (stripe_t) malloc(sizeof(struct stripe_s));
+	memset(*stripe, 0, sizeof(struct stripe_s));
+
+	(*stripe)->glc = glc;
+	(*stripe)->count = count;
+	for (i = 0; i < count; i++)
+		(*stripe)->device[i].fd = -1;
+
+	for (i = 0; i < count; i++) {
+		if (pread(fd[i], &header, sizeof(glc_stripe_header_t), 0) !=
+		    sizeof(glc_stripe_header_t)) {
+			glc_log(glc, GLC_ERROR, "stripe", "can't read stripe header");
+			goto err;
+		}
+
+		if (header.signature != GLC_STRIPE_SIGNATURE) {
+			glc_log(glc, GLC_ERROR, "stripe",
+				 "signature 0x%08x does not match 0x%08x",
+				 header.signature, GLC_STRIPE_SIGNATURE);
+			goto err;
+		}
+
+		if ((header.count != count) || (header.index >= count) ||
+		    (!header.chunk_size) ||
+		    ((i) && (header.chunk_size != (*stripe)->chunk_size))) {
+			glc_log(glc, GLC_ERROR, "stripe",
+				 "stripe %u of %u doesn't belong to this set of %u stripes",
+				 header.index, header.count, count);
+			goto err;
+		}
+
+		if ((*stripe)->device[header.index].fd >= 0) {
+			glc_log(glc, GLC_ERROR, "stripe",
+				 "stripe %u given twice", header.index);
+			goto err;
+		}
+
+		(*stripe)->device[header.index].fd = fd[i];
+		(*stripe)->chunk_size = header.chunk_size;
+	}
+
+	return 0;
+err:
+	free(*stripe);
+	return ret;
+}
+
+int stripe_write(stripe_t stripe, const void *data, size_t size)
+{
+	struct stripe_buffer_s *buffer = stripe->buffer;
+	const char *src = (const char *) data;
+	size_t len;
+	int ret;
+
+	stripe->dirty = 1;
+	while (size) {
+		len = stripe->chunk_size - buffer->used;
+		if (len > size)
+			len = size;
+
+		memcpy(&buffer->data[buffer->used], src, len);
+		buffer->used += len;
+		src += len;
+		size -= len;
+
+		if (buffer->used < stripe->chunk_size)
+			break;
+
+		/* chunk is full, hand it to stripe's writer and continue in next one */
+		buffer->size = buffer->used;
+		if ((ret = stripe_submit(stripe, buffer)))
+			return ret;
+		if ((ret = stripe_next(stripe)))
+			return ret;
+		buffer = stripe->buffer;
+	}
+
+	return stripe->err;
+}
+
+int stripe_flush(stripe_t stripe)
+{
+	struct stripe_buffer_s *buffer = stripe->buffer;
+	unsigned int i, j;
+	int ret;
+
+	for (i = 0; i < stripe->count; i++) {
+		for (j = 0; j < STRIPE_BUFFERS; j++) {
+			if ((ret = stripe_wait(stripe, &stripe->device[i].buffer[j])))
+				return ret;
+		}
+	}
+
+	/* nothing written since last flush */
+	if ((!stripe->dirty) || (!buffer->used))
+		return stripe->err;
+
+	/* partial chunk is written again when it is full */
+	if ((ret = stripe_pwrite(buffer->device->fd, buffer->data,
+				 buffer->used, buffer->offset)))
+		return stripe->err = ret;
+	stripe->dirty = 0;
+
+	return 0;
+}
+
+ssize_t stripe_pread(stripe_t stripe, void *data, size_t size, u_int64_t offset)
+{
+	char *dst = (char *) data;
+	u_int64_t chunk;
+	size_t pos, len, done = 0;
+	ssize_t ret;
+
+	while (size) {
+		chunk = offset / stripe->chunk_size;
+		pos = offset % stripe->chunk_size;
+		len = stripe->chunk_size - pos;
+		if (len > size)
+			len = size;
+
+		ret = pread(stripe->device[chunk % stripe->count].fd, dst, len,
+			    sizeof(glc_stripe_header_t) +
+			    (chunk / stripe->count) * stripe->chunk_size + pos);
+		if (ret == -1) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		} else if (!ret)
+			break;
+
+		dst += ret;
+		size -= ret;
+		offset += ret;
+		done += ret;
+	}
+
+	return done;
+}
+
+int stripe_size(stripe_t stripe, u_int64_t *size)
+{
+	struct stat st;
+	unsigned int i;
+	u_int64_t data[STRIPE_MAX], total = 0, chunks, first;
+
+	/*
+	 Chunks are filled in order, but stripes are written by
+	 separate threads, so after a crash any stripe can be short.
+	 Stream ends at first chunk that is not complete, chunk k
+	 lives in stripe k % count.
+	 */
+	chunks = (u_int64_t) -1;
+	for (i = 0; i < stripe->count; i++) {
+		if (fstat(stripe->device[i].fd, &st) == -1)
+			return errno;
+		data[i] = 0;
+		if ((u_int64_t) st.st_size > sizeof(glc_stripe_header_t))
+			data[i] = st.st_size - sizeof(glc_stripe_header_t);
+		total += data[i];
+
+		first = (data[i] / stripe->chunk_size) * stripe->count + i;
+		if (first < chunks)
+			chunks = first;
+	}
+
+	/* partial tail of first incomplete chunk is still valid data */
+	*size = chunks * stripe->chunk_size +
+		data[chunks % stripe->count] % stripe->chunk_size;
+
+	if (*size != total)
+		glc_log(stripe->glc, GLC_WARNING, "stripe",
+			"stripes are incomplete, stream truncated to %llu of %llu bytes",
+			(unsigned long long) *size, (unsigned long long) total);
+
+	return 0;
+}
+
+unsigned int stripe_count(stripe_t stripe)
+{
+	return stripe->count;
+}
+
+int stripe_fd(stripe_t stripe, unsigned int index)
+{
+	return stripe->device[index].fd;
+}
+
+int stripe_destroy(stripe_t stripe)
+{
+	unsigned int i, j;
+	int ret = 0;
+
+	if (!stripe->writing) {
+		free(stripe);
+		return 0;
+	}
+
+	if (stripe->buffer)
+		ret = stripe_flush(stripe);
+
+	pthread_mutex_lock(&stripe->mutex);
+	stripe->stop = 1;
+	for (i = 0; i < stripe->count; i++)
+		pthread_cond_broadcast(&stripe->device[i].queue_cond);
+	pthread_mutex_unlock(&stripe->mutex);
+
+	for (i = 0; i < stripe->count; i++) {
+		if (stripe->device[i].running)
+			pthread_join(stripe->device[i].thread, NULL);
+		pthread_cond_destroy(&stripe->device[i].queue_cond);
+
+		for (j = 0; j < STRIPE_BUFFERS; j++) {
+			if (stripe->device[i].buffer[j].data)
+				free(stripe->device[i].buffer[j].data);
+		}
+	}
+
+	pthread_cond_destroy(&stripe->done_cond);
+	pthread_mutex_destroy(&stripe->mutex);
+	free(stripe);
+
+	return ret;
+}
+
+int stripe_submit(stripe_t stripe, struct stripe_buffer_s *buffer)
+{
+	struct stripe_device_s *device = buffer->device;
+
+	pthread_mutex_lock(&stripe->mutex);
+	buffer->busy = 1;
+	device->queue[(device->queue_head + device->queue_count++) % STRIPE_BUFFERS] = buffer;
+	pthread_cond_signal(&device->queue_cond);
+	pthread_mutex_unlock(&stripe->mutex);
+
+	return 0;
+}
+
+int stripe_wait(stripe_t stripe, struct stripe_buffer_s *buffer)
+{
+	int ret;
+
+	pthread_mutex_lock(&stripe->mutex);
+	while (buffer->busy)
+		pthread_cond_wait(&stripe->done_cond, &stripe->mutex);
+	ret = stripe->err;
+	pthread_mutex_unlock(&stripe->mutex);
+
+	return ret;
+}
+
+int stripe_next(stripe_t stripe)
+{
+	struct stripe_device_s *device;
+	struct stripe_buffer_s *buffer;
+	int ret;
+
+	stripe->chunk++;
+	device = &stripe->device[stripe->chunk % stripe->count];
+	buffer = &device->buffer[device->cur];
+	device->cur = (device->cur + 1) % STRIPE_BUFFERS;
+
+	if ((ret = stripe_wait(stripe, buffer)))
+		return ret;
+
+	buffer->offset = sizeof(glc_stripe_header_t) +
+			 (stripe->chunk / stripe->count) * stripe->chunk_size;
+	buffer->used = 0;
+	stripe->buffer = buffer;
+
+	return 0;
+}
+
+int stripe_pwrite(int fd, const char *data, size_t size, off_t offset)
+{
+	ssize_t ret;
+
+	while (size) {
+		if ((ret = pwrite(fd, data, size, offset)) == -1) {
+			if (errno == EINTR)
+				continue;
+			return errno;
+		} else if (!ret)
+			return EIO;
+
+		data += ret;
+		size -= ret;
+		offset += ret;
+	}
+
+	return 0;
+}
+
+void *stripe_thread(void *argptr)
+{
+	struct stripe_device_s *device = (struct stripe_device_s *) argptr;
+	stripe_t stripe = device->stripe;
+	struct stripe_buffer_s *buffer;
+	int ret;
+
+	pthread_mutex_lock(&stripe->mutex);
+	for (;;) {
+		while ((!device->queue_count) && (!stripe->stop))
+			pthread_cond_wait(&device->queue_cond, &stripe->mutex);
+		if (!device->queue_count)
+			break;
+
+		buffer = device->queue[device->queue_head];
+		device->queue_head = (device->queue_head + 1) % STRIPE_BUFFERS;
+		device->queue_count--;
+		pthread_mutex_unlock(&stripe->mutex);
+
+		ret = stripe_pwrite(device->fd, buffer->data, buffer->size, buffer->offset);
+
+		pthread_mutex_lock(&stripe->mutex);
+		if (ret)
+			stripe->err = ret;
+		buffer->busy = 0;
+		pthread_cond_broadcast(&stripe->done_cond);
+	}
+	pthread_mutex_unlock(&stripe->mutex);
+
+	return NULL;
+}
+
+/**  \} */
@@ -0,0 +1,136 @@
+/**
+ * \file glc/core/stripe.h
+ * \brief stream striping over several files
+ * \author Pyry Haulos <pyry.haulos@gmail.com>
+ * \date 2007-2008
+ * For conditions of distribution and use, see copyright notice in glc.h
+ */
+
+/**
+ * \addtogroup core
+ *  \{
+ * \defgroup stripe stream striping over several files
+ *  \{
+ */
+
+#ifndef _STRIPE_H
+#define _STRIPE_H
+
+#include <sys/types.h>
+#include <glc/common/glc.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** maximum number of stripes */
+#define STRIPE_MAX                 16
+/** number of chunk buffers per stripe, also maximum number of writes in flight */
+#define STRIPE_BUFFERS             4
+
+/**
+ * \brief stripe object
+ */
+typedef struct stripe_s* stripe_t;
+
+/**
+ * \brief initialize stripe writer
+ *
+ * Writes glc_stripe_header_t to beginning of each file. Data is
+ * collected into chunk buffers and full chunks are written round-robin
+ * to stripes, each stripe by its own writer thread.
+ * \param stripe stripe writer
+ * \param glc glc
+ * \param fd file descriptors, one per stripe
+ * \param count number of stripes
+ * \param chunk_size chunk size
+ * \return 0 on success otherwise an error code
+ */
+int stripe_init(stripe_t *stripe, glc_t *glc, int *fd, unsigned int count,
+		size_t chunk_size);
+
+/**
+ * \brief open stripes for reading
+ *
+ * Stripe headers are validated and stripes are ordered by their
+ * number, so files can be given in any order.
+ * \param stripe stripe reader
+ * \param glc glc
+ * \param fd file descriptors, one per stripe
+ * \param count number of stripes
+ * \return 0 on success, EINVAL if files don't form a complete set
+ */
+int stripe_open(stripe_t *stripe, glc_t *glc, int *fd, unsigned int count);
+
+/**
+ * \brief write data
+ * \param stripe stripe writer
+ * \param data data
+ * \param size data size
+ * \return 0 on success, otherwise error code of this or any earlier write
+ */
+int stripe_write(stripe_t stripe, const void *data, size_t size);
+
+/**
+ * \brief write all data to files
+ *
+ * Waits for writes in flight and writes partial chunk.
+ * \param stripe stripe writer
+ * \return 0 on success otherwise an error code
+ */
+int stripe_flush(stripe_t stripe);
+
+/**
+ * \brief read data
+ * \param stripe stripe reader
+ * \param data buffer
+ * \param size number of bytes to read
+ * \param offset offset in striped stream
+ * \return number of bytes read, less than size at end of stream,
+ *         or -1 and errno on error
+ */
+ssize_t stripe_pread(stripe_t stripe, void *data, size_t size, u_int64_t offset);
+
+/**
+ * \brief size of striped stream
+ *
+ * Stream ends at first chunk that isn't complete in its stripe, so
+ * data following a chunk lost in crash is ignored.
+ * \param stripe stripe reader
+ * \param size returns size
+ * \return 0 on success otherwise an error code
+ */
+int stripe_size(stripe_t stripe, u_int64_t *size);
+
+/**
+ * \brief number of stripes
+ * \param stripe stripe object
+ * \return number of stripes
+ */
+unsigned int stripe_count(stripe_t stripe);
+
+/**
+ * \brief file descriptor of stripe
+ * \param stripe stripe object
+ * \param index stripe number
+ * \return file descriptor
+ */
+int stripe_fd(stripe_t stripe, unsigned int index);
+
+/**
+ * \brief flush and destroy stripe object
+ *
+ * File descriptors are not closed.
+ * \param stripe stripe object
+ * \return 0 on success otherwise an error code
+ */
+int stripe_destroy(stripe_t stripe);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/**  \} */
+/**  \} */
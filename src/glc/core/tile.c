@@ -0,0 +1,707 @@
+/**
+ * \file glc/core/tile.c
+ * \brief write only changed tiles of video frames
+ * \author Pyry Haulos <pyry.haulos@gmail.com>
+ * \date 2007-2008
+ * For conditions of distribution and use, see copyright notice in glc.h
+ */
+
+/**
+ * \addtogroup tile
+ *  \{
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <packetstream.h>
+#include <errno.h>
+
+#include <glc/common/glc.h>
+#include <glc/common/core.h>
+#include <glc/common/log.h>
+#include <glc/common/thread.h>
+#include <glc/common/util.h>
+
+#include "tile.h"
+
+struct tile_plane_s {
+	size_t offset;
+	unsigned int row;	/* bytes per row in frame */
+	unsigned int w, h;	/* plane size in pixels */
+	unsigned int bpp;
+	unsigned int shift;	/* tile size in plane is size >> shift */
+};
+
+struct tile_geometry_s {
+	unsigned int w, h;
+	unsigned int size;
+	unsigned int tiles_x, tiles_y;
+
+	struct tile_plane_s plane[3];
+	int planes;
+	size_t frame_size;
+};
+
+struct tile_video_stream_s {
+	glc_stream_id_t id;
+	int supported;
+	struct tile_geometry_s geom;
+
+	/* previous frame as it was written */
+	char *prev;
+	int prev_valid;
+
+	u_int32_t *changed;
+	unsigned int changed_count;
+	size_t changed_size;
+
+	struct tile_video_stream_s *next;
+};
+
+struct tile_s {
+	glc_t *glc;
+	glc_thread_t thread;
+	int running;
+
+	unsigned int size;
+
+	struct tile_video_stream_s *video;
+};
+
+struct untile_video_stream_s {
+	glc_stream_id_t id;
+	int supported;
+	struct tile_geometry_s geom;
+
+	/* current frame, tiles are written into this */
+	char *frame;
+	int frame_valid;
+
+	struct untile_video_stream_s *next;
+};
+
+struct untile_s {
+	glc_t *glc;
+	glc_thread_t thread;
+	int running;
+
+	struct untile_video_stream_s *video;
+};
+
+int tile_geometry_format(struct tile_geometry_s *geom,
+			 glc_video_format_message_t *format_msg);
+int tile_geometry_size(struct tile_geometry_s *geom, unsigned int size);
+void tile_rect(struct tile_geometry_s *geom, int p, unsigned int index,
+	       size_t *offset, size_t *len, unsigned int *rows);
+size_t tile_bytes(struct tile_geometry_s *geom, unsigned int index);
+int tile_changed(struct tile_geometry_s *geom, unsigned int index,
+		 const char *frame, const char *prev);
+size_t tile_save(struct tile_geometry_s *geom, unsigned int index,
+		 const char *frame, char *to);
+size_t tile_restore(struct tile_geometry_s *geom, unsigned int index,
+		    char *frame, const char *from);
+
+void tile_finish_callback(void *ptr, int err);
+int tile_read_callback(glc_thread_state_t *state);
+int tile_write_callback(glc_thread_state_t *state);
+
+void tile_get_video_stream(tile_t tile, glc_stream_id_t id,
+			   struct tile_video_stream_s **video);
+int tile_video_format_message(tile_t tile, glc_video_format_message_t *format_msg);
+int tile_video_frame_message(tile_t tile, struct tile_video_stream_s *video,
+			     glc_thread_state_t *state);
+
+void untile_finish_callback(void *ptr, int err);
+int untile_read_callback(glc_thread_state_t *state);
+int untile_write_callback(glc_thread_state_t *state);
+
+void untile_get_video_stream(untile_t untile, glc_stream_id_t id,
+			     struct untile_video_stream_s **video);
+int untile_video_format_message(untile_t untile, glc_video_format_message_t *format_msg);
+int untile_video_tiles_message(untile_t untile, glc_thread_state_t *state);
+
+int tile_init(tile_t *tile, glc_t *glc)
+{
+	*tile = (tile_t) malloc(sizeof(struct tile_s));
+	memset(*tile, 0, sizeof(struct tile_s));
+
+	(*tile)->glc = glc;
+	(*tile)->size = 64;
+
+	/* each frame depends on previous one */
+	(*tile)->thread.flags = GLC_THREAD_READ | GLC_THREAD_WRITE;
+	(*tile)->thread.read_callback = &tile_read_callback;
+	(*tile)->thread.write_callback = &tile_write_callback;
+	(*tile)->thread.finish_callback = &tile_finish_callback;
+	(*tile)->thread.ptr = *tile;
+	(*tile)->thread.threads = 1;
+
+	return 0;
+}
+
+int tile_set_size(tile_t tile, unsigned int size)
+{
+	/* chroma tiles are half of this */
+	if ((size < 8) || (size % 2))
+		return EINVAL;
+
+	tile->size = size;
+	return 0;
+}
+
+int tile_process_start(tile_t tile, ps_buffer_t *from, ps_buffer_t *to)
+{
+	int ret;
+	if (tile->running)
+		return EAGAIN;
+
+	if ((ret = glc_thread_create(tile->glc, &tile->thread, from, to)))
+		return ret;
+	tile->running = 1;
+
+	return 0;
+}
+
+int tile_process_wait(tile_t tile)
+{
+	if (!tile->running)
+		return EAGAIN;
+
+	glc_thread_wait(&tile->thread);
+	tile->running = 0;
+
+	return 0;
+}
+
+int tile_destroy(tile_t tile)
+{
+	free(tile);
+	return 0;
+}
+
+void tile_finish_callback(void *ptr, int err)
+{
+	tile_t tile = (tile_t) ptr;
+	struct tile_video_stream_s *del;
+
+	if (err)
+		glc_log(tile->glc, GLC_ERROR, "tile", "%s (%d)", strerror(err), err);
+
+	while (tile->video != NULL) {
+		del = tile->video;
+		tile->video = tile->video->next;
+
+		if (del->prev)
+			free(del->prev);
+		if (del->changed)
+			free(del->changed);
+		free(del);
+	}
+}
+
+int tile_read_callback(glc_thread_state_t *state)
+{
+	tile_t tile = (tile_t) state->ptr;
+	struct tile_video_stream_s *video;
+	glc_video_frame_header_t *pic_hdr;
+
+	if (state->header.type == GLC_MESSAGE_VIDEO_FORMAT)
+		tile_video_format_message(tile, (glc_video_format_message_t *) state->read_data);
+	else if (state->header.type == GLC_CALLBACK_REQUEST) {
+		/* stream file might be reopened, next frames must be complete */
+		for (video = tile->video; video != NULL; video = video->next)
+			video->prev_valid = 0;
+	} else if (state->header.type == GLC_MESSAGE_VIDEO_FRAME) {
+		pic_hdr = (glc_video_frame_header_t *) state->read_data;
+		tile_get_video_stream(tile, pic_hdr->id, &video);
+
+		if ((video->supported) &&
+		    (state->read_size == sizeof(glc_video_frame_header_t) +
+					 video->geom.frame_size))
+			return tile_video_frame_message(tile, video, state);
+
+		video->prev_valid = 0;
+	}
+
+	state->flags |= GLC_THREAD_COPY;
+	return 0;
+}
+
+int tile_video_frame_message(tile_t tile, struct tile_video_stream_s *video,
+			     glc_thread_state_t *state)
+{
+	char *frame = &state->read_data[sizeof(glc_video_frame_header_t)];
+	unsigned int i;
+
+	state->threadptr = video;
+
+	if (!video->prev_valid)
+		goto full;
+
+	video->changed_count = 0;
+	video->changed_size = 0;
+	for (i = 0; i < video->geom.tiles_x * video->geom.tiles_y; i++) {
+		if (tile_changed(&video->geom, i, frame, video->prev)) {
+			video->changed[video->changed_count++] = i;
+			video->changed_size += tile_bytes(&video->geom, i);
+		}
+	}
+
+	if (!video->changed_count) {
+		state->header.type = GLC_MESSAGE_VIDEO_REPEAT;
+		state->write_size = sizeof(glc_video_repeat_message_t);
+		return 0;
+	}
+
+	/* scattered tiles are not worth it if most of the frame has changed */
+	if (video->changed_size > video->geom.frame_size / 2)
+		goto full;
+
+	state->header.type = GLC_MESSAGE_VIDEO_TILES;
+	state->write_size = sizeof(glc_video_tiles_header_t) +
+			    sizeof(u_int32_t) * video->changed_count +
+			    video->changed_size;
+	return 0;
+
+full:
+	memcpy(video->prev, frame, video->geom.frame_size);
+	video->prev_valid = 1;
+	state->flags |= GLC_THREAD_COPY;
+	return 0;
+}
+
+int tile_write_callback(glc_thread_state_t *state)
+{
+	struct tile_video_stream_s *video = state->threadptr;
+	glc_video_frame_header_t *pic_hdr = (glc_video_frame_header_t *) state->read_data;
+	char *frame = &state->read_data[sizeof(glc_video_frame_header_t)];
+	glc_video_repeat_message_t *repeat_msg;
+	glc_video_tiles_header_t *tiles_hdr;
+	char *data;
+	unsigned int i;
+
+	if (state->header.type == GLC_MESSAGE_VIDEO_REPEAT) {
+		repeat_msg = (glc_video_repeat_message_t *) state->write_data;
+		repeat_msg->id = pic_hdr->id;
+		repeat_msg->time = pic_hdr->time;
+		return 0;
+	}
+
+	tiles_hdr = (glc_video_tiles_header_t *) state->write_data;
+	tiles_hdr->id = pic_hdr->id;
+	tiles_hdr->time = pic_hdr->time;
+	tiles_hdr->size = video->geom.size;
+	tiles_hdr->count = video->changed_count;
+
+	memcpy(&state->write_data[sizeof(glc_video_tiles_header_t)], video->changed,
+	       sizeof(u_int32_t) * video->changed_count);
+
+	/* written tiles update previous frame too */
+	data = &state->write_data[sizeof(glc_video_tiles_header_t) +
+				  sizeof(u_int32_t) * video->changed_count];
+	for (i = 0; i < video->changed_count; i++) {
+		tile_save(&video->geom, video->changed[i], frame, data);
+		data += tile_restore(&video->geom, video->changed[i], video->prev, data);
+	}
+
+	return 0;
+}
+
+void tile_get_video_stream(tile_t tile, glc_stream_id_t id,
+			   struct tile_video_stream_s **video)
+{
+	*video = tile->video;
+
+	while (*video != NULL) {
+		if ((*video)->id == id)
+			break;
+		*video = (*video)->next;
+	}
+
+	if (*video == NULL) {
+		*video = (struct tile_video_stream_s *)
+			malloc(sizeof(struct tile_video_stream_s));
+		memset(*video, 0, sizeof(struct tile_video_stream_s));
+
+		(*video)->id = id;
+
+		(*video)->next = tile->video;
+		tile->video = *video;
+	}
+}
+
+int tile_video_format_message(tile_t tile, glc_video_format_message_t *format_msg)
+{
+	struct tile_video_stream_s *video;
+
+	tile_get_video_stream(tile, format_msg->id, &video);
+	video->prev_valid = 0;
+	video->supported = 0;
+
+	if ((tile_geometry_format(&video->geom, format_msg)) ||
+	    (tile_geometry_size(&video->geom, tile->size))) {
+		glc_log(tile->glc, GLC_WARNING, "tile",
+			 "video stream %d is in unsupported format 0x%02x, writing full frames",
+			 format_msg->id, format_msg->format);
+		return 0;
+	}
+
+	video->prev = (char *) realloc(video->prev, video->geom.frame_size);
+	video->changed = (u_int32_t *) realloc(video->changed, sizeof(u_int32_t) *
+					       video->geom.tiles_x * video->geom.tiles_y);
+	if ((!video->prev) || (!video->changed))
+		return ENOMEM;
+
+	glc_log(tile->glc, GLC_DEBUG, "tile", "video %d: %ux%u tiles of %ux%u",
+		 video->id, video->geom.tiles_x, video->geom.tiles_y,
+		 video->geom.size, video->geom.size);
+
+	video->supported = 1;
+	return 0;
+}
+
+int untile_init(untile_t *untile, glc_t *glc)
+{
+	*untile = (untile_t) malloc(sizeof(struct untile_s));
+	memset(*untile, 0, sizeof(struct untile_s));
+
+	(*untile)->glc = glc;
+
+	(*untile)->thread.flags = GLC_THREAD_READ | GLC_THREAD_WRITE;
+	(*untile)->thread.read_callback = &untile_read_callback;
+	(*untile)->thread.write_callback = &untile_write_callback;
+	(*untile)->thread.finish_callback = &untile_finish_callback;
+	(*untile)->thread.ptr = *untile;
+	(*untile)->thread.threads = 1;
+
+	return 0;
+}
+
+int untile_process_start(untile_t untile, ps_buffer_t *from, ps_buffer_t *to)
+{
+	int ret;
+	if (untile->running)
+		return EAGAIN;
+
+	if ((ret = glc_thread_create(untile->glc, &untile->thread, from, to)))
+		return ret;
+	untile->running = 1;
+
+	return 0;
+}
+
+int untile_process_wait(untile_t untile)
+{
+	if (!untile->running)
+		return EAGAIN;
+
+	glc_thread_wait(&untile->thread);
+	untile->running = 0;
+
+	return 0;
+}
+
+int untile_destroy(untile_t untile)
+{
+	free(untile);
+	return 0;
+}
+
+void untile_finish_callback(void *ptr, int err)
+{
+	untile_t untile = (untile_t) ptr;
+	struct untile_video_stream_s *del;
+
+	if (err)
+		glc_log(untile->glc, GLC_ERROR, "untile", "%s (%d)", strerror(err), err);
+
+	while (untile->video != NULL) {
+		del = untile->video;
+		untile->video = untile->video->next;
+
+		if (del->frame)
+			free(del->frame);
+		free(del);
+	}
+}
+
+int untile_read_callback(glc_thread_state_t *state)
+{
+	untile_t untile = (untile_t) state->ptr;
+	struct untile_video_stream_s *video;
+	glc_video_frame_header_t *pic_hdr;
+
+	if (state->header.type == GLC_MESSAGE_VIDEO_FORMAT)
+		untile_video_format_message(untile, (glc_video_format_message_t *) state->read_data);
+	else if (state->header.type == GLC_MESSAGE_VIDEO_FRAME) {
+		pic_hdr = (glc_video_frame_header_t *) state->read_data;
+		untile_get_video_stream(untile, pic_hdr->id, &video);
+
+		/* keep a copy for following tiles */
+		if ((video->supported) &&
+		    (state->read_size == sizeof(glc_video_frame_header_t) +
+					 video->geom.frame_size)) {
+			memcpy(video->frame, &state->read_data[sizeof(glc_video_frame_header_t)],
+			       video->geom.frame_size);
+			video->frame_valid = 1;
+		} else
+			video->frame_valid = 0;
+	} else if (state->header.type == GLC_MESSAGE_VIDEO_TILES)
+		return untile_video_tiles_message(untile, state);
+
+	state->flags |= GLC_THREAD_COPY;
+	return 0;
+}
+
+int untile_video_tiles_message(untile_t untile, glc_thread_state_t *state)
+{
+	glc_video_tiles_header_t *tiles_hdr = (glc_video_tiles_header_t *) state->read_data;
+	struct untile_video_stream_s *video;
+	u_int32_t *index;
+	size_t left;
+	char *data;
+	unsigned int i;
+
+	untile_get_video_stream(untile, tiles_hdr->id, &video);
+
+	if ((!video->frame_valid) ||
+	    (tile_geometry_size(&video->geom, tiles_hdr->size)) ||
+	    (state->read_size < sizeof(glc_video_tiles_header_t) +
+				sizeof(u_int32_t) * tiles_hdr->count))
+		goto broken;
+
+	index = (u_int32_t *) &state->read_data[sizeof(glc_video_tiles_header_t)];
+	data = (char *) &index[tiles_hdr->count];
+	left = state->read_size - sizeof(glc_video_tiles_header_t) -
+	       sizeof(u_int32_t) * tiles_hdr->count;
+
+	for (i = 0; i < tiles_hdr->count; i++) {
+		if ((index[i] >= video->geom.tiles_x * video->geom.tiles_y) ||
+		    (tile_bytes(&video->geom, index[i]) > left))
+			goto broken;
+
+		left -= tile_bytes(&video->geom, index[i]);
+		data += tile_restore(&video->geom, index[i], video->frame, data);
+	}
+
+	state->threadptr = video;
+	state->header.type = GLC_MESSAGE_VIDEO_FRAME;
+	state->write_size = sizeof(glc_video_frame_header_t) + video->geom.frame_size;
+	return 0;
+
+broken:
+	glc_log(untile->glc, GLC_WARNING, "untile",
+		 "tiles don't match any frame in video stream %d, skipping", tiles_hdr->id);
+	video->frame_valid = 0;
+	state->flags |= GLC_THREAD_STATE_SKIP_WRITE;
+	return 0;
+}
+
+int untile_write_callback(glc_thread_state_t *state)
+{
+	struct untile_video_stream_s *video = state->threadptr;
+	glc_video_tiles_header_t *tiles_hdr = (glc_video_tiles_header_t *) state->read_data;
+	glc_video_frame_header_t *pic_hdr = (glc_video_frame_header_t *) state->write_data;
+
+	pic_hdr->id = tiles_hdr->id;
+	pic_hdr->time = tiles_hdr->time;
+	memcpy(&state->write_data[sizeof(glc_video_frame_header_t)], video->frame,
+	       video->geom.frame_size);
+
+	return 0;
+}
+
+void untile_get_video_stream(untile_t untile, glc_stream_id_t id,
+			     struct untile_video_stream_s **video)
+{
+	*video = untile->video;
+
+	while (*video != NULL) {
+		if ((*video)->id == id)
+			break;
+		*video = (*video)->next;
+	}
+
+	if (*video == NULL) {
+		*video = (struct untile_video_stream_s *)
+			malloc(sizeof(struct untile_video_stream_s));
+		memset(*video, 0, sizeof(struct untile_video_stream_s));
+
+		(*video)->id = id;
+
+		(*video)->next = untile->video;
+		untile->video = *video;
+	}
+}
+
+int untile_video_format_message(untile_t untile, glc_video_format_message_t *format_msg)
+{
+	struct untile_video_stream_s *video;
+
+	untile_get_video_stream(untile, format_msg->id, &video);
+	video->frame_valid = 0;
+	video->supported = 0;
+
+	/* tile size is set when tiles arrive */
+	if (tile_geometry_format(&video->geom, format_msg))
+		return 0;
+
+	if (!(video->frame = (char *) realloc(video->frame, video->geom.frame_size)))
+		return ENOMEM;
+
+	video->supported = 1;
+	return 0;
+}
+
+int tile_geometry_format(struct tile_geometry_s *geom,
+			 glc_video_format_message_t *format_msg)
+{
+	unsigned int bpp;
+
+	memset(geom, 0, sizeof(struct tile_geometry_s));
+	geom->w = format_msg->width;
+	geom->h = format_msg->height;
+
+	if ((!geom->w) || (!geom->h))
+		return EINVAL;
+
+	if (format_msg->format == GLC_VIDEO_YCBCR_420JPEG) {
+		geom->planes = 3;
+
+		geom->plane[0].w = geom->plane[0].row = geom->w;
+		geom->plane[0].h = geom->h;
+
+		geom->plane[1].w = geom->plane[1].row = geom->plane[2].w =
+			geom->plane[2].row = geom->w / 2;
+		geom->plane[1].h = geom->plane[2].h = geom->h / 2;
+		geom->plane[1].offset = geom->w * geom->h;
+		geom->plane[2].offset = geom->plane[1].offset +
+					geom->plane[1].w * geom->plane[1].h;
+		geom->plane[1].shift = geom->plane[2].shift = 1;
+
+		geom->plane[0].bpp = geom->plane[1].bpp = geom->plane[2].bpp = 1;
+		geom->frame_size = geom->plane[2].offset +
+				   geom->plane[2].w * geom->plane[2].h;
+		return 0;
+	}
+
+	if ((format_msg->format == GLC_VIDEO_BGR) ||
+	    (format_msg->format == GLC_VIDEO_RGB))
+		bpp = 3;
+	else if (format_msg->format == GLC_VIDEO_BGRA)
+		bpp = 4;
+	else
+		return ENOTSUP;
+
+	geom->planes = 1;
+	geom->plane[0].w = geom->w;
+	geom->plane[0].h = geom->h;
+	geom->plane[0].bpp = bpp;
+	geom->plane[0].row = geom->w * bpp;
+	if ((format_msg->flags & GLC_VIDEO_DWORD_ALIGNED) && (geom->plane[0].row % 8))
+		geom->plane[0].row += 8 - geom->plane[0].row % 8;
+	geom->frame_size = geom->plane[0].row * geom->h;
+
+	return 0;
+}
+
+int tile_geometry_size(struct tile_geometry_s *geom, unsigned int size)
+{
+	if ((!geom->planes) || (size < 8) || (size % 2))
+		return EINVAL;
+
+	geom->size = size;
+	geom->tiles_x = (geom->w + size - 1) / size;
+	geom->tiles_y = (geom->h + size - 1) / size;
+	return 0;
+}
+
+void tile_rect(struct tile_geometry_s *geom, int p, unsigned int index,
+	       size_t *offset, size_t *len, unsigned int *rows)
+{
+	struct tile_plane_s *plane = &geom->plane[p];
+	unsigned int size = geom->size >> plane->shift;
+	unsigned int x = (index % geom->tiles_x) * size;
+	unsigned int y = (index / geom->tiles_x) * size;
+
+	if ((x >= plane->w) || (y >= plane->h)) {
+		*offset = *len = *rows = 0;
+		return;
+	}
+
+	*offset = plane->offset + (size_t) y * plane->row + (size_t) x * plane->bpp;
+	*len = (size_t) (size < plane->w - x ? size : plane->w - x) * plane->bpp;
+	*rows = size < plane->h - y ? size : plane->h - y;
+}
+
+size_t tile_bytes(struct tile_geometry_s *geom, unsigned int index)
+{
+	size_t offset, len, bytes = 0;
+	unsigned int rows;
+	int p;
+
+	for (p = 0; p < geom->planes; p++) {
+		tile_rect(geom, p, index, &offset, &len, &rows);
+		bytes += len * rows;
+	}
+
+	return bytes;
+}
+
+int tile_changed(struct tile_geometry_s *geom, unsigned int index,
+		 const char *frame, const char *prev)
+{
+	size_t offset, len;
+	unsigned int rows, r;
+	int p;
+
+	for (p = 0; p < geom->planes; p++) {
+		tile_rect(geom, p, index, &offset, &len, &rows);
+		for (r = 0; r < rows; r++, offset += geom->plane[p].row) {
+			if (memcmp(&frame[offset], &prev[offset], len))
+				return 1;
+		}
+	}
+
+	return 0;
+}
+
+size_t tile_save(struct tile_geometry_s *geom, unsigned int index,
+		 const char *frame, char *to)
+{
+	size_t offset, len, bytes = 0;
+	unsigned int rows, r;
+	int p;
+
+	for (p = 0; p < geom->planes; p++) {
+		tile_rect(geom, p, index, &offset, &len, &rows);
+		for (r = 0; r < rows; r++, offset += geom->plane[p].row) {
+			memcpy(&to[bytes], &frame[offset], len);
+			bytes += len;
+		}
+	}
+
+	return bytes;
+}
+
+size_t tile_restore(struct tile_geometry_s *geom, unsigned int index,
+		    char *frame, const char *from)
+{
+	size_t offset, len, bytes = 0;
+	unsigned int rows, r;
+	int p;
+
+	for (p = 0; p < geom->planes; p++) {
+		tile_rect(geom, p, index, &offset, &len, &rows);
+		for (r = 0; r < rows; r++, offset += geom->plane[p].row) {
+			memcpy(&frame[offset], &from[bytes], len);
+			bytes += len;
+		}
+	}
+
+	return bytes;
+}
+
+/**  \} */
@@ -0,0 +1,126 @@
+/**
+ * \file glc/core/tile.h
+ * \brief write only changed tiles of video frames
+ * \author Pyry Haulos <pyry.haulos@gmail.com>
+ * \date 2007-2008
+ * For conditions of distribution and use, see copyright notice in glc.h
+ */
+
+/**
+ * \addtogroup core
+ *  \{
+ * \defgroup tile write only changed tiles of video frames
+ *  \{
+ */
+
+#ifndef _TILE_H
+#define _TILE_H
+
+#include <packetstream.h>
+#include <glc/common/glc.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief tile object
+ */
+typedef struct tile_s* tile_t;
+
+/**
+ * \brief untile object
+ */
+typedef struct untile_s* untile_t;
+
+/**
+ * \brief initialize tile object
+ * \param tile tile object
+ * \param glc glc
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int tile_init(tile_t *tile, glc_t *glc);
+
+/**
+ * \brief set tile size
+ *
+ * Tiles are square and measured in pixels. In Y'CbCr 4:2:0
+ * frames chroma tiles are half of this. Default is 64.
+ * \param tile tile object
+ * \param size tile width and height
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int tile_set_size(tile_t tile, unsigned int size);
+
+/**
+ * \brief start tile process
+ *
+ * tile compares each video frame against previous frame in
+ * the same stream and writes only changed tiles in a
+ * GLC_MESSAGE_VIDEO_TILES message. Unchanged frames are written
+ * as GLC_MESSAGE_VIDEO_REPEAT and frames where most of the tiles
+ * have changed are passed through as they are.
+ * \param tile tile object
+ * \param from source buffer
+ * \param to target buffer
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int tile_process_start(tile_t tile, ps_buffer_t *from, ps_buffer_t *to);
+
+/**
+ * \brief block until process has finished
+ * \param tile tile object
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int tile_process_wait(tile_t tile);
+
+/**
+ * \brief destroy tile object
+ * \param tile tile object
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int tile_destroy(tile_t tile);
+
+/**
+ * \brief initialize untile object
+ * \param untile untile object
+ * \param glc glc
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int untile_init(untile_t *untile, glc_t *glc);
+
+/**
+ * \brief start untile process
+ *
+ * untile rebuilds full video frames from GLC_MESSAGE_VIDEO_TILES
+ * messages. Everything else is passed through.
+ * \param untile untile object
+ * \param from source buffer
+ * \param to target buffer
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int untile_process_start(untile_t untile, ps_buffer_t *from,
+				  ps_buffer_t *to);
+
+/**
+ * \brief block until process has finished
+ * \param untile untile object
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int untile_process_wait(untile_t untile);
+
+/**
+ * \brief destroy untile object
+ * \param untile untile object
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int untile_destroy(untile_t untile);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/**  \} */
+/**  \} */
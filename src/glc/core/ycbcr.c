@@ -112,7 +112,7 @@ int ycbcr_init(ycbcr_t *ycbcr, glc_t *glc)
 
 	(*ycbcr)->glc = glc;
 
-	(*ycbcr)->thread.flags = GLC_THREAD_READ | GLC_THREAD_WRITE;
+	(*ycbcr)->thread.flags = GLC_THREAD_READ | GLC_THREAD_WRITE | GLC_THREAD_REORDER;
 	(*ycbcr)->thread.read_callback = &ycbcr_read_callback;
 	(*ycbcr)->thread.write_callback = &ycbcr_write_callback;
 	(*ycbcr)->thread.finish_callback = &ycbcr_finish_callback;
@@ -62,6 +62,7 @@ int img_read_callback(glc_thread_state_t *state);
 int img_video_format_message(img_t img, glc_video_format_message_t *video_format);
 int img_video_frame_message(img_t img, glc_video_frame_header_t *pic_hdr,
 	    const unsigned char *pic, size_t pic_size);
+int img_video_repeat_message(img_t img, glc_video_repeat_message_t *repeat);
 
 int img_write_bmp(img_t img, const unsigned char *pic,
 		  unsigned int w, unsigned int h,
@@ -184,6 +185,8 @@ int img_read_callback(glc_thread_state_t *state)
 		ret = img_video_frame_message(img, (glc_video_frame_header_t *) state->read_data,
 			      (const unsigned char *) &state->read_data[sizeof(glc_video_frame_header_t)],
 			      state->read_size);
+	} else if (state->header.type == GLC_MESSAGE_VIDEO_REPEAT) {
+		ret = img_video_repeat_message(img, (glc_video_repeat_message_t *) state->read_data);
 	}
 
 	return ret;
@@ -242,11 +245,25 @@ int img_video_frame_message(img_t img, glc_video_frame_header_t *pic_hdr,
 		ret = img->write_proc(img, pic, img->w, img->h, filename);
 	}
 
-	memcpy(img->prev_video_frame_message, pic, pic_size);
+	if (pic != img->prev_video_frame_message)
+		memcpy(img->prev_video_frame_message, pic, pic_size);
 
 	return ret;
 }
 
+int img_video_repeat_message(img_t img, glc_video_repeat_message_t *repeat)
+{
+	glc_video_frame_header_t pic_hdr;
+
+	if (!img->prev_video_frame_message)
+		return 0;
+
+	pic_hdr.id = repeat->id;
+	pic_hdr.time = repeat->time;
+	return img_video_frame_message(img, &pic_hdr, img->prev_video_frame_message,
+				       img->row * img->h);
+}
+
 int img_write_bmp(img_t img, const unsigned char *pic,
 		  unsigned int w, unsigned int h, const char *filename)
 {
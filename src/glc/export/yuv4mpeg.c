@@ -54,6 +54,7 @@ void yuv4mpeg_finish_callback(void *priv, int err);
 
 int yuv4mpeg_handle_hdr(yuv4mpeg_t yuv4mpeg, glc_video_format_message_t *video_format);
 int yuv4mpeg_handle_video_frame_message(yuv4mpeg_t yuv4mpeg, glc_video_frame_header_t *pic_header, char *data);
+int yuv4mpeg_handle_video_repeat_message(yuv4mpeg_t yuv4mpeg, glc_video_repeat_message_t *repeat);
 int yuv4mpeg_write_video_frame_message(yuv4mpeg_t yuv4mpeg, char *pic);
 
 int yuv4mpeg_init(yuv4mpeg_t *yuv4mpeg, glc_t *glc)
@@ -161,6 +162,8 @@ int yuv4mpeg_read_callback(glc_thread_state_t *state)
 		return yuv4mpeg_handle_hdr(yuv4mpeg, (glc_video_format_message_t *) state->read_data);
 	else if (state->header.type == GLC_MESSAGE_VIDEO_FRAME)
 		return yuv4mpeg_handle_video_frame_message(yuv4mpeg, (glc_video_frame_header_t *) state->read_data, &state->read_data[sizeof(glc_video_frame_header_t)]);
+	else if (state->header.type == GLC_MESSAGE_VIDEO_REPEAT)
+		return yuv4mpeg_handle_video_repeat_message(yuv4mpeg, (glc_video_repeat_message_t *) state->read_data);
 
 	return 0;
 }
@@ -196,18 +199,17 @@ int yuv4mpeg_handle_hdr(yuv4mpeg_t yuv4mpeg, glc_video_format_message_t *video_f
 	yuv4mpeg->size = video_format->width * video_format->height +
 			 (video_format->width * video_format->height) / 2;
 
-	if (yuv4mpeg->interpolate) {
-		if (yuv4mpeg->prev_video_frame_message)
-			yuv4mpeg->prev_video_frame_message = (char *) realloc(yuv4mpeg->prev_video_frame_message, yuv4mpeg->size);
-		else
-			yuv4mpeg->prev_video_frame_message = (char *) malloc(yuv4mpeg->size);
-
-		/* Set Y' 0 */
-		memset(yuv4mpeg->prev_video_frame_message, 0, video_format->width * video_format->height);
-		/* Set CbCr 128 */
-		memset(&yuv4mpeg->prev_video_frame_message[video_format->width * video_format->height],
-		       128, (video_format->width * video_format->height) / 2);
-	}
+	/* previous frame is needed for repeat messages too */
+	if (yuv4mpeg->prev_video_frame_message)
+		yuv4mpeg->prev_video_frame_message = (char *) realloc(yuv4mpeg->prev_video_frame_message, yuv4mpeg->size);
+	else
+		yuv4mpeg->prev_video_frame_message = (char *) malloc(yuv4mpeg->size);
+
+	/* Set Y' 0 */
+	memset(yuv4mpeg->prev_video_frame_message, 0, video_format->width * video_format->height);
+	/* Set CbCr 128 */
+	memset(&yuv4mpeg->prev_video_frame_message[video_format->width * video_format->height],
+	       128, (video_format->width * video_format->height) / 2);
 
 	/* calculate fps in p/q */
 	/** \todo something more intelligent perhaps... */
@@ -238,12 +240,25 @@ int yuv4mpeg_handle_video_frame_message(yuv4mpeg_t yuv4mpeg, glc_video_frame_hea
 		yuv4mpeg->time += yuv4mpeg->fps_usec;
 	}
 
-	if (yuv4mpeg->interpolate)
+	if (data != yuv4mpeg->prev_video_frame_message)
 		memcpy(yuv4mpeg->prev_video_frame_message, data, yuv4mpeg->size);
 
 	return 0;
 }
 
+int yuv4mpeg_handle_video_repeat_message(yuv4mpeg_t yuv4mpeg, glc_video_repeat_message_t *repeat)
+{
+	glc_video_frame_header_t pic_hdr;
+
+	if (!yuv4mpeg->prev_video_frame_message)
+		return 0;
+
+	pic_hdr.id = repeat->id;
+	pic_hdr.time = repeat->time;
+	return yuv4mpeg_handle_video_frame_message(yuv4mpeg, &pic_hdr,
+						   yuv4mpeg->prev_video_frame_message);
+}
+
 int yuv4mpeg_write_video_frame_message(yuv4mpeg_t yuv4mpeg, char *pic)
 {
 	fprintf(yuv4mpeg->to, "FRAME\n");
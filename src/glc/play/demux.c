@@ -208,6 +208,7 @@ void *demux_thread(void *argptr)
 
 		if ((msg_hdr.type == GLC_MESSAGE_CLOSE) |
 		    (msg_hdr.type == GLC_MESSAGE_VIDEO_FRAME) |
+		    (msg_hdr.type == GLC_MESSAGE_VIDEO_REPEAT) |
 		    (msg_hdr.type == GLC_MESSAGE_VIDEO_FORMAT)) {
 			/* handle msg to gl_play */
 			demux_video_stream_message(demux, &msg_hdr, data, data_size);
@@ -265,6 +266,8 @@ int demux_video_stream_message(demux_t demux, glc_message_header_t *header,
 		id = ((glc_video_format_message_t *) data)->id;
 	else if (header->type == GLC_MESSAGE_VIDEO_FRAME)
 		id = ((glc_video_frame_header_t *) data)->id;
+	else if (header->type == GLC_MESSAGE_VIDEO_REPEAT)
+		id = ((glc_video_repeat_message_t *) data)->id;
 	else
 		return EINVAL;
 
@@ -39,6 +39,7 @@
 #define GL_PLAY_FULLSCREEN         0x4
 #define GL_PLAY_NON_POWER_OF_TWO   0x8
 #define GL_PLAY_CANCEL            0x10
+#define GL_PLAY_DROPPED           0x20
 
 struct gl_play_s {
 	glc_t *glc;
@@ -69,6 +70,10 @@ struct gl_play_s {
 
 	GLint *vertices;
 
+	/* last dropped frame, uploaded only if it is repeated */
+	char *dropped;
+	size_t dropped_size;
+
 	Atom wm_proto_atom;
 	Atom wm_delete_window_atom;
 	Atom net_wm_state_atom;
@@ -90,6 +95,7 @@ int gl_play_create_textures(gl_play_t gl_play);
 int gl_play_destroy_textures(gl_play_t gl_play);
 
 int gl_play_draw_video_frame_messageture(gl_play_t gl_play, char *from);
+int gl_play_show_frame(gl_play_t gl_play, glc_utime_t frame_time);
 
 int gl_play_handle_xevents(gl_play_t gl_play, glc_thread_state_t *state);
 
@@ -120,6 +126,8 @@ int gl_play_init(gl_play_t *gl_play, glc_t *glc)
 
 int gl_play_destroy(gl_play_t gl_play)
 {
+	if (gl_play->dropped)
+		free(gl_play->dropped);
 	free(gl_play);
 	return 0;
 }
@@ -218,10 +226,12 @@ int gl_play_draw_video_frame_messageture(gl_play_t gl_play, char *from)
 			tile_w = gl_play_next_texture_size(gl_play, width_r);
 
 			glBindTexture(GL_TEXTURE_2D, gl_play->tiles[c]);
-			glTexImage2D(GL_TEXTURE_2D, 0, 3, tile_w, tile_h,
-				     0, gl_play->format, GL_UNSIGNED_BYTE,
-				     &from[gl_play->row * (gl_play->h - height_r) +
-					   gl_play->bpp * (gl_play->w - width_r)]);
+			/* NULL redraws previous frame from textures */
+			if (from)
+				glTexImage2D(GL_TEXTURE_2D, 0, 3, tile_w, tile_h,
+					     0, gl_play->format, GL_UNSIGNED_BYTE,
+					     &from[gl_play->row * (gl_play->h - height_r) +
+						   gl_play->bpp * (gl_play->w - width_r)]);
 
 			glEnableClientState(GL_VERTEX_ARRAY);
 			glVertexPointer(2, GL_INT, 0, &gl_play->vertices[c * 8]);
@@ -602,7 +612,9 @@ int gl_play_read_callback(glc_thread_state_t *state)
 
 	glc_video_format_message_t *format_msg;
 	glc_video_frame_header_t *pic_hdr;
+	glc_video_repeat_message_t *repeat_msg;
 	glc_utime_t time;
+	char *dropped;
 
 	gl_handle_xevents(gl_play, state);
 
@@ -614,6 +626,7 @@ int gl_play_read_callback(glc_thread_state_t *state)
 		if (format_msg->id != gl_play->id)
 			return 0; /* just ignore it */
 
+		gl_play->flags &= ~GL_PLAY_DROPPED;
 		gl_play->w = format_msg->width;
 		gl_play->h = format_msg->height;
 		gl_play->bpp = 3;
@@ -658,23 +671,66 @@ int gl_play_read_callback(glc_thread_state_t *state)
 		time = glc_state_time(gl_play->glc);
 		if (time > pic_hdr->time + gl_play->skip_threshold) {
 			glc_log(gl_play->glc, GLC_DEBUG, "gl_play", "dropped frame");
+
+			/* repeat messages may still need the picture, keep a copy instead of uploading */
+			if (gl_play->dropped_size < gl_play->row * gl_play->h) {
+				if (!(dropped = (char *) realloc(gl_play->dropped, gl_play->row * gl_play->h))) {
+					gl_play->flags &= ~GL_PLAY_DROPPED;
+					gl_play_draw_video_frame_messageture(gl_play, &state->read_data[sizeof(glc_video_frame_header_t)]);
+					return 0;
+				}
+				gl_play->dropped = dropped;
+				gl_play->dropped_size = gl_play->row * gl_play->h;
+			}
+
+			memcpy(gl_play->dropped, &state->read_data[sizeof(glc_video_frame_header_t)],
+			       gl_play->row * gl_play->h);
+			gl_play->flags |= GL_PLAY_DROPPED;
 			return 0;
 		}
 
 		/* draw first, measure and sleep after */
+		gl_play->flags &= ~GL_PLAY_DROPPED;
 		gl_play_draw_video_frame_messageture(gl_play, &state->read_data[sizeof(glc_video_frame_header_t)]);
+		gl_play_show_frame(gl_play, pic_hdr->time);
+	} else if (state->header.type == GLC_MESSAGE_VIDEO_REPEAT) {
+		repeat_msg = (glc_video_repeat_message_t *) state->read_data;
 
-		/* wait until actual drawing is done */
-		glFinish();
+		if ((repeat_msg->id != gl_play->id) ||
+		    (!(gl_play->flags & GL_PLAY_INITIALIZED)))
+			return 0;
 
 		time = glc_state_time(gl_play->glc);
-		if (pic_hdr->time > time + gl_play->sleep_threshold)
-			usleep(pic_hdr->time - time);
+		if (time > repeat_msg->time + gl_play->skip_threshold) {
+			glc_log(gl_play->glc, GLC_DEBUG, "gl_play", "dropped frame");
+			return 0;
+		}
 
-		glXSwapBuffers(gl_play->dpy, gl_play->win);
+		/* back buffer is undefined after swap, draw from textures again */
+		if (gl_play->flags & GL_PLAY_DROPPED) {
+			gl_play->flags &= ~GL_PLAY_DROPPED;
+			gl_play_draw_video_frame_messageture(gl_play, gl_play->dropped);
+		} else
+			gl_play_draw_video_frame_messageture(gl_play, NULL);
+		gl_play_show_frame(gl_play, repeat_msg->time);
 	}
 
 	return 0;
 }
 
+int gl_play_show_frame(gl_play_t gl_play, glc_utime_t frame_time)
+{
+	glc_utime_t time;
+
+	/* wait until actual drawing is done */
+	glFinish();
+
+	time = glc_state_time(gl_play->glc);
+	if (frame_time > time + gl_play->sleep_threshold)
+		usleep(frame_time - time);
+
+	glXSwapBuffers(gl_play->dpy, gl_play->win);
+	return 0;
+}
+
 /**  \} */
@@ -54,6 +54,7 @@ __PRIVATE void *wrapped_func(const char *symbol);
 __PRIVATE int open_stream();
 __PRIVATE int close_stream();
 __PRIVATE int reload_stream();
+__PRIVATE int refresh_stream();
 __PRIVATE int start_capture();
 __PRIVATE int stop_capture();
 __PRIVATE void increment_capture();
@@ -81,6 +82,7 @@ __PRIVATE int opengl_capture_start();
 __PRIVATE int opengl_capture_stop();
 __PRIVATE int opengl_refresh_color_correction();
 __PRIVATE int opengl_close();
+__PRIVATE int opengl_refresh();
 __PRIVATE int opengl_push_message(glc_message_header_t *hdr, void *message, size_t message_size);
 /**  \} */
 
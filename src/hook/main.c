@@ -30,6 +30,7 @@
 #include <glc/common/state.h>
 #include <glc/core/pack.h>
 #include <glc/core/file.h>
+#include <glc/core/tile.h>
 
 #include "lib.h"
 
@@ -40,6 +41,13 @@
 #define MAIN_SYNC                 0x20
 #define MAIN_COMPRESS_LZJB        0x40
 #define MAIN_START                0x80
+#define MAIN_COMPRESS_LZ4        0x100
+#define MAIN_COMPRESS_ZSTD       0x200
+#define MAIN_COMPRESS_ADAPTIVE   0x400
+#define MAIN_COMPRESS_PREDICT    0x800
+#define MAIN_COMPRESS_AUDIO_RICE 0x1000
+#define MAIN_COMPRESS_DCT        0x2000
+#define MAIN_DIRECT              0x4000
 
 struct main_private_s {
 	glc_t glc;
@@ -47,10 +55,24 @@ struct main_private_s {
 
 	ps_buffer_t *uncompressed;
 	ps_buffer_t *compressed;
+	ps_buffer_t *tiled;
 	size_t uncompressed_size, compressed_size;
 
 	file_t file;
 	pack_t pack;
+	tile_t tile;
+	unsigned int tile_size;
+	unsigned int keyframe_interval;
+	int compression_level;
+	unsigned int quality;
+	size_t slice_size;
+	size_t batch_size;
+	glc_utime_t batch_time;
+	u_int64_t segment_size;
+	glc_utime_t segment_time;
+	size_t prealloc_size;
+	size_t writeback_size;
+	size_t stripe_size;
 
 	unsigned int capture;
 	const char *stream_file_fmt;
@@ -81,6 +103,7 @@ __PRIVATE int load_environ();
 __PRIVATE void signal_handler(int signum);
 __PRIVATE void get_real_libc_dlsym();
 __PRIVATE void reload_stream_callback(void *arg);
+__PRIVATE char *segment_filename(void *arg, unsigned int segment);
 
 void init_glc()
 {
@@ -169,6 +192,12 @@ int init_buffers()
 	if ((ret = ps_buffer_init(mpriv.uncompressed, &attr)))
 		return ret;
 
+	if (mpriv.tile_size) {
+		mpriv.tiled = (ps_buffer_t *) malloc(sizeof(ps_buffer_t));
+		if ((ret = ps_buffer_init(mpriv.tiled, &attr)))
+			return ret;
+	}
+
 	if (!(mpriv.flags & MAIN_COMPRESS_NONE)) {
 		ps_bufferattr_setsize(&attr, mpriv.compressed_size);
 		mpriv.compressed = (ps_buffer_t *) malloc(sizeof(ps_buffer_t));
@@ -191,6 +220,16 @@ int open_stream()
 
 	if ((ret = file_set_sync(mpriv.file, (mpriv.flags & MAIN_SYNC) ? 1 : 0)))
 		return ret;
+	if ((ret = file_set_direct(mpriv.file, (mpriv.flags & MAIN_DIRECT) ? 1 : 0)))
+		return ret;
+	if ((ret = file_set_write_batch(mpriv.file, mpriv.batch_size, mpriv.batch_time)))
+		return ret;
+	if ((ret = file_set_preallocate(mpriv.file, mpriv.prealloc_size)))
+		return ret;
+	if ((ret = file_set_writeback(mpriv.file, mpriv.writeback_size)))
+		return ret;
+	if ((ret = file_set_stripe_size(mpriv.file, mpriv.stripe_size)))
+		return ret;
 	if ((ret = file_open_target(mpriv.file, mpriv.stream_file)))
 		return ret;
 	if ((ret = file_write_info(mpriv.file, stream_info,
@@ -240,6 +279,40 @@ err:
 		"can't reload stream: %s (%d)\n", strerror(ret), ret);
 }
 
+char *segment_filename(void *arg, unsigned int segment)
+{
+	/* app-1234-0.glc continues as app-1234-0-1.glc, each stripe alike */
+	char *filename = glc_util_format_filename(mpriv.stream_file_fmt, mpriv.capture);
+	char *name, *next, *ext, *p, *start, *segment_file;
+	unsigned int stripes = 1;
+	int base, striped;
+
+	/* only names with stripe prefix are lists */
+	striped = !strncmp(filename, FILE_STRIPE_PREFIX, strlen(FILE_STRIPE_PREFIX));
+	name = striped ? &filename[strlen(FILE_STRIPE_PREFIX)] : filename;
+
+	for (p = name; striped && ((p = strchr(p, ',')) != NULL); p++)
+		stripes++;
+	segment_file = (char *) malloc(strlen(filename) + 13 * stripes);
+
+	p = start = segment_file + sprintf(segment_file, "%s", striped ? FILE_STRIPE_PREFIX : "");
+	for (; name != NULL; name = next) {
+		if ((next = striped ? strchr(name, ',') : NULL) != NULL)
+			*next++ = '\0';
+
+		ext = strrchr(name, '.');
+		base = strlen(name);
+		if ((ext != NULL) && (strchr(ext, '/') == NULL))
+			base = ext - name;
+
+		p += sprintf(p, "%s%.*s-%u%s", p == start ? "" : ",",
+			     base, name, segment, &name[base]);
+	}
+	free(filename);
+
+	return segment_file;
+}
+
 int reload_stream()
 {
 	glc_message_header_t hdr;
@@ -251,6 +324,23 @@ int reload_stream()
 	return opengl_push_message(&hdr, &callback_req, sizeof(glc_callback_request_t));
 }
 
+int refresh_stream()
+{
+	glc_message_header_t hdr;
+	glc_callback_request_t callback_req;
+
+	/* file object asked for a random access point */
+	if (!glc_state_test(&mpriv.glc, GLC_STATE_REFRESH))
+		return 0;
+	glc_state_clear(&mpriv.glc, GLC_STATE_REFRESH);
+
+	/* filters restart inter-frame coding when request passes them */
+	hdr.type = GLC_CALLBACK_REQUEST;
+	callback_req.arg = mpriv.file;
+	opengl_refresh();
+	return opengl_push_message(&hdr, &callback_req, sizeof(glc_callback_request_t));
+}
+
 void increment_capture()
 {
 	mpriv.capture++;
@@ -309,6 +399,7 @@ err:
 
 int start_glc()
 {
+	ps_buffer_t *stream = mpriv.uncompressed;
 	int ret;
 
 	if (lib.running)
@@ -325,9 +416,23 @@ int start_glc()
 	/* NOTE at the moment only reload is used as callback */
 	if ((ret = file_set_callback(mpriv.file, &reload_stream_callback)))
 		return ret;
+	if ((ret = file_set_segment(mpriv.file, mpriv.segment_size, mpriv.segment_time,
+				    &segment_filename, NULL)))
+		return ret;
 	if ((ret = open_stream()))
 		return ret;
 
+	/* unchanged parts of frames are dropped before compression */
+	if (mpriv.tile_size) {
+		if ((ret = tile_init(&mpriv.tile, &mpriv.glc)))
+			return ret;
+		if ((ret = tile_set_size(mpriv.tile, mpriv.tile_size)))
+			return ret;
+		if ((ret = tile_process_start(mpriv.tile, mpriv.uncompressed, mpriv.tiled)))
+			return ret;
+		stream = mpriv.tiled;
+	}
+
 	if (!(mpriv.flags & MAIN_COMPRESS_NONE)) {
 		if ((ret = file_write_process_start(mpriv.file, mpriv.compressed)))
 			return ret;
@@ -341,12 +446,36 @@ int start_glc()
 			pack_set_compression(mpriv.pack, PACK_LZO);
 		else if (mpriv.flags & MAIN_COMPRESS_LZJB)
 			pack_set_compression(mpriv.pack, PACK_LZJB);
+		else if (mpriv.flags & MAIN_COMPRESS_LZ4)
+			pack_set_compression(mpriv.pack, PACK_LZ4);
+		else if (mpriv.flags & MAIN_COMPRESS_ZSTD)
+			pack_set_compression(mpriv.pack, PACK_ZSTD);
+		else if (mpriv.flags & MAIN_COMPRESS_ADAPTIVE)
+			pack_set_compression(mpriv.pack, PACK_ADAPTIVE);
+		else if (mpriv.flags & MAIN_COMPRESS_PREDICT)
+			pack_set_compression(mpriv.pack, PACK_PREDICT);
+		else if (mpriv.flags & MAIN_COMPRESS_DCT)
+			pack_set_compression(mpriv.pack, PACK_DCT);
+
+		if (mpriv.flags & MAIN_COMPRESS_AUDIO_RICE) {
+			if ((ret = pack_set_audio_compression(mpriv.pack, PACK_RICE)))
+				return ret;
+		}
+
+		if ((ret = pack_set_compression_level(mpriv.pack, mpriv.compression_level)))
+			return ret;
+		if ((ret = pack_set_quality(mpriv.pack, mpriv.quality)))
+			return ret;
+		if ((ret = pack_set_keyframe_interval(mpriv.pack, mpriv.keyframe_interval)))
+			return ret;
+		if ((ret = pack_set_slice_size(mpriv.pack, mpriv.slice_size)))
+			return ret;
 
-		if ((ret = pack_process_start(mpriv.pack, mpriv.uncompressed, mpriv.compressed)))
+		if ((ret = pack_process_start(mpriv.pack, stream, mpriv.compressed)))
 			return ret;
 	} else {
 		glc_log(&mpriv.glc, GLC_WARNING, "main", "compression disabled");
-		if ((ret = file_write_process_start(mpriv.file, mpriv.uncompressed)))
+		if ((ret = file_write_process_start(mpriv.file, stream)))
 			return ret;
 	}
 
@@ -410,6 +539,10 @@ void lib_close()
 		goto err;
 
 	if (lib.running) {
+		if (mpriv.tile_size) {
+			tile_process_wait(mpriv.tile);
+			tile_destroy(mpriv.tile);
+		}
 		if (!(mpriv.flags & MAIN_COMPRESS_NONE)) {
 			pack_process_wait(mpriv.pack);
 			pack_destroy(mpriv.pack);
@@ -424,6 +557,11 @@ void lib_close()
 		free(mpriv.compressed);
 	}
 
+	if (mpriv.tiled) {
+		ps_buffer_destroy(mpriv.tiled);
+		free(mpriv.tiled);
+	}
+
 	ps_buffer_destroy(mpriv.uncompressed);
 	free(mpriv.uncompressed);
 
@@ -472,13 +610,66 @@ int load_environ()
 			mpriv.flags |= MAIN_SYNC;
 	}
 
+	if (getenv("GLC_DIRECT")) {
+		if (atoi(getenv("GLC_DIRECT")))
+			mpriv.flags |= MAIN_DIRECT;
+	}
+
+	mpriv.batch_size = 256 * 1024;
+	if (getenv("GLC_WRITE_BATCH_SIZE"))
+		mpriv.batch_size = atoi(getenv("GLC_WRITE_BATCH_SIZE")) * 1024;
+
+	mpriv.batch_time = 50000;
+	if (getenv("GLC_WRITE_BATCH_TIME"))
+		mpriv.batch_time = atoi(getenv("GLC_WRITE_BATCH_TIME")) * 1000;
+
+	mpriv.prealloc_size = 64 * 1024 * 1024;
+	if (getenv("GLC_PREALLOCATE"))
+		mpriv.prealloc_size = (size_t) atoi(getenv("GLC_PREALLOCATE")) * 1024 * 1024;
+
+	mpriv.writeback_size = 0;
+	if (getenv("GLC_WRITEBACK"))
+		mpriv.writeback_size = (size_t) atoi(getenv("GLC_WRITEBACK")) * 1024 * 1024;
+
+	mpriv.stripe_size = 1024 * 1024;
+	if (getenv("GLC_STRIPE_SIZE"))
+		mpriv.stripe_size = atoi(getenv("GLC_STRIPE_SIZE")) * 1024;
+
+	mpriv.segment_size = 0;
+	if (getenv("GLC_SEGMENT_SIZE"))
+		mpriv.segment_size = (u_int64_t) atoi(getenv("GLC_SEGMENT_SIZE")) * 1024 * 1024;
+
+	mpriv.segment_time = 0;
+	if (getenv("GLC_SEGMENT_TIME"))
+		mpriv.segment_time = (glc_utime_t) atoi(getenv("GLC_SEGMENT_TIME")) * 1000000;
+
 	mpriv.uncompressed_size = 1024 * 1024 * 25;
 	if (getenv("GLC_UNCOMPRESSED_BUFFER_SIZE"))
-		mpriv.uncompressed_size = atoi(getenv("GLC_UNCOMPRESSED_BUFFER_SIZE")) * 1024 * 1024;
+		mpriv.uncompressed_size = (size_t) atoi(getenv("GLC_UNCOMPRESSED_BUFFER_SIZE")) * 1024 * 1024;
 
 	mpriv.compressed_size = 1024 * 1024 * 50;
 	if (getenv("GLC_COMPRESSED_BUFFER_SIZE"))
-		mpriv.compressed_size = atoi(getenv("GLC_COMPRESSED_BUFFER_SIZE")) * 1024 * 1024;
+		mpriv.compressed_size = (size_t) atoi(getenv("GLC_COMPRESSED_BUFFER_SIZE")) * 1024 * 1024;
+
+	mpriv.tile_size = 0;
+	if (getenv("GLC_TILES"))
+		mpriv.tile_size = atoi(getenv("GLC_TILES"));
+
+	mpriv.compression_level = 0;
+	if (getenv("GLC_COMPRESS_LEVEL"))
+		mpriv.compression_level = atoi(getenv("GLC_COMPRESS_LEVEL"));
+
+	mpriv.quality = 75;
+	if (getenv("GLC_COMPRESS_QUALITY"))
+		mpriv.quality = atoi(getenv("GLC_COMPRESS_QUALITY"));
+
+	mpriv.slice_size = 0;
+	if (getenv("GLC_COMPRESS_SLICE_SIZE"))
+		mpriv.slice_size = atoi(getenv("GLC_COMPRESS_SLICE_SIZE")) * 1024;
+
+	mpriv.keyframe_interval = 0;
+	if (getenv("GLC_KEYFRAME_INTERVAL"))
+		mpriv.keyframe_interval = atoi(getenv("GLC_KEYFRAME_INTERVAL"));
 
 	if (getenv("GLC_COMPRESS")) {
 		if (!strcmp(getenv("GLC_COMPRESS"), "lzo"))
@@ -487,10 +678,25 @@ int load_environ()
 			mpriv.flags |= MAIN_COMPRESS_QUICKLZ;
 		else if (!strcmp(getenv("GLC_COMPRESS"), "lzjb"))
 			mpriv.flags |= MAIN_COMPRESS_LZJB;
+		else if (!strcmp(getenv("GLC_COMPRESS"), "lz4"))
+			mpriv.flags |= MAIN_COMPRESS_LZ4;
+		else if (!strcmp(getenv("GLC_COMPRESS"), "zstd"))
+			mpriv.flags |= MAIN_COMPRESS_ZSTD;
+		else if (!strcmp(getenv("GLC_COMPRESS"), "adaptive"))
+			mpriv.flags |= MAIN_COMPRESS_ADAPTIVE;
+		else if (!strcmp(getenv("GLC_COMPRESS"), "predict"))
+			mpriv.flags |= MAIN_COMPRESS_PREDICT;
+		else if (!strcmp(getenv("GLC_COMPRESS"), "dct"))
+			mpriv.flags |= MAIN_COMPRESS_DCT;
 		else
 			mpriv.flags |= MAIN_COMPRESS_NONE;
 	}
 
+	if (getenv("GLC_AUDIO_COMPRESS")) {
+		if (!strcmp(getenv("GLC_AUDIO_COMPRESS"), "rice"))
+			mpriv.flags |= MAIN_COMPRESS_AUDIO_RICE;
+	}
+
 	return 0;
 }
 
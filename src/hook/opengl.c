@@ -45,6 +45,8 @@ struct opengl_private_s {
 
 	int capture_glfinish;
 	int convert_ycbcr_420jpeg;
+	int convert_gpu;
+	int scale_gpu;
 	double scale_factor;
 	GLenum read_buffer;
 	double fps;
@@ -58,6 +60,7 @@ __PRIVATE struct opengl_private_s opengl;
 __PRIVATE void get_real_opengl();
 __PRIVATE void opengl_capture_current();
 __PRIVATE void opengl_draw_indicator();
+__PRIVATE int opengl_start_unscaled(ps_buffer_t **unscaled);
 
 int opengl_init(glc_t *glc)
 {
@@ -68,6 +71,8 @@ int opengl_init(glc_t *glc)
 	opengl.capture_glfinish = 0;
 	opengl.read_buffer = GL_FRONT;
 	opengl.capturing = 0;
+	opengl.convert_gpu = 0;
+	opengl.scale_gpu = 0;
 	int ret = 0;
 	unsigned int x, y, w, h;
 
@@ -95,8 +100,11 @@ int opengl_init(glc_t *glc)
 	} else
 		opengl.convert_ycbcr_420jpeg = 1;
 
+	if (getenv("GLC_GPU_COLORSPACE"))
+		opengl.convert_gpu = atoi(getenv("GLC_GPU_COLORSPACE"));
+
 	if (getenv("GLC_UNSCALED_BUFFER_SIZE"))
-		opengl.unscaled_size = atoi(getenv("GLC_UNSCALED_BUFFER_SIZE")) * 1024 * 1024;
+		opengl.unscaled_size = (size_t) atoi(getenv("GLC_UNSCALED_BUFFER_SIZE")) * 1024 * 1024;
 	else
 		opengl.unscaled_size = 1024 * 1024 * 25;
 
@@ -117,9 +125,21 @@ int opengl_init(glc_t *glc)
 	if (getenv("GLC_SCALE"))
 		opengl.scale_factor = atof(getenv("GLC_SCALE"));
 
+	if (getenv("GLC_GPU_SCALE"))
+		opengl.scale_gpu = atoi(getenv("GLC_GPU_SCALE"));
+
 	if (getenv("GLC_TRY_PBO"))
 		gl_capture_try_pbo(opengl.gl_capture, atoi(getenv("GLC_TRY_PBO")));
 
+	if (getenv("GLC_PBO_COUNT"))
+		gl_capture_set_pbo_count(opengl.gl_capture, atoi(getenv("GLC_PBO_COUNT")));
+
+	if (getenv("GLC_DETECT_REPEAT"))
+		gl_capture_detect_repeat(opengl.gl_capture, atoi(getenv("GLC_DETECT_REPEAT")));
+
+	if (getenv("GLC_CAPTURE_WORKER"))
+		gl_capture_use_worker(opengl.gl_capture, atoi(getenv("GLC_CAPTURE_WORKER")));
+
 	gl_capture_set_pack_alignment(opengl.gl_capture, 8);
 	if (getenv("GLC_CAPTURE_DWORD_ALIGNED")) {
 		if (!atoi(getenv("GLC_CAPTURE_DWORD_ALIGNED")))
@@ -149,40 +169,101 @@ int opengl_init(glc_t *glc)
 
 int opengl_start(ps_buffer_t *buffer)
 {
+	ps_buffer_t *unscaled;
+	int gpu = 0, ret;
+
 	if (opengl.started)
 		return EINVAL;
 
 	opengl.buffer = buffer;
 
-	/* init unscaled buffer if it is needed */
-	if ((opengl.scale_factor != 1.0) | opengl.convert_ycbcr_420jpeg) {
+	if (!opengl.convert_ycbcr_420jpeg)
+		opengl.convert_gpu = 0;
+
+	/* Y'CbCr conversion on CPU scales too, GPU-scaled BGR frames would skip it */
+	if ((opengl.convert_ycbcr_420jpeg) && (!opengl.convert_gpu) && (opengl.scale_gpu)) {
+		glc_log(opengl.glc, GLC_WARNING, "opengl",
+			 "GPU scaling needs GPU colorspace conversion, scaling on CPU");
+		opengl.scale_gpu = 0;
+	}
+
+	/* Y'CbCr conversion on GPU always scales on GPU too */
+	if ((opengl.scale_gpu) | (opengl.convert_gpu)) {
+		if (!gl_capture_set_scale(opengl.gl_capture, opengl.scale_factor))
+			gpu = (opengl.scale_factor != 1.0) | (opengl.convert_gpu);
+		else
+			opengl.convert_gpu = 0;
+	}
+
+	if (opengl.convert_gpu) {
+		/* gl_capture writes Y'CbCr frames directly */
+		gl_capture_set_pixel_format(opengl.gl_capture, GL_BGRA);
+		gl_capture_convert_ycbcr_420jpeg(opengl.gl_capture, 1);
+	} else if (gpu)
+		gl_capture_set_pixel_format(opengl.gl_capture, GL_BGR);
+	else if ((opengl.scale_factor != 1.0) | opengl.convert_ycbcr_420jpeg) {
 		/* if scaling is enabled, it is faster to capture as GL_BGRA */
 		gl_capture_set_pixel_format(opengl.gl_capture, GL_BGRA);
+	} else
+		gl_capture_set_pixel_format(opengl.gl_capture, GL_BGR);
 
-		ps_bufferattr_t attr;
-		ps_bufferattr_init(&attr);
-		ps_bufferattr_setsize(&attr, opengl.unscaled_size);
-		opengl.unscaled = (ps_buffer_t *) malloc(sizeof(ps_buffer_t));
-		ps_buffer_init(opengl.unscaled, &attr);
+	if (gpu) {
+		/* unscaled buffer is created only if GPU fails for some stream */
+		gl_capture_set_buffer(opengl.gl_capture, opengl.buffer);
+		gl_capture_set_fallback_callback(opengl.gl_capture, &opengl_start_unscaled);
+	} else if ((opengl.scale_factor != 1.0) | opengl.convert_ycbcr_420jpeg) {
+		if ((ret = opengl_start_unscaled(&unscaled)))
+			return ret;
+		gl_capture_set_buffer(opengl.gl_capture, unscaled);
+	} else
+		gl_capture_set_buffer(opengl.gl_capture, opengl.buffer);
 
-		if (opengl.convert_ycbcr_420jpeg) {
-			ycbcr_init(&opengl.ycbcr, opengl.glc);
-			ycbcr_set_scale(opengl.ycbcr, opengl.scale_factor);
-			ycbcr_process_start(opengl.ycbcr, opengl.unscaled, buffer);
-		} else {
-			scale_init(&opengl.scale, opengl.glc);
-			scale_set_scale(opengl.scale, opengl.scale_factor);
-			scale_process_start(opengl.scale, opengl.unscaled, buffer);
-		}
+	opengl.started = 1;
+	return 0;
+}
+
+int opengl_start_unscaled(ps_buffer_t **unscaled)
+{
+	ps_bufferattr_t attr;
+	int ret;
+
+	if (!(opengl.unscaled = (ps_buffer_t *) malloc(sizeof(ps_buffer_t))))
+		return ENOMEM;
 
-		gl_capture_set_buffer(opengl.gl_capture, opengl.unscaled);
+	ps_bufferattr_init(&attr);
+	ps_bufferattr_setsize(&attr, opengl.unscaled_size);
+	ret = ps_buffer_init(opengl.unscaled, &attr);
+	ps_bufferattr_destroy(&attr);
+	if (ret)
+		goto err;
+
+	/* frames are scaled and converted on CPU */
+	if (opengl.convert_ycbcr_420jpeg) {
+		ycbcr_init(&opengl.ycbcr, opengl.glc);
+		ycbcr_set_scale(opengl.ycbcr, opengl.scale_factor);
+		ret = ycbcr_process_start(opengl.ycbcr, opengl.unscaled, opengl.buffer);
 	} else {
-		gl_capture_set_pixel_format(opengl.gl_capture, GL_BGR);
-		gl_capture_set_buffer(opengl.gl_capture, opengl.buffer);
+		scale_init(&opengl.scale, opengl.glc);
+		scale_set_scale(opengl.scale, opengl.scale_factor);
+		ret = scale_process_start(opengl.scale, opengl.unscaled, opengl.buffer);
+	}
+	if (ret) {
+		if (opengl.convert_ycbcr_420jpeg)
+			ycbcr_destroy(opengl.ycbcr);
+		else
+			scale_destroy(opengl.scale);
+		ps_buffer_destroy(opengl.unscaled);
+		goto err;
 	}
 
-	opengl.started = 1;
+	*unscaled = opengl.unscaled;
 	return 0;
+err:
+	glc_log(opengl.glc, GLC_ERROR, "opengl",
+		 "can't start unscaled buffer: %s (%d)", strerror(ret), ret);
+	free(opengl.unscaled);
+	opengl.unscaled = NULL;
+	return ret;
 }
 
 int opengl_close()
@@ -231,6 +312,11 @@ int opengl_close()
 	return 0;
 }
 
+int opengl_refresh()
+{
+	return gl_capture_refresh(opengl.gl_capture);
+}
+
 int opengl_push_message(glc_message_header_t *hdr, void *message, size_t message_size)
 {
 	ps_packet_t packet;
@@ -351,6 +437,7 @@ void __opengl_glXSwapBuffers(Display *dpy, GLXDrawable drawable)
 	if (opengl.read_buffer == GL_FRONT)
 		opengl.glXSwapBuffers(dpy, drawable);
 
+	refresh_stream();
 	gl_capture_frame(opengl.gl_capture, dpy, drawable);
 
 	if (opengl.read_buffer == GL_BACK)
@@ -400,8 +487,10 @@ void opengl_capture_current()
 	Display *dpy = glXGetCurrentDisplay();
 	GLXDrawable drawable = glXGetCurrentDrawable();
 
-	if ((dpy != NULL) && (drawable != None))
+	if ((dpy != NULL) && (drawable != None)) {
+		refresh_stream();
 		gl_capture_frame(opengl.gl_capture, dpy, drawable);
+	}
 }
 
 
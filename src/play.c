@@ -26,6 +26,7 @@
 #include <glc/core/info.h>
 #include <glc/core/ycbcr.h>
 #include <glc/core/scale.h>
+#include <glc/core/tile.h>
 
 #include <glc/export/img.h>
 #include <glc/export/wav.h>
@@ -49,6 +50,7 @@ struct play_s {
 	unsigned int scale_width, scale_height;
 
 	size_t compressed_size, uncompressed_size;
+	int readahead_size;
 
 	int override_color_correction;
 	float brightness, contrast;
@@ -99,6 +101,7 @@ int main(int argc, char *argv[])
 		{"streaming",		0, NULL, 't'},
 		{"compressed",		1, NULL, 'c'},
 		{"uncompressed",	1, NULL, 'u'},
+		{"readahead",		1, NULL, 'R'},
 		{"show",		1, NULL, 's'},
 		{"verbosity",		1, NULL, 'v'},
 		{"help",		0, NULL, 'h'},
@@ -119,6 +122,9 @@ int main(int argc, char *argv[])
 	play.compressed_size = 10 * 1024 * 1024;
 	play.uncompressed_size = 10 * 1024 * 1024;
 
+	/* read stream file 32MiB ahead */
+	play.readahead_size = 32 * 1024 * 1024;
+
 	/* log to stderr */
 	play.log_level = 0;
 	play.info_level = 1;
@@ -135,7 +141,7 @@ int main(int argc, char *argv[])
 	play.green_gamma = 1.0;
 	play.blue_gamma = 1.0;
 
-	while ((opt = getopt_long(argc, argv, "i:a:b:p:y:o:f:r:g:l:td:c:u:s:v:hV",
+	while ((opt = getopt_long(argc, argv, "i:a:b:p:y:o:f:r:g:l:td:c:u:R:s:v:hV",
 				  long_options, &optind)) != -1) {
 		switch (opt) {
 		case 'i':
@@ -211,6 +217,11 @@ int main(int argc, char *argv[])
 			if (play.uncompressed_size <= 0)
 				goto usage;
 			break;
+		case 'R':
+			play.readahead_size = atoi(optarg) * 1024 * 1024;
+			if (play.readahead_size < 0)
+				goto usage;
+			break;
 		case 's':
 			val_str = optarg;
 			play.action = action_val;
@@ -250,6 +261,8 @@ int main(int argc, char *argv[])
 	/* open stream file */
 	if (file_init(&play.file, &play.glc))
 		return EXIT_FAILURE;
+	if (file_set_readahead(play.file, play.readahead_size))
+		return EXIT_FAILURE;
 	if (file_open_source(play.file, play.stream_file))
 		return EXIT_FAILURE;
 
@@ -326,6 +339,8 @@ usage:
 	       "                             default is 10 MiB\n"
 	       "  -u, --uncompressed=SIZE  uncompressed stream buffer size in MiB\n"
 	       "                             default is 10 MiB\n"
+	       "  -R, --readahead=SIZE     read stream file SIZE MiB ahead, 0 disables\n"
+	       "                             default is 32 MiB\n"
 	       "  -s, --show=VAL           show stream summary value, possible values are:\n"
 	       "                             all, signature, version, flags, fps,\n"
 	       "                             pid, name, date\n"
@@ -371,6 +386,7 @@ int play_stream(struct play_s *play)
 
 	 file -(uncompressed)->     reads data from stream file
 	 unpack -(uncompressed)->   decompresses lzo/quicklz packets
+	 untile -(untiled)->        rebuilds frames from changed tiles
 	 rgb -(rgb)->               does conversion to BGR
 	 scale -(scale)->           does rescaling
 	 color -(color)->           applies color correction
@@ -382,12 +398,13 @@ int play_stream(struct play_s *play)
 	*/
 
 	ps_bufferattr_t attr;
-	ps_buffer_t uncompressed_buffer, compressed_buffer,
+	ps_buffer_t uncompressed_buffer, compressed_buffer, untiled_buffer,
 		    rgb_buffer, color_buffer, scale_buffer;
 	demux_t demux;
 	color_t color;
 	scale_t scale;
 	unpack_t unpack;
+	untile_t untile;
 	rgb_t rgb;
 	int ret = 0;
 
@@ -408,6 +425,8 @@ int play_stream(struct play_s *play)
 		goto err;
 	if ((ret = ps_buffer_init(&uncompressed_buffer, &attr)))
 		goto err;
+	if ((ret = ps_buffer_init(&untiled_buffer, &attr)))
+		goto err;
 	if ((ret = ps_buffer_init(&color_buffer, &attr)))
 		goto err;
 	if ((ret = ps_buffer_init(&rgb_buffer, &attr)))
@@ -422,6 +441,8 @@ int play_stream(struct play_s *play)
 	/* init filters */
 	if ((ret = unpack_init(&unpack, &play->glc)))
 		goto err;
+	if ((ret = untile_init(&untile, &play->glc)))
+		goto err;
 	if ((ret = rgb_init(&rgb, &play->glc)))
 		goto err;
 	if ((ret = scale_init(&scale, &play->glc)))
@@ -444,7 +465,9 @@ int play_stream(struct play_s *play)
 	/* construct a pipeline for playback */
 	if ((ret = unpack_process_start(unpack, &compressed_buffer, &uncompressed_buffer)))
 		goto err;
-	if ((ret = rgb_process_start(rgb, &uncompressed_buffer, &rgb_buffer)))
+	if ((ret = untile_process_start(untile, &uncompressed_buffer, &untiled_buffer)))
+		goto err;
+	if ((ret = rgb_process_start(rgb, &untiled_buffer, &rgb_buffer)))
 		goto err;
 	if ((ret = scale_process_start(scale, &rgb_buffer, &scale_buffer)))
 		goto err;
@@ -466,11 +489,14 @@ int play_stream(struct play_s *play)
 		goto err;
 	if ((ret = rgb_process_wait(rgb)))
 		goto err;
+	if ((ret = untile_process_wait(untile)))
+		goto err;
 	if ((ret = unpack_process_wait(unpack)))
 		goto err;
 
 	/* stream processed - clean up time */
 	unpack_destroy(unpack);
+	untile_destroy(untile);
 	rgb_destroy(rgb);
 	scale_destroy(scale);
 	color_destroy(color);
@@ -478,6 +504,7 @@ int play_stream(struct play_s *play)
 
 	ps_buffer_destroy(&compressed_buffer);
 	ps_buffer_destroy(&uncompressed_buffer);
+	ps_buffer_destroy(&untiled_buffer);
 	ps_buffer_destroy(&color_buffer);
 	ps_buffer_destroy(&scale_buffer);
 	ps_buffer_destroy(&rgb_buffer);
@@ -566,6 +593,7 @@ int export_img(struct play_s *play)
 
 	 file -(uncompressed_buffer)->     reads data from stream file
 	 unpack -(uncompressed_buffer)->   decompresses lzo/quicklz packets
+	 untile -(untiled_buffer)->        rebuilds frames from changed tiles
 	 rgb -(rgb)->               does conversion to BGR
 	 scale -(scale)->           does rescaling
 	 color -(color)->           applies color correction
@@ -573,12 +601,13 @@ int export_img(struct play_s *play)
 	*/
 
 	ps_bufferattr_t attr;
-	ps_buffer_t uncompressed_buffer, compressed_buffer,
+	ps_buffer_t uncompressed_buffer, compressed_buffer, untiled_buffer,
 		    rgb_buffer, color_buffer, scale_buffer;
 	img_t img;
 	color_t color;
 	scale_t scale;
 	unpack_t unpack;
+	untile_t untile;
 	rgb_t rgb;
 	int ret = 0;
 
@@ -595,6 +624,8 @@ int export_img(struct play_s *play)
 		goto err;
 	if ((ret = ps_buffer_init(&uncompressed_buffer, &attr)))
 		goto err;
+	if ((ret = ps_buffer_init(&untiled_buffer, &attr)))
+		goto err;
 	if ((ret = ps_buffer_init(&color_buffer, &attr)))
 		goto err;
 	if ((ret = ps_buffer_init(&rgb_buffer, &attr)))
@@ -608,6 +639,8 @@ int export_img(struct play_s *play)
 	/* filters */
 	if ((ret = unpack_init(&unpack, &play->glc)))
 		goto err;
+	if ((ret = untile_init(&untile, &play->glc)))
+		goto err;
 	if ((ret = rgb_init(&rgb, &play->glc)))
 		goto err;
 	if ((ret = scale_init(&scale, &play->glc)))
@@ -631,7 +664,9 @@ int export_img(struct play_s *play)
 	/* pipeline... */
 	if ((ret = unpack_process_start(unpack, &compressed_buffer, &uncompressed_buffer)))
 		goto err;
-	if ((ret = rgb_process_start(rgb, &uncompressed_buffer, &rgb_buffer)))
+	if ((ret = untile_process_start(untile, &uncompressed_buffer, &untiled_buffer)))
+		goto err;
+	if ((ret = rgb_process_start(rgb, &untiled_buffer, &rgb_buffer)))
 		goto err;
 	if ((ret = scale_process_start(scale, &rgb_buffer, &scale_buffer)))
 		goto err;
@@ -653,10 +688,13 @@ int export_img(struct play_s *play)
 		goto err;
 	if ((ret = rgb_process_wait(rgb)))
 		goto err;
+	if ((ret = untile_process_wait(untile)))
+		goto err;
 	if ((ret = unpack_process_wait(unpack)))
 		goto err;
 
 	unpack_destroy(unpack);
+	untile_destroy(untile);
 	rgb_destroy(rgb);
 	scale_destroy(scale);
 	color_destroy(color);
@@ -664,6 +702,7 @@ int export_img(struct play_s *play)
 
 	ps_buffer_destroy(&compressed_buffer);
 	ps_buffer_destroy(&uncompressed_buffer);
+	ps_buffer_destroy(&untiled_buffer);
 	ps_buffer_destroy(&color_buffer);
 	ps_buffer_destroy(&scale_buffer);
 	ps_buffer_destroy(&rgb_buffer);
@@ -681,6 +720,7 @@ int export_yuv4mpeg(struct play_s *play)
 
 	 file -(uncompressed_buffer)->     reads data from stream file
 	 unpack -(uncompressed_buffer)->   decompresses lzo/quicklz packets
+	 untile -(untiled_buffer)->        rebuilds frames from changed tiles
 	 scale -(scale)->           does rescaling
 	 color -(color)->           applies color correction
 	 ycbcr -(ycbcr)->           does conversion to Y'CbCr (if necessary)
@@ -688,12 +728,13 @@ int export_yuv4mpeg(struct play_s *play)
 	*/
 
 	ps_bufferattr_t attr;
-	ps_buffer_t uncompressed_buffer, compressed_buffer,
+	ps_buffer_t uncompressed_buffer, compressed_buffer, untiled_buffer,
 		    ycbcr_buffer, color_buffer, scale_buffer;
 	yuv4mpeg_t yuv4mpeg;
 	ycbcr_t ycbcr;
 	scale_t scale;
 	unpack_t unpack;
+	untile_t untile;
 	color_t color;
 	int ret = 0;
 
@@ -710,6 +751,8 @@ int export_yuv4mpeg(struct play_s *play)
 		goto err;
 	if ((ret = ps_buffer_init(&uncompressed_buffer, &attr)))
 		goto err;
+	if ((ret = ps_buffer_init(&untiled_buffer, &attr)))
+		goto err;
 	if ((ret = ps_buffer_init(&color_buffer, &attr)))
 		goto err;
 	if ((ret = ps_buffer_init(&ycbcr_buffer, &attr)))
@@ -723,6 +766,8 @@ int export_yuv4mpeg(struct play_s *play)
 	/* initialize filters */
 	if ((ret = unpack_init(&unpack, &play->glc)))
 		goto err;
+	if ((ret = untile_init(&untile, &play->glc)))
+		goto err;
 	if ((ret = ycbcr_init(&ycbcr, &play->glc)))
 		goto err;
 	if ((ret = scale_init(&scale, &play->glc)))
@@ -746,7 +791,9 @@ int export_yuv4mpeg(struct play_s *play)
 	/* construct the pipeline */
 	if ((ret = unpack_process_start(unpack, &compressed_buffer, &uncompressed_buffer)))
 		goto err;
-	if ((ret = scale_process_start(scale, &uncompressed_buffer, &scale_buffer)))
+	if ((ret = untile_process_start(untile, &uncompressed_buffer, &untiled_buffer)))
+		goto err;
+	if ((ret = scale_process_start(scale, &untiled_buffer, &scale_buffer)))
 		goto err;
 	if ((ret = color_process_start(color, &scale_buffer, &color_buffer)))
 		goto err;
@@ -768,10 +815,13 @@ int export_yuv4mpeg(struct play_s *play)
 		goto err;
 	if ((ret = ycbcr_process_wait(ycbcr)))
 		goto err;
+	if ((ret = untile_process_wait(untile)))
+		goto err;
 	if ((ret = unpack_process_wait(unpack)))
 		goto err;
 
 	unpack_destroy(unpack);
+	untile_destroy(untile);
 	ycbcr_destroy(ycbcr);
 	scale_destroy(scale);
 	color_destroy(color);
@@ -779,6 +829,7 @@ int export_yuv4mpeg(struct play_s *play)
 
 	ps_buffer_destroy(&compressed_buffer);
 	ps_buffer_destroy(&uncompressed_buffer);
+	ps_buffer_destroy(&untiled_buffer);
 	ps_buffer_destroy(&color_buffer);
 	ps_buffer_destroy(&scale_buffer);
 	ps_buffer_destroy(&ycbcr_buffer);